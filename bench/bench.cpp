@@ -0,0 +1,635 @@
+#include "efibootmgrw.h"
+#include "boot_snapshot.h"
+#include "cache_backend.h"
+#include "cmdline.h"
+#include "device_path_text.h"
+#include "efi_load_option.h"
+#include "fleet_index.h"
+#include "json_writer.h"
+#include "listing.h"
+#include "load_option_store.h"
+#include "partition_table.h"
+#include "sha256.h"
+#include "sim_backend.h"
+#include "ucs2.h"
+
+#include "fixtures.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+
+#ifdef _WIN32
+# include <process.h>
+#else
+# include <unistd.h>
+#endif
+
+/*
+ * Every allocation the program makes goes through here, so a benchmark's
+ * allocations per op are just the difference in the count.
+ */
+static std::atomic<size_t> allocation_count { 0 };
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace efibootmgrw::bench {
+
+using test::make_store;
+using test::silence_stdout;
+
+using clock = std::chrono::steady_clock;
+
+struct options {
+    std::chrono::milliseconds min_time { 200 };
+    lak::optional<lak::astring_view> filter;
+    lak::optional<lak::astring_view> out;
+};
+
+struct result {
+    std::string name;
+    size_t iterations;
+    double ns_per_op;
+    double allocations_per_op;
+    double firmware_calls_per_op;
+};
+
+[[nodiscard]]
+auto firmware_calls(const sim_backend* sim) -> size_t {
+    if (!sim) return 0;
+    sim_stats s = sim->stats();
+    return s.reads + s.writes + s.removes;
+}
+
+// Doubles the iteration count until a run takes at least min_time.
+[[nodiscard]]
+auto measure(const options& opt, std::string name, const std::function<void()>& f, const sim_backend* sim = nullptr)
+-> result {
+    f();
+
+    for (size_t iterations = 1;; iterations *= 2) {
+        size_t calls = firmware_calls(sim);
+        size_t allocations = allocation_count.load(std::memory_order_relaxed);
+        clock::time_point start = clock::now();
+
+        for (size_t i = 0; i < iterations; ++i)
+            f();
+
+        clock::duration elapsed = clock::now() - start;
+
+        if (elapsed < opt.min_time && iterations < (size_t(1) << 30))
+            continue;
+
+        auto per_op = [&](size_t n) { return static_cast<double>(n) / static_cast<double>(iterations); };
+
+        return result {
+                std::move(name),
+                iterations,
+                static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+                / static_cast<double>(iterations),
+                per_op(allocation_count.load(std::memory_order_relaxed) - allocations),
+                per_op(firmware_calls(sim) - calls),
+        };
+    }
+}
+
+// Lets a cache_backend sit over a store the bench keeps hold of.
+struct borrowed_backend final : efivar_backend {
+    efivar_backend& inner;
+
+    explicit borrowed_backend(efivar_backend& inner) : inner { inner } {}
+
+    auto read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+    -> vresult<lak::span<void>> override {
+        return inner.read(name, guid, buf, attributes);
+    }
+
+    auto size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> override {
+        return inner.size(name, guid);
+    }
+
+    auto fingerprint(lak::wstring_view name, lak::wstring_view guid) -> vresult<var_fingerprint> override {
+        return inner.fingerprint(name, guid);
+    }
+
+    auto write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+    -> vresult<lak::monostate> override {
+        return inner.write(name, guid, buf, attributes);
+    }
+
+    auto remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> override {
+        return inner.remove(name, guid);
+    }
+
+    auto enumerate() -> vresult<vec<efi_var_name>> override {
+        return inner.enumerate();
+    }
+
+    auto thread_safe() const -> bool override {
+        return inner.thread_safe();
+    }
+};
+
+/*
+ * A scratch file in the temp directory, removed again once done with. The
+ * pid in its name keeps runs started side by side out of each other's way.
+ */
+struct temp_file {
+    std::string path;
+
+    explicit temp_file(std::string_view name) {
+#ifdef _WIN32
+        int pid = ::_getpid();
+#else
+        int pid = ::getpid();
+#endif
+        path = (std::filesystem::temp_directory_path() / fmt::format("efibootmgrw-bench-{}-{}", pid, name)).string();
+    }
+
+    temp_file(const temp_file&) = delete;
+    temp_file& operator=(const temp_file&) = delete;
+
+    ~temp_file() {
+        std::remove(path.c_str());
+    }
+
+    [[nodiscard]]
+    auto view() const -> lak::astring_view {
+        return lak::astring_view { path.data(), path.size() };
+    }
+};
+
+constexpr lak::astring_view sample_path =
+        "HD(1,GPT,C12A7328-F81F-11D2-BA4B-00A0C93EC93B,0x800,0x100000)/File(\\EFI\\ubuntu\\shimx64.efi)";
+
+[[nodiscard]]
+auto sample_file_path_list() -> vec<byte_t> {
+    return parse_device_path(sample_path).unsafe_unwrap();
+}
+
+// Paths like those firmware writes for disks, network boot and vendor entries.
+constexpr lak::astring_view device_path_corpus[] = {
+    "PciRoot(0x0)/Pci(0x1F,0x2)/Sata(0x0,0xFFFF,0x0)/HD(1,GPT,C12A7328-F81F-11D2-BA4B-00A0C93EC93B,0x800,0x100000)"
+    "/File(\\EFI\\ubuntu\\shimx64.efi)",
+    "PciRoot(0x0)/Pci(0x1D,0x0)/Pci(0x0,0x0)/NVMe(0x1,00-25-38-B1-21-00-A0-01)"
+    "/HD(1,GPT,0F5E2C3A-7D1B-4E8F-9A6C-2B3D4E5F6A7B,0x800,0x82000)/File(\\EFI\\Microsoft\\Boot\\bootmgfw.efi)",
+    "HD(2,MBR,0x1D3C9A2B,0x100000,0x64000)/File(\\EFI\\BOOT\\BOOTX64.EFI)",
+    "PciRoot(0x0)/Pci(0x1C,0x0)/Pci(0x0,0x0)/MAC(525400123456,0x1)/IPv4(0.0.0.0,UDP,DHCP,0.0.0.0,0.0.0.0,0.0.0.0)",
+    "PciRoot(0x0)/Pci(0x1C,0x0)/Pci(0x0,0x0)/MAC(525400123456,0x1)/IPv4(0.0.0.0)/Uri(http://boot.example.com/ipxe.efi)",
+    "PciRoot(0x0)/Pci(0x1C,0x0)/Pci(0x0,0x0)/MAC(525400123456,0x1)/IPv6(::,TCP,StatelessAutoConfigure,::,::,0)",
+    "VenHw(99E275E7-75A0-4B37-A2E6-C5385E6C00CB)",
+    "PciRoot(0x0)/Pci(0x14,0x0)/USB(0x3,0x0)/HD(1,MBR,0x4E2A8C1D,0x800,0x1DFF800)/File(\\EFI\\BOOT\\BOOTX64.EFI)",
+};
+
+/*
+ * Load options with labels like those seen in dumps from real machines,
+ * mostly ASCII of varying length with the odd accented or CJK one.
+ */
+struct label_corpus {
+    vec<vec<byte_t>> options;
+    vec<lak::span<const char16_t>> tails;
+    size_t units = 0;
+};
+
+// With unique set, every label is numbered so no two options are alike.
+[[nodiscard]]
+auto make_label_corpus(size_t n, lak::span<const byte_t> path, bool unique = true) -> label_corpus {
+    constexpr const char* labels[] = {
+        "ubuntu",
+        "Windows Boot Manager",
+        "Linux Boot Manager",
+        "UEFI: Samsung SSD 980 PRO 1TB, Partition 1",
+        "UEFI OS",
+        "EFI USB Device (SanDisk Cruzer Blade 1.00)",
+        "Fedora Linux 40 (Workstation Edition) 6.8.9-300.fc40.x86_64",
+        "Red Hat Enterprise Linux",
+        "Système de démarrage",
+        "UEFI PXEv4 (MAC:A0B1C2D3E4F5)",
+        "ネットワークブート",
+        "Network Boot IPv6 over Intel(R) Ethernet Connection I219-LM",
+    };
+
+    label_corpus corpus;
+
+    for (size_t i = 0; i < n; ++i) {
+        std::string label = unique
+                ? fmt::format("{} #{}", labels[i % std::size(labels)], i)
+                : std::string(labels[i % std::size(labels)]);
+        corpus.options.push_back(build_load_option(
+                load_option_active,
+                lak::astring_view { label.data(), label.size() },
+                path
+        ));
+    }
+
+    for (const vec<byte_t>& option : corpus.options) {
+        lak::span<const char16_t> tail {
+                reinterpret_cast<const char16_t*>(option.data() + load_option_view::header_size),
+                (option.size() - load_option_view::header_size) / sizeof(char16_t)
+        };
+        corpus.tails.push_back(tail);
+        corpus.units += tail.size();
+    }
+
+    return corpus;
+}
+
+void run_all(const options& opt, vec<result>& results) {
+    auto wanted = [&](lak::astring_view name) {
+        if (!opt.filter) return true;
+        std::string_view n { name.data(), name.size() };
+        return n.find(std::string_view { opt.filter->data(), opt.filter->size() }) != std::string_view::npos;
+    };
+
+    auto add = [&](lak::astring_view name, const std::function<void()>& f, const sim_backend* sim = nullptr) {
+        if (wanted(name))
+            results.push_back(measure(opt, std::string(name.begin(), name.end()), f, sim));
+    };
+
+    vec<byte_t> path = sample_file_path_list();
+    lak::span<const byte_t> path_span { path.data(), path.size() };
+
+    vec<byte_t> option = build_load_option(load_option_active, "Linux Boot Manager", path_span);
+    fmt::memory_buffer text;
+
+    add("load_option_desc", [&] {
+        load_option_view::parse(lak::span<const byte_t> { option.data(), option.size() })
+            .if_ok([&](load_option_view v) {
+                text.clear();
+                append_u8string(text, v.desc());
+            });
+    });
+
+    // Per op is the whole corpus, the scalar cases being what the vector code replaced.
+    {
+        label_corpus corpus = make_label_corpus(10000, path_span);
+        vec<lak::u16string_view> descs;
+
+        for (lak::span<const char16_t> tail : corpus.tails)
+            descs.push_back(lak::u16string_view { tail.data(), find_nul16_scalar(tail) });
+
+        std::string utf8(corpus.units * 3, '\0');
+
+        add("labels_10000_find_nul_scalar", [&] {
+            size_t n = 0;
+            for (lak::span<const char16_t> tail : corpus.tails)
+                n += find_nul16_scalar(tail);
+            if (n == 0) std::abort();
+        });
+
+        add("labels_10000_find_nul", [&] {
+            size_t n = 0;
+            for (lak::span<const char16_t> tail : corpus.tails)
+                n += find_nul16(tail);
+            if (n == 0) std::abort();
+        });
+
+        add("labels_10000_to_utf8_scalar", [&] {
+            size_t n = 0;
+            for (lak::u16string_view desc : descs)
+                n += utf16_to_utf8_scalar(desc, utf8.data());
+            if (n == 0) std::abort();
+        });
+
+        add("labels_10000_to_utf8", [&] {
+            size_t n = 0;
+            for (lak::u16string_view desc : descs)
+                n += utf16_to_utf8(desc, utf8.data());
+            if (n == 0) std::abort();
+        });
+
+        add("labels_10000_decode", [&] {
+            for (const vec<byte_t>& option : corpus.options) {
+                load_option_view::parse(lak::span<const byte_t> { option.data(), option.size() })
+                    .if_ok([&](load_option_view v) {
+                        text.clear();
+                        append_u8string(text, v.desc());
+                    });
+            }
+        });
+    }
+
+    // A fleet's worth of entries where hosts share payloads, as dump analysis sees them.
+    {
+        label_corpus corpus = make_label_corpus(10000, path_span, false);
+
+        add("fleet_10000_summarize_each", [&] {
+            size_t n = 0;
+            for (const vec<byte_t>& option : corpus.options)
+                n += load_option_summary::of(lak::span<const byte_t> { option.data(), option.size() }).label.size();
+            if (n == 0) std::abort();
+        });
+
+        add("fleet_10000_intern", [&] {
+            load_option_store store;
+            for (const vec<byte_t>& option : corpus.options)
+                (void) store.intern(lak::span<const byte_t> { option.data(), option.size() });
+            if (store.entries().size() != 12) std::abort();
+        });
+    }
+
+    // Which hosts boot shim first, by rescanning every host's entries or from the index.
+    {
+        constexpr size_t hosts = 10000;
+
+        vec<byte_t> pxe_path = parse_device_path("PciRoot(0x0)/MAC(525400123456,0x1)").unsafe_unwrap();
+        vec<byte_t> windows_path = parse_device_path(
+                "HD(1,GPT,C12A7328-F81F-11D2-BA4B-00A0C93EC93B,0x800,0x100000)/File(\\EFI\\Microsoft\\Boot\\bootmgfw.efi)"
+        ).unsafe_unwrap();
+
+        vec<vec<byte_t>> payloads = {
+            build_load_option(load_option_active, "ubuntu", path_span),
+            build_load_option(load_option_active, "UEFI PXEv4", lak::span<const byte_t> { pxe_path.data(), pxe_path.size() }),
+            build_load_option(load_option_active, "Windows Boot Manager", lak::span<const byte_t> { windows_path.data(), windows_path.size() }),
+        };
+
+        // Every host has all three, a third of them with PXE first.
+        auto order_of = [](size_t host) -> std::array<size_t, 3> {
+            return host % 3 == 0 ? std::array<size_t, 3> { 1, 0, 2 } : std::array<size_t, 3> { 0, 1, 2 };
+        };
+
+        vec<load_option_summary> summaries;
+        for (const vec<byte_t>& p : payloads)
+            summaries.push_back(load_option_summary::of(lak::span<const byte_t> { p.data(), p.size() }));
+
+        fleet_index index;
+        for (size_t h = 0; h < hosts; ++h) {
+            std::array<size_t, 3> order = order_of(h);
+            for (size_t pos = 0; pos < order.size(); ++pos)
+                index.add(static_cast<u32>(h), summaries[order[pos]], static_cast<u16>(pos));
+        }
+        index.finish();
+
+        fleet_query query = parse_fleet_query("loader=\\EFI\\ubuntu\\shimx64.efi@0").unsafe_unwrap();
+        constexpr size_t expected = hosts - (hosts + 2) / 3;
+
+        add("fleet_query_10000_scan", [&] {
+            size_t n = 0;
+            for (size_t h = 0; h < hosts; ++h) {
+                const vec<byte_t>& first = payloads[order_of(h)[0]];
+                load_option_summary s = load_option_summary::of(lak::span<const byte_t> { first.data(), first.size() });
+                n += fleet_index::key(fleet_index::field::loader, s.loader) == "\\efi\\ubuntu\\shimx64.efi";
+            }
+            if (n != expected) std::abort();
+        });
+
+        add("fleet_query_10000_indexed", [&] {
+            if (run_fleet_query(index, query).size() != expected) std::abort();
+        });
+    }
+
+    // A 1 MiB GPT image with an ESP, as -c -d reads it, from disk each time or through the cache.
+    {
+        temp_file image { "img" };
+        constexpr size_t sector = 512, sectors = 2048, entries_lba = 2, entry_count = 128, entry_size = 128;
+
+        vec<byte_t> disk(sector * sectors);
+        auto put = [&](size_t offset, auto value) { std::memcpy(disk.data() + offset, &value, sizeof(value)); };
+
+        put(446 + 4, u8 { 0xEE });
+        put(446 + 8, u32 { 1 });
+        put(446 + 12, u32 { sectors - 1 });
+        put(510, u16 { 0xAA55 });
+
+        size_t e = entries_lba * sector;
+        efi_guid esp { 0xC12A7328, 0xF81F, 0x11D2, { 0xBA, 0x4B, 0x00, 0xA0, 0xC9, 0x3E, 0xC9, 0x3B } };
+        esp.to_bytes(disk.data() + e);
+        esp.to_bytes(disk.data() + e + 16);
+        put(e + 32, u64 { 64 });
+        put(e + 40, u64 { 1023 });
+
+        size_t h = sector;
+        std::memcpy(disk.data() + h, "EFI PART", 8);
+        put(h + 8, u32 { 0x10000 });
+        put(h + 12, u32 { 92 });
+        put(h + 24, u64 { 1 });
+        put(h + 72, u64 { entries_lba });
+        put(h + 80, u32 { entry_count });
+        put(h + 84, u32 { entry_size });
+        put(h + 88, crc32(lak::span<const byte_t> { disk.data() + e, entry_count * entry_size }));
+        put(h + 16, crc32(lak::span<const byte_t> { disk.data() + h, 92 }));
+
+        if (std::FILE* f = std::fopen(image.path.c_str(), "wb")) {
+            std::fwrite(disk.data(), 1, disk.size(), f);
+            std::fclose(f);
+        }
+
+        add("partition_table_read", [&] {
+            if (!read_partition_table(image.view()).is_ok()) std::abort();
+        });
+
+        partition_cache cache;
+
+        add("partition_table_cached", [&] {
+            if (!cache.get(image.view()).is_ok()) std::abort();
+        });
+    }
+
+    {
+        // About the size of a signed shim, what a verbose listing hashes per entry.
+        vec<byte_t> loader(1 << 20, byte_t(0x5A));
+        sha256_digest digest { };
+
+        add("sha256_1mib", [&] {
+            digest = sha256::of(loader);
+        });
+    }
+
+    {
+        vec<vec<byte_t>> paths;
+        for (lak::astring_view text : device_path_corpus)
+            paths.push_back(parse_device_path(text).unsafe_unwrap());
+
+        auto walk = [&] {
+            size_t n = 0;
+            for (const vec<byte_t>& path : paths)
+                for (const device_path_node& node : device_path_nodes { lak::span<const byte_t> { path.data(), path.size() } })
+                    device_path::visit(node, [&](const auto&) { ++n; });
+            return n;
+        };
+
+        size_t nodes = walk();
+
+        add("device_path_walk", [&] {
+            if (walk() != nodes) std::abort();
+        });
+    }
+
+    add("device_path_format", [&] {
+        text.clear();
+        format_device_path(text, path_span);
+    });
+
+    add("device_path_parse", [&] {
+        if (!parse_device_path(sample_path).is_ok()) std::abort();
+    });
+
+    {
+        const char* argv[] = { "efibootmgrw", "-v", "-j", "4", "-b", "0001", "-a", "--efivars-dir", "/tmp" };
+
+        add("parse_args", [&] {
+            Context ctx;
+            parse_args(ctx, lak::span<const char*> { argv, std::size(argv) });
+        });
+    }
+
+    {
+        std::string order;
+        for (size_t i = 0; i < 32; ++i)
+            order += fmt::format("{}{:04X}", i ? "," : "", i);
+
+        const char* argv[] = { "efibootmgrw", "-o", order.c_str() };
+
+        add("boot_order_parse_32", [&] {
+            Context ctx;
+            parse_args(ctx, lak::span<const char*> { argv, std::size(argv) });
+        });
+    }
+
+    for (size_t n : { 10, 100, 1000 }) {
+        std::unique_ptr<sim_backend> sim = make_store(n, path_span);
+        std::string name = fmt::format("default_print_{}", n);
+        Context ctx;
+
+        silence_stdout quiet;
+        add(lak::astring_view { name.data(), name.size() }, [&] { (void) default_print(ctx, *sim); }, sim.get());
+    }
+
+    // A run of the monitoring agent against a warm cache, opening it included.
+    {
+        std::unique_ptr<sim_backend> sim = make_store(100, path_span);
+        temp_file cache_file { "cache" };
+        Context ctx;
+
+        {
+            cache_backend cold { std::make_unique<borrowed_backend>(*sim), cache_file.view() };
+            (void) BootSnapshot::load(cold);
+            (void) cold.save();
+        }
+
+        silence_stdout quiet;
+        add("default_print_100_cached", [&] {
+            cache_backend warm { std::make_unique<borrowed_backend>(*sim), cache_file.view() };
+            (void) default_print(ctx, warm);
+        }, sim.get());
+    }
+
+    {
+        std::unique_ptr<sim_backend> sim = make_store(100, path_span);
+        Context ctx;
+        ctx.args.json = true;
+
+        silence_stdout quiet;
+        add("json_print_100", [&] { json_print(ctx, *sim); }, sim.get());
+    }
+
+    // Firmware that can overlap calls, e.g. efivarfs, where -j should pay off.
+    for (size_t jobs : { 1, 2, 4, 8 }) {
+        sim_config config;
+        config.read_latency = std::chrono::microseconds { 50 };
+        config.serialize = false;
+        // Room to spare, it's latency being measured here.
+        config.capacity = size_t(1) << 26;
+
+        std::unique_ptr<sim_backend> sim = make_store(100, path_span, config);
+        std::string name = fmt::format("snapshot_load_100_50us_jobs_{}", jobs);
+
+        add(lak::astring_view { name.data(), name.size() }, [&] {
+            (void) BootSnapshot::load(*sim, jobs);
+        }, sim.get());
+    }
+}
+
+void write_results(const vec<result>& results, fmt::memory_buffer& out) {
+    json_writer w { out };
+
+    w.begin_object();
+    w.key("benchmarks");
+    w.begin_array();
+
+    for (const result& r : results) {
+        w.begin_object();
+        w.key("name");
+        w.value(lak::astring_view { r.name.data(), r.name.size() });
+        w.key("iterations");
+        w.value(u64(r.iterations));
+        w.key("ns_per_op");
+        w.value(r.ns_per_op);
+        w.key("allocations_per_op");
+        w.value(r.allocations_per_op);
+        w.key("firmware_calls_per_op");
+        w.value(r.firmware_calls_per_op);
+        w.end_object();
+    }
+
+    w.end_array();
+    w.end_object();
+    w.newline();
+}
+
+}
+
+int main(int argc, const char** argv) {
+    using namespace efibootmgrw;
+    using namespace efibootmgrw::bench;
+
+    options opt;
+
+    for (int i = 1; i < argc; ++i) {
+        lak::astring_view arg = lak::astring_view::from_c_str(argv[i]);
+
+        if (i + 1 < argc && arg == "--filter") {
+            opt.filter = lak::astring_view::from_c_str(argv[++i]);
+        } else if (i + 1 < argc && arg == "--out") {
+            opt.out = lak::astring_view::from_c_str(argv[++i]);
+        } else if (i + 1 < argc && arg == "--min-time") {
+            opt.min_time = std::chrono::milliseconds { std::atoi(argv[++i]) };
+        } else {
+            fmt::print(stderr, "Usage: {} [--filter substring] [--out file.json] [--min-time ms]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    vec<result> results;
+    run_all(opt, results);
+
+    fmt::memory_buffer out;
+    write_results(results, out);
+
+    std::FILE* file = opt.out ? std::fopen(std::string(opt.out->begin(), opt.out->end()).c_str(), "wb") : stdout;
+
+    if (!file) {
+        fmt::print(stderr, "unable to open {}\n", *opt.out);
+        return EXIT_FAILURE;
+    }
+
+    std::fwrite(out.data(), 1, out.size(), file);
+
+    if (file != stdout)
+        std::fclose(file);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,79 @@
+#include "arena.h"
+
+#include <algorithm>
+
+namespace efibootmgrw {
+
+auto bump_arena::alloc(size_t size, size_t align) -> lak::span<byte_t> {
+    assert(align != 0 && (align & (align - 1)) == 0 && align <= max_alignment);
+
+    auto aligned = [&](const chunk& c) {
+        return (c.top + align - 1) & ~(align - 1);
+    };
+
+    if (chunks_.empty() || aligned(chunks_.back()) + size > chunks_.back().size) {
+        // Oversized requests get a chunk to themselves.
+        size_t chunk_size = std::max(chunk_size_, size);
+
+        chunks_.push_back(chunk {
+                std::unique_ptr<byte_t[]>(new byte_t[chunk_size]),
+                chunk_size,
+                0
+        });
+    }
+
+    chunk& c = chunks_.back();
+    size_t offset = aligned(c);
+
+    c.top = offset + size;
+    used_ += size;
+
+    return lak::span<byte_t> { c.data.get() + offset, size };
+}
+
+void bump_arena::shrink_last(lak::span<byte_t> last, size_t size) {
+    assert(!chunks_.empty());
+    assert(size <= last.size());
+
+    chunk& c = chunks_.back();
+
+    assert(last.data() + last.size() == c.data.get() + c.top);
+
+    c.top -= last.size() - size;
+    used_ -= last.size() - size;
+}
+
+void bump_arena::adopt(bump_arena&& other) {
+    // Keep our last chunk last so it can keep being bumped.
+    chunks_.insert(
+            chunks_.begin(),
+            std::make_move_iterator(other.chunks_.begin()),
+            std::make_move_iterator(other.chunks_.end())
+    );
+
+    used_ += other.used_;
+
+    other.chunks_.clear();
+    other.used_ = 0;
+}
+
+auto bump_arena::bytes_free(size_t align) const -> size_t {
+    if (chunks_.empty())
+        return 0;
+
+    const chunk& c = chunks_.back();
+    size_t offset = (c.top + align - 1) & ~(align - 1);
+
+    return offset < c.size ? c.size - offset : 0;
+}
+
+auto bump_arena::bytes_reserved() const -> size_t {
+    size_t total = 0;
+
+    for (const chunk& c : chunks_)
+        total += c.size;
+
+    return total;
+}
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "efibootmgrw.h"
+
+#include <memory>
+
+namespace efibootmgrw {
+
+/*
+ * Bump allocator handing out spans that never move, so views into it
+ * stay valid for as long as the arena (or whoever adopts it) lives.
+ */
+struct bump_arena {
+    static constexpr size_t default_chunk_size = 16 * 1024;
+
+    // Anything new[] gives us is aligned to at least this.
+    static constexpr size_t max_alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+    explicit bump_arena(size_t chunk_size = default_chunk_size) : chunk_size_ { chunk_size } {}
+
+    bump_arena(const bump_arena&) = delete;
+    bump_arena& operator=(const bump_arena&) = delete;
+
+    bump_arena(bump_arena&&) = default;
+    bump_arena& operator=(bump_arena&&) = default;
+
+    [[nodiscard]]
+    auto alloc(size_t size, size_t align = alignof(u64)) -> lak::span<byte_t>;
+
+    // Hand back the tail of the most recent allocation.
+    void shrink_last(lak::span<byte_t> last, size_t size);
+
+    // Take ownership of everything allocated from other.
+    void adopt(bump_arena&& other);
+
+    // Bytes handed out, not counting alignment padding.
+    [[nodiscard]]
+    auto bytes_used() const -> size_t {
+        return used_;
+    }
+
+    [[nodiscard]]
+    auto bytes_reserved() const -> size_t;
+
+    // The largest allocation that fits in the current chunk, so doesn't start another.
+    [[nodiscard]]
+    auto bytes_free(size_t align = alignof(u64)) const -> size_t;
+
+private:
+    struct chunk {
+        std::unique_ptr<byte_t[]> data;
+        size_t size;
+        size_t top;
+    };
+
+    vec<chunk> chunks_;
+    size_t chunk_size_;
+    size_t used_ = 0;
+};
+
+}
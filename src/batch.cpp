@@ -0,0 +1,290 @@
+#include "batch.h"
+#include "cmdline.h"
+#include "plan_changes.h"
+#include "ucs2.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace efibootmgrw {
+
+namespace {
+
+/*
+ * Variables as planned so far: each is read from inner the first time
+ * it's asked for, and writes and removals only ever land here.
+ */
+struct staged_backend final : efivar_backend {
+    explicit staged_backend(efivar_backend& inner) : inner_ { inner } {}
+
+    [[nodiscard]]
+    auto read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+    -> vresult<lak::span<void>> override {
+        vresult<const staged_var*> var = lookup(name, guid);
+
+        if (!var.is_ok())
+            return lak::err_t { var.unsafe_unwrap_err() };
+
+        const vec<byte_t>& bytes = *var.unsafe_unwrap()->data;
+
+        if (bytes.size() > buf.size_bytes())
+            return lak::err_t { var_err { var_err::kind_t::buffer_too_small } };
+
+        std::memcpy(buf.data(), bytes.data(), bytes.size());
+
+        if (attributes)
+            *attributes = var.unsafe_unwrap()->attributes;
+
+        return lak::ok_t { lak::span<void> { buf.data(), bytes.size() } };
+    }
+
+    [[nodiscard]]
+    auto size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> override {
+        vresult<const staged_var*> var = lookup(name, guid);
+
+        if (!var.is_ok())
+            return lak::err_t { var.unsafe_unwrap_err() };
+
+        return lak::ok_t { var.unsafe_unwrap()->data->size() };
+    }
+
+    auto write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+    -> vresult<lak::monostate> override {
+        const auto* p = static_cast<const byte_t*>(buf.data());
+        vars_[key(name, guid)] = staged_var { vec<byte_t>(p, p + buf.size_bytes()), attributes, true };
+        return lak::ok_t { };
+    }
+
+    auto remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> override {
+        vars_[key(name, guid)] = staged_var { lak::nullopt, efi_variable_default_attributes, true };
+        return lak::ok_t { };
+    }
+
+    [[nodiscard]]
+    auto enumerate() -> vresult<vec<efi_var_name>> override {
+        if (!names_) {
+            vresult<vec<efi_var_name>> names = inner_.enumerate();
+
+            if (!names.is_ok())
+                return lak::err_t { names.unsafe_unwrap_err() };
+
+            names_ = std::move(names.unsafe_unwrap());
+        }
+
+        vec<efi_var_name> out;
+
+        for (const efi_var_name& n : *names_) {
+            if (auto it = vars_.find(key(n.name, n.guid)); it == vars_.end() || it->second.data)
+                out.push_back(n);
+        }
+
+        for (const auto& [k, var] : vars_) {
+            bool listed = std::any_of(names_->begin(), names_->end(), [&](const efi_var_name& n) {
+                return n.name == k.first && n.guid == k.second;
+            });
+
+            if (var.dirty && var.data && !listed)
+                out.push_back(efi_var_name { k.first, k.second });
+        }
+
+        return lak::ok_t { std::move(out) };
+    }
+
+    // Every variable written or removed, as one transaction.
+    [[nodiscard]]
+    auto changes() const -> transaction {
+        transaction tx;
+
+        for (const auto& [k, var] : vars_) {
+            if (!var.dirty)
+                continue;
+
+            if (var.data)
+                tx.set(k.first, k.second, lak::span<const byte_t> { var.data->data(), var.data->size() }, var.attributes);
+            else
+                tx.remove(k.first, k.second);
+        }
+
+        return tx;
+    }
+
+private:
+    using key_t = std::pair<lak::wstring, lak::wstring>;
+
+    struct staged_var {
+        // Unset if the variable doesn't exist
+        lak::optional<vec<byte_t>> data;
+        u32 attributes = efi_variable_default_attributes;
+        // Written or removed, rather than just read
+        bool dirty = false;
+    };
+
+    efivar_backend& inner_;
+    std::map<key_t, staged_var> vars_;
+    lak::optional<vec<efi_var_name>> names_;
+
+    [[nodiscard]]
+    static auto key(lak::wstring_view name, lak::wstring_view guid) -> key_t {
+        return key_t { lak::wstring(name.begin(), name.end()), lak::wstring(guid.begin(), guid.end()) };
+    }
+
+    [[nodiscard]]
+    auto lookup(lak::wstring_view name, lak::wstring_view guid) -> vresult<const staged_var*> {
+        key_t k = key(name, guid);
+        auto it = vars_.find(k);
+
+        if (it == vars_.end()) {
+            bump_arena arena;
+            staged_var var;
+            vresult<lak::span<byte_t>> data = read_variable(inner_, name, guid, arena, nullptr, &var.attributes);
+
+            if (data.is_ok())
+                var.data = vec<byte_t>(data.unsafe_unwrap().begin(), data.unsafe_unwrap().end());
+            else if (data.unsafe_unwrap_err().kind != var_err::kind_t::not_found)
+                return lak::err_t { data.unsafe_unwrap_err() };
+
+            it = vars_.emplace(std::move(k), std::move(var)).first;
+        }
+
+        if (!it->second.data)
+            return lak::err_t { var_err { var_err::kind_t::not_found } };
+
+        return lak::ok_t { &it->second };
+    }
+};
+
+[[nodiscard]]
+auto is_space(char c) -> bool {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/*
+ * Splits [begin, end) into arguments in place, null terminating each, as
+ * unquoting only ever shrinks an argument. end must be writable, i.e. the
+ * line's '\n' or the string's terminator. False on an unterminated quote.
+ */
+[[nodiscard]]
+auto split_args(char* begin, char* end, vec<const char*>& out) -> bool {
+    char* r = begin;
+
+    while (r < end) {
+        if (is_space(*r)) {
+            ++r;
+            continue;
+        }
+
+        char* w = r;
+        out.push_back(w);
+
+        while (r < end && !is_space(*r)) {
+            if (*r == '"' || *r == '\'') {
+                char quote = *r++;
+
+                while (r < end && *r != quote)
+                    *w++ = *r++;
+
+                if (r == end)
+                    return false;
+
+                ++r;
+            } else {
+                *w++ = *r++;
+            }
+        }
+
+        // w <= r, so this only overwrites what's been consumed, or end.
+        bool last = r == end;
+        *w = '\0';
+
+        if (!last)
+            ++r;
+    }
+
+    return true;
+}
+
+// Options that pick the backend or what to do with it belong on the real command line.
+[[nodiscard]]
+auto only_changes(const Context& ctx) -> bool {
+    const auto& a = ctx.args;
+
+    return !a.efivars_dir && !a.analyze_dir && !a.journal && !a.cache_file && !a.batch_file
+           && !a.simulate && !a.watch && !a.all && !a.json && !a.ndjson && !a.rollback && !a.resume
+           && !a.sim_latency && !a.sim_capacity && a.sim_faults.empty() && !a.stats && !a.stats_textfile;
+}
+
+}
+
+auto plan_batch(Context& ctx, efivar_backend& vars) -> vresult<transaction> {
+    lak::astring_view path = *ctx.args.batch_file;
+    std::string text;
+
+    read_text_file(path)
+        .if_ok([&](std::string& t) { text = std::move(t); })
+        .if_err([&](const var_err& err) {
+            Fatal(ctx, "unable to read {}: {}\n", path, to_u8string(err.wstring()));
+        });
+
+    staged_backend staged { vars };
+    // Shared by every line, so each disk's table is read once a run.
+    partition_cache disks;
+
+    auto stage = [&](Context& line_ctx) -> vresult<lak::monostate> {
+        vresult<transaction> tx = plan_changes(line_ctx, staged, disks);
+
+        if (!tx.is_ok())
+            return lak::err_t { tx.unsafe_unwrap_err() };
+
+        for (const var_change& c : tx.unsafe_unwrap().changes()) {
+            if (c.data) {
+                lak::span<void> data { const_cast<byte_t*>(c.data->data()), c.data->size() };
+                (void) staged.write(c.name, c.guid, data, c.attributes);
+            } else {
+                (void) staged.remove(c.name, c.guid);
+            }
+        }
+
+        return lak::ok_t { };
+    };
+
+    if (auto res = stage(ctx); !res.is_ok())
+        return lak::err_t { res.unsafe_unwrap_err() };
+
+    vec<const char*> argv;
+    char* line = text.data();
+    char* text_end = text.data() + text.size();
+
+    for (size_t line_number = 1; line < text_end; ++line_number) {
+        char* line_end = std::find(line, text_end, '\n');
+
+        char* first = std::find_if_not(line, line_end, is_space);
+
+        argv.clear();
+        argv.push_back(ctx.program.data());
+
+        if (first != line_end && *first != '#' && !split_args(first, line_end, argv))
+            Fatal(ctx, "{}:{}: unterminated quote\n", path, line_number);
+
+        line = line_end + 1;
+
+        if (argv.size() == 1)
+            continue;
+
+        Context line_ctx;
+        line_ctx.args.color_diagnostics = ctx.args.color_diagnostics;
+        line_ctx.args.jobs = ctx.args.jobs;
+
+        parse_args(line_ctx, lak::span<const char*> { argv.data(), argv.size() });
+
+        if (!only_changes(line_ctx))
+            Fatal(ctx, "{}:{}: only options that change variables can be used in a batch\n", path, line_number);
+
+        if (auto res = stage(line_ctx); !res.is_ok())
+            Fatal(ctx, "{}:{}: {}\n", path, line_number, to_u8string(res.unsafe_unwrap_err().wstring()));
+    }
+
+    return lak::ok_t { staged.changes() };
+}
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "efivar_backend.h"
+#include "transaction.h"
+
+namespace efibootmgrw {
+
+/*
+ * --batch: one command line per line of a file (- for stdin), e.g.
+ *
+ *   # comment
+ *   -b 0003 -B
+ *   -b 0001 -a
+ *   -o 0001,0000
+ *   --apply "/etc/efibootmgrw/boot menu.conf"
+ *
+ * Arguments are split on whitespace, '...' and "..." quote, and
+ * backslashes are taken literally so device paths need no escaping.
+ * Only options that change variables may appear.
+ *
+ * The command line's own changes are planned first, then each line
+ * against the variables as the ones before it left them. Variables are
+ * read from vars at most once, and everything comes back as a single
+ * transaction, to be committed once.
+ */
+[[nodiscard]]
+auto plan_batch(Context& ctx, efivar_backend& vars) -> vresult<transaction>;
+
+}
@@ -0,0 +1,117 @@
+#include "boot_json.h"
+#include "json_writer.h"
+#include "efi_load_option.h"
+#include "device_path_text.h"
+
+namespace efibootmgrw {
+
+namespace {
+
+void write_optional(json_writer& w, lak::astring_view key, const lak::optional<u16>& v) {
+    w.key(key);
+    if (v)
+        w.value(u64(*v));
+    else
+        w.null();
+}
+
+void write_globals(json_writer& w, const BootSnapshot& snap) {
+    write_optional(w, "boot_next", snap.boot_next);
+    write_optional(w, "boot_current", snap.boot_current);
+    write_optional(w, "timeout", snap.timeout);
+
+    w.key("boot_order");
+    w.begin_array();
+    for (u16 id : snap.boot_order())
+        w.value(u64(id));
+    w.end_array();
+
+    if (snap.boot_order_error()) {
+        w.key("boot_order_error");
+        std::string msg = to_u8string(snap.boot_order_error()->wstring());
+        w.value(lak::astring_view { msg.data(), msg.size() });
+    }
+}
+
+void write_entry(json_writer& w, fmt::memory_buffer& scratch, const BootSnapshot& snap, size_t position) {
+    u16 id = snap.boot_order()[position];
+    const BootSnapshot::entry* e = snap.find(id);
+
+    w.key("id");
+    w.value(u64(id));
+    w.key("position");
+    w.value(u64(position));
+
+    if (e->err) {
+        w.key("error");
+        std::string msg = to_u8string(e->err->wstring());
+        w.value(lak::astring_view { msg.data(), msg.size() });
+        return;
+    }
+
+    load_option_view::parse(e->data)
+        .if_ok([&](load_option_view opt) {
+            w.key("attributes");
+            w.value(u64(opt.attributes()));
+            w.key("active");
+            w.value(opt.active());
+            w.key("label");
+            w.value(opt.desc());
+
+            scratch.clear();
+            format_device_path(scratch, opt.file_path_list());
+            w.key("device_path");
+            w.value(lak::astring_view { scratch.data(), scratch.size() });
+
+            w.key("optional_data");
+            w.value_hex(opt.optional_data());
+        })
+        .if_err([&](load_option_err err) {
+            w.key("error");
+            w.value(to_string(err));
+        });
+}
+
+}
+
+void write_boot_json(fmt::memory_buffer& out, const BootSnapshot& snap, bool ndjson) {
+    json_writer w { out };
+    fmt::memory_buffer scratch;
+
+    if (ndjson) {
+        w.begin_object();
+        w.key("type");
+        w.value(lak::astring_view { "globals" });
+        write_globals(w, snap);
+        w.end_object();
+        w.newline();
+
+        for (size_t i = 0; i < snap.boot_order().size(); ++i) {
+            w.begin_object();
+            w.key("type");
+            w.value(lak::astring_view { "entry" });
+            write_entry(w, scratch, snap, i);
+            w.end_object();
+            w.newline();
+        }
+
+        return;
+    }
+
+    w.begin_object();
+    write_globals(w, snap);
+
+    w.key("entries");
+    w.begin_array();
+    for (size_t i = 0; i < snap.boot_order().size(); ++i) {
+        w.begin_object();
+        write_entry(w, scratch, snap, i);
+        w.end_object();
+    }
+    w.end_array();
+
+    w.end_object();
+    w.newline();
+}
+
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "boot_snapshot.h"
+
+namespace efibootmgrw {
+
+/*
+ * The snapshot as one JSON document, or as ndjson with a "globals" record
+ * followed by one "entry" record per BootOrder position. Entries that
+ * couldn't be read or parsed carry an "error" instead of their fields.
+ */
+void write_boot_json(fmt::memory_buffer& out, const BootSnapshot& snap, bool ndjson);
+
+}
@@ -0,0 +1,87 @@
+#include "boot_snapshot.h"
+#include "load_option_name.h"
+#include "stats.h"
+
+#include <algorithm>
+
+namespace efibootmgrw {
+
+auto BootSnapshot::load(efivar_backend& vars, size_t jobs) -> BootSnapshot {
+    stat_timer timer { stat_kind::snapshot };
+    BootSnapshot snap;
+
+    snap.boot_next    = snap.read_u16(vars, L"BootNext");
+    snap.boot_current = snap.read_u16(vars, L"BootCurrent");
+    snap.timeout      = snap.read_u16(vars, L"Timeout");
+
+    read_variable(vars, L"BootOrder", efi_global_variable, snap.arena_, &snap.calls_)
+            .if_ok([&](lak::span<byte_t> data) {
+                snap.boot_order_ = lak::span<const u16> {
+                        reinterpret_cast<const u16*>(data.data()),
+                        data.size() / sizeof(u16)
+                };
+            })
+            .if_err([&](var_err err) {
+                snap.boot_order_err_ = err;
+            });
+
+    vec<u16> ids { snap.boot_order_.begin(), snap.boot_order_.end() };
+
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    snap.entries_.resize(ids.size());
+
+    for (size_t i = 0; i < ids.size(); ++i)
+        snap.entries_[i].id = ids[i];
+
+    vec<load_option_name> names;
+    vec<variable_read> reads(ids.size());
+    names.reserve(ids.size());
+
+    for (u16 id : ids)
+        names.push_back(boot_option_name(id));
+
+    read_variables_parallel(
+            vars,
+            lak::span<const load_option_name> { names.data(), names.size() },
+            jobs,
+            snap.arena_,
+            snap.calls_,
+            lak::span<variable_read> { reads.data(), reads.size() }
+    );
+
+    for (size_t i = 0; i < ids.size(); ++i) {
+        snap.entries_[i].data = reads[i].data;
+        snap.entries_[i].err  = reads[i].err;
+    }
+
+    return snap;
+}
+
+auto BootSnapshot::find(u16 id) const -> const entry* {
+    auto it = std::lower_bound(
+            entries_.begin(),
+            entries_.end(),
+            id,
+            [](const entry& e, u16 id) { return e.id < id; }
+    );
+
+    return it != entries_.end() && it->id == id ? &*it : nullptr;
+}
+
+auto BootSnapshot::read_u16(efivar_backend& vars, lak::wstring_view name) -> lak::optional<u16> {
+    u16 out;
+
+    ++calls_;
+
+    vresult<lak::span<void>> res = vars.read(name, efi_global_variable, { &out, sizeof(u16) }, nullptr);
+
+    // Anything shorter leaves out partly uninitialised.
+    if (res.is_ok() && res.unsafe_unwrap().size_bytes() == sizeof(u16))
+        return out;
+
+    return lak::nullopt;
+}
+
+}
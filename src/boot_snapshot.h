@@ -0,0 +1,83 @@
+#pragma once
+
+#include "efibootmgrw.h"
+#include "efivar_backend.h"
+#include "arena.h"
+
+namespace efibootmgrw {
+
+/*
+ * Every boot related variable, read from the backend in one pass.
+ * Firmware reads can take milliseconds each, so everything after
+ * load() is served from memory.
+ */
+struct BootSnapshot {
+    struct entry {
+        u16 id;
+        // Points into the snapshot's arena, empty if err is set
+        lak::span<const byte_t> data;
+        lak::optional<var_err> err;
+    };
+
+    lak::optional<u16> boot_next;
+    lak::optional<u16> boot_current;
+    lak::optional<u16> timeout;
+
+    BootSnapshot() = default;
+
+    // Entries point into the arena, so a copy would dangle.
+    BootSnapshot(const BootSnapshot&) = delete;
+    BootSnapshot& operator=(const BootSnapshot&) = delete;
+
+    BootSnapshot(BootSnapshot&&) = default;
+    BootSnapshot& operator=(BootSnapshot&&) = default;
+
+    // Reads BootNext, BootCurrent, Timeout, BootOrder and every Boot#### in BootOrder.
+    // Boot#### entries are read by up to `jobs` threads if the backend allows it.
+    [[nodiscard]]
+    static auto load(efivar_backend& vars, size_t jobs = 1) -> BootSnapshot;
+
+    [[nodiscard]]
+    auto boot_order() const -> lak::span<const u16> {
+        return boot_order_;
+    }
+
+    // Set if BootOrder itself couldn't be read.
+    [[nodiscard]]
+    auto boot_order_error() const -> const lak::optional<var_err>& {
+        return boot_order_err_;
+    }
+
+    // Sorted by id, each id at most once.
+    [[nodiscard]]
+    auto entries() const -> lak::span<const entry> {
+        return lak::span<const entry> { entries_.data(), entries_.size() };
+    }
+
+    [[nodiscard]]
+    auto find(u16 id) const -> const entry*;
+
+    // Number of calls made to the backend by load().
+    [[nodiscard]]
+    auto firmware_calls() const -> size_t {
+        return calls_;
+    }
+
+    [[nodiscard]]
+    auto arena() const -> const bump_arena& {
+        return arena_;
+    }
+
+private:
+    bump_arena arena_;
+    vec<entry> entries_;
+
+    lak::span<const u16> boot_order_;
+    lak::optional<var_err> boot_order_err_;
+
+    size_t calls_ = 0;
+
+    auto read_u16(efivar_backend& vars, lak::wstring_view name) -> lak::optional<u16>;
+};
+
+}
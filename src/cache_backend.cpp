@@ -0,0 +1,282 @@
+#include "cache_backend.h"
+#include "replace_file.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+# include <fcntl.h>
+#endif
+
+namespace efibootmgrw {
+
+namespace {
+
+constexpr char cache_magic[8] = { 'E', 'F', 'B', 'M', 'W', 'C', 'C', '1' };
+constexpr u32 cache_version = 1;
+
+// Matches read_variable, so load options read from the cache stay aligned.
+constexpr size_t cache_data_alignment = alignof(u64);
+
+static_assert(sizeof(cache_header) == 16);
+static_assert(sizeof(cache_record) == 40);
+
+// Names outside of ASCII aren't cached, nothing we read has one.
+[[nodiscard]]
+auto ascii_name(lak::wstring_view name, std::string& out) -> bool {
+    out.clear();
+
+    for (wchar_t c : name) {
+        if (c <= 0 || c >= 0x80)
+            return false;
+        out.push_back(static_cast<char>(c));
+    }
+
+    return true;
+}
+
+#ifdef _WIN32
+[[nodiscard]]
+auto read_cache_file(lak::astring_view path) -> vec<byte_t> {
+    std::string p { path.begin(), path.end() };
+    std::FILE* file = std::fopen(p.c_str(), "rb");
+
+    if (!file)
+        return { };
+
+    vec<byte_t> bytes;
+    byte_t chunk[4096];
+
+    for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), file)) > 0;)
+        bytes.insert(bytes.end(), chunk, chunk + n);
+
+    std::fclose(file);
+
+    return bytes;
+}
+#endif
+
+}
+
+cache_backend::cache_backend(std::unique_ptr<efivar_backend> inner, lak::astring_view path)
+        : inner_ { std::move(inner) }, path_ { path.begin(), path.end() } {
+#ifndef _WIN32
+    vresult<mapped_file> mapped = mapped_file::open_at(AT_FDCWD, path_.c_str());
+
+    if (!mapped.is_ok())
+        return;
+
+    file_ = std::move(mapped.unsafe_unwrap());
+    bytes_ = file_.bytes();
+#else
+    file_ = read_cache_file(path);
+    bytes_ = lak::span<const byte_t> { file_.data(), file_.size() };
+#endif
+
+    cache_header header;
+
+    if (bytes_.size() < sizeof(header))
+        return;
+
+    std::memcpy(&header, bytes_.data(), sizeof(header));
+
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version)
+        return;
+
+    if ((bytes_.size() - sizeof(header)) / sizeof(cache_record) < header.count)
+        return;
+
+    // The mapping is page aligned, and records are 8 byte multiples after a 16 byte header.
+    records_ = lak::span<const cache_record> {
+            reinterpret_cast<const cache_record*>(bytes_.data() + sizeof(header)),
+            header.count
+    };
+}
+
+auto cache_backend::find_record(std::string_view name) const -> const cache_record* {
+    auto name_of = [&](const cache_record& r) -> lak::optional<std::string_view> {
+        if (r.name_offset > bytes_.size() || r.name_size > bytes_.size() - r.name_offset)
+            return lak::nullopt;
+        return std::string_view { reinterpret_cast<const char*>(bytes_.data()) + r.name_offset, r.name_size };
+    };
+
+    size_t lo = 0, hi = records_.size();
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        lak::optional<std::string_view> mid_name = name_of(records_[mid]);
+
+        // A damaged cache is just a cold one.
+        if (!mid_name)
+            return nullptr;
+
+        if (*mid_name < name)
+            lo = mid + 1;
+        else if (name < *mid_name)
+            hi = mid;
+        else
+            return &records_[mid];
+    }
+
+    return nullptr;
+}
+
+auto cache_backend::lookup(lak::wstring_view name, lak::wstring_view guid)
+-> vresult<lak::optional<lak::span<const byte_t>>> {
+    using found_t = lak::optional<lak::span<const byte_t>>;
+
+    std::string key;
+
+    if (guid != lak::wstring_view { efi_global_variable } || !ascii_name(name, key))
+        return lak::ok_t { found_t { } };
+
+    {
+        std::lock_guard lock { mutex_ };
+
+        if (auto it = seen_.find(key); it != seen_.end())
+            return lak::ok_t { found_t { it->second.data } };
+    }
+
+    vresult<var_fingerprint> fp = inner_->fingerprint(name, guid);
+
+    if (!fp.is_ok()) {
+        if (fp.unsafe_unwrap_err().kind == var_err::kind_t::not_found)
+            return lak::err_t { fp.unsafe_unwrap_err() };
+
+        return lak::ok_t { found_t { } };
+    }
+
+    seen_var var { fp.unsafe_unwrap(), { }, { } };
+
+    const cache_record* record = find_record(key);
+
+    if (record && record->fingerprint == var.fingerprint
+        && record->data_offset <= bytes_.size() && record->data_size <= bytes_.size() - record->data_offset) {
+        var.data = bytes_.subspan(record->data_offset, record->data_size);
+
+        std::lock_guard lock { mutex_ };
+        ++stats_.hits;
+        return lak::ok_t { found_t { seen_.emplace(std::move(key), std::move(var)).first->second.data } };
+    }
+
+    bump_arena arena;
+    vresult<lak::span<byte_t>> data = read_variable(*inner_, name, guid, arena);
+
+    if (!data.is_ok())
+        return lak::err_t { data.unsafe_unwrap_err() };
+
+    var.owned.assign(data.unsafe_unwrap().begin(), data.unsafe_unwrap().end());
+
+    std::lock_guard lock { mutex_ };
+    ++stats_.misses;
+    auto [it, inserted] = seen_.emplace(std::move(key), std::move(var));
+
+    if (inserted)
+        it->second.data = lak::span<const byte_t> { it->second.owned.data(), it->second.owned.size() };
+
+    return lak::ok_t { found_t { it->second.data } };
+}
+
+void cache_backend::forget(lak::wstring_view name) {
+    std::string key;
+
+    if (!ascii_name(name, key))
+        return;
+
+    std::lock_guard lock { mutex_ };
+
+    if (auto it = seen_.find(key); it != seen_.end())
+        seen_.erase(it);
+}
+
+auto cache_backend::read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+-> vresult<lak::span<void>> {
+    // Attributes aren't cached, and only a commit about to write asks for them.
+    if (attributes)
+        return inner_->read(name, guid, buf, attributes);
+
+    vresult<lak::optional<lak::span<const byte_t>>> found = lookup(name, guid);
+
+    if (!found.is_ok())
+        return lak::err_t { found.unsafe_unwrap_err() };
+
+    const lak::optional<lak::span<const byte_t>>& data = found.unsafe_unwrap();
+
+    if (!data)
+        return inner_->read(name, guid, buf, nullptr);
+
+    if (data->size() > buf.size_bytes())
+        return lak::err_t { var_err { var_err::kind_t::buffer_too_small } };
+
+    std::memcpy(buf.data(), data->data(), data->size());
+
+    return lak::ok_t { lak::span<void> { buf.data(), data->size() } };
+}
+
+auto cache_backend::size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> {
+    vresult<lak::optional<lak::span<const byte_t>>> found = lookup(name, guid);
+
+    if (!found.is_ok())
+        return lak::err_t { found.unsafe_unwrap_err() };
+
+    if (const lak::optional<lak::span<const byte_t>>& data = found.unsafe_unwrap())
+        return lak::ok_t { data->size() };
+
+    return inner_->size(name, guid);
+}
+
+auto cache_backend::write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+-> vresult<lak::monostate> {
+    forget(name);
+    return inner_->write(name, guid, buf, attributes);
+}
+
+auto cache_backend::remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> {
+    forget(name);
+    return inner_->remove(name, guid);
+}
+
+auto cache_backend::save() -> vresult<lak::monostate> {
+    std::lock_guard lock { mutex_ };
+
+    vec<byte_t> out(sizeof(cache_header) + seen_.size() * sizeof(cache_record));
+    vec<cache_record> records;
+    records.reserve(seen_.size());
+
+    // seen_ is ordered by name, so records come out sorted.
+    for (const auto& [name, var] : seen_) {
+        cache_record r { };
+        r.fingerprint = var.fingerprint;
+
+        r.name_offset = static_cast<u32>(out.size());
+        r.name_size = static_cast<u32>(name.size());
+        out.insert(out.end(), reinterpret_cast<const byte_t*>(name.data()), reinterpret_cast<const byte_t*>(name.data()) + name.size());
+
+        out.resize((out.size() + cache_data_alignment - 1) / cache_data_alignment * cache_data_alignment);
+
+        r.data_offset = static_cast<u32>(out.size());
+        r.data_size = static_cast<u32>(var.data.size());
+        out.insert(out.end(), var.data.begin(), var.data.end());
+
+        records.push_back(r);
+    }
+
+    cache_header header { };
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.count = static_cast<u32>(records.size());
+
+    std::memcpy(out.data(), &header, sizeof(header));
+    std::memcpy(out.data() + sizeof(header), records.data(), records.size() * sizeof(cache_record));
+
+    // Renamed over the old one, as other runs may have it mapped.
+    return replace_file(path_, lak::span<const byte_t> { out.data(), out.size() });
+}
+
+auto cache_backend::stats() const -> cache_stats {
+    std::lock_guard lock { mutex_ };
+    return stats_;
+}
+
+}
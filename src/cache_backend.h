@@ -0,0 +1,120 @@
+#pragma once
+
+#include "efivar_backend.h"
+#include "mapped_file.h"
+
+#include <map>
+#include <mutex>
+
+namespace efibootmgrw {
+
+/*
+ * On disk, all native endian, the cache being local to the machine:
+ *
+ *   cache_header
+ *   cache_record[count], sorted by name
+ *   names (ASCII) and data, each variable's data aligned to 8
+ *
+ * Records are used where they lie in the mapping, and load options decode
+ * as views over their bytes, so a hit costs a stat() and a memcpy.
+ */
+struct cache_header {
+    char magic[8];
+    u32 version;
+    u32 count;
+};
+
+struct cache_record {
+    var_fingerprint fingerprint;
+    u32 name_offset;
+    u32 name_size;
+    u32 data_offset;
+    u32 data_size;
+};
+
+struct cache_stats {
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+/*
+ * Serves global variables whose fingerprint hasn't changed since the last
+ * run from a cache file, and everything else from inner. Without
+ * fingerprints from inner every call simply passes through.
+ */
+struct cache_backend final : efivar_backend {
+    // Starts empty if path doesn't hold a cache we can use.
+    cache_backend(std::unique_ptr<efivar_backend> inner, lak::astring_view path);
+
+    [[nodiscard]]
+    auto read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+    -> vresult<lak::span<void>> override;
+
+    [[nodiscard]]
+    auto size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> override;
+
+    [[nodiscard]]
+    auto fingerprint(lak::wstring_view name, lak::wstring_view guid) -> vresult<var_fingerprint> override {
+        return inner_->fingerprint(name, guid);
+    }
+
+    auto write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+    -> vresult<lak::monostate> override;
+
+    auto remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> override;
+
+    [[nodiscard]]
+    auto enumerate() -> vresult<vec<efi_var_name>> override {
+        return inner_->enumerate();
+    }
+
+    [[nodiscard]]
+    auto thread_safe() const -> bool override {
+        return inner_->thread_safe();
+    }
+
+    auto authenticate(Context& ctx) -> vresult<lak::monostate> override {
+        return inner_->authenticate(ctx);
+    }
+
+    // Replaces the cache file with every variable seen since construction.
+    auto save() -> vresult<lak::monostate>;
+
+    [[nodiscard]]
+    auto stats() const -> cache_stats;
+
+private:
+    struct seen_var {
+        var_fingerprint fingerprint;
+        // Into the mapping for hits, into owned for misses
+        lak::span<const byte_t> data;
+        vec<byte_t> owned;
+    };
+
+    std::unique_ptr<efivar_backend> inner_;
+    std::string path_;
+
+#ifndef _WIN32
+    mapped_file file_;
+#else
+    vec<byte_t> file_;
+#endif
+    lak::span<const byte_t> bytes_;
+    lak::span<const cache_record> records_;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, seen_var, std::less<>> seen_;
+    cache_stats stats_;
+
+    [[nodiscard]]
+    auto find_record(std::string_view name) const -> const cache_record*;
+
+    // The variable's data, or nullopt if it can't be cached and should be
+    // asked of inner_ directly.
+    [[nodiscard]]
+    auto lookup(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::optional<lak::span<const byte_t>>>;
+
+    void forget(lak::wstring_view name);
+};
+
+}
@@ -1,221 +1,428 @@
-#include "cmdline.h"
-
-#include "fmt/xchar.h"
-
-#include <ranges>
-#include <system_error>
-#include <charconv>
-#include <utility>
-
-namespace efibootmgrw {
-
-std::string_view help = R"(
--a | --active             Set bootnum active.
--A | --inactive           Set bootnum inactive.
--b | --bootnum XXXX       Modify BootXXXX (hex).
--B | --delete-bootnum     Delete bootnum.
--c | --create             Create new variable bootnum and add to bootorder.
--d | --disk disk          (Defaults to /dev/sda) containing loader.
--e | --edd [1|3|-1]       Force EDD 1.0 or 3.0 creation variables, or guess.
--E | --device num         EDD 1.0 device number (defaults to 0x80).
--f | --reconnect          Re-connect devices after driver is loaded.
--F | --no-reconnect       Do not re-connect devices after driver is loaded.
--g | --gpt                Force disk w/ invalid PMBR to be treated as GPT.
--i | --iface name         Create a netboot entry for the named interface.
--l | --loader name        (Defaults to \elilo.efi).
--L | --label label        Boot manager display label (defaults to "Linux").
--n | --bootnext XXXX      Set BootNext to XXXX (hex).
--N | --delete-bootnext    Delete BootNext.
--o | --bootorder XXXX,YYYY,ZZZZ,...     Explicitly set BootOrder (hex).
--O | --delete-bootorder   Delete BootOrder.
--p | --part part          (Defaults to 1) containing loader.
--q | --quiet              Be quiet.
--t | --timeout seconds    Boot manager timeout.
--T | --delete-timeout     Delete Timeout value.
--u | --unicode | --UCS-2  Pass extra args as UCS-2 (default is ASCII).
--v | --verbose            Print additional information.
--V | --version            Return version and exit.
--w | --write-signature    Write unique sig to MBR if needed.
--@ | --append-binary-args Append extra variable args from
-file (use - to read from stdin).)";
-
-void parse_args(Context& ctx, lak::span<const char *> argv) {
-    vec<lak::astring_view> args_v;
-
-    for (const char *str_p : argv) {
-        args_v.push_back(lak::astring_view::from_c_str(str_p));
-    }
-
-    ctx.cmdline_args = args_v;
-
-    lak::span<lak::astring_view> args = lak::span { args_v }.subspan(1);
-    lak::astring_view arg;
-
-    auto read_arg = [&](lak::astring_view short_name, lak::astring_view long_name) {
-        for (auto opt : { short_name, long_name }) {
-            if (args[0] != opt) {
-                return false;
-            }
-
-            if (args.size() == 1) {
-                Fatal(ctx, "option {}: argument missing!\n", opt);
-            } else {
-                arg = args[1];
-                args = args.subspan(2);
-            }
-
-            return true;
-        }
-
-        return false;
-    };
-
-    auto read_flag = [&](lak::astring_view short_name, lak::astring_view long_name) {
-        for (auto opt : { short_name, long_name }) {
-            if (args[0] != opt) {
-                return false;
-            }
-
-            args = args.subspan(1);
-            return true;
-        }
-
-        return false;
-    };
-
-    auto parse_int = [&](lak::astring_view v, i32 base = 10) -> lak::result<i64, std::error_code> {
-        i64 res;
-
-        auto from_chars = std::from_chars(v.begin(), v.end(), res, base);
-
-        if (from_chars.ec == std::errc())
-            return lak::ok_t { res };
-        else
-            return lak::err_t { std::make_error_code(from_chars.ec) };
-    };
-
-    auto parse_int_fatal = [&](lak::astring_view flag, lak::astring_view v, i32 base = 10) -> i64 {
-        lak::result<i64, std::error_code> res = parse_int(v, base);
-
-        return res.if_err([&](std::error_code ec) {
-                    Fatal(ctx, "failed to parse {} for flag {}: {}\n", v, flag, ec.message());
-                    unreachable();
-                })
-                .if_ok([&](i64 i) {
-                    return i;
-                })
-                .unsafe_unwrap();
-    };
-
-    auto read_int_fatal = [&](lak::astring_view flag, i32 base = 10) -> i64 {
-        i64 res = parse_int_fatal(flag, arg, base);
-        arg = args[1];
-        args = args.subspan(1);
-        return res;
-    };
-
-    auto read_hex_fatal = [&](lak::astring_view flag) -> i64 {
-        return read_int_fatal(flag, 16);
-    };
-
-    while (!args.empty()) {
-        if (read_flag("-h", "-help")) {
-            fmt::print("Usage: {} [options] {}\n", ctx.cmdline_args[0], help);
-            exit(0);
-        }
-
-        if (read_flag("-a", "--active")) {
-            ctx.args.active = true;
-        } else if (read_flag("-A", "--inactive")) {
-            ctx.args.inactive = true;
-        } else if (read_arg("-b", "--bootnum")) {
-            ctx.args.boot_num = read_hex_fatal("boot_num");
-        } else if (read_arg("-B", "--delete-bootnum")) {
-            ctx.args.delete_boot_num = true;
-        } else if (read_flag("-c", "--create")) {
-            ctx.args.create = true;
-        } else if (read_arg("-d", "--disk")) {
-            ctx.args.disk = arg;
-        } else if (read_arg("-e", "--edd")) {
-            if (arg == "-1")
-                ctx.args.edd = -1;
-            else if (arg == "1")
-                ctx.args.edd = 1;
-            else if (arg == "3")
-                ctx.args.edd = 3;
-            else
-                Fatal(ctx, "Invalid option for edd: {}. Options are {{ -1, 1, 3 }}.\n.", arg);
-
-            args = args.subspan(1);
-        } else if (read_arg("-E", "--device")) {
-            ctx.args.device = read_hex_fatal("device");
-        } else if (read_flag("-f", "--reconnect")) {
-            ctx.args.reconnect = true;
-        } else if (read_flag("-F", "--no-reconnect")) {
-            ctx.args.no_reconnect = true;
-        } else if (read_flag("-g", "--gpt")) {
-            ctx.args.force_gpt = true;
-        } else if (read_arg("-i", "--iface")) {
-            ctx.args.iface = arg;
-        } else if (read_arg("-l", "--loader")) {
-            ctx.args.loader = arg;
-        } else if (read_arg("-L", "--label")) {
-            ctx.args.label = arg;
-        } else if (read_arg("-n", "--bootnext")) {
-            ctx.args.device = read_hex_fatal("bootnext");
-        } else if (read_flag("-N", "--delete-bootnext")) {
-            ctx.args.delete_boot_next = true;
-        } else if (read_arg("-o", "--bootorder")) {
-            vec<i64> boot_order;
-
-            for (auto subrange : std::ranges::views::split(arg, ",")) {
-                lak::astring_view str { subrange.begin(), subrange.end() };
-
-                boot_order.push_back(parse_int_fatal("boot_order", str, 16));
-            }
-
-            ctx.args.boot_order = boot_order;
-        } else if (read_flag("-O", "--delete-bootorder")) {
-            ctx.args.delete_boot_order = true;
-        } else if (read_arg("-p", "--part")) {
-            ctx.args.device = read_int_fatal("part");
-        } else if (read_flag("-q", "--quiet")) {
-            ctx.args.quiet = true;
-        } else if (read_arg("-t", "--timeout")) {
-            ctx.args.device = read_int_fatal("timeout");
-        } else if (read_flag("-T", "--delete-timeout")) {
-            ctx.args.delete_timeout = true;
-        } else if (read_flag("-u", "--unicode") || read_flag("-u", "--UCS-2")) {
-            ctx.args.unicode = true;
-        } else if (read_flag("-v", "--verbose")) {
-            ctx.args.verbose = true;
-        } else if (read_flag("-V", "--version")) {
-            ctx.args.version = true;
-        } else if (read_flag("-w", "--write_signature")) {
-            ctx.args.write_signature = true;
-        } else if (read_flag("-@", "--append-binary-args")) {
-            ctx.args.append_binary_args = true;
-        } else {
-            Fatal(ctx, "Unrecognized flag {}\n", args[0]);
-        }
-    }
-
-    if (ctx.args.version) {
-        fmt::print("efibootmgrw: version 0.01a\n");
-        exit(0);
-    }
-
-    if (ctx.args.delete_boot_num && !ctx.args.boot_num) {
-        Fatal(ctx, "Cannot delete unspecified boot number!\n");
-    }
-
-    if (ctx.args.create && !ctx.args.boot_num) {
-        Fatal(ctx, "Cannot create unspecified boot number!\n");
-    }
-
-    if ((ctx.args.active || ctx.args.inactive) && !ctx.args.boot_num) {
-        Fatal(ctx, "Cannot change activity of unspecified boot number!\n");
-    }
-}
-
+#include "cmdline.h"
+
+#include "fmt/xchar.h"
+
+#include <array>
+#include <ranges>
+#include <system_error>
+#include <charconv>
+#include <utility>
+
+namespace efibootmgrw {
+
+namespace {
+
+[[nodiscard]]
+auto parse_int_fatal(Context& ctx, lak::astring_view flag, lak::astring_view v, i32 base = 10) -> i64 {
+    i64 res;
+
+    auto from_chars = std::from_chars(v.begin(), v.end(), res, base);
+
+    if (from_chars.ec != std::errc() || from_chars.ptr != v.end())
+        Fatal(ctx, "failed to parse {} for flag {}: {}\n", v, flag,
+              from_chars.ec != std::errc() ? std::make_error_code(from_chars.ec).message() : "trailing characters");
+
+    return res;
+}
+
+using option_handler = void (*)(Context& ctx, lak::astring_view arg);
+
+struct option {
+    // 0 if there's no short form
+    char short_name;
+    std::string_view long_name;
+    std::string_view alias;
+    // Empty for flags, otherwise the option takes an argument, named this in the help.
+    std::string_view metavar;
+    // Lines after the first are indented to line up under it.
+    std::string_view help;
+    option_handler handle;
+};
+
+void print_help(Context& ctx, lak::astring_view);
+
+/*
+ * Every option, in the order --help lists them. Each handler sits beside
+ * the names it answers to, so one can't end up filling another's field.
+ */
+constexpr option options[] = {
+    { 'h', "--help", "-help", { }, "Print this help and exit.", print_help },
+    { 'a', "--active", { }, { }, "Set bootnum active.",
+      [](Context& ctx, lak::astring_view) { ctx.args.active = true; } },
+    { 'A', "--inactive", { }, { }, "Set bootnum inactive.",
+      [](Context& ctx, lak::astring_view) { ctx.args.inactive = true; } },
+    { 'b', "--bootnum", { }, "XXXX", "Modify BootXXXX (hex).",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.boot_num = parse_int_fatal(ctx, "bootnum", arg, 16); } },
+    { 'B', "--delete-bootnum", { }, { }, "Delete bootnum.",
+      [](Context& ctx, lak::astring_view) { ctx.args.delete_boot_num = true; } },
+    { 'c', "--create", { }, { }, "Create new variable bootnum and add to bootorder.",
+      [](Context& ctx, lak::astring_view) { ctx.args.create = true; } },
+    { 'd', "--disk", { }, "disk", "(Defaults to /dev/sda) containing loader.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.disk = arg; } },
+    { 'e', "--edd", { }, "[1|3|-1]", "Force EDD 1.0 or 3.0 creation variables, or guess.",
+      [](Context& ctx, lak::astring_view arg) {
+          if (arg == "-1")
+              ctx.args.edd = -1;
+          else if (arg == "1")
+              ctx.args.edd = 1;
+          else if (arg == "3")
+              ctx.args.edd = 3;
+          else
+              Fatal(ctx, "Invalid option for edd: {}. Options are {{ -1, 1, 3 }}.\n", arg);
+      } },
+    { 'E', "--device", { }, "num", "EDD 1.0 device number (defaults to 0x80).",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.device = parse_int_fatal(ctx, "device", arg, 16); } },
+    { 'f', "--reconnect", { }, { }, "Re-connect devices after driver is loaded.",
+      [](Context& ctx, lak::astring_view) { ctx.args.reconnect = true; } },
+    { 'F', "--no-reconnect", { }, { }, "Do not re-connect devices after driver is loaded.",
+      [](Context& ctx, lak::astring_view) { ctx.args.no_reconnect = true; } },
+    { 'g', "--gpt", { }, { }, "Force disk w/ invalid PMBR to be treated as GPT.",
+      [](Context& ctx, lak::astring_view) { ctx.args.force_gpt = true; } },
+    { 'i', "--iface", { }, "name", "Create a netboot entry for the named interface.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.iface = arg; } },
+    { 'j', "--jobs", { }, "n", "Read boot entries with up to n threads (defaults to 1).",
+      [](Context& ctx, lak::astring_view arg) {
+          i64 jobs = parse_int_fatal(ctx, "jobs", arg);
+
+          if (jobs < 1)
+              Fatal(ctx, "jobs must be at least 1, got {}\n", jobs);
+
+          ctx.args.jobs = static_cast<size_t>(jobs);
+      } },
+    { 'l', "--loader", { }, "name", "(Defaults to \\elilo.efi).",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.loader = arg; } },
+    { 'L', "--label", { }, "label", "Boot manager display label (defaults to \"Linux\").",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.label = arg; } },
+    { 'n', "--bootnext", { }, "XXXX", "Set BootNext to XXXX (hex).",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.boot_next = parse_int_fatal(ctx, "bootnext", arg, 16); } },
+    { 'N', "--delete-bootnext", { }, { }, "Delete BootNext.",
+      [](Context& ctx, lak::astring_view) { ctx.args.delete_boot_next = true; } },
+    { 'o', "--bootorder", { }, "XXXX,YYYY,ZZZZ,...", "Explicitly set BootOrder (hex).",
+      [](Context& ctx, lak::astring_view arg) {
+          vec<i64> boot_order;
+
+          for (auto subrange : std::ranges::views::split(arg, ',')) {
+              lak::astring_view str { subrange.begin(), subrange.end() };
+
+              boot_order.push_back(parse_int_fatal(ctx, "bootorder", str, 16));
+          }
+
+          ctx.args.boot_order = std::move(boot_order);
+      } },
+    { 'O', "--delete-bootorder", { }, { }, "Delete BootOrder.",
+      [](Context& ctx, lak::astring_view) { ctx.args.delete_boot_order = true; } },
+    { 'p', "--part", { }, "part", "(Defaults to 1) containing loader.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.part = parse_int_fatal(ctx, "part", arg); } },
+    { 'q', "--quiet", { }, { }, "Be quiet.",
+      [](Context& ctx, lak::astring_view) { ctx.args.quiet = true; } },
+    { 't', "--timeout", { }, "seconds", "Boot manager timeout.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.timeout = parse_int_fatal(ctx, "timeout", arg); } },
+    { 'T', "--delete-timeout", { }, { }, "Delete Timeout value.",
+      [](Context& ctx, lak::astring_view) { ctx.args.delete_timeout = true; } },
+    { 'u', "--unicode", "--UCS-2", { }, "Pass extra args as UCS-2 (default is ASCII).",
+      [](Context& ctx, lak::astring_view) { ctx.args.unicode = true; } },
+    { 'v', "--verbose", { }, { }, "Print additional information.",
+      [](Context& ctx, lak::astring_view) { ctx.args.verbose = true; } },
+    { 'V', "--version", { }, { }, "Return version and exit.",
+      [](Context& ctx, lak::astring_view) { ctx.args.version = true; } },
+    { 'w', "--write-signature", { }, { }, "Write unique sig to MBR if needed.",
+      [](Context& ctx, lak::astring_view) { ctx.args.write_signature = true; } },
+    { '@', "--append-binary-args", { }, { }, "Append extra variable args from\nfile (use - to read from stdin).",
+      [](Context& ctx, lak::astring_view) { ctx.args.append_binary_args = true; } },
+    { 0, "--efivars-dir", { }, "dir", "Use variables stored as files in dir, laid out\nlike /sys/firmware/efi/efivars.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.efivars_dir = arg; } },
+    { 0, "--all", { }, { },
+      "List every Boot####, Driver####, SysPrep####,\n"
+      "PlatformRecovery#### and OsRecovery####, including\n"
+      "those missing from BootOrder, and BootOrder ids\n"
+      "that don't exist.",
+      [](Context& ctx, lak::astring_view) { ctx.args.all = true; } },
+    { 0, "--watch", { }, { }, "Print the boot variables, then keep printing\nwhichever are added, removed or changed. On\nefivarfs, changes made by firmware or another\nOS aren't seen, see --watch-rescan.",
+      [](Context& ctx, lak::astring_view) { ctx.args.watch = true; } },
+    { 0, "--watch-rescan", { }, "s", "With --watch, also re-read every variable after\ns seconds without a change (off by default).",
+      [](Context& ctx, lak::astring_view arg) {
+          i64 seconds = parse_int_fatal(ctx, "watch-rescan", arg);
+
+          if (seconds < 1 || seconds > 86400)
+              Fatal(ctx, "watch-rescan must be 1 to 86400 seconds, got {}\n", seconds);
+
+          ctx.args.watch_rescan = static_cast<u64>(seconds);
+      } },
+    { 0, "--json", { }, { }, "Print boot variables as a single JSON document.",
+      [](Context& ctx, lak::astring_view) { ctx.args.json = true; } },
+    { 0, "--ndjson", { }, { }, "Print boot variables as one JSON record per line.",
+      [](Context& ctx, lak::astring_view) { ctx.args.ndjson = true; } },
+    { 0, "--apply", { }, "file", "Change only what's needed for the boot variables\nto match file, see desired_state.h for the format.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.apply_file = arg; } },
+    { 0, "--journal", { }, "file",
+      "Where changes are journaled until they have all\n"
+      "been written (defaults to /var/tmp/efibootmgrw.journal,\n"
+      "or %ProgramData%\\efibootmgrw.journal on Windows).",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.journal = arg; } },
+    { 0, "--rollback", { }, { }, "Undo the changes of an interrupted run.",
+      [](Context& ctx, lak::astring_view) { ctx.args.rollback = true; } },
+    { 0, "--resume", { }, { }, "Finish the changes of an interrupted run.",
+      [](Context& ctx, lak::astring_view) { ctx.args.resume = true; } },
+    { 0, "--batch", { }, "file",
+      "Run the command line on each line of file (- for\n"
+      "stdin) and write all of the changes at once.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.batch_file = arg; } },
+    { 0, "--cache", { }, "file", "Keep variables in file between runs, and only\nre-read those that have changed since.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.cache_file = arg; } },
+    { 0, "--stats", { }, { }, "Print call counts, bytes and latencies of firmware\ncalls and of each phase of the run to stderr, as\nJSON with --json or --ndjson.",
+      [](Context& ctx, lak::astring_view) { ctx.args.stats = true; } },
+    { 0, "--stats-textfile", { }, "file", "Write the same in Prometheus text format to file,\nfor node_exporter's textfile collector.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.stats_textfile = arg; } },
+    { 0, "--simulate", { }, { }, "Work on an in-memory copy of the variables, the\nreal ones are never written.",
+      [](Context& ctx, lak::astring_view) { ctx.args.simulate = true; } },
+    { 0, "--sim-latency", { }, "us", "Delay every simulated firmware call by us.",
+      [](Context& ctx, lak::astring_view arg) {
+          ctx.args.sim_latency = static_cast<u64>(parse_int_fatal(ctx, "sim-latency", arg));
+      } },
+    { 0, "--sim-capacity", { }, "bytes", "Simulated NVRAM size (defaults to 65536).",
+      [](Context& ctx, lak::astring_view arg) {
+          ctx.args.sim_capacity = static_cast<u64>(parse_int_fatal(ctx, "sim-capacity", arg));
+      } },
+    { 0, "--sim-fault", { }, "spec",
+      "Fail simulated calls, as op:kind[:name][:after=N][:times=N]\n"
+      "e.g. write:out_of_space:BootOrder. May be repeated.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.sim_faults.push_back(arg); } },
+    { 0, "--analyze", { }, "dir", "Summarise captured variables, one subdirectory\nper host, each laid out like --efivars-dir.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.analyze_dir = arg; } },
+    { 0, "--golden", { }, "dir", "With --analyze, count hosts whose Boot#### entries\nand BootOrder match those in dir.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.golden_dir = arg; } },
+    { 0, "--query", { }, "expr", "With --analyze, index the hosts and list those\nmatching expr, e.g. loader=\\EFI\\ubuntu\\shimx64.efi@0\nor node=mac<node=hd. Can be given more than once.",
+      [](Context& ctx, lak::astring_view arg) { ctx.args.queries.push_back(arg); } },
+};
+
+static_assert(std::size(options) < 0xFF, "option indices are stored as u8");
+
+constexpr u8 no_option = 0xFF;
+
+// Short options are looked up by their character directly.
+[[nodiscard]]
+consteval auto build_short_index() -> std::array<u8, 128> {
+    std::array<u8, 128> index;
+    index.fill(no_option);
+
+    for (size_t i = 0; i < std::size(options); ++i) {
+        if (options[i].short_name == 0)
+            continue;
+
+        if (index[static_cast<u8>(options[i].short_name)] != no_option)
+            throw "two options share a short name";
+
+        index[static_cast<u8>(options[i].short_name)] = static_cast<u8>(i);
+    }
+
+    return index;
+}
+
+constexpr std::array<u8, 128> short_index = build_short_index();
+
+[[nodiscard]]
+constexpr auto long_hash(std::string_view name, u32 seed) -> u32 {
+    u32 h = 2166136261u ^ seed;
+
+    for (char c : name)
+        h = (h ^ static_cast<u8>(c)) * 16777619u;
+
+    return h;
+}
+
+/*
+ * Long names and aliases are looked up through a perfect hash: a seed is
+ * searched for at compile time under which no two of them share a slot,
+ * so a lookup is one hash and one string compare.
+ */
+struct long_index_t {
+    static constexpr size_t size = 512;
+
+    u32 seed;
+    std::array<u8, size> slots;
+
+    [[nodiscard]]
+    constexpr auto slot(std::string_view name) const -> u8 {
+        return slots[long_hash(name, seed) & (size - 1)];
+    }
+};
+
+[[nodiscard]]
+consteval auto build_long_index() -> long_index_t {
+    for (u32 seed = 0; seed < 0x10000; ++seed) {
+        long_index_t index { seed, { } };
+        index.slots.fill(no_option);
+
+        bool collided = false;
+
+        auto place = [&](std::string_view name, size_t i) {
+            u8& slot = index.slots[long_hash(name, seed) & (long_index_t::size - 1)];
+
+            if (slot != no_option)
+                collided = true;
+            else
+                slot = static_cast<u8>(i);
+        };
+
+        for (size_t i = 0; i < std::size(options) && !collided; ++i) {
+            place(options[i].long_name, i);
+            if (!options[i].alias.empty())
+                place(options[i].alias, i);
+        }
+
+        if (!collided)
+            return index;
+    }
+
+    throw "no perfect hash seed for the long option names";
+}
+
+constexpr long_index_t long_index = build_long_index();
+
+[[nodiscard]]
+auto find_option(lak::astring_view arg) -> const option* {
+    if (arg.size() == 2 && arg[0] == '-' && arg[1] != '-') {
+        auto c = static_cast<u8>(arg[1]);
+
+        if (c < short_index.size() && short_index[c] != no_option)
+            return &options[short_index[c]];
+
+        return nullptr;
+    }
+
+    std::string_view name { arg.data(), arg.size() };
+
+    if (name.empty())
+        return nullptr;
+
+    u8 i = long_index.slot(name);
+
+    if (i != no_option && (options[i].long_name == name || options[i].alias == name))
+        return &options[i];
+
+    return nullptr;
+}
+
+constexpr size_t help_column = 26;
+
+void print_help(Context& ctx, lak::astring_view) {
+    fmt::memory_buffer out;
+    auto it = std::back_inserter(out);
+
+    fmt::format_to(it, "Usage: {} [options]\n", ctx.program);
+
+    for (const option& opt : options) {
+        size_t start = out.size();
+
+        if (opt.short_name)
+            fmt::format_to(it, "-{} | {}", opt.short_name, opt.long_name);
+        else
+            fmt::format_to(it, "     {}", opt.long_name);
+
+        if (!opt.alias.empty())
+            fmt::format_to(it, " | {}", opt.alias);
+
+        if (!opt.metavar.empty())
+            fmt::format_to(it, " {}", opt.metavar);
+
+        size_t width = out.size() - start;
+
+        if (width >= help_column) {
+            out.push_back('\n');
+            width = 0;
+        }
+
+        for (auto line : std::ranges::views::split(opt.help, '\n')) {
+            fmt::format_to(it, "{:{}}{}\n", "", help_column - width, std::string_view { line.begin(), line.end() });
+            width = 0;
+        }
+    }
+
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    exit(0);
+}
+
+}
+
+void parse_args(Context& ctx, lak::span<const char *> argv) {
+    if (argv.size() > 0)
+        ctx.program = lak::astring_view::from_c_str(argv[0]);
+
+    for (size_t i = 1; i < argv.size(); ++i) {
+        lak::astring_view arg = lak::astring_view::from_c_str(argv[i]);
+        const option* opt = find_option(arg);
+
+        if (!opt)
+            Fatal(ctx, "Unrecognized flag {}\n", arg);
+
+        lak::astring_view value;
+
+        if (!opt->metavar.empty()) {
+            if (++i == argv.size())
+                Fatal(ctx, "option {}: argument missing!\n", arg);
+
+            value = lak::astring_view::from_c_str(argv[i]);
+        }
+
+        opt->handle(ctx, value);
+    }
+
+    if (ctx.args.version) {
+        fmt::print("efibootmgrw: version 0.01a\n");
+        exit(0);
+    }
+
+    if (ctx.args.json && ctx.args.ndjson) {
+        Fatal(ctx, "--json and --ndjson are mutually exclusive!\n");
+    }
+
+    if (ctx.args.all && (ctx.args.json || ctx.args.ndjson)) {
+        Fatal(ctx, "--all can't be combined with --json or --ndjson!\n");
+    }
+
+    if (ctx.args.watch && (ctx.args.all || ctx.args.cache_file)) {
+        Fatal(ctx, "--watch can't be combined with --all or --cache!\n");
+    }
+
+    if (ctx.args.watch_rescan && !ctx.args.watch) {
+        Fatal(ctx, "--watch-rescan only makes sense with --watch!\n");
+    }
+
+    if ((ctx.args.stats || ctx.args.stats_textfile) && ctx.args.watch) {
+        Fatal(ctx, "--stats and --stats-textfile can't be combined with --watch!\n");
+    }
+
+    if (ctx.args.cache_file && ctx.args.simulate) {
+        Fatal(ctx, "--cache and --simulate are mutually exclusive!\n");
+    }
+
+    if (ctx.args.golden_dir && !ctx.args.analyze_dir) {
+        Fatal(ctx, "--golden only makes sense with --analyze!\n");
+    }
+
+    if (!ctx.args.queries.empty() && !ctx.args.analyze_dir) {
+        Fatal(ctx, "--query only makes sense with --analyze!\n");
+    }
+
+    if (!ctx.args.queries.empty() && ctx.args.golden_dir) {
+        Fatal(ctx, "--query and --golden are mutually exclusive!\n");
+    }
+
+    if (ctx.args.rollback && ctx.args.resume) {
+        Fatal(ctx, "--rollback and --resume are mutually exclusive!\n");
+    }
+
+    if (ctx.args.delete_boot_num && !ctx.args.boot_num) {
+        Fatal(ctx, "Cannot delete unspecified boot number!\n");
+    }
+
+    if (ctx.args.create && !ctx.args.boot_num) {
+        Fatal(ctx, "Cannot create unspecified boot number!\n");
+    }
+
+    if ((ctx.args.active || ctx.args.inactive) && !ctx.args.boot_num) {
+        Fatal(ctx, "Cannot change activity of unspecified boot number!\n");
+    }
+}
+
 }
\ No newline at end of file
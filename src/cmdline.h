@@ -1,9 +1,9 @@
-#pragma once
-
-#include "efibootmgrw.h"
-
-namespace efibootmgrw {
-
-void parse_args(Context& ctx, lak::span<const char *> argv);
-
+#pragma once
+
+#include "efibootmgrw.h"
+
+namespace efibootmgrw {
+
+void parse_args(Context& ctx, lak::span<const char *> argv);
+
 }
\ No newline at end of file
@@ -0,0 +1,340 @@
+#include "desired_state.h"
+#include "device_path_text.h"
+#include "efi_load_option.h"
+#include "load_option_name.h"
+#include "ucs2.h"
+
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+
+namespace efibootmgrw {
+
+namespace {
+
+[[nodiscard]]
+auto is_space(char c) -> bool {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Whitespace separated words of one line.
+struct line_cursor {
+    lak::astring_view line;
+    size_t pos = 0;
+
+    void skip_space() {
+        while (pos < line.size() && is_space(line[pos]))
+            ++pos;
+    }
+
+    [[nodiscard]]
+    auto done() -> bool {
+        skip_space();
+        return pos == line.size();
+    }
+
+    [[nodiscard]]
+    auto word() -> lak::astring_view {
+        skip_space();
+        size_t start = pos;
+        while (pos < line.size() && !is_space(line[pos]))
+            ++pos;
+        return lak::astring_view { line.begin() + start, line.begin() + pos };
+    }
+
+    // "..." with \" and \\ escapes
+    [[nodiscard]]
+    auto quoted(std::string& out) -> bool {
+        skip_space();
+        if (pos == line.size() || line[pos] != '"')
+            return false;
+
+        for (++pos; pos < line.size(); ++pos) {
+            char c = line[pos];
+
+            if (c == '"') {
+                ++pos;
+                return true;
+            }
+
+            if (c == '\\' && pos + 1 < line.size())
+                c = line[++pos];
+
+            out.push_back(c);
+        }
+
+        return false;
+    }
+
+    [[nodiscard]]
+    auto rest() -> lak::astring_view {
+        skip_space();
+        size_t end = line.size();
+        while (end > pos && is_space(line[end - 1]))
+            --end;
+        return lak::astring_view { line.begin() + pos, line.begin() + end };
+    }
+};
+
+template<typename T>
+[[nodiscard]]
+auto parse_number(lak::astring_view str, T& out, int base) -> bool {
+    auto res = std::from_chars(str.data(), str.data() + str.size(), out, base);
+    return !str.empty() && res.ec == std::errc() && res.ptr == str.data() + str.size();
+}
+
+[[nodiscard]]
+auto parse_hex_bytes(lak::astring_view str, vec<byte_t>& out) -> bool {
+    if (str.size() % 2 != 0)
+        return false;
+
+    for (size_t i = 0; i < str.size(); i += 2) {
+        u8 b;
+        if (!parse_number(lak::astring_view { str.begin() + i, str.begin() + i + 2 }, b, 16))
+            return false;
+        out.push_back(b);
+    }
+
+    return true;
+}
+
+// A key widened for parse_load_option_name, empty if too long to name one.
+struct wide_key {
+    wchar_t chars[21] { };
+    size_t size = 0;
+
+    explicit wide_key(lak::astring_view key) {
+        if (key.size() < std::size(chars))
+            for (char c : key)
+                chars[size++] = static_cast<wchar_t>(static_cast<unsigned char>(c));
+    }
+
+    [[nodiscard]]
+    operator lak::wstring_view() const { // NOLINT(google-explicit-constructor)
+        return lak::wstring_view { chars, size };
+    }
+};
+
+[[nodiscard]]
+auto same_bytes(lak::span<const byte_t> a, const vec<byte_t>& b) -> bool {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+}
+
+auto parse_desired_state(lak::astring_view text) -> lak::result<desired_state, desired_state_err> {
+    desired_state state;
+    size_t line_no = 0;
+
+    for (size_t start = 0; start < text.size();) {
+        size_t end = start;
+        while (end < text.size() && text[end] != '\n')
+            ++end;
+
+        line_cursor cur { lak::astring_view { text.begin() + start, text.begin() + end } };
+        start = end + 1;
+        ++line_no;
+
+        auto fail = [&](lak::astring_view what) -> lak::result<desired_state, desired_state_err> {
+            return lak::err_t { desired_state_err { line_no, what } };
+        };
+
+        lak::astring_view key = cur.word();
+
+        if (key.empty() || key[0] == '#')
+            continue;
+
+        if (key == "Timeout" || key == "BootNext") {
+            u16 value;
+            if (!parse_number(cur.word(), value, key == "Timeout" ? 10 : 16) || !cur.done())
+                return fail("expected a number");
+            (key == "Timeout" ? state.timeout : state.boot_next) = value;
+        } else if (key == "BootOrder") {
+            vec<u16> order;
+            lak::astring_view list = cur.word();
+
+            for (size_t i = 0; i <= list.size();) {
+                size_t j = i;
+                while (j < list.size() && list[j] != ',')
+                    ++j;
+
+                u16 id;
+                if (!parse_number(lak::astring_view { list.begin() + i, list.begin() + j }, id, 16))
+                    return fail("expected comma separated hex ids");
+
+                order.push_back(id);
+                i = j + 1;
+            }
+
+            if (!cur.done())
+                return fail("unexpected text after BootOrder");
+
+            state.boot_order = std::move(order);
+        } else if (key == "Prune") {
+            if (!cur.done())
+                return fail("unexpected text after Prune");
+            state.prune = true;
+        } else if (lak::optional<parsed_load_option_name> entry = parse_load_option_name(wide_key { key });
+                entry && entry->cls == load_option_class::boot) {
+            desired_entry e;
+            e.id = entry->id;
+
+            lak::astring_view activity = cur.word();
+            if (activity == "active")
+                e.active = true;
+            else if (activity == "inactive")
+                e.active = false;
+            else
+                return fail("expected active or inactive");
+
+            if (!cur.quoted(e.label))
+                return fail("expected a quoted label");
+
+            size_t before_data = cur.pos;
+            lak::astring_view data = cur.word();
+
+            if (data.size() >= 5 && lak::astring_view { data.begin(), data.begin() + 5 } == "data=") {
+                if (!parse_hex_bytes(lak::astring_view { data.begin() + 5, data.end() }, e.optional_data))
+                    return fail("expected data=hex");
+            } else {
+                cur.pos = before_data;
+            }
+
+            lak::astring_view path = cur.rest();
+            if (path.empty())
+                return fail("expected a device path");
+
+            lak::result<vec<byte_t>, device_path_parse_err> bytes = parse_device_path(path);
+
+            if (!bytes.is_ok())
+                return fail(bytes.unsafe_unwrap_err().what);
+
+            e.file_path_list = std::move(bytes.unsafe_unwrap());
+
+            bool duplicate = std::any_of(state.entries.begin(), state.entries.end(), [&](const desired_entry& other) {
+                return other.id == e.id;
+            });
+
+            if (duplicate)
+                return fail("entry given more than once");
+
+            state.entries.push_back(std::move(e));
+        } else {
+            return fail("unknown setting");
+        }
+    }
+
+    return lak::ok_t { std::move(state) };
+}
+
+auto plan_desired_state(const desired_state& state, efivar_backend& vars, const BootSnapshot& snap, transaction& tx)
+-> vresult<lak::monostate> {
+    bump_arena arena;
+
+    // The snapshot only holds entries in BootOrder, anything else is read here.
+    auto current = [&](u16 id) -> vresult<lak::optional<lak::span<const byte_t>>> {
+        if (const BootSnapshot::entry* e = snap.find(id); e && !e->err)
+            return lak::ok_t { lak::optional<lak::span<const byte_t>> { e->data } };
+
+        vresult<lak::span<byte_t>> res = read_variable(vars, boot_option_name(id), efi_global_variable, arena);
+
+        if (res.is_ok())
+            return lak::ok_t { lak::optional<lak::span<const byte_t>> { res.unsafe_unwrap() } };
+
+        if (res.unsafe_unwrap_err().kind == var_err::kind_t::not_found)
+            return lak::ok_t { lak::optional<lak::span<const byte_t>> { } };
+
+        return lak::err_t { res.unsafe_unwrap_err() };
+    };
+
+    for (const desired_entry& want : state.entries) {
+        vresult<lak::optional<lak::span<const byte_t>>> have = current(want.id);
+
+        if (!have.is_ok())
+            return lak::err_t { have.unsafe_unwrap_err() };
+
+        u32 attributes = want.active ? load_option_active : 0;
+        bool same = false;
+
+        if (const lak::optional<lak::span<const byte_t>>& bytes = have.unsafe_unwrap()) {
+            load_option_view::parse(*bytes).if_ok([&](load_option_view opt) {
+                attributes |= opt.attributes() & ~load_option_active;
+
+                same = opt.attributes() == attributes
+                       && to_u8string(opt.desc()) == want.label
+                       && same_device_path(
+                               opt.file_path_list(),
+                               lak::span<const byte_t> { want.file_path_list.data(), want.file_path_list.size() }
+                       )
+                       && same_bytes(opt.optional_data(), want.optional_data);
+            });
+        }
+
+        if (same)
+            continue;
+
+        vec<byte_t> data = build_load_option(
+                attributes,
+                lak::astring_view { want.label.data(), want.label.size() },
+                lak::span<const byte_t> { want.file_path_list.data(), want.file_path_list.size() },
+                lak::span<const byte_t> { want.optional_data.data(), want.optional_data.size() }
+        );
+
+        tx.set(boot_option_name(want.id), efi_global_variable, lak::span<const byte_t> { data.data(), data.size() });
+    }
+
+    auto set_u16 = [&](lak::wstring_view name, const lak::optional<u16>& want, const lak::optional<u16>& have) {
+        if (want && want != have)
+            tx.set(name, efi_global_variable, lak::span<const byte_t> { reinterpret_cast<const byte_t*>(&*want), sizeof(u16) });
+    };
+
+    set_u16(L"Timeout", state.timeout, snap.timeout);
+    set_u16(L"BootNext", state.boot_next, snap.boot_next);
+
+    lak::span<const u16> have_order = snap.boot_order();
+    vec<u16> order = state.boot_order ? *state.boot_order : vec<u16>(have_order.begin(), have_order.end());
+
+    if (state.prune) {
+        auto wanted = [&](u16 id) {
+            return std::any_of(state.entries.begin(), state.entries.end(), [&](const desired_entry& e) {
+                return e.id == id;
+            });
+        };
+
+        vec<u16> existing;
+        vresult<vec<efi_var_name>> names = vars.enumerate();
+
+        if (names.is_ok()) {
+            for (const efi_var_name& var : names.unsafe_unwrap()) {
+                if (var.guid != efi_global_variable)
+                    continue;
+                if (lak::optional<parsed_load_option_name> entry = parse_load_option_name(var.name);
+                        entry && entry->cls == load_option_class::boot)
+                    existing.push_back(entry->id);
+            }
+        } else if (names.unsafe_unwrap_err().kind == var_err::kind_t::unsupported) {
+            // Without enumeration the best we know of is what BootOrder lists.
+            for (const BootSnapshot::entry& e : snap.entries()) {
+                if (!e.err)
+                    existing.push_back(e.id);
+            }
+        } else {
+            return lak::err_t { names.unsafe_unwrap_err() };
+        }
+
+        for (u16 id : existing) {
+            if (!wanted(id))
+                tx.remove(boot_option_name(id), efi_global_variable);
+        }
+
+        // Only the file's entries are left, so BootOrder can't name anything else.
+        std::erase_if(order, [&](u16 id) { return !wanted(id); });
+    }
+
+    if (!std::equal(order.begin(), order.end(), have_order.begin(), have_order.end()))
+        tx.set_boot_order(lak::span<const u16> { order.data(), order.size() });
+
+    return lak::ok_t { };
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "boot_snapshot.h"
+#include "transaction.h"
+
+namespace efibootmgrw {
+
+/*
+ * What the boot menu should look like, one setting per line:
+ *
+ *   # comment
+ *   Timeout 5
+ *   BootNext 0001
+ *   BootOrder 0001,0000
+ *   Boot0000 active "ubuntu" HD(1,GPT,...)/File(\EFI\ubuntu\shimx64.efi)
+ *   Boot0001 inactive "PXE" data=0102 PciRoot(0x0)/Pci(0x1C,0x0)/MAC(...)
+ *   Prune
+ *
+ * Entries are named exactly as their variables are, upper case hex and
+ * all, and take their device path as UEFI text, running to the end of the
+ * line. Anything left out is left alone, except that Prune deletes every
+ * Boot#### the file doesn't mention and drops them from BootOrder.
+ */
+struct desired_entry {
+    u16 id;
+    bool active;
+    std::string label;
+    vec<byte_t> file_path_list;
+    vec<byte_t> optional_data;
+};
+
+struct desired_state {
+    lak::optional<u16> timeout;
+    lak::optional<u16> boot_next;
+    lak::optional<vec<u16>> boot_order;
+    vec<desired_entry> entries;
+    bool prune = false;
+};
+
+struct desired_state_err {
+    // 1 based
+    size_t line;
+    lak::astring_view what;
+};
+
+[[nodiscard]]
+auto parse_desired_state(lak::astring_view text) -> lak::result<desired_state, desired_state_err>;
+
+/*
+ * Adds to tx only the changes that make the firmware match state.
+ * Entries are compared decoded, so attribute bits the file can't
+ * express (hidden, category, ...) are kept as they are.
+ */
+[[nodiscard]]
+auto plan_desired_state(const desired_state& state, efivar_backend& vars, const BootSnapshot& snap, transaction& tx)
+-> vresult<lak::monostate>;
+
+}
@@ -0,0 +1,840 @@
+#include "device_path_text.h"
+#include "efi_load_option.h"
+
+#include "lak/visit.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <iterator>
+
+namespace efibootmgrw {
+
+namespace {
+
+// EISA ids of the PCI and PCIe root bridges, PNP0A03 and PNP0A08
+constexpr u32 pci_root_hid  = 0x0A0341D0;
+constexpr u32 pcie_root_hid = 0x0A0841D0;
+
+constexpr u16 protocol_tcp = 6;
+constexpr u16 protocol_udp = 17;
+
+void format_hex(fmt::memory_buffer& out, lak::span<const byte_t> bytes) {
+    constexpr char digits[] = "0123456789ABCDEF";
+
+    for (byte_t b : bytes) {
+        out.push_back(digits[b >> 4]);
+        out.push_back(digits[b & 0xF]);
+    }
+}
+
+// Three letters packed 5 bits apiece, then the product id, e.g. PNP0A03.
+void format_eisa_id(fmt::memory_buffer& out, u32 id) {
+    out.push_back(static_cast<char>('A' - 1 + ((id >> 10) & 0x1F)));
+    out.push_back(static_cast<char>('A' - 1 + ((id >> 5) & 0x1F)));
+    out.push_back(static_cast<char>('A' - 1 + (id & 0x1F)));
+    fmt::format_to(std::back_inserter(out), "{:04X}", id >> 16);
+}
+
+void format_ipv4(fmt::memory_buffer& out, const lak::array<u8, 4>& ip) {
+    fmt::format_to(std::back_inserter(out), "{}.{}.{}.{}", ip[0], ip[1], ip[2], ip[3]);
+}
+
+void format_ipv6(fmt::memory_buffer& out, const lak::array<u8, 16>& ip) {
+    for (size_t i = 0; i < ip.size(); i += 2) {
+        if (i != 0) out.push_back(':');
+        fmt::format_to(std::back_inserter(out), "{:x}", (ip[i] << 8) | ip[i + 1]);
+    }
+}
+
+void format_protocol(fmt::memory_buffer& out, u16 protocol) {
+    if (protocol == protocol_tcp)
+        fmt::format_to(std::back_inserter(out), "TCP");
+    else if (protocol == protocol_udp)
+        fmt::format_to(std::back_inserter(out), "UDP");
+    else
+        fmt::format_to(std::back_inserter(out), "0x{:X}", protocol);
+}
+
+// ip:port, leaving the port off when it's 0 as the spec's text form does.
+void format_endpoint(fmt::memory_buffer& out, const lak::array<u8, 4>& ip, u16 port) {
+    format_ipv4(out, ip);
+    if (port != 0)
+        fmt::format_to(std::back_inserter(out), ":{}", port);
+}
+
+// [ip]:port, or just ip when the port is 0.
+void format_endpoint(fmt::memory_buffer& out, const lak::array<u8, 16>& ip, u16 port) {
+    if (port != 0) out.push_back('[');
+    format_ipv6(out, ip);
+    if (port != 0)
+        fmt::format_to(std::back_inserter(out), "]:{}", port);
+}
+
+void format_raw(fmt::memory_buffer& out, const device_path_node& node) {
+    fmt::format_to(std::back_inserter(out), "Path({},{},", static_cast<u8>(node.type), node.subtype);
+    format_hex(out, node.payload);
+    out.push_back(')');
+}
+
+// Uri() ends at a ')' followed by '/', ',' or nothing, so one can't hold that.
+[[nodiscard]]
+auto closes_early(lak::astring_view str) -> bool {
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (str[i] == ')' && (i + 1 == str.size() || str[i + 1] == '/' || str[i + 1] == ','))
+            return true;
+    }
+
+    return false;
+}
+
+[[nodiscard]]
+auto is_eisa_letters(u32 id) -> bool {
+    for (u32 shift : { 10u, 5u, 0u }) {
+        u32 c = (id >> shift) & 0x1F;
+        if (c < 1 || c > 26) return false;
+    }
+
+    return true;
+}
+
+template<DevicePathType TYPE, u8 SUBTYPE>
+void format_vendor(fmt::memory_buffer& out, lak::astring_view name, const device_path::vendor<TYPE, SUBTYPE>& n) {
+    fmt::format_to(std::back_inserter(out), "{}({}", name, n.guid);
+
+    if (!n.data.empty()) {
+        out.push_back(',');
+        format_hex(out, n.data);
+    }
+
+    out.push_back(')');
+}
+
+}
+
+void format_device_path_node(fmt::memory_buffer& out, const device_path_node& node) {
+    auto it = std::back_inserter(out);
+    size_t size = node.payload.size();
+
+    // Anything whose text wouldn't parse back to these exact bytes, e.g.
+    // trailing data or a layout the text form can't say, is written as
+    // Path() instead, so formatting never loses information.
+    device_path::visit(node, lak::overloaded {
+        [&](const device_path::pci& n) {
+            if (size != 2)
+                return format_raw(out, node);
+
+            fmt::format_to(it, "Pci(0x{:X},0x{:X})", n.device, n.function);
+        },
+        [&](const device_path::hardware_vendor& n) {
+            format_vendor(out, "VenHw", n);
+        },
+        [&](const device_path::acpi& n) {
+            if (size != 8 || (n.hid != pci_root_hid && n.hid != pcie_root_hid && !is_eisa_letters(n.hid)))
+                return format_raw(out, node);
+
+            if (n.hid == pci_root_hid) {
+                fmt::format_to(it, "PciRoot(0x{:X})", n.uid);
+            } else if (n.hid == pcie_root_hid) {
+                fmt::format_to(it, "PcieRoot(0x{:X})", n.uid);
+            } else {
+                fmt::format_to(it, "Acpi(");
+                format_eisa_id(out, n.hid);
+                fmt::format_to(it, ",0x{:X})", n.uid);
+            }
+        },
+        [&](const device_path::usb& n) {
+            if (size != 2)
+                return format_raw(out, node);
+
+            fmt::format_to(it, "USB(0x{:X},0x{:X})", n.parent_port, n.interface);
+        },
+        [&](const device_path::mac& n) {
+            if (size != 33)
+                return format_raw(out, node);
+
+            // Ethernet and 802.3 use 6 bytes of the 32, the rest should be padding.
+            bool padded = std::all_of(n.address.begin() + 6, n.address.end(), [](u8 b) { return b == 0; });
+            size_t len = n.if_type <= 1 && padded ? 6 : n.address.size();
+
+            fmt::format_to(it, "MAC(");
+            format_hex(out, lak::span<const byte_t> { n.address.data(), len });
+            fmt::format_to(it, ",0x{:X})", n.if_type);
+        },
+        [&](const device_path::ipv4& n) {
+            if ((size != 15 && size != 23) || static_cast<u8>(node.payload[14]) > 1)
+                return format_raw(out, node);
+
+            fmt::format_to(it, "IPv4(");
+            format_endpoint(out, n.remote, n.remote_port);
+            out.push_back(',');
+            format_protocol(out, n.protocol);
+            fmt::format_to(it, ",{},", n.static_ip ? "Static" : "DHCP");
+            format_endpoint(out, n.local, n.local_port);
+
+            // Older firmware's 15 byte node has no gateway or mask, and
+            // leaving them off is how the parser knows to write one.
+            if (size == 23) {
+                out.push_back(',');
+                format_ipv4(out, n.gateway);
+                out.push_back(',');
+                format_ipv4(out, n.subnet_mask);
+            }
+
+            out.push_back(')');
+        },
+        [&](const device_path::ipv6& n) {
+            constexpr lak::astring_view origins[] = {
+                    "Static",
+                    "StatelessAutoConfigure",
+                    "StatefulAutoConfigure",
+            };
+
+            if (size != 39 && size != 56)
+                return format_raw(out, node);
+
+            fmt::format_to(it, "IPv6(");
+            format_endpoint(out, n.remote, n.remote_port);
+            out.push_back(',');
+            format_protocol(out, n.protocol);
+            out.push_back(',');
+            if (n.origin < std::size(origins))
+                fmt::format_to(it, "{}", origins[n.origin]);
+            else
+                fmt::format_to(it, "0x{:X}", n.origin);
+            out.push_back(',');
+            format_endpoint(out, n.local, n.local_port);
+
+            // As for IPv4, the 39 byte node predates gateway and prefix.
+            if (size == 56) {
+                out.push_back(',');
+                format_ipv6(out, n.gateway);
+                fmt::format_to(it, ",0x{:X}", n.prefix_length);
+            }
+
+            out.push_back(')');
+        },
+        [&](const device_path::messaging_vendor& n) {
+            format_vendor(out, "VenMsg", n);
+        },
+        [&](const device_path::sata& n) {
+            if (size != 6)
+                return format_raw(out, node);
+
+            fmt::format_to(it, "Sata(0x{:X},0x{:X},0x{:X})", n.hba_port, n.port_multiplier_port, n.lun);
+        },
+        [&](const device_path::nvme& n) {
+            if (size != 12)
+                return format_raw(out, node);
+
+            fmt::format_to(it, "NVMe(0x{:X},", n.namespace_id);
+            for (size_t i = 0; i < n.eui64.size(); ++i) {
+                if (i != 0) out.push_back('-');
+                format_hex(out, lak::span<const byte_t> { &n.eui64[i], 1 });
+            }
+            out.push_back(')');
+        },
+        [&](const device_path::uri& n) {
+            if (closes_early(n.value))
+                return format_raw(out, node);
+
+            fmt::format_to(it, "Uri({})", n.value);
+        },
+        [&](const device_path::hard_drive& n) {
+            using hd = device_path::hard_drive;
+
+            bool canonical = size == hd::min_size && (
+                    n.format == hd::format_gpt ? n.signature_type == hd::signature_guid
+                    : n.format == hd::format_mbr ? n.signature_type == hd::signature_mbr
+                            && std::all_of(n.signature.begin() + 4, n.signature.end(), [](u8 b) { return b == 0; })
+                    : n.signature_type == hd::signature_none
+                            && std::all_of(n.signature.begin(), n.signature.end(), [](u8 b) { return b == 0; }));
+
+            if (!canonical)
+                return format_raw(out, node);
+
+            fmt::format_to(it, "HD({},", n.partition_number);
+
+            if (n.format == device_path::hard_drive::format_gpt) {
+                fmt::format_to(it, "GPT,{}", n.partition_guid());
+            } else if (n.format == device_path::hard_drive::format_mbr) {
+                u32 sig;
+                std::memcpy(&sig, n.signature.data(), sizeof(sig));
+                fmt::format_to(it, "MBR,0x{:08X}", sig);
+            } else {
+                fmt::format_to(it, "0x{:X},0", n.format);
+            }
+
+            fmt::format_to(it, ",0x{:X},0x{:X})", n.partition_start, n.partition_size);
+        },
+        [&](const device_path::media_vendor& n) {
+            format_vendor(out, "VenMedia", n);
+        },
+        [&](const device_path::file_path& n) {
+            size_t len = n.length();
+
+            // Exactly the characters and their terminator, with surrogates
+            // paired and no ')' that would end the node early.
+            bool canonical = size == (len + 1) * 2;
+
+            for (size_t i = 0; canonical && i < len; ++i) {
+                char16_t c = n[i];
+
+                if (c == u')')
+                    canonical = i + 1 < len && n[i + 1] != u'/' && n[i + 1] != u',';
+                else if (c >= 0xD800 && c < 0xDC00 && i + 1 < len && n[i + 1] >= 0xDC00 && n[i + 1] < 0xE000)
+                    ++i;
+                else if (c >= 0xD800 && c < 0xE000)
+                    canonical = false;
+            }
+
+            if (!canonical)
+                return format_raw(out, node);
+
+            fmt::format_to(it, "File(");
+
+            for (size_t i = 0; i < len; ++i) {
+                char32_t c = n[i];
+
+                if (c >= 0xD800 && c < 0xDC00 && i + 1 < len && n[i + 1] >= 0xDC00 && n[i + 1] < 0xE000) {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (n[i + 1] - 0xDC00);
+                    ++i;
+                }
+
+                append_utf8(out, c);
+            }
+
+            out.push_back(')');
+        },
+        [&](const device_path::end_instance&) {
+            out.push_back(',');
+        },
+        [&](const device_path::end_entire&) {
+        },
+        [&](const device_path::unknown& n) {
+            format_raw(out, n.node);
+        },
+    });
+}
+
+void format_device_path(fmt::memory_buffer& out, lak::span<const byte_t> path) {
+    device_path_iterator it { path };
+    bool separate = false;
+
+    for (; it != std::default_sentinel; ++it) {
+        if (it->is_end()) {
+            format_device_path_node(out, *it);
+
+            if (it->subtype == device_path::end_entire::subtype)
+                return;
+
+            separate = false;
+            continue;
+        }
+
+        if (separate)
+            out.push_back('/');
+
+        format_device_path_node(out, *it);
+        separate = true;
+    }
+
+    if (it.malformed())
+        fmt::format_to(std::back_inserter(out), "{}<malformed>", separate ? "/" : "");
+}
+
+namespace {
+
+struct parser {
+    lak::astring_view text;
+    size_t pos = 0;
+    device_path_writer w;
+
+    using result = lak::result<lak::monostate, device_path_parse_err>;
+
+    [[nodiscard]]
+    auto fail(lak::astring_view what) const -> result {
+        return lak::err_t { device_path_parse_err { pos, what } };
+    }
+
+    [[nodiscard]]
+    static auto split(lak::astring_view args, vec<lak::astring_view>& out) -> size_t {
+        out.clear();
+
+        size_t start = 0;
+        for (size_t i = 0; i <= args.size(); ++i) {
+            if (i == args.size() || args[i] == ',') {
+                out.push_back(lak::astring_view { args.begin() + start, args.begin() + i });
+                start = i + 1;
+            }
+        }
+
+        return out.size();
+    }
+
+    template<typename T>
+    [[nodiscard]]
+    static auto number(lak::astring_view str, T& out) -> bool {
+        int base = 10;
+
+        if (str.size() > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+            base = 16;
+            str = lak::astring_view { str.begin() + 2, str.end() };
+        }
+
+        auto res = std::from_chars(str.data(), str.data() + str.size(), out, base);
+        return res.ec == std::errc() && res.ptr == str.data() + str.size();
+    }
+
+    [[nodiscard]]
+    static auto hex_digit(char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Pairs of hex digits, ignoring '-' separators.
+    [[nodiscard]]
+    static auto hex(lak::astring_view str, vec<byte_t>& out) -> bool {
+        out.clear();
+
+        int hi = -1;
+        for (char c : str) {
+            if (c == '-') continue;
+
+            int d = hex_digit(c);
+            if (d < 0) return false;
+
+            if (hi < 0) {
+                hi = d;
+            } else {
+                out.push_back(static_cast<byte_t>((hi << 4) | d));
+                hi = -1;
+            }
+        }
+
+        return hi < 0;
+    }
+
+    [[nodiscard]]
+    static auto guid(lak::astring_view str, efi_guid& out) -> bool {
+        vec<byte_t> bytes;
+
+        if (str.size() != 36 || str[8] != '-' || str[13] != '-' || str[18] != '-' || str[23] != '-')
+            return false;
+
+        if (!hex(str, bytes) || bytes.size() != efi_guid::size)
+            return false;
+
+        // Text is big endian throughout, the first three fields aren't on disk.
+        out.data1 = static_cast<u32>(bytes[0]) << 24 | bytes[1] << 16 | bytes[2] << 8 | bytes[3];
+        out.data2 = static_cast<u16>(bytes[4] << 8 | bytes[5]);
+        out.data3 = static_cast<u16>(bytes[6] << 8 | bytes[7]);
+        std::copy(bytes.begin() + 8, bytes.end(), out.data4.begin());
+
+        return true;
+    }
+
+    [[nodiscard]]
+    static auto ipv4(lak::astring_view str, lak::array<u8, 4>& out) -> bool {
+        vec<lak::astring_view> parts;
+        size_t start = 0;
+
+        for (size_t i = 0; i <= str.size(); ++i) {
+            if (i == str.size() || str[i] == '.') {
+                parts.push_back(lak::astring_view { str.begin() + start, str.begin() + i });
+                start = i + 1;
+            }
+        }
+
+        if (parts.size() != 4)
+            return false;
+
+        for (size_t i = 0; i < 4; ++i) {
+            if (!number(parts[i], out[i]))
+                return false;
+        }
+
+        return true;
+    }
+
+    [[nodiscard]]
+    static auto ipv6_groups(lak::astring_view str, vec<u16>& out) -> bool {
+        size_t start = 0;
+
+        if (str.empty())
+            return true;
+
+        for (size_t i = 0; i <= str.size(); ++i) {
+            if (i != str.size() && str[i] != ':')
+                continue;
+
+            u16 group;
+            auto res = std::from_chars(str.data() + start, str.data() + i, group, 16);
+            if (start == i || res.ec != std::errc() || res.ptr != str.data() + i)
+                return false;
+
+            out.push_back(group);
+            start = i + 1;
+        }
+
+        return true;
+    }
+
+    // Eight groups of hex, or fewer with "::" standing in for the zeros.
+    [[nodiscard]]
+    static auto ipv6(lak::astring_view str, lak::array<u8, 16>& out) -> bool {
+        vec<u16> head, tail;
+        bool compressed = false;
+
+        for (size_t i = 0; i + 1 < str.size(); ++i) {
+            if (str[i] == ':' && str[i + 1] == ':') {
+                compressed = true;
+                if (!ipv6_groups(lak::astring_view { str.begin(), str.begin() + i }, head)
+                    || !ipv6_groups(lak::astring_view { str.begin() + i + 2, str.end() }, tail))
+                    return false;
+                break;
+            }
+        }
+
+        if (!compressed && !ipv6_groups(str, head))
+            return false;
+
+        if (compressed ? head.size() + tail.size() > 7 : head.size() != 8)
+            return false;
+
+        out = { };
+
+        for (size_t i = 0; i < head.size(); ++i) {
+            out[i * 2] = static_cast<u8>(head[i] >> 8);
+            out[i * 2 + 1] = static_cast<u8>(head[i]);
+        }
+
+        for (size_t i = 0; i < tail.size(); ++i) {
+            size_t g = 8 - tail.size() + i;
+            out[g * 2] = static_cast<u8>(tail[i] >> 8);
+            out[g * 2 + 1] = static_cast<u8>(tail[i]);
+        }
+
+        return true;
+    }
+
+    // ip or ip:port
+    [[nodiscard]]
+    static auto endpoint(lak::astring_view str, lak::array<u8, 4>& ip, u16& port) -> bool {
+        port = 0;
+
+        for (size_t i = 0; i < str.size(); ++i) {
+            if (str[i] == ':')
+                return ipv4(lak::astring_view { str.begin(), str.begin() + i }, ip)
+                       && number(lak::astring_view { str.begin() + i + 1, str.end() }, port);
+        }
+
+        return ipv4(str, ip);
+    }
+
+    // ip or [ip]:port
+    [[nodiscard]]
+    static auto endpoint(lak::astring_view str, lak::array<u8, 16>& ip, u16& port) -> bool {
+        port = 0;
+
+        if (str.empty() || str[0] != '[')
+            return ipv6(str, ip);
+
+        for (size_t i = 1; i + 1 < str.size(); ++i) {
+            if (str[i] == ']' && str[i + 1] == ':')
+                return ipv6(lak::astring_view { str.begin() + 1, str.begin() + i }, ip)
+                       && number(lak::astring_view { str.begin() + i + 2, str.end() }, port);
+        }
+
+        return false;
+    }
+
+    [[nodiscard]]
+    static auto protocol(lak::astring_view str, u16& out) -> bool {
+        if (str == "TCP") { out = protocol_tcp; return true; }
+        if (str == "UDP") { out = protocol_udp; return true; }
+        return number(str, out);
+    }
+
+    [[nodiscard]]
+    static auto eisa_id(lak::astring_view str, u32& out) -> bool {
+        if (str.size() != 7)
+            return false;
+
+        u32 product;
+        auto res = std::from_chars(str.data() + 3, str.data() + 7, product, 16);
+        if (res.ec != std::errc() || res.ptr != str.data() + 7)
+            return false;
+
+        out = product << 16;
+        for (size_t i = 0; i < 3; ++i) {
+            if (str[i] < 'A' || str[i] > 'Z') return false;
+            out |= static_cast<u32>(str[i] - 'A' + 1) << (10 - i * 5);
+        }
+
+        return true;
+    }
+
+    // The node after pos, up to the next '/' or ',' outside of parentheses.
+    auto node() -> result {
+        size_t start = pos;
+
+        // \EFI\BOOT\BOOTX64.EFI on its own is a File() node.
+        if (pos < text.size() && text[pos] == '\\') {
+            while (pos < text.size() && text[pos] != '/' && text[pos] != ',')
+                ++pos;
+
+            w.begin_node(DevicePathType::Media, device_path::file_path::subtype);
+            w.put_string(lak::astring_view { text.begin() + start, text.begin() + pos });
+            w.end_node();
+            return lak::ok_t { };
+        }
+
+        while (pos < text.size() && text[pos] != '(')
+            ++pos;
+
+        if (pos == text.size())
+            return fail("expected '('");
+
+        lak::astring_view name { text.begin() + start, text.begin() + pos };
+        size_t args_start = ++pos;
+
+        // Paths and URIs can hold parentheses of their own, so only
+        // a ')' that ends the node closes it.
+        bool raw = name == "File" || name == "Uri";
+
+        while (pos < text.size()) {
+            if (text[pos] == ')') {
+                if (!raw || pos + 1 == text.size() || text[pos + 1] == '/' || text[pos + 1] == ',')
+                    break;
+            }
+            ++pos;
+        }
+
+        if (pos == text.size())
+            return fail("expected ')'");
+
+        lak::astring_view args { text.begin() + args_start, text.begin() + pos };
+        ++pos;
+
+        return build(name, args);
+    }
+
+    auto build(lak::astring_view name, lak::astring_view args) -> result {
+        vec<lak::astring_view> a;
+        vec<byte_t> bytes;
+        size_t n = split(args, a);
+
+        if (name == "File") {
+            w.begin_node(DevicePathType::Media, device_path::file_path::subtype);
+            w.put_string(args);
+        } else if (name == "Uri") {
+            w.begin_node(DevicePathType::Messaging, device_path::uri::subtype);
+            w.put_bytes(lak::span<const byte_t> { reinterpret_cast<const byte_t*>(args.data()), args.size() });
+        } else if (name == "Pci") {
+            u8 dev, fn;
+            if (n != 2 || !number(a[0], dev) || !number(a[1], fn))
+                return fail("expected Pci(device,function)");
+            w.begin_node(DevicePathType::Hardware, device_path::pci::subtype);
+            w.put(fn);
+            w.put(dev);
+        } else if (name == "PciRoot" || name == "PcieRoot" || name == "Acpi") {
+            u32 hid = name == "PciRoot" ? pci_root_hid : pcie_root_hid;
+            u32 uid;
+
+            if (name == "Acpi") {
+                if (n != 2 || !eisa_id(a[0], hid) || !number(a[1], uid))
+                    return fail("expected Acpi(hid,uid)");
+            } else if (n != 1 || !number(a[0], uid)) {
+                return fail("expected a uid");
+            }
+
+            w.begin_node(DevicePathType::Acpi, device_path::acpi::subtype);
+            w.put(hid);
+            w.put(uid);
+        } else if (name == "VenHw" || name == "VenMsg" || name == "VenMedia") {
+            efi_guid g;
+            if (n < 1 || n > 2 || !guid(a[0], g) || (n == 2 && !hex(a[1], bytes)))
+                return fail("expected Ven*(guid[,data])");
+
+            if (name == "VenHw")
+                w.begin_node(DevicePathType::Hardware, device_path::hardware_vendor::subtype);
+            else if (name == "VenMsg")
+                w.begin_node(DevicePathType::Messaging, device_path::messaging_vendor::subtype);
+            else
+                w.begin_node(DevicePathType::Media, device_path::media_vendor::subtype);
+
+            byte_t raw[efi_guid::size];
+            g.to_bytes(raw);
+            w.put_bytes(raw);
+            if (n == 2) w.put_bytes(bytes);
+        } else if (name == "USB") {
+            u8 port, iface;
+            if (n != 2 || !number(a[0], port) || !number(a[1], iface))
+                return fail("expected USB(port,interface)");
+            w.begin_node(DevicePathType::Messaging, device_path::usb::subtype);
+            w.put(port);
+            w.put(iface);
+        } else if (name == "MAC") {
+            u8 if_type = 0;
+            if (n < 1 || n > 2 || !hex(a[0], bytes) || bytes.size() > 32 || (n == 2 && !number(a[1], if_type)))
+                return fail("expected MAC(address[,type])");
+            bytes.resize(32);
+            w.begin_node(DevicePathType::Messaging, device_path::mac::subtype);
+            w.put_bytes(bytes);
+            w.put(if_type);
+        } else if (name == "IPv4") {
+            device_path::ipv4 ip { };
+            if (n < 1 || !endpoint(a[0], ip.remote, ip.remote_port)
+                || (n > 1 && !protocol(a[1], ip.protocol))
+                || (n > 2 && a[2] != "Static" && a[2] != "DHCP")
+                || (n > 3 && !endpoint(a[3], ip.local, ip.local_port))
+                || (n > 4 && !ipv4(a[4], ip.gateway))
+                || (n > 5 && !ipv4(a[5], ip.subnet_mask))
+                || n > 6)
+                return fail("expected IPv4(remote[,protocol,type,local,gateway,mask])");
+            ip.static_ip = n > 2 && a[2] == "Static";
+            w.begin_node(DevicePathType::Messaging, device_path::ipv4::subtype);
+            w.put(ip.local);
+            w.put(ip.remote);
+            w.put(ip.local_port);
+            w.put(ip.remote_port);
+            w.put(ip.protocol);
+            w.put(static_cast<u8>(ip.static_ip));
+            // Exactly up to local is how the 15 byte node is written.
+            if (n != 4) {
+                w.put(ip.gateway);
+                w.put(ip.subnet_mask);
+            }
+        } else if (name == "IPv6") {
+            device_path::ipv6 ip { };
+            bool ok = n >= 1 && n <= 6 && endpoint(a[0], ip.remote, ip.remote_port);
+            if (ok && n > 1) ok = protocol(a[1], ip.protocol);
+            if (ok && n > 2) {
+                if (a[2] == "Static") ip.origin = 0;
+                else if (a[2] == "StatelessAutoConfigure") ip.origin = 1;
+                else if (a[2] == "StatefulAutoConfigure") ip.origin = 2;
+                else ok = number(a[2], ip.origin);
+            }
+            if (ok && n > 3) ok = endpoint(a[3], ip.local, ip.local_port);
+            if (ok && n > 4) ok = ipv6(a[4], ip.gateway);
+            if (ok && n > 5) ok = number(a[5], ip.prefix_length);
+            if (!ok)
+                return fail("expected IPv6(remote[,protocol,origin,local,gateway,prefix])");
+            w.begin_node(DevicePathType::Messaging, device_path::ipv6::subtype);
+            w.put(ip.local);
+            w.put(ip.remote);
+            w.put(ip.local_port);
+            w.put(ip.remote_port);
+            w.put(ip.protocol);
+            w.put(ip.origin);
+            // As for IPv4, exactly up to local is the 39 byte node.
+            if (n != 4) {
+                w.put(ip.prefix_length);
+                w.put(ip.gateway);
+            }
+        } else if (name == "Sata") {
+            u16 hba, pmp, lun;
+            if (n != 3 || !number(a[0], hba) || !number(a[1], pmp) || !number(a[2], lun))
+                return fail("expected Sata(hba,pmp,lun)");
+            w.begin_node(DevicePathType::Messaging, device_path::sata::subtype);
+            w.put(hba);
+            w.put(pmp);
+            w.put(lun);
+        } else if (name == "NVMe") {
+            u32 nsid;
+            if (n != 2 || !number(a[0], nsid) || !hex(a[1], bytes) || bytes.size() != 8)
+                return fail("expected NVMe(nsid,eui64)");
+            w.begin_node(DevicePathType::Messaging, device_path::nvme::subtype);
+            w.put(nsid);
+            w.put_bytes(bytes);
+        } else if (name == "HD") {
+            u32 part;
+            u64 start, size;
+            u8 format, sig_type;
+            lak::array<u8, 16> sig { };
+
+            if (n != 5 || !number(a[0], part) || !number(a[3], start) || !number(a[4], size))
+                return fail("expected HD(partition,type,signature,start,size)");
+
+            if (a[1] == "GPT") {
+                efi_guid g;
+                if (!guid(a[2], g))
+                    return fail("expected a partition GUID");
+                format = device_path::hard_drive::format_gpt;
+                sig_type = device_path::hard_drive::signature_guid;
+                g.to_bytes(sig.data());
+            } else if (a[1] == "MBR") {
+                u32 s;
+                if (!number(a[2], s))
+                    return fail("expected an MBR signature");
+                format = device_path::hard_drive::format_mbr;
+                sig_type = device_path::hard_drive::signature_mbr;
+                std::memcpy(sig.data(), &s, sizeof(s));
+            } else if (number(a[1], format)) {
+                sig_type = device_path::hard_drive::signature_none;
+            } else {
+                return fail("expected GPT or MBR");
+            }
+
+            w.begin_node(DevicePathType::Media, device_path::hard_drive::subtype);
+            w.put(part);
+            w.put(start);
+            w.put(size);
+            w.put(sig);
+            w.put(format);
+            w.put(sig_type);
+        } else if (name == "Path") {
+            u8 type, subtype;
+            if (n < 2 || n > 3 || !number(a[0], type) || !number(a[1], subtype) || (n == 3 && !hex(a[2], bytes)))
+                return fail("expected Path(type,subtype[,data])");
+            w.begin_node(static_cast<DevicePathType>(type), subtype);
+            if (n == 3) w.put_bytes(bytes);
+        } else {
+            return fail("unknown device path node");
+        }
+
+        w.end_node();
+        return lak::ok_t { };
+    }
+
+    auto run() -> result {
+        while (pos < text.size()) {
+            result res = node();
+            if (!res.is_ok())
+                return res;
+
+            if (pos == text.size())
+                break;
+
+            if (text[pos] == ',')
+                w.end_instance();
+            else if (text[pos] != '/')
+                return fail("expected '/' or ','");
+
+            ++pos;
+        }
+
+        w.end_entire();
+        return lak::ok_t { };
+    }
+};
+
+}
+
+auto parse_device_path(lak::astring_view text) -> lak::result<vec<byte_t>, device_path_parse_err> {
+    parser p;
+    p.text = text;
+
+    if (auto done = p.run(); !done.is_ok())
+        return lak::err_t { done.unsafe_unwrap_err() };
+
+    // Also bounds every node's u16 length.
+    if (p.w.bytes.size() > max_file_path_list_size)
+        return lak::err_t { device_path_parse_err { text.size(), "device path too long" } };
+
+    return lak::ok_t { std::move(p.w.bytes) };
+}
+
+}
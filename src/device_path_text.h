@@ -0,0 +1,32 @@
+#pragma once
+
+#include "efi_device_path.h"
+
+namespace efibootmgrw {
+
+/*
+ * The text form of device paths from the UEFI spec (chapter 10.6), e.g.
+ * PciRoot(0x0)/Pci(0x1C,0x0)/MAC(525400123456,0x1) or
+ * HD(1,GPT,<guid>,0x800,0x100000)/File(\EFI\BOOT\BOOTX64.EFI).
+ * Nodes we don't decode, or whose bytes the text can't carry exactly, are
+ * written as Path(type,subtype,hex), so parsing what's formatted gives back
+ * the same bytes. Non-zero IP ports are written as ip:port and [ip6]:port.
+ */
+
+// Appends to out directly, nothing else is allocated.
+void format_device_path_node(fmt::memory_buffer& out, const device_path_node& node);
+
+// Nodes are separated by '/' and instances by ','.
+void format_device_path(fmt::memory_buffer& out, lak::span<const byte_t> path);
+
+struct device_path_parse_err {
+    // Into the text being parsed.
+    size_t offset;
+    lak::astring_view what;
+};
+
+// Accepts anything format_device_path writes, and bare \paths as File().
+[[nodiscard]]
+auto parse_device_path(lak::astring_view text) -> lak::result<vec<byte_t>, device_path_parse_err>;
+
+}
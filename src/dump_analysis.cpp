@@ -0,0 +1,291 @@
+#include "dump_analysis.h"
+#include "dump_corpus.h"
+#include "load_option_store.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace efibootmgrw {
+
+namespace {
+
+void bump(count_map& map, std::string_view key, size_t n = 1) {
+    if (auto it = map.find(key); it != map.end())
+        it->second += n;
+    else
+        map.emplace(std::string(key), n);
+}
+
+}
+
+void dump_analysis::merge(dump_analysis&& other) {
+    hosts                    += other.hosts;
+    unreadable_hosts         += other.unreadable_hosts;
+    hosts_without_boot_order += other.hosts_without_boot_order;
+    variables                += other.variables;
+    unreadable_variables     += other.unreadable_variables;
+    bytes_mapped             += other.bytes_mapped;
+    boot_entries             += other.boot_entries;
+    malformed_entries        += other.malformed_entries;
+    inactive_entries         += other.inactive_entries;
+    entries_without_file     += other.entries_without_file;
+    dangling_boot_order      += other.dangling_boot_order;
+    hosts_matching_golden    += other.hosts_matching_golden;
+    entries_not_in_golden    += other.entries_not_in_golden;
+    golden_entries_missing   += other.golden_entries_missing;
+    boot_order_drift         += other.boot_order_drift;
+    compared_to_golden        = compared_to_golden || other.compared_to_golden;
+
+    for (auto& [key, n] : other.loaders)
+        bump(loaders, key, n);
+
+    for (auto& [key, n] : other.labels)
+        bump(labels, key, n);
+
+    for (auto& [hash, n] : other.payloads)
+        payloads[hash] += n;
+}
+
+#ifndef _WIN32
+
+namespace {
+
+// Scratch space for one worker, reused from host to host.
+struct worker_state {
+    dump_analysis totals;
+    load_option_store store;
+    const golden_host* golden = nullptr;
+
+    vec<u16> present;
+    vec<u16> order;
+    // Of the current host, as content hashes
+    vec<u64> entries;
+    lak::optional<u64> boot_order;
+};
+
+// Entries are only counted by the store here, and totalled once at the end.
+void analyze_entry(worker_state& w, lak::span<const byte_t> data) {
+    w.entries.push_back(w.store.intern(data).hash);
+}
+
+void compare_to_golden(worker_state& w) {
+    dump_analysis& t = w.totals;
+    const golden_host& golden = *w.golden;
+
+    std::sort(w.entries.begin(), w.entries.end());
+
+    size_t extra = 0, missing = 0;
+
+    for (size_t i = 0, j = 0; i < w.entries.size() || j < golden.entries.size();) {
+        if (j == golden.entries.size() || (i < w.entries.size() && w.entries[i] < golden.entries[j])) {
+            ++extra;
+            ++i;
+        } else if (i == w.entries.size() || golden.entries[j] < w.entries[i]) {
+            ++missing;
+            ++j;
+        } else {
+            ++i;
+            ++j;
+        }
+    }
+
+    bool order_differs = w.boot_order != golden.boot_order;
+
+    t.entries_not_in_golden += extra;
+    t.golden_entries_missing += missing;
+    t.boot_order_drift += order_differs ? 1 : 0;
+
+    if (extra == 0 && missing == 0 && !order_differs)
+        ++t.hosts_matching_golden;
+}
+
+// Folds what the store counted into the totals, a lookup per distinct payload.
+void total_entries(worker_state& w) {
+    dump_analysis& t = w.totals;
+
+    for (const load_option_store::entry& e : w.store.entries()) {
+        const load_option_summary& s = e.summary;
+
+        t.boot_entries += e.count;
+        t.payloads[e.hash] += e.count;
+
+        if (s.malformed) {
+            t.malformed_entries += e.count;
+            continue;
+        }
+
+        if (!s.active)
+            t.inactive_entries += e.count;
+
+        bump(t.labels, s.label, e.count);
+
+        if (s.has_file)
+            bump(t.loaders, s.loader, e.count);
+        else
+            t.entries_without_file += e.count;
+    }
+}
+
+void analyze_host(worker_state& w, int root_fd, const char* host) {
+    dump_analysis& t = w.totals;
+
+    w.present.clear();
+    w.order.clear();
+    w.entries.clear();
+    w.boot_order.reset();
+
+    lak::optional<dump_host_totals> read = read_dump_host(root_fd, host, [&](lak::optional<u16> id, lak::span<const byte_t> bytes) {
+        if (id) {
+            w.present.push_back(*id);
+            analyze_entry(w, bytes);
+            return;
+        }
+
+        w.boot_order = content_hash(bytes);
+
+        for (size_t i = 0; i + sizeof(u16) <= bytes.size(); i += sizeof(u16)) {
+            u16 order_id;
+            std::memcpy(&order_id, bytes.data() + i, sizeof(u16));
+            w.order.push_back(order_id);
+        }
+    });
+
+    if (!read) {
+        ++t.unreadable_hosts;
+        return;
+    }
+
+    ++t.hosts;
+    t.variables += read->variables;
+    t.unreadable_variables += read->unreadable_variables;
+    t.bytes_mapped += read->bytes_mapped;
+
+    if (!read->has_boot_order)
+        ++t.hosts_without_boot_order;
+
+    std::sort(w.present.begin(), w.present.end());
+
+    for (u16 id : w.order) {
+        if (!std::binary_search(w.present.begin(), w.present.end(), id))
+            ++t.dangling_boot_order;
+    }
+
+    if (w.golden)
+        compare_to_golden(w);
+}
+
+}
+
+auto load_golden_host(lak::astring_view dir) -> vresult<golden_host> {
+    std::string path { dir.begin(), dir.end() };
+
+    // analyze_host only counts hosts it can't open, so see why first.
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0)
+        return lak::err_t { var_err::from_errno(errno) };
+
+    ::close(fd);
+
+    worker_state w;
+    analyze_host(w, AT_FDCWD, path.c_str());
+
+    std::sort(w.entries.begin(), w.entries.end());
+
+    return lak::ok_t { golden_host { std::move(w.entries), w.boot_order } };
+}
+
+auto analyze_dumps(lak::astring_view dir, size_t jobs, const golden_host* golden) -> vresult<dump_analysis> {
+    vresult<dump_corpus> opened = dump_corpus::open(dir);
+
+    if (!opened.is_ok())
+        return lak::err_t { opened.unsafe_unwrap_err() };
+
+    const dump_corpus& corpus = opened.unsafe_unwrap();
+    const vec<std::string>& hosts = corpus.hosts();
+
+    size_t workers = std::max<size_t>(std::min(jobs, hosts.size()), 1);
+    vec<worker_state> state(workers);
+
+    for (worker_state& w : state) {
+        w.golden = golden;
+        w.totals.compared_to_golden = golden != nullptr;
+    }
+
+    {
+        thread_pool pool { workers > 1 ? workers : 0 };
+
+        pool.for_each_index_stealing(hosts.size(), [&](size_t w, size_t i) {
+            analyze_host(state[w], corpus.fd(), hosts[i].c_str());
+        });
+    }
+
+    for (worker_state& w : state)
+        total_entries(w);
+
+    dump_analysis result = std::move(state[0].totals);
+
+    for (size_t w = 1; w < workers; ++w)
+        result.merge(std::move(state[w].totals));
+
+    return lak::ok_t { std::move(result) };
+}
+
+#else
+
+auto load_golden_host(lak::astring_view) -> vresult<golden_host> {
+    return lak::err_t { var_err { var_err::kind_t::unsupported } };
+}
+
+auto analyze_dumps(lak::astring_view, size_t, const golden_host*) -> vresult<dump_analysis> {
+    return lak::err_t { var_err { var_err::kind_t::unsupported } };
+}
+
+#endif
+
+namespace {
+
+void print_top(lak::astring_view title, const count_map& map, size_t top) {
+    vec<std::pair<std::string_view, size_t>> sorted { map.begin(), map.end() };
+
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+
+    if (sorted.size() > top)
+        sorted.resize(top);
+
+    fmt::print("{} ({} distinct):\n", title, map.size());
+
+    for (const auto& [key, n] : sorted)
+        fmt::print("{:>10}  {}\n", n, key);
+}
+
+}
+
+void print_dump_analysis(const dump_analysis& a, size_t top) {
+    fmt::print("Hosts: {} ({} unreadable, {} without BootOrder)\n",
+               a.hosts, a.unreadable_hosts, a.hosts_without_boot_order);
+    fmt::print("Variables: {} ({} unreadable, {} bytes mapped)\n",
+               a.variables, a.unreadable_variables, a.bytes_mapped);
+    fmt::print("Boot entries: {} ({} distinct, {} malformed, {} inactive, {} without a file path)\n",
+               a.boot_entries, a.payloads.size(), a.malformed_entries, a.inactive_entries, a.entries_without_file);
+    fmt::print("BootOrder references to missing entries: {}\n", a.dangling_boot_order);
+
+    if (a.compared_to_golden) {
+        fmt::print("Hosts matching the golden host: {} of {} ({} entries it lacks, {} of its entries missing, {} BootOrders differ)\n",
+                   a.hosts_matching_golden, a.hosts, a.entries_not_in_golden, a.golden_entries_missing, a.boot_order_drift);
+    }
+
+    print_top("Loaders", a.loaders, top);
+    print_top("Labels", a.labels, top);
+}
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace efibootmgrw {
+
+struct string_hash {
+    using is_transparent = void;
+
+    [[nodiscard]]
+    auto operator()(std::string_view str) const -> size_t {
+        return std::hash<std::string_view> { }(str);
+    }
+};
+
+// Looked up by string_view, so only new keys allocate.
+using count_map = std::unordered_map<std::string, size_t, string_hash, std::equal_to<>>;
+
+/*
+ * Totals over a corpus of captured variable dumps, one directory per host,
+ * each laid out like efivarfs (Name-guid files holding attributes then data).
+ */
+struct dump_analysis {
+    size_t hosts = 0;
+    size_t unreadable_hosts = 0;
+    size_t hosts_without_boot_order = 0;
+
+    size_t variables = 0;
+    size_t unreadable_variables = 0;
+    size_t bytes_mapped = 0;
+
+    size_t boot_entries = 0;
+    size_t malformed_entries = 0;
+    size_t inactive_entries = 0;
+    // Entries whose path has no File() node, e.g. network boot.
+    size_t entries_without_file = 0;
+    // BootOrder ids with no Boot#### to go with them.
+    size_t dangling_boot_order = 0;
+
+    // Keyed by the text form of the File() node, e.g. File(\EFI\BOOT\BOOTX64.EFI)
+    count_map loaders;
+    count_map labels;
+
+    // Occurrences of each distinct Boot#### payload, by content_hash
+    std::unordered_map<u64, size_t> payloads;
+
+    // Only filled in when compared against a golden_host.
+    bool compared_to_golden = false;
+    size_t hosts_matching_golden = 0;
+    // Boot#### payloads the golden host doesn't have, and the reverse.
+    size_t entries_not_in_golden = 0;
+    size_t golden_entries_missing = 0;
+    size_t boot_order_drift = 0;
+
+    void merge(dump_analysis&& other);
+};
+
+// A known good host, as content hashes, for hosts to be compared against.
+struct golden_host {
+    // Every Boot#### payload, sorted
+    vec<u64> entries;
+    lak::optional<u64> boot_order;
+};
+
+// dir is laid out like --efivars-dir, i.e. one host of an analyze_dumps corpus.
+[[nodiscard]]
+auto load_golden_host(lak::astring_view dir) -> vresult<golden_host>;
+
+/*
+ * Every subdirectory of dir is a host. Hosts are spread over `jobs` threads.
+ *
+ * Each Boot#### payload is hashed and interned, and only decoded the first
+ * time a thread sees it. With golden, each host also counts as matching if
+ * it has exactly the golden host's payloads and BootOrder, compared by hash.
+ */
+[[nodiscard]]
+auto analyze_dumps(lak::astring_view dir, size_t jobs, const golden_host* golden = nullptr)
+-> vresult<dump_analysis>;
+
+// Totals followed by the `top` most common loaders and labels.
+void print_dump_analysis(const dump_analysis& analysis, size_t top = 20);
+
+}
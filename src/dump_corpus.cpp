@@ -0,0 +1,169 @@
+#include "dump_corpus.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <utility>
+
+#ifndef _WIN32
+# include "mapped_file.h"
+# include <dirent.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/stat.h>
+#endif
+
+namespace efibootmgrw {
+
+#ifndef _WIN32
+
+namespace {
+
+// "-8be4df61-93ca-11d2-aa0d-00e098032b8c", as efivarfs names them
+constexpr std::string_view global_suffix = "-8be4df61-93ca-11d2-aa0d-00e098032b8c";
+
+[[nodiscard]]
+auto is_global(std::string_view name) -> bool {
+    if (name.size() <= global_suffix.size())
+        return false;
+
+    std::string_view suffix = name.substr(name.size() - global_suffix.size());
+
+    for (size_t i = 0; i < suffix.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(suffix[i])) != global_suffix[i])
+            return false;
+    }
+
+    return true;
+}
+
+}
+
+dump_corpus::dump_corpus(dump_corpus&& other) noexcept
+        : fd_ { std::exchange(other.fd_, -1) }, hosts_ { std::move(other.hosts_) } {}
+
+dump_corpus& dump_corpus::operator=(dump_corpus&& other) noexcept {
+    std::swap(fd_, other.fd_);
+    std::swap(hosts_, other.hosts_);
+    return *this;
+}
+
+dump_corpus::~dump_corpus() {
+    if (fd_ >= 0)
+        ::close(fd_);
+}
+
+auto dump_corpus::open(lak::astring_view dir) -> vresult<dump_corpus> {
+    std::string root_path { dir.begin(), dir.end() };
+
+    int root_fd = ::open(root_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (root_fd < 0)
+        return lak::err_t { var_err::from_errno(errno) };
+
+    // fdopendir takes root_fd, the corpus keeps its own for openat.
+    int list_fd = ::dup(root_fd);
+    DIR* root = list_fd < 0 ? nullptr : ::fdopendir(list_fd);
+
+    if (!root) {
+        int code = errno;
+        if (list_fd >= 0)
+            ::close(list_fd);
+        ::close(root_fd);
+        return lak::err_t { var_err::from_errno(code) };
+    }
+
+    dump_corpus corpus;
+    corpus.fd_ = root_fd;
+
+    while (dirent* ent = ::readdir(root)) {
+        std::string_view name = ent->d_name;
+
+        if (name == "." || name == "..")
+            continue;
+
+        bool is_dir = ent->d_type == DT_DIR;
+
+        if (ent->d_type == DT_UNKNOWN) {
+            struct stat st { };
+            is_dir = ::fstatat(root_fd, ent->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        if (is_dir)
+            corpus.hosts_.emplace_back(name);
+    }
+
+    ::closedir(root);
+
+    std::sort(corpus.hosts_.begin(), corpus.hosts_.end());
+
+    return lak::ok_t { std::move(corpus) };
+}
+
+auto read_dump_host(int root_fd, const char* host, const dump_var_visitor& visit)
+-> lak::optional<dump_host_totals> {
+    int dir_fd = ::openat(root_fd, host, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd < 0)
+        return lak::nullopt;
+
+    // Owns dir_fd from here on.
+    DIR* dir = ::fdopendir(dir_fd);
+
+    if (!dir) {
+        ::close(dir_fd);
+        return lak::nullopt;
+    }
+
+    dump_host_totals t;
+
+    while (dirent* ent = ::readdir(dir)) {
+        std::string_view name = ent->d_name;
+
+        if (name == "." || name == "..")
+            continue;
+
+        ++t.variables;
+
+        if (!is_global(name))
+            continue;
+
+        std::string_view var = name.substr(0, name.size() - global_suffix.size());
+        lak::optional<parsed_load_option_name> entry = parse_load_option_name(var);
+        lak::optional<u16> id;
+
+        if (entry && entry->cls == load_option_class::boot)
+            id = entry->id;
+        else if (var != "BootOrder")
+            continue;
+
+        vresult<mapped_file> file = mapped_file::open_at(dir_fd, ent->d_name);
+
+        if (!file.is_ok()) {
+            ++t.unreadable_variables;
+            continue;
+        }
+
+        // Skip the attributes.
+        lak::span<const byte_t> bytes = file.unsafe_unwrap().bytes();
+        t.bytes_mapped += bytes.size();
+
+        if (bytes.size() < sizeof(u32)) {
+            ++t.unreadable_variables;
+            continue;
+        }
+
+        if (!id)
+            t.has_boot_order = true;
+
+        visit(id, bytes.subspan(sizeof(u32)));
+    }
+
+    ::closedir(dir);
+
+    return t;
+}
+
+#endif
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace efibootmgrw {
+
+#ifndef _WIN32
+
+/*
+ * A directory of captured variable dumps, one subdirectory per host, each
+ * laid out like efivarfs (Name-guid files holding attributes then data).
+ */
+struct dump_corpus {
+    dump_corpus() = default;
+
+    dump_corpus(const dump_corpus&) = delete;
+    dump_corpus& operator=(const dump_corpus&) = delete;
+
+    dump_corpus(dump_corpus&& other) noexcept;
+    dump_corpus& operator=(dump_corpus&& other) noexcept;
+
+    ~dump_corpus();
+
+    [[nodiscard]]
+    static auto open(lak::astring_view dir) -> vresult<dump_corpus>;
+
+    // Sorted, so a stolen slice of them is the same hosts every run.
+    [[nodiscard]]
+    auto hosts() const -> const vec<std::string>& {
+        return hosts_;
+    }
+
+    [[nodiscard]]
+    auto fd() const -> int {
+        return fd_;
+    }
+
+private:
+    int fd_ = -1;
+    vec<std::string> hosts_;
+};
+
+// What reading a host came across, besides what it handed on.
+struct dump_host_totals {
+    size_t variables = 0;
+    size_t unreadable_variables = 0;
+    size_t bytes_mapped = 0;
+    bool has_boot_order = false;
+};
+
+// Called with the id of a Boot####, or none for BootOrder, and its data.
+using dump_var_visitor = std::function<void(lak::optional<u16>, lak::span<const byte_t>)>;
+
+/*
+ * Maps the global Boot#### and BootOrder variables of the host directory
+ * relative to root_fd one at a time, in directory order. Data excludes the
+ * attributes and is only valid for the duration of the call. None if the
+ * host's directory couldn't be opened.
+ */
+[[nodiscard]]
+auto read_dump_host(int root_fd, const char* host, const dump_var_visitor& visit)
+-> lak::optional<dump_host_totals>;
+
+#endif
+
+}
@@ -0,0 +1,134 @@
+#include "efi_device_path.h"
+#include "ucs2.h"
+
+#include <algorithm>
+
+namespace efibootmgrw {
+
+void device_path_iterator::advance() {
+    if (rest_.size() < sizeof(efi_device_path)) {
+        // Trailing garbage too short to be a header.
+        malformed_ = !rest_.empty();
+        done_ = true;
+        return;
+    }
+
+    u16 length;
+    std::memcpy(&length, rest_.data() + 2, sizeof(u16));
+
+    if (length < sizeof(efi_device_path) || length > rest_.size()) {
+        malformed_ = true;
+        done_ = true;
+        return;
+    }
+
+    node_ = device_path_node {
+            static_cast<DevicePathType>(rest_[0]),
+            rest_[1],
+            rest_.subspan(sizeof(efi_device_path), length - sizeof(efi_device_path))
+    };
+
+    rest_ = rest_.subspan(length);
+    done_ = false;
+}
+
+void device_path_writer::begin_node(DevicePathType type, u8 subtype) {
+    node_start_ = bytes.size();
+    put(static_cast<u8>(type));
+    put(subtype);
+    put(u16 { 0 });
+}
+
+void device_path_writer::end_node() {
+    auto length = static_cast<u16>(bytes.size() - node_start_);
+    std::memcpy(bytes.data() + node_start_ + 2, &length, sizeof(u16));
+}
+
+void device_path_writer::put_string(lak::astring_view str) {
+    for_each_u16(str, [&](char16_t c) { put(c); });
+    put(char16_t { 0 });
+}
+
+void device_path_writer::end_instance() {
+    begin_node(DevicePathType::End, device_path::end_instance::subtype);
+    end_node();
+}
+
+void device_path_writer::end_entire() {
+    begin_node(DevicePathType::End, device_path::end_entire::subtype);
+    end_node();
+}
+
+auto device_path_nodes::valid() const -> bool {
+    device_path_iterator it { bytes };
+    bool ended = false;
+
+    for (; it != std::default_sentinel; ++it) {
+        ended = it->is_end() && it->subtype == device_path::end_entire::subtype;
+    }
+
+    return ended && !it.malformed();
+}
+
+namespace {
+
+template<typename T>
+[[nodiscard]]
+auto same(const T& a, const T& b) -> bool {
+    return std::equal(a.begin(), a.end(), b.begin());
+}
+
+[[nodiscard]]
+auto same_payload(lak::span<const byte_t> a, lak::span<const byte_t> b) -> bool {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+// Nodes of the same type and subtype whose bytes differ.
+[[nodiscard]]
+auto same_fields(const device_path_node& a, const device_path_node& b) -> bool {
+    using namespace device_path;
+
+    auto sized = [&](size_t short_size, size_t long_size) {
+        return (a.payload.size() == short_size || a.payload.size() == long_size)
+               && (b.payload.size() == short_size || b.payload.size() == long_size);
+    };
+
+    if (a.type == ipv4::type && a.subtype == ipv4::subtype && sized(15, 23)) {
+        ipv4 x = ipv4::decode(a.payload), y = ipv4::decode(b.payload);
+        return same(x.local, y.local) && same(x.remote, y.remote)
+               && x.local_port == y.local_port && x.remote_port == y.remote_port
+               && x.protocol == y.protocol && x.static_ip == y.static_ip
+               && same(x.gateway, y.gateway) && same(x.subnet_mask, y.subnet_mask);
+    }
+
+    if (a.type == ipv6::type && a.subtype == ipv6::subtype && sized(39, 56)) {
+        ipv6 x = ipv6::decode(a.payload), y = ipv6::decode(b.payload);
+        return same(x.local, y.local) && same(x.remote, y.remote)
+               && x.local_port == y.local_port && x.remote_port == y.remote_port
+               && x.protocol == y.protocol && x.origin == y.origin
+               && x.prefix_length == y.prefix_length && same(x.gateway, y.gateway);
+    }
+
+    return false;
+}
+
+}
+
+auto same_device_path(lak::span<const byte_t> a, lak::span<const byte_t> b) -> bool {
+    if (same_payload(a, b))
+        return true;
+
+    device_path_iterator x { a }, y { b };
+
+    for (; x != std::default_sentinel && y != std::default_sentinel; ++x, ++y) {
+        if (x->type != y->type || x->subtype != y->subtype)
+            return false;
+
+        if (!same_payload(x->payload, y->payload) && !same_fields(*x, *y))
+            return false;
+    }
+
+    return x == std::default_sentinel && y == std::default_sentinel && !x.malformed() && !y.malformed();
+}
+
+}
@@ -1,23 +1,534 @@
-#pragma once
-
-#include "efibootmgrw.h"
-
-namespace efibootmgrw {
-
-enum class DevicePathType : uint8_t {
-    Hardware = 0x01,
-    Acpi = 0x02,
-    Messaging = 0x03,
-    Media = 0x04,
-    BiosBootSpecification = 0x05,
-    // my life would be so much easier if this was 0
-    End = 0x7f,
-};
-
-struct efi_device_path {
-    DevicePathType type;
-    uint8_t subtype;
-    uint16_t length;
-};
-
-}
\ No newline at end of file
+#pragma once
+
+#include "efibootmgrw.h"
+#include "efi_guid.h"
+
+#include "lak/array.hpp"
+
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+
+namespace efibootmgrw {
+
+enum class DevicePathType : uint8_t {
+    Hardware = 0x01,
+    Acpi = 0x02,
+    Messaging = 0x03,
+    Media = 0x04,
+    BiosBootSpecification = 0x05,
+    // my life would be so much easier if this was 0
+    End = 0x7f,
+};
+
+struct efi_device_path {
+    DevicePathType type;
+    uint8_t subtype;
+    uint16_t length;
+};
+
+static_assert(sizeof(efi_device_path) == 4);
+
+// One node of a device path, its payload excludes the header.
+struct device_path_node {
+    DevicePathType type;
+    u8 subtype;
+    lak::span<const byte_t> payload;
+
+    [[nodiscard]]
+    auto is_end() const -> bool {
+        return type == DevicePathType::End;
+    }
+};
+
+/*
+ * Walks the nodes of a packed device path list. Stops early, with
+ * malformed() set, on a node whose length is impossible.
+ */
+struct device_path_iterator {
+    device_path_iterator() = default;
+
+    explicit device_path_iterator(lak::span<const byte_t> bytes) : rest_ { bytes } {
+        advance();
+    }
+
+    [[nodiscard]]
+    auto operator*() const -> const device_path_node& {
+        return node_;
+    }
+
+    [[nodiscard]]
+    auto operator->() const -> const device_path_node* {
+        return &node_;
+    }
+
+    auto operator++() -> device_path_iterator& {
+        advance();
+        return *this;
+    }
+
+    [[nodiscard]]
+    auto operator==(std::default_sentinel_t) const -> bool {
+        return done_;
+    }
+
+    [[nodiscard]]
+    auto malformed() const -> bool {
+        return malformed_;
+    }
+
+private:
+    lak::span<const byte_t> rest_;
+    device_path_node node_ { };
+    bool done_ = true;
+    bool malformed_ = false;
+
+    void advance();
+};
+
+struct device_path_nodes {
+    lak::span<const byte_t> bytes;
+
+    [[nodiscard]]
+    auto begin() const -> device_path_iterator {
+        return device_path_iterator { bytes };
+    }
+
+    [[nodiscard]]
+    auto end() const -> std::default_sentinel_t {
+        return { };
+    }
+
+    // Every node has a sane length and the list is closed by an End node.
+    [[nodiscard]]
+    auto valid() const -> bool;
+};
+
+// Builds a packed device path list one node at a time.
+struct device_path_writer {
+    vec<byte_t> bytes;
+
+    void begin_node(DevicePathType type, u8 subtype);
+
+    // Patches the length of the node started by begin_node.
+    void end_node();
+
+    template<typename T>
+    void put(T value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto* p = reinterpret_cast<const byte_t*>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    void put_bytes(lak::span<const byte_t> data) {
+        bytes.insert(bytes.end(), data.begin(), data.end());
+    }
+
+    // UTF-8 in, null terminated UCS-2 out.
+    void put_string(lak::astring_view str);
+
+    void end_instance();
+
+    void end_entire();
+
+private:
+    size_t node_start_ = 0;
+};
+
+namespace device_path {
+
+namespace detail {
+
+template<typename T>
+[[nodiscard]]
+auto read(lak::span<const byte_t> bytes, size_t offset) -> T {
+    T out;
+    std::memcpy(&out, bytes.data() + offset, sizeof(T));
+    return out;
+}
+
+}
+
+/*
+ * Decoded node types. Each names its type/subtype, the smallest payload
+ * it can be decoded from, and a decode() that may assume that much.
+ * Variable length tails are left as spans into the original bytes.
+ */
+
+struct pci {
+    static constexpr DevicePathType type = DevicePathType::Hardware;
+    static constexpr u8 subtype = 0x01;
+    static constexpr size_t min_size = 2;
+
+    u8 function;
+    u8 device;
+
+    static auto decode(lak::span<const byte_t> p) -> pci {
+        return { p[0], p[1] };
+    }
+};
+
+template<DevicePathType TYPE, u8 SUBTYPE>
+struct vendor {
+    static constexpr DevicePathType type = TYPE;
+    static constexpr u8 subtype = SUBTYPE;
+    static constexpr size_t min_size = efi_guid::size;
+
+    efi_guid guid;
+    lak::span<const byte_t> data;
+
+    static auto decode(lak::span<const byte_t> p) -> vendor {
+        return { efi_guid::from_bytes(p.data()), p.subspan(efi_guid::size) };
+    }
+};
+
+using hardware_vendor  = vendor<DevicePathType::Hardware, 0x04>;
+using messaging_vendor = vendor<DevicePathType::Messaging, 0x0A>;
+using media_vendor     = vendor<DevicePathType::Media, 0x03>;
+
+struct acpi {
+    static constexpr DevicePathType type = DevicePathType::Acpi;
+    static constexpr u8 subtype = 0x01;
+    static constexpr size_t min_size = 8;
+
+    // Compressed EISA id, PNP0A03 and friends
+    u32 hid;
+    u32 uid;
+
+    static auto decode(lak::span<const byte_t> p) -> acpi {
+        return { detail::read<u32>(p, 0), detail::read<u32>(p, 4) };
+    }
+};
+
+struct usb {
+    static constexpr DevicePathType type = DevicePathType::Messaging;
+    static constexpr u8 subtype = 0x05;
+    static constexpr size_t min_size = 2;
+
+    u8 parent_port;
+    u8 interface;
+
+    static auto decode(lak::span<const byte_t> p) -> usb {
+        return { p[0], p[1] };
+    }
+};
+
+struct mac {
+    static constexpr DevicePathType type = DevicePathType::Messaging;
+    static constexpr u8 subtype = 0x0B;
+    static constexpr size_t min_size = 33;
+
+    // Padded to 32 bytes, only the first 6 matter for ethernet.
+    lak::array<u8, 32> address;
+    u8 if_type;
+
+    static auto decode(lak::span<const byte_t> p) -> mac {
+        mac out;
+        std::memcpy(out.address.data(), p.data(), out.address.size());
+        out.if_type = p[32];
+        return out;
+    }
+};
+
+struct ipv4 {
+    static constexpr DevicePathType type = DevicePathType::Messaging;
+    static constexpr u8 subtype = 0x0C;
+    // Gateway and subnet mask came later, older firmware leaves them off.
+    static constexpr size_t min_size = 15;
+
+    lak::array<u8, 4> local;
+    lak::array<u8, 4> remote;
+    u16 local_port;
+    u16 remote_port;
+    u16 protocol;
+    bool static_ip;
+    lak::array<u8, 4> gateway { };
+    lak::array<u8, 4> subnet_mask { };
+
+    static auto decode(lak::span<const byte_t> p) -> ipv4 {
+        ipv4 out;
+        std::memcpy(out.local.data(), p.data(), 4);
+        std::memcpy(out.remote.data(), p.data() + 4, 4);
+        out.local_port = detail::read<u16>(p, 8);
+        out.remote_port = detail::read<u16>(p, 10);
+        out.protocol = detail::read<u16>(p, 12);
+        out.static_ip = p[14] != 0;
+        if (p.size() >= 23) {
+            std::memcpy(out.gateway.data(), p.data() + 15, 4);
+            std::memcpy(out.subnet_mask.data(), p.data() + 19, 4);
+        }
+        return out;
+    }
+};
+
+struct ipv6 {
+    static constexpr DevicePathType type = DevicePathType::Messaging;
+    static constexpr u8 subtype = 0x0D;
+    static constexpr size_t min_size = 39;
+
+    lak::array<u8, 16> local;
+    lak::array<u8, 16> remote;
+    u16 local_port;
+    u16 remote_port;
+    u16 protocol;
+    u8 origin;
+    u8 prefix_length = 0;
+    lak::array<u8, 16> gateway { };
+
+    static auto decode(lak::span<const byte_t> p) -> ipv6 {
+        ipv6 out;
+        std::memcpy(out.local.data(), p.data(), 16);
+        std::memcpy(out.remote.data(), p.data() + 16, 16);
+        out.local_port = detail::read<u16>(p, 32);
+        out.remote_port = detail::read<u16>(p, 34);
+        out.protocol = detail::read<u16>(p, 36);
+        out.origin = p[38];
+        if (p.size() >= 56) {
+            out.prefix_length = p[39];
+            std::memcpy(out.gateway.data(), p.data() + 40, 16);
+        }
+        return out;
+    }
+};
+
+struct sata {
+    static constexpr DevicePathType type = DevicePathType::Messaging;
+    static constexpr u8 subtype = 0x12;
+    static constexpr size_t min_size = 6;
+
+    u16 hba_port;
+    u16 port_multiplier_port;
+    u16 lun;
+
+    static auto decode(lak::span<const byte_t> p) -> sata {
+        return { detail::read<u16>(p, 0), detail::read<u16>(p, 2), detail::read<u16>(p, 4) };
+    }
+};
+
+struct nvme {
+    static constexpr DevicePathType type = DevicePathType::Messaging;
+    static constexpr u8 subtype = 0x17;
+    static constexpr size_t min_size = 12;
+
+    u32 namespace_id;
+    lak::array<u8, 8> eui64;
+
+    static auto decode(lak::span<const byte_t> p) -> nvme {
+        nvme out;
+        out.namespace_id = detail::read<u32>(p, 0);
+        std::memcpy(out.eui64.data(), p.data() + 4, 8);
+        return out;
+    }
+};
+
+struct uri {
+    static constexpr DevicePathType type = DevicePathType::Messaging;
+    static constexpr u8 subtype = 0x18;
+    static constexpr size_t min_size = 0;
+
+    // Not null terminated
+    lak::astring_view value;
+
+    static auto decode(lak::span<const byte_t> p) -> uri {
+        return { lak::astring_view { reinterpret_cast<const char*>(p.data()), p.size() } };
+    }
+};
+
+struct hard_drive {
+    static constexpr DevicePathType type = DevicePathType::Media;
+    static constexpr u8 subtype = 0x01;
+    static constexpr size_t min_size = 38;
+
+    static constexpr u8 format_mbr = 0x01;
+    static constexpr u8 format_gpt = 0x02;
+
+    static constexpr u8 signature_none = 0x00;
+    static constexpr u8 signature_mbr = 0x01;
+    static constexpr u8 signature_guid = 0x02;
+
+    u32 partition_number;
+    u64 partition_start;
+    u64 partition_size;
+    // A GUID for GPT, a u32 disk signature for MBR
+    lak::array<u8, 16> signature;
+    u8 format;
+    u8 signature_type;
+
+    [[nodiscard]]
+    auto partition_guid() const -> efi_guid {
+        return efi_guid::from_bytes(signature.data());
+    }
+
+    static auto decode(lak::span<const byte_t> p) -> hard_drive {
+        hard_drive out;
+        out.partition_number = detail::read<u32>(p, 0);
+        out.partition_start = detail::read<u64>(p, 4);
+        out.partition_size = detail::read<u64>(p, 12);
+        std::memcpy(out.signature.data(), p.data() + 20, 16);
+        out.format = p[36];
+        out.signature_type = p[37];
+        return out;
+    }
+};
+
+struct file_path {
+    static constexpr DevicePathType type = DevicePathType::Media;
+    static constexpr u8 subtype = 0x04;
+    static constexpr size_t min_size = 0;
+
+    // Null terminated UCS-2, possibly unaligned so left as bytes.
+    lak::span<const byte_t> path;
+
+    // Number of characters before the terminator.
+    [[nodiscard]]
+    auto length() const -> size_t {
+        size_t n = 0;
+        while (n < path.size() / 2 && (*this)[n] != 0)
+            ++n;
+        return n;
+    }
+
+    [[nodiscard]]
+    auto operator[](size_t i) const -> char16_t {
+        return detail::read<char16_t>(path, i * 2);
+    }
+
+    static auto decode(lak::span<const byte_t> p) -> file_path {
+        return { p };
+    }
+};
+
+struct end_instance {
+    static constexpr DevicePathType type = DevicePathType::End;
+    static constexpr u8 subtype = 0x01;
+    static constexpr size_t min_size = 0;
+
+    static auto decode(lak::span<const byte_t>) -> end_instance {
+        return { };
+    }
+};
+
+struct end_entire {
+    static constexpr DevicePathType type = DevicePathType::End;
+    static constexpr u8 subtype = 0xFF;
+    static constexpr size_t min_size = 0;
+
+    static auto decode(lak::span<const byte_t>) -> end_entire {
+        return { };
+    }
+};
+
+// Anything we don't decode, or that's too short to be what it claims.
+struct unknown {
+    device_path_node node;
+};
+
+template<typename... Ns>
+struct node_list { };
+
+using all_nodes = node_list<
+        pci,
+        hardware_vendor,
+        acpi,
+        usb,
+        mac,
+        ipv4,
+        ipv6,
+        messaging_vendor,
+        sata,
+        nvme,
+        uri,
+        hard_drive,
+        media_vendor,
+        file_path,
+        end_instance,
+        end_entire
+>;
+
+namespace detail {
+
+// The low 3 bits of the type are unique across every type the spec defines,
+// and no subtype we decode reaches 0x20 bar End Entire's 0xFF.
+constexpr size_t type_bits = 3;
+constexpr size_t subtype_bits = 5;
+constexpr size_t table_size = 1 << (type_bits + subtype_bits);
+
+[[nodiscard]]
+constexpr auto slot(DevicePathType type, u8 subtype) -> size_t {
+    return (static_cast<size_t>(type) & ((1 << type_bits) - 1)) << subtype_bits
+           | (subtype & ((1 << subtype_bits) - 1));
+}
+
+template<typename V>
+struct table_entry {
+    DevicePathType type;
+    u8 subtype;
+    void (*call)(const device_path_node&, V&);
+};
+
+template<typename V>
+void call_unknown(const device_path_node& node, V& v) {
+    v(unknown { node });
+}
+
+template<typename N, typename V>
+void call_node(const device_path_node& node, V& v) {
+    if (node.payload.size() < N::min_size)
+        v(unknown { node });
+    else
+        v(N::decode(node.payload));
+}
+
+template<typename V, typename... Ns>
+consteval auto make_table(node_list<Ns...>) {
+    std::array<table_entry<V>, table_size> table { };
+
+    for (table_entry<V>& e : table)
+        e = { DevicePathType::End, 0, &call_unknown<V> };
+
+    auto add = [&]<typename N>() {
+        table_entry<V>& e = table[slot(N::type, N::subtype)];
+
+        // Fails to compile if two node types ever land in the same slot.
+        if (e.call != &call_unknown<V>)
+            throw "device path dispatch table collision";
+
+        e = { N::type, N::subtype, &call_node<N, V> };
+    };
+
+    (add.template operator()<Ns>(), ...);
+
+    return table;
+}
+
+template<typename V>
+constexpr auto table = make_table<V>(all_nodes { });
+
+}
+
+/*
+ * Calls v with the decoded form of node, or with device_path::unknown.
+ * One table lookup per node rather than a compare per known type.
+ */
+template<typename V>
+void visit(const device_path_node& node, V&& v) {
+    const auto& e = detail::table<std::remove_cvref_t<V>>[detail::slot(node.type, node.subtype)];
+
+    if (e.type == node.type && e.subtype == node.subtype)
+        e.call(node, v);
+    else
+        v(unknown { node });
+}
+
+}
+
+/*
+ * Whether a and b name the same thing node by node. An IPv4 or IPv6 node in
+ * the older short layout equals a long one whose extra fields are zero, as
+ * the text form lets either be written for the same address.
+ */
+[[nodiscard]]
+auto same_device_path(lak::span<const byte_t> a, lak::span<const byte_t> b) -> bool;
+
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "efibootmgrw.h"
+
+#include "lak/array.hpp"
+
+#include <cstring>
+
+namespace efibootmgrw {
+
+// EFI_GUID, stored mixed endian: the first three fields little endian, the rest as bytes.
+struct efi_guid {
+    u32 data1 = 0;
+    u16 data2 = 0;
+    u16 data3 = 0;
+    lak::array<u8, 8> data4 { };
+
+    static constexpr size_t size = 16;
+
+    [[nodiscard]]
+    static auto from_bytes(const byte_t* bytes) -> efi_guid {
+        efi_guid guid;
+        std::memcpy(&guid.data1, bytes, sizeof(u32));
+        std::memcpy(&guid.data2, bytes + 4, sizeof(u16));
+        std::memcpy(&guid.data3, bytes + 6, sizeof(u16));
+        std::memcpy(guid.data4.data(), bytes + 8, 8);
+        return guid;
+    }
+
+    void to_bytes(byte_t* bytes) const {
+        std::memcpy(bytes, &data1, sizeof(u32));
+        std::memcpy(bytes + 4, &data2, sizeof(u16));
+        std::memcpy(bytes + 6, &data3, sizeof(u16));
+        std::memcpy(bytes + 8, data4.data(), 8);
+    }
+
+    auto operator<=>(const efi_guid&) const = default;
+};
+
+}
+
+// 8BE4DF61-93CA-11D2-AA0D-00E098032B8C, no braces
+template<>
+struct fmt::formatter<efibootmgrw::efi_guid> {
+    constexpr auto parse(fmt::format_parse_context& ctx) -> decltype(ctx.begin()) {
+        auto it = ctx.begin(), end = ctx.end();
+
+        if (it != end && *it != '}')
+            throw format_error("invalid format");
+
+        return it;
+    }
+
+    template<typename FormatContext>
+    auto format(const efibootmgrw::efi_guid& g, FormatContext& ctx) -> decltype(ctx.out()) {
+        return fmt::format_to(
+                ctx.out(),
+                "{:08X}-{:04X}-{:04X}-{:02X}{:02X}-{:02X}{:02X}{:02X}{:02X}{:02X}{:02X}",
+                g.data1, g.data2, g.data3,
+                g.data4[0], g.data4[1], g.data4[2], g.data4[3],
+                g.data4[4], g.data4[5], g.data4[6], g.data4[7]
+        );
+    }
+};
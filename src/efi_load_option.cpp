@@ -1,38 +1,88 @@
-#include "efibootmgrw.h"
-#include "efi_load_option.h"
-#include "efi_device_path.h"
-#include "reinterpret_visitor.h"
-
-namespace efibootmgrw {
-
-// We have to read into this a bunch anyways, so this is convenient
-auto efi_load_option::as_bytes() -> lak::span<byte_t> {
-    return lak::span<byte_t> {
-            reinterpret_cast<byte_t*>(this),
-            sizeof(*this)
-    };
-}
-
-auto efi_load_option::flexible_data() -> lak::span<byte_t> {
-    return { data_ };
-}
-
-auto efi_load_option::desc() -> lak::wstring_view {
-    return lak::wstring_view::from_c_str(
-            reinterpret_cast<const wchar_t*>(data_.data())
-    );
-}
-
-auto efi_load_option::file_path_list(Context& ctx) -> lak::span<efi_device_path> {
-    return file_path_list(ctx, desc().size());
-}
-
-auto efi_load_option::file_path_list(Context& ctx, size_t offset) -> lak::span<efi_device_path> {
-    // Fairly sure this is UB anyways but it's a flexible length type
-    // so I can't even use std::bit_cast, oh well.
-    auto* path = reinterpret_cast<efi_device_path*>(std::launder(data_.data() + offset));
-
-    Fatal(ctx, "unimplemented");
-}
-
-}
\ No newline at end of file
+#include "efibootmgrw.h"
+#include "efi_load_option.h"
+#include "ucs2.h"
+
+#include <cstring>
+
+namespace efibootmgrw {
+
+auto to_string(load_option_err err) -> lak::astring_view {
+    switch (err) {
+        case load_option_err::truncated:                return "load option is truncated";
+        case load_option_err::misaligned:               return "load option is misaligned";
+        case load_option_err::unterminated_description: return "description is not terminated";
+        case load_option_err::file_path_list_overflow:  return "file path list runs past the end of the load option";
+    }
+
+    unreachable();
+    return { };
+}
+
+auto load_option_view::parse(lak::span<const byte_t> bytes)
+-> lak::result<load_option_view, load_option_err> {
+    if (bytes.size() < header_size)
+        return lak::err_t { load_option_err::truncated };
+
+    if (reinterpret_cast<uintptr_t>(bytes.data()) % alignof(char16_t) != 0)
+        return lak::err_t { load_option_err::misaligned };
+
+    load_option_view view;
+
+    view.bytes_ = bytes;
+
+    u16 file_path_list_length;
+    std::memcpy(&view.attributes_, bytes.data(), sizeof(u32));
+    std::memcpy(&file_path_list_length, bytes.data() + sizeof(u32), sizeof(u16));
+
+    lak::span<const char16_t> str {
+            reinterpret_cast<const char16_t*>(bytes.data() + header_size),
+            (bytes.size() - header_size) / sizeof(char16_t)
+    };
+
+    size_t len = find_nul16(str);
+
+    if (len == str.size())
+        return lak::err_t { load_option_err::unterminated_description };
+
+    view.desc_ = lak::u16string_view { str.data(), len };
+
+    size_t file_path_list_offset = header_size + (len + 1) * sizeof(char16_t);
+
+    if (bytes.size() - file_path_list_offset < file_path_list_length)
+        return lak::err_t { load_option_err::file_path_list_overflow };
+
+    view.file_path_list_ = bytes.subspan(file_path_list_offset, file_path_list_length);
+    view.optional_data_ = bytes.subspan(file_path_list_offset + file_path_list_length);
+
+    return lak::ok_t { view };
+}
+
+auto build_load_option(
+        u32 attributes,
+        lak::astring_view desc,
+        lak::span<const byte_t> file_path_list,
+        lak::span<const byte_t> optional_data
+) -> vec<byte_t> {
+    assert(file_path_list.size() <= max_file_path_list_size);
+
+    vec<byte_t> out(load_option_view::header_size);
+
+    auto file_path_list_length = static_cast<u16>(file_path_list.size());
+    std::memcpy(out.data(), &attributes, sizeof(u32));
+    std::memcpy(out.data() + sizeof(u32), &file_path_list_length, sizeof(u16));
+
+    auto put = [&](char16_t c) {
+        const auto* p = reinterpret_cast<const byte_t*>(&c);
+        out.insert(out.end(), p, p + sizeof(c));
+    };
+
+    for_each_u16(desc, put);
+    put(0);
+
+    out.insert(out.end(), file_path_list.begin(), file_path_list.end());
+    out.insert(out.end(), optional_data.begin(), optional_data.end());
+
+    return out;
+}
+
+}
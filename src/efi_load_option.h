@@ -1,82 +1,103 @@
-#pragma once
-
-#include "lak/array.hpp"
-#include "efi_device_path.h"
-#include "native_methods.h"
-
-namespace efibootmgrw {
-
-struct efi_load_option {
-    u32 attributes = 0;
-    u16 file_path_list_length = 0;
-
-    // wchar_t[]                  description;
-    // efi_device_path_protocol[] file_path_list;
-    // byte_t[]                   optional_data;
-
-    // "deal" with flexible members
-    lak::array<byte_t, 4096> data_;
-
-    [[nodiscard]] auto as_bytes() -> lak::span<byte_t>;
-
-    [[nodiscard]] auto flexible_data() -> lak::span<byte_t>;
-
-    [[nodiscard]] auto desc() -> lak::wstring_view;
-
-    [[nodiscard]] auto file_path_list(Context&) -> lak::span<efi_device_path>;
-
-    // Take the length of the string so we can save the effort
-    [[nodiscard]] auto file_path_list(Context&, size_t) -> lak::span<efi_device_path>;
-
-    // Needed for safe usage of this class as we assume
-    // wchar_t == u16 in our strings
-    static_assert(sizeof(wchar_t) == sizeof(char16_t));
-};
-
-struct caching_efi_load_option {
-    lak::optional<u16> len;
-    efi_load_option e;
-
-    [[nodiscard]]
-    auto bytes() -> lak::span<byte_t> {
-        return e.as_bytes();
-    }
-
-    void clear() {
-        len = lak::nullopt;
-    }
-
-    [[nodiscard]]
-    auto desc(Context& ctx) {
-        if (len) {
-            fmt::print("len = {}\n", len);
-            return lak::wstring_view {
-                    lak::span<wchar_t>(e.flexible_data()).subspan(0, len)
-            };
-        } else {
-            auto str = e.desc();
-
-            if (str.size() > static_cast<size_t>(std::numeric_limits<i32>::max())) {
-                Fatal(ctx, "Description size exceeds capacity!");
-            }
-
-            // Safe to narrow now
-            len = static_cast<i32>(str.size());
-
-            return str;
-        }
-    }
-
-    auto read_into(lak::wstring_view var, lak::wstring_view guid) -> winapi::wresult<lak::span<void>> {
-        return winapi::get_firmware_env_var(var, guid, bytes());
-    }
-
-    [[nodiscard]]
-    auto file_path_list(Context& ctx) -> lak::span<efi_device_path> {
-        return len
-               ? e.file_path_list(ctx, static_cast<size_t>(len))
-               : e.file_path_list(ctx, desc(ctx).size());
-    }
-};
-
-}
\ No newline at end of file
+#pragma once
+
+#include "efi_device_path.h"
+#include "efivar_backend.h"
+
+namespace efibootmgrw {
+
+// EFI_LOAD_OPTION attributes, see UEFI spec 3.1.3
+constexpr u32 load_option_active          = 0x00000001;
+constexpr u32 load_option_force_reconnect = 0x00000002;
+constexpr u32 load_option_hidden          = 0x00000008;
+constexpr u32 load_option_category        = 0x00001F00;
+constexpr u32 load_option_category_boot   = 0x00000000;
+constexpr u32 load_option_category_app    = 0x00000100;
+
+enum class load_option_err : u8 {
+    // Shorter than attributes + file_path_list_length
+    truncated,
+    // desc() would be an unaligned char16_t*
+    misaligned,
+    unterminated_description,
+    // file_path_list_length runs off the end of the variable
+    file_path_list_overflow,
+};
+
+[[nodiscard]]
+auto to_string(load_option_err err) -> lak::astring_view;
+
+/*
+ * A whole EFI_LOAD_OPTION as read from a Boot#### (etc.) variable:
+ *
+ * u32                        attributes;
+ * u16                        file_path_list_length;
+ * char16_t[]                 description;
+ * efi_device_path_protocol[] file_path_list;
+ * byte_t[]                   optional_data;
+ *
+ * Bounds are checked once by parse(), after which every field is a
+ * precomputed view into the original bytes. Nothing is ever copied,
+ * so the bytes (usually in a bump_arena) must outlive the view.
+ */
+struct load_option_view {
+    static constexpr size_t header_size = sizeof(u32) + sizeof(u16);
+
+    load_option_view() = default;
+
+    // bytes must be at least 2 byte aligned.
+    [[nodiscard]]
+    static auto parse(lak::span<const byte_t> bytes) -> lak::result<load_option_view, load_option_err>;
+
+    [[nodiscard]]
+    auto attributes() const -> u32 {
+        return attributes_;
+    }
+
+    [[nodiscard]]
+    auto active() const -> bool {
+        return (attributes_ & load_option_active) != 0;
+    }
+
+    [[nodiscard]]
+    auto desc() const -> lak::u16string_view {
+        return desc_;
+    }
+
+    // Raw device path nodes, terminated by an End node.
+    [[nodiscard]]
+    auto file_path_list() const -> lak::span<const byte_t> {
+        return file_path_list_;
+    }
+
+    [[nodiscard]]
+    auto optional_data() const -> lak::span<const byte_t> {
+        return optional_data_;
+    }
+
+    [[nodiscard]]
+    auto bytes() const -> lak::span<const byte_t> {
+        return bytes_;
+    }
+
+private:
+    lak::span<const byte_t> bytes_;
+    u32 attributes_ = 0;
+    lak::u16string_view desc_;
+    lak::span<const byte_t> file_path_list_;
+    lak::span<const byte_t> optional_data_;
+};
+
+// file_path_list_length is a u16.
+constexpr size_t max_file_path_list_size = 0xFFFF;
+
+// The inverse of load_option_view::parse(), desc is UTF-8. file_path_list
+// must be at most max_file_path_list_size bytes.
+[[nodiscard]]
+auto build_load_option(
+        u32 attributes,
+        lak::astring_view desc,
+        lak::span<const byte_t> file_path_list,
+        lak::span<const byte_t> optional_data = { }
+) -> vec<byte_t>;
+
+}
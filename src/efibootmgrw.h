@@ -1,152 +1,228 @@
-#pragma once
-
-#include "fmt/format.h"
-#include "fmt/xchar.h"
-
-#include "lak/optional.hpp"
-#include "lak/result.hpp"
-
-#include "lak/span.hpp"
-
-#include "lak/stdint.hpp"
-
-#include "lak/string.hpp"
-#include "lak/string_view_forward.hpp"
-#include "lak/string_literals.hpp"
-
-#include <vector>
-#include <cstdint>
-
-#include <cassert>
-
-template<typename T>
-using vec = std::vector<T>;
-
-using u8    [[maybe_unused]] = uint8_t;
-using u16   [[maybe_unused]] = uint16_t;
-using u32   [[maybe_unused]] = uint32_t;
-using u64   [[maybe_unused]] = uint64_t;
-using usize [[maybe_unused]] = uintptr_t;
-
-using i8    [[maybe_unused]] = int8_t;
-using i16   [[maybe_unused]] = int16_t;
-using i32   [[maybe_unused]] = int32_t;
-using i64   [[maybe_unused]] = int64_t;
-using isize [[maybe_unused]] = intptr_t;
-
-#define lambda(param, __VA_ARGS__) ([&]<typename T>(T&& param) { return __VA_ARGS__; })
-
-#ifdef NDEBUG
-# ifndef LAK_COMPILER_MSVC
-#  define unreachable() __builtin_unreachable()
-# else
-#  define unreachable() assert(0 && "unreachable")
-# endif
-#else
-#  define unreachable() assert(0 && "unreachable")
-#endif
-
-namespace efibootmgrw {
-
-template<typename C>
-constexpr static std::string add_color(C& ctx, const std::string& msg) {
-    if (ctx.args.color_diagnostics)
-        return "efibootmgrw: \033[0;1;31m" + msg + ":\033[0m ";
-    return "efibootmgrw: " + msg + ": ";
-}
-
-struct Context {
-    Context() = default;
-
-    vec<lak::astring_view> cmdline_args;
-
-    struct {
-        bool delete_boot_num = false;
-        bool create = false;
-        bool reconnect = false;
-        bool no_reconnect = false;
-        bool force_gpt = false;
-        bool delete_boot_next = false;
-        bool quiet = false;
-        bool delete_boot_order;
-        bool delete_timeout = false;
-        bool unicode = false;
-        bool verbose = true;
-        bool version = false;
-        bool write_signature = false;
-        bool append_binary_args = false;
-        bool color_diagnostics = true;
-
-        lak::optional<i8> edd;
-
-        lak::optional<i64> active;
-        lak::optional<i64> inactive;
-        lak::optional<i64> boot_num;
-        lak::optional<i64> boot_next;
-        lak::optional<i64> timeout;
-
-        lak::optional<lak::astring_view> disk;
-        lak::optional<lak::astring_view> iface;
-
-        lak::astring_view loader = R"(\elilo.efi)";
-        lak::astring_view label = "Linux";
-
-        lak::optional<vec<i64>> boot_order;
-
-        i64 device = 0x80;
-        i64 part = 1;
-    } args;
-};
-
-/*
- * You may be saying, "what the fuck?", but this is to make
- * clang-tidy shut up about "bugprone-unused-raii" for Fatal in particular,
- * as it ignores code from macros and this macro is effectively a no-op wrapper.
- */
-#define Fatal(...) Fatal(__VA_ARGS__)
-
-template<typename C>
-struct Fatal {
-public:
-    explicit Fatal(C& ctx) {
-        fmt::print(stderr, "{}", add_color(ctx, "fatal"));
-    }
-
-    template<typename... Ts>
-    Fatal(C& ctx, const fmt::format_string<Ts...> fmt, Ts&& ... args) {
-        fmt::print(stderr, "{}", add_color(ctx, "fatal"));
-        fmt::print(stderr, fmt, std::forward<Ts&&>(args)...);
-    }
-
-    template<typename... Ts>
-    Fatal(C& ctx, const fmt::wformat_string<Ts...> fmt, Ts&& ... args) {
-        fmt::print(stderr, "{}", add_color(ctx, "fatal"));
-        // using print tries to convert the format arg store
-        // into wformat_args for some godforsaken reaosn
-        fmt::vprint(
-                stderr,
-                fmt,
-                fmt::make_wformat_args(std::forward<Ts&&>(args)...)
-        );
-    }
-
-    [[noreturn]] ~Fatal() {
-        exit(1);
-    }
-
-    static Fatal<C> from_wstr(C& ctx, lak::wstring v) {
-        return Fatal(ctx, L"{}\n", v);
-    }
-
-    template<class T>
-    Fatal& operator<<(T&& val) {
-        if constexpr (lak::is_same_v<lak::remove_cvref_t<T>, std::basic_string<wchar_t>>) {
-            fmt::print(stderr, L"{}", std::forward<T&&>(val));
-        } else {
-            fmt::print(stderr, "{}", std::forward<T&&>(val));
-        }
-        return *this;
-    }
-};
-
+#pragma once
+
+#include "fmt/format.h"
+#include "fmt/xchar.h"
+
+#include "lak/optional.hpp"
+#include "lak/result.hpp"
+
+#include "lak/span.hpp"
+
+#include "lak/stdint.hpp"
+
+#include "lak/string.hpp"
+#include "lak/string_view_forward.hpp"
+#include "lak/string_literals.hpp"
+
+#include <vector>
+#include <cstdint>
+
+#include <cassert>
+
+template<typename T>
+using vec = std::vector<T>;
+
+using u8    [[maybe_unused]] = uint8_t;
+using u16   [[maybe_unused]] = uint16_t;
+using u32   [[maybe_unused]] = uint32_t;
+using u64   [[maybe_unused]] = uint64_t;
+using usize [[maybe_unused]] = uintptr_t;
+
+using i8    [[maybe_unused]] = int8_t;
+using i16   [[maybe_unused]] = int16_t;
+using i32   [[maybe_unused]] = int32_t;
+using i64   [[maybe_unused]] = int64_t;
+using isize [[maybe_unused]] = intptr_t;
+
+#define lambda(param, __VA_ARGS__) ([&]<typename T>(T&& param) { return __VA_ARGS__; })
+
+#ifdef NDEBUG
+# ifndef LAK_COMPILER_MSVC
+#  define unreachable() __builtin_unreachable()
+# else
+#  define unreachable() assert(0 && "unreachable")
+# endif
+#else
+#  define unreachable() assert(0 && "unreachable")
+#endif
+
+namespace efibootmgrw {
+
+// Works on anything with push_back, std::string and fmt::memory_buffer alike.
+template<typename OUT>
+inline void append_utf8(OUT& out, char32_t c) {
+    if (c < 0x80) {
+        out.push_back(static_cast<char>(c));
+    } else if (c < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (c >> 6)));
+        out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    } else if (c < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (c >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (c >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    }
+}
+
+/*
+ * Mixing wide and narrow output on the same FILE doesn't work
+ * with glibc, so anything wide is printed as UTF-8 instead.
+ * wchar_t is UTF-16 on Windows and UTF-32 everywhere else.
+ */
+template<typename OUT>
+inline void append_u8string(OUT& out, lak::wstring_view str) {
+    for (size_t i = 0; i < str.size(); ++i) {
+        auto c = static_cast<char32_t>(str[i]);
+
+        if (c >= 0xD800 && c < 0xDC00 && i + 1 < str.size()) {
+            auto lo = static_cast<char32_t>(str[i + 1]);
+
+            if (lo >= 0xDC00 && lo < 0xE000) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+                ++i;
+            }
+        }
+
+        append_utf8(out, c);
+    }
+}
+
+inline auto to_u8string(lak::wstring_view str) -> std::string {
+    std::string out;
+    out.reserve(str.size());
+    append_u8string(out, str);
+    return out;
+}
+
+template<typename C>
+constexpr static std::string add_color(C& ctx, const std::string& msg) {
+    if (ctx.args.color_diagnostics)
+        return "efibootmgrw: \033[0;1;31m" + msg + ":\033[0m ";
+    return "efibootmgrw: " + msg + ": ";
+}
+
+struct Context {
+    Context() = default;
+
+    // argv[0]
+    lak::astring_view program = "efibootmgrw";
+
+    struct {
+        bool delete_boot_num = false;
+        bool create = false;
+        bool reconnect = false;
+        bool no_reconnect = false;
+        bool force_gpt = false;
+        bool delete_boot_next = false;
+        bool quiet = false;
+        bool delete_boot_order = false;
+        bool delete_timeout = false;
+        bool unicode = false;
+        bool verbose = false;
+        bool version = false;
+        bool write_signature = false;
+        bool append_binary_args = false;
+        bool color_diagnostics = true;
+        bool json = false;
+        bool ndjson = false;
+        bool rollback = false;
+        bool resume = false;
+        bool simulate = false;
+        bool all = false;
+        bool watch = false;
+        bool stats = false;
+
+        lak::optional<i8> edd;
+
+        lak::optional<i64> active;
+        lak::optional<i64> inactive;
+        lak::optional<i64> boot_num;
+        lak::optional<i64> boot_next;
+        lak::optional<i64> timeout;
+
+        lak::optional<lak::astring_view> disk;
+        lak::optional<lak::astring_view> iface;
+        lak::optional<lak::astring_view> efivars_dir;
+        lak::optional<lak::astring_view> analyze_dir;
+        lak::optional<lak::astring_view> golden_dir;
+        lak::optional<lak::astring_view> journal;
+        lak::optional<lak::astring_view> apply_file;
+        lak::optional<lak::astring_view> cache_file;
+        lak::optional<lak::astring_view> batch_file;
+        lak::optional<lak::astring_view> stats_textfile;
+
+        lak::astring_view loader = R"(\elilo.efi)";
+        lak::astring_view label = "Linux";
+
+        lak::optional<vec<i64>> boot_order;
+
+        i64 device = 0x80;
+        i64 part = 1;
+
+        size_t jobs = 1;
+
+        lak::optional<u64> watch_rescan;
+
+        lak::optional<u64> sim_latency;
+        lak::optional<u64> sim_capacity;
+        vec<lak::astring_view> sim_faults;
+        vec<lak::astring_view> queries;
+    } args;
+};
+
+/*
+ * You may be saying, "what the fuck?", but this is to make
+ * clang-tidy shut up about "bugprone-unused-raii" for Fatal in particular,
+ * as it ignores code from macros and this macro is effectively a no-op wrapper.
+ */
+#define Fatal(...) Fatal(__VA_ARGS__)
+
+template<typename C>
+struct Fatal {
+public:
+    explicit Fatal(C& ctx) {
+        fmt::print(stderr, "{}", add_color(ctx, "fatal"));
+    }
+
+    template<typename... Ts>
+    Fatal(C& ctx, const fmt::format_string<Ts...> fmt, Ts&& ... args) {
+        fmt::print(stderr, "{}", add_color(ctx, "fatal"));
+        fmt::print(stderr, fmt, std::forward<Ts&&>(args)...);
+    }
+
+    template<typename... Ts>
+    Fatal(C& ctx, const fmt::wformat_string<Ts...> fmt, Ts&& ... args) {
+        fmt::print(stderr, "{}", add_color(ctx, "fatal"));
+        // using print tries to convert the format arg store
+        // into wformat_args for some godforsaken reaosn
+        lak::wstring msg = fmt::vformat(
+                fmt::wstring_view(fmt),
+                fmt::make_wformat_args(std::forward<Ts&&>(args)...)
+        );
+        fmt::print(stderr, "{}", to_u8string(msg));
+    }
+
+    [[noreturn]] ~Fatal() {
+        exit(1);
+    }
+
+    static Fatal<C> from_wstr(C& ctx, lak::wstring v) {
+        return Fatal(ctx, L"{}\n", v);
+    }
+
+    template<class T>
+    Fatal& operator<<(T&& val) {
+        if constexpr (lak::is_same_v<lak::remove_cvref_t<T>, std::basic_string<wchar_t>>) {
+            fmt::print(stderr, "{}", to_u8string(val));
+        } else {
+            fmt::print(stderr, "{}", std::forward<T&&>(val));
+        }
+        return *this;
+    }
+};
+
 }
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "efivar_backend.h"
+#include "cache_backend.h"
+#include "sim_backend.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+
+#ifdef _WIN32
+# include "winapi_backend.h"
+# include "lak/../../src/win32/wrapper.hpp"
+#else
+# include "efivarfs_backend.h"
+# include <cstring>
+#endif
+
+namespace efibootmgrw {
+
+auto var_err::wstring() const -> lak::wstring {
+    if (code != 0) {
+#ifdef _WIN32
+        return lak::winapi::error_code_to_wstring(static_cast<DWORD>(code));
+#else
+        lak::astring_view msg = lak::astring_view::from_c_str(std::strerror(static_cast<int>(code)));
+        return lak::wstring(msg.begin(), msg.end());
+#endif
+    }
+
+    switch (kind) {
+        case kind_t::not_found:        return L"Variable not found";
+        case kind_t::buffer_too_small: return L"Buffer too small for variable";
+        case kind_t::out_of_space:     return L"Out of variable storage space";
+        case kind_t::access_denied:    return L"Access denied";
+        case kind_t::unsupported:      return L"Operation not supported by backend";
+        case kind_t::io:               return L"I/O error";
+        case kind_t::corrupt:          return L"Data is corrupt";
+    }
+
+    unreachable();
+    return { };
+}
+
+auto var_err::from_errno(int code) -> var_err {
+    kind_t kind;
+
+    switch (code) {
+        case ENOENT:     kind = kind_t::not_found; break;
+        case ENOSPC:     kind = kind_t::out_of_space; break;
+        case EACCES:
+        case EPERM:      kind = kind_t::access_denied; break;
+        case EOPNOTSUPP: kind = kind_t::unsupported; break;
+        default:         kind = kind_t::io; break;
+    }
+
+    return var_err { kind, code };
+}
+
+namespace {
+
+// Fits any sane load option in a single read.
+constexpr size_t initial_read_size = 4096;
+
+// Past the largest variable any firmware we know of will store.
+constexpr size_t max_read_size = 1 << 20;
+
+// Keeps u16 and u32 fields of every variable aligned.
+constexpr size_t variable_alignment = alignof(u64);
+
+}
+
+auto read_variable(
+        efivar_backend& vars,
+        lak::wstring_view name,
+        lak::wstring_view guid,
+        bump_arena& arena,
+        size_t* calls,
+        u32* attributes
+) -> vresult<lak::span<byte_t>> {
+    auto count = [&] {
+        if (calls) ++*calls;
+    };
+
+    auto read_into = [&](size_t capacity) -> vresult<lak::span<byte_t>> {
+        lak::span<byte_t> buf = arena.alloc(capacity, variable_alignment);
+
+        count();
+        vresult<lak::span<void>> res = vars.read(name, guid, buf, attributes);
+
+        if (!res.is_ok()) {
+            arena.shrink_last(buf, 0);
+            return lak::err_t { res.unsafe_unwrap_err() };
+        }
+
+        size_t len = res.unsafe_unwrap().size_bytes();
+        arena.shrink_last(buf, len);
+        return lak::ok_t { buf.subspan(0, len) };
+    };
+
+    auto too_small = [](vresult<lak::span<byte_t>>& res) {
+        return !res.is_ok() && res.unsafe_unwrap_err().kind == var_err::kind_t::buffer_too_small;
+    };
+
+    // With room left in the arena anyway, read straight into it and only ask
+    // for the size if that wasn't enough, so most reads are a single call.
+    if (size_t room = arena.bytes_free(variable_alignment); room >= initial_read_size) {
+        vresult<lak::span<byte_t>> res = read_into(room);
+
+        if (!too_small(res))
+            return res;
+    }
+
+    size_t capacity = initial_read_size;
+
+    vresult<size_t> size = vars.size(name, guid);
+
+    // Backends without a size query, like winapi, answer without asking firmware.
+    if (size.is_ok() || size.unsafe_unwrap_err().kind != var_err::kind_t::unsupported)
+        count();
+
+    if (size.is_ok()) {
+        capacity = size.unsafe_unwrap();
+    } else if (size.unsafe_unwrap_err().kind == var_err::kind_t::not_found) {
+        return lak::err_t { size.unsafe_unwrap_err() };
+    }
+
+    for (;;) {
+        vresult<lak::span<byte_t>> res = read_into(capacity);
+
+        // The variable may have grown since we asked for its size.
+        if (!too_small(res) || capacity >= max_read_size)
+            return res;
+
+        capacity = std::max(capacity * 2, initial_read_size);
+    }
+}
+
+void read_variables_parallel(
+        efivar_backend& vars,
+        lak::span<const load_option_name> names,
+        size_t jobs,
+        bump_arena& arena,
+        size_t& calls,
+        lak::span<variable_read> out
+) {
+    assert(names.size() == out.size());
+
+    auto read_one = [&](size_t i, bump_arena& into, size_t& counter) {
+        read_variable(vars, names[i], efi_global_variable, into, &counter)
+                .if_ok([&](lak::span<byte_t> data) {
+                    out[i].data = data;
+                })
+                .if_err([&](var_err err) {
+                    out[i].err = err;
+                });
+    };
+
+    size_t workers = vars.thread_safe() ? std::min(jobs, names.size()) : 1;
+
+    if (workers <= 1) {
+        for (size_t i = 0; i < names.size(); ++i)
+            read_one(i, arena, calls);
+
+        return;
+    }
+
+    struct worker_state {
+        bump_arena arena;
+        size_t calls = 0;
+    };
+
+    vec<worker_state> state(workers);
+    std::atomic<size_t> next = 0;
+
+    {
+        thread_pool pool { workers };
+
+        pool.for_each_index(workers, [&](size_t w) {
+            for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < names.size();)
+                read_one(i, state[w].arena, state[w].calls);
+        });
+    }
+
+    for (worker_state& w : state) {
+        arena.adopt(std::move(w.arena));
+        calls += w.calls;
+    }
+}
+
+auto make_default_backend(Context& ctx) -> std::unique_ptr<efivar_backend> {
+    std::unique_ptr<efivar_backend> vars;
+
+#ifdef _WIN32
+    if (ctx.args.efivars_dir) {
+        Fatal(ctx, "--efivars-dir is not supported on Windows\n");
+    }
+
+    vars = std::make_unique<winapi_backend>();
+#else
+    vars = std::make_unique<efivarfs_backend>(
+            ctx.args.efivars_dir ? *ctx.args.efivars_dir : efivarfs_backend::default_path
+    );
+#endif
+
+    if (active_stats)
+        vars = std::make_unique<stats_backend>(std::move(vars));
+
+    if (ctx.args.cache_file)
+        return std::make_unique<cache_backend>(std::move(vars), *ctx.args.cache_file);
+
+    if (!ctx.args.simulate)
+        return vars;
+
+    sim_config config;
+
+    if (ctx.args.sim_latency) {
+        config.read_latency = std::chrono::microseconds { *ctx.args.sim_latency };
+        config.write_latency = config.read_latency;
+    }
+
+    if (ctx.args.sim_capacity)
+        config.capacity = *ctx.args.sim_capacity;
+
+    auto sim = std::make_unique<sim_backend>(config);
+
+    // Starts empty where the real backend can't enumerate.
+    if (auto res = sim->seed_from(*vars); !res.is_ok()) {
+        var_err err = res.unsafe_unwrap_err();
+
+        if (err.kind == var_err::kind_t::out_of_space) {
+            Fatal(ctx, "unable to seed the simulator: the variables don't fit in {} bytes, see --sim-capacity\n", config.capacity);
+        } else if (err.kind != var_err::kind_t::unsupported) {
+            Fatal(ctx, "unable to seed the simulator: {}\n", to_u8string(err.wstring()));
+        }
+    }
+
+    for (lak::astring_view spec : ctx.args.sim_faults) {
+        lak::optional<sim_fault> fault = parse_sim_fault(spec);
+
+        if (!fault) {
+            Fatal(ctx, "invalid --sim-fault {}\n", spec);
+        }
+
+        sim->inject(std::move(*fault));
+    }
+
+    return sim;
+}
+
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "efibootmgrw.h"
+#include "arena.h"
+#include "load_option_name.h"
+
+#include <memory>
+
+namespace efibootmgrw {
+
+// Variable attributes, see UEFI spec 8.2 (GetVariable)
+constexpr u32 efi_variable_non_volatile       = 0x00000001;
+constexpr u32 efi_variable_bootservice_access = 0x00000002;
+constexpr u32 efi_variable_runtime_access     = 0x00000004;
+
+constexpr u32 efi_variable_default_attributes =
+        efi_variable_non_volatile
+        | efi_variable_bootservice_access
+        | efi_variable_runtime_access;
+
+const lak::wstring efi_global_variable = L"{8BE4DF61-93CA-11D2-AA0D-00E098032B8C}";
+
+struct var_err {
+    enum class kind_t : u8 {
+        not_found,
+        buffer_too_small,
+        out_of_space,
+        access_denied,
+        unsupported,
+        io,
+        // Data we wrote ourselves, e.g. a journal, doesn't parse.
+        corrupt,
+    };
+
+    kind_t kind;
+
+    // errno or GetLastError(), 0 if the error didn't come from the OS.
+    i64 code = 0;
+
+    [[nodiscard]] auto wstring() const -> lak::wstring;
+
+    [[nodiscard]] static auto from_errno(int code) -> var_err;
+
+    [[nodiscard]] static auto to_wstring(const var_err& e) -> lak::wstring {
+        return e.wstring();
+    }
+};
+
+template<typename T>
+using vresult = lak::result<T, var_err>;
+
+// Changes whenever the variable does, and can be had without reading it.
+struct var_fingerprint {
+    u64 size = 0;
+    // mtime on efivarfs, a write counter for the simulator
+    u64 version = 0;
+    // inode on efivarfs, new for every mount and so every boot
+    u64 identity = 0;
+
+    [[nodiscard]]
+    auto operator==(const var_fingerprint&) const -> bool = default;
+};
+
+struct efi_var_name {
+    lak::wstring name;
+    // Braced and upper case, same as efi_global_variable
+    lak::wstring guid;
+};
+
+/*
+ * Everything that touches firmware variables goes through here,
+ * so that we aren't tied to GetFirmwareEnvironmentVariableW.
+ */
+struct efivar_backend {
+    virtual ~efivar_backend() = default;
+
+    // Returns the prefix of buf that was written to. If attributes isn't
+    // null it gets those the variable is stored with.
+    [[nodiscard]]
+    virtual auto read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+    -> vresult<lak::span<void>> = 0;
+
+    // Size of the variable's data, for backends that can tell without reading it.
+    [[nodiscard]]
+    virtual auto size(lak::wstring_view, lak::wstring_view) -> vresult<size_t> {
+        return lak::err_t { var_err { var_err::kind_t::unsupported } };
+    }
+
+    // For backends that can tell a variable changed without reading it.
+    [[nodiscard]]
+    virtual auto fingerprint(lak::wstring_view, lak::wstring_view) -> vresult<var_fingerprint> {
+        return lak::err_t { var_err { var_err::kind_t::unsupported } };
+    }
+
+    virtual auto write(
+            lak::wstring_view name,
+            lak::wstring_view guid,
+            lak::span<void> buf,
+            u32 attributes = efi_variable_default_attributes
+    ) -> vresult<lak::monostate> = 0;
+
+    virtual auto remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> = 0;
+
+    [[nodiscard]]
+    virtual auto enumerate() -> vresult<vec<efi_var_name>> = 0;
+
+    // Whether calls may be made from several threads at once.
+    [[nodiscard]]
+    virtual auto thread_safe() const -> bool {
+        return false;
+    }
+
+    // Acquire whatever privileges are needed to touch variables at all.
+    virtual auto authenticate(Context&) -> vresult<lak::monostate> {
+        return lak::ok_t { };
+    }
+};
+
+/*
+ * Reads a variable into exactly as much of arena as it needs, only asking
+ * its size when it doesn't fit in what's left of the arena's current chunk.
+ * Backends that can't report sizes get a guess that is doubled until the
+ * variable fits.
+ * calls, if given, is incremented once per backend call, and attributes,
+ * if given, gets the variable's attributes.
+ */
+[[nodiscard]]
+auto read_variable(
+        efivar_backend& vars,
+        lak::wstring_view name,
+        lak::wstring_view guid,
+        bump_arena& arena,
+        size_t* calls = nullptr,
+        u32* attributes = nullptr
+) -> vresult<lak::span<byte_t>>;
+
+struct variable_read {
+    // Points into the arena read into, empty if err is set
+    lak::span<const byte_t> data;
+    lak::optional<var_err> err;
+};
+
+/*
+ * read_variable for each of names, global variables all, into the matching
+ * element of out. Runs on up to jobs threads if vars is thread safe, each
+ * with its own arena that arena adopts once they're done.
+ */
+void read_variables_parallel(
+        efivar_backend& vars,
+        lak::span<const load_option_name> names,
+        size_t jobs,
+        bump_arena& arena,
+        size_t& calls,
+        lak::span<variable_read> out
+);
+
+// --efivars-dir if given, otherwise the firmware of the running system.
+[[nodiscard]]
+auto make_default_backend(Context& ctx) -> std::unique_ptr<efivar_backend>;
+
+}
@@ -0,0 +1,395 @@
+#ifndef _WIN32
+
+#include "efivarfs_backend.h"
+
+#include <cerrno>
+#include <cctype>
+#include <climits>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/fs.h>
+
+namespace efibootmgrw {
+
+namespace {
+
+constexpr long efivarfs_magic = 0xde5e81e4;
+
+// "{8BE4DF61-...}" <-> "8be4df61-..."
+constexpr size_t guid_chars = 36;
+
+[[nodiscard]]
+auto is_guid(lak::astring_view str) -> bool {
+    if (str.size() != guid_chars)
+        return false;
+
+    for (size_t i = 0; i < str.size(); ++i) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (str[i] != '-') return false;
+        } else if (!std::isxdigit(static_cast<unsigned char>(str[i]))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+[[nodiscard]]
+auto last_errno() -> var_err {
+    return var_err::from_errno(errno);
+}
+
+struct fd_t {
+    int fd;
+
+    explicit fd_t(int fd) : fd { fd } {}
+
+    fd_t(const fd_t&) = delete;
+    fd_t& operator=(const fd_t&) = delete;
+
+    ~fd_t() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    [[nodiscard]] operator int() const { // NOLINT(google-explicit-constructor)
+        return fd;
+    }
+};
+
+// Attributes and data in one piece, kept per thread so that the steady
+// state of a listing doesn't allocate.
+[[nodiscard]]
+auto scratch_buffer(size_t size) -> vec<byte_t>& {
+    thread_local vec<byte_t> scratch;
+
+    if (scratch.size() < size)
+        scratch.resize(size);
+
+    return scratch;
+}
+
+// Variables are created immutable by efivarfs to stop `rm -rf /` bricking machines.
+void clear_immutable(int fd) {
+    int flags;
+
+    if (::ioctl(fd, FS_IOC_GETFLAGS, &flags) < 0 || !(flags & FS_IMMUTABLE_FL))
+        return;
+
+    flags &= ~FS_IMMUTABLE_FL;
+
+    // Best effort, the write or unlink will report the actual failure.
+    (void) ::ioctl(fd, FS_IOC_SETFLAGS, &flags);
+}
+
+}
+
+/*
+ * Name-guid, built on the stack so that naming a variable doesn't allocate.
+ * Leaves room for the ".tmp" of a plain directory write.
+ */
+struct efivarfs_backend::var_file {
+    char chars[NAME_MAX + 1];
+    size_t size = 0;
+
+    var_file(lak::wstring_view name, lak::wstring_view guid) {
+        if (name.size() + 1 + guid.size() + 4 > NAME_MAX) {
+            chars[0] = '\0';
+            return;
+        }
+
+        // Variable names are UCS-2, but anything outside of ASCII
+        // would be a very strange thing to find in a variable name.
+        for (wchar_t c : name)
+            chars[size++] = static_cast<char>(c);
+
+        chars[size++] = '-';
+
+        for (wchar_t c : guid) {
+            if (c == L'{' || c == L'}')
+                continue;
+
+            chars[size++] = static_cast<char>(std::tolower(static_cast<int>(c)));
+        }
+
+        chars[size] = '\0';
+    }
+
+    [[nodiscard]]
+    explicit operator bool() const {
+        return size > 0;
+    }
+
+    [[nodiscard]]
+    auto c_str() const -> const char* {
+        return chars;
+    }
+
+    [[nodiscard]]
+    auto tmp() const -> var_file {
+        var_file t = *this;
+        std::memcpy(t.chars + t.size, ".tmp", 5);
+        t.size += 4;
+        return t;
+    }
+};
+
+efivarfs_backend::efivarfs_backend(lak::astring_view dir) : dir_ { dir.begin(), dir.end() } {
+    dir_fd_ = ::open(dir_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (dir_fd_ < 0) {
+        dir_errno_ = errno;
+        return;
+    }
+
+    struct statfs fs { };
+
+    if (::fstatfs(dir_fd_, &fs) == 0) {
+        efivarfs_ = static_cast<long>(fs.f_type) == efivarfs_magic;
+    }
+}
+
+efivarfs_backend::~efivarfs_backend() {
+    if (dir_fd_ >= 0) ::close(dir_fd_);
+}
+
+auto efivarfs_backend::check(const var_file& file) const -> vresult<lak::monostate> {
+    if (dir_fd_ < 0)
+        return lak::err_t { var_err::from_errno(dir_errno_) };
+
+    if (!file)
+        return lak::err_t { var_err::from_errno(ENAMETOOLONG) };
+
+    return lak::ok_t { };
+}
+
+auto efivarfs_backend::read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+-> vresult<lak::span<void>> {
+    var_file file { name, guid };
+
+    if (auto res = check(file); !res.is_ok())
+        return lak::err_t { res.unsafe_unwrap_err() };
+
+    fd_t fd { ::openat(dir_fd_, file.c_str(), O_RDONLY | O_CLOEXEC) };
+
+    if (fd < 0)
+        return lak::err_t { last_errno() };
+
+    // efivarfs has no read_iter, so a readv() is a firmware round trip per
+    // segment, each seeing its own copy of the variable. One read() gets it
+    // all at once, and the extra byte tells us whether buf was big enough.
+    vec<byte_t>& scratch = scratch_buffer(sizeof(u32) + buf.size_bytes() + 1);
+
+    ssize_t ret = ::read(fd, scratch.data(), sizeof(u32) + buf.size_bytes() + 1);
+
+    if (ret < 0)
+        return lak::err_t { last_errno() };
+
+    if (static_cast<size_t>(ret) < sizeof(u32))
+        return lak::err_t { var_err { var_err::kind_t::io } };
+
+    size_t len = static_cast<size_t>(ret) - sizeof(u32);
+
+    if (len > buf.size_bytes())
+        return lak::err_t { var_err { var_err::kind_t::buffer_too_small } };
+
+    u32 stored_attributes;
+    std::memcpy(&stored_attributes, scratch.data(), sizeof(stored_attributes));
+
+    if (len > 0)
+        std::memcpy(buf.data(), scratch.data() + sizeof(u32), len);
+
+    if (attributes)
+        *attributes = stored_attributes;
+
+    return lak::ok_t { lak::span<void> { lak::span<byte_t> { buf }.subspan(0, len) }};
+}
+
+auto efivarfs_backend::size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> {
+    var_file file { name, guid };
+
+    if (auto res = check(file); !res.is_ok())
+        return lak::err_t { res.unsafe_unwrap_err() };
+
+    struct stat st { };
+
+    if (::fstatat(dir_fd_, file.c_str(), &st, 0) < 0)
+        return lak::err_t { last_errno() };
+
+    if (static_cast<size_t>(st.st_size) < sizeof(u32))
+        return lak::err_t { var_err { var_err::kind_t::io } };
+
+    return lak::ok_t { static_cast<size_t>(st.st_size) - sizeof(u32) };
+}
+
+auto efivarfs_backend::fingerprint(lak::wstring_view name, lak::wstring_view guid) -> vresult<var_fingerprint> {
+    var_file file { name, guid };
+
+    if (auto res = check(file); !res.is_ok())
+        return lak::err_t { res.unsafe_unwrap_err() };
+
+    struct stat st { };
+
+    if (::fstatat(dir_fd_, file.c_str(), &st, 0) < 0)
+        return lak::err_t { last_errno() };
+
+    return lak::ok_t { var_fingerprint {
+            static_cast<u64>(st.st_size),
+            static_cast<u64>(st.st_mtim.tv_sec) * 1'000'000'000 + static_cast<u64>(st.st_mtim.tv_nsec),
+            static_cast<u64>(st.st_ino),
+    } };
+}
+
+auto efivarfs_backend::write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+-> vresult<lak::monostate> {
+    var_file file { name, guid };
+
+    if (auto res = check(file); !res.is_ok())
+        return res;
+
+    // SetVariable, and so efivarfs, deletes a variable written with no
+    // data, and a plain directory should too.
+    if (!efivarfs_ && buf.size_bytes() == 0)
+        return remove(name, guid);
+
+    // efivarfs wants the whole variable in a single write. It has no
+    // write_iter, so a writev() would land as one write() per segment and
+    // the attributes alone would delete the variable.
+    size_t total = sizeof(attributes) + buf.size_bytes();
+    vec<byte_t>& scratch = scratch_buffer(total);
+
+    std::memcpy(scratch.data(), &attributes, sizeof(attributes));
+
+    if (buf.size_bytes() > 0)
+        std::memcpy(scratch.data() + sizeof(attributes), buf.data(), buf.size_bytes());
+
+    auto write_all = [&](int fd) -> vresult<lak::monostate> {
+        ssize_t ret = ::write(fd, scratch.data(), total);
+
+        if (ret < 0)
+            return lak::err_t { last_errno() };
+
+        if (static_cast<size_t>(ret) != total)
+            return lak::err_t { var_err { var_err::kind_t::io } };
+
+        return lak::ok_t { };
+    };
+
+    if (efivarfs_) {
+        fd_t fd { ::openat(dir_fd_, file.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644) };
+
+        if (fd < 0)
+            return lak::err_t { last_errno() };
+
+        clear_immutable(fd);
+
+        return write_all(fd);
+    }
+
+    // Plain directory, replace atomically so a crash never leaves half a variable.
+    var_file tmp = file.tmp();
+
+    {
+        fd_t fd { ::openat(dir_fd_, tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+
+        if (fd < 0)
+            return lak::err_t { last_errno() };
+
+        vresult<lak::monostate> res = write_all(fd);
+
+        if (!res.is_ok()) {
+            ::unlinkat(dir_fd_, tmp.c_str(), 0);
+            return res;
+        }
+    }
+
+    if (::renameat(dir_fd_, tmp.c_str(), dir_fd_, file.c_str()) < 0) {
+        var_err err = last_errno();
+        ::unlinkat(dir_fd_, tmp.c_str(), 0);
+        return lak::err_t { err };
+    }
+
+    return lak::ok_t { };
+}
+
+auto efivarfs_backend::remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> {
+    var_file file { name, guid };
+
+    if (auto res = check(file); !res.is_ok())
+        return res;
+
+    if (efivarfs_) {
+        fd_t fd { ::openat(dir_fd_, file.c_str(), O_RDONLY | O_CLOEXEC) };
+
+        if (fd < 0)
+            return lak::err_t { last_errno() };
+
+        clear_immutable(fd);
+    }
+
+    if (::unlinkat(dir_fd_, file.c_str(), 0) < 0)
+        return lak::err_t { last_errno() };
+
+    return lak::ok_t { };
+}
+
+auto efivarfs_backend::enumerate() -> vresult<vec<efi_var_name>> {
+    if (dir_fd_ < 0)
+        return lak::err_t { var_err::from_errno(dir_errno_) };
+
+    // A descriptor of our own, a dup() would share its offset with every
+    // other enumerate() going on at once.
+    int fd = ::openat(dir_fd_, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0)
+        return lak::err_t { last_errno() };
+
+    DIR* dir = ::fdopendir(fd);
+
+    if (!dir) {
+        var_err err = last_errno();
+        ::close(fd);
+        return lak::err_t { err };
+    }
+
+    vec<efi_var_name> names;
+
+    while (const dirent* ent = ::readdir(dir)) {
+        lak::astring_view file = lak::astring_view::from_c_str(ent->d_name);
+
+        // Name, dash, guid
+        if (file.size() < guid_chars + 2 || file[file.size() - guid_chars - 1] != '-')
+            continue;
+
+        lak::astring_view name { file.begin(), file.end() - guid_chars - 1 };
+        lak::astring_view guid { file.end() - guid_chars, file.end() };
+
+        if (!is_guid(guid))
+            continue;
+
+        efi_var_name var;
+
+        var.name.assign(name.begin(), name.end());
+
+        var.guid.reserve(guid_chars + 2);
+        var.guid += L'{';
+        for (char c : guid)
+            var.guid += static_cast<wchar_t>(std::toupper(static_cast<unsigned char>(c)));
+        var.guid += L'}';
+
+        names.push_back(std::move(var));
+    }
+
+    ::closedir(dir);
+
+    return lak::ok_t { std::move(names) };
+}
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+namespace efibootmgrw {
+
+/*
+ * Variables as files named `Name-guid`, each holding the u32 attributes
+ * followed by the data. This is the layout of efivarfs, so pointing this
+ * at a plain directory gives us a stand-in store for hosts without EFI.
+ */
+struct efivarfs_backend final : efivar_backend {
+    inline static const lak::astring_view default_path = "/sys/firmware/efi/efivars";
+
+    explicit efivarfs_backend(lak::astring_view dir);
+
+    efivarfs_backend(const efivarfs_backend&) = delete;
+    efivarfs_backend& operator=(const efivarfs_backend&) = delete;
+
+    ~efivarfs_backend() override;
+
+    [[nodiscard]]
+    auto read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+    -> vresult<lak::span<void>> override;
+
+    // Free, efivarfs keeps the size in the inode.
+    [[nodiscard]]
+    auto size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> override;
+
+    // Size, mtime and inode, a stat() away.
+    [[nodiscard]]
+    auto fingerprint(lak::wstring_view name, lak::wstring_view guid) -> vresult<var_fingerprint> override;
+
+    auto write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+    -> vresult<lak::monostate> override;
+
+    auto remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> override;
+
+    [[nodiscard]]
+    auto enumerate() -> vresult<vec<efi_var_name>> override;
+
+    // Every call opens its own file.
+    [[nodiscard]]
+    auto thread_safe() const -> bool override {
+        return true;
+    }
+
+    [[nodiscard]]
+    auto is_efivarfs() const -> bool {
+        return efivarfs_;
+    }
+
+    [[nodiscard]]
+    auto dir() const -> lak::astring_view {
+        return lak::astring_view { dir_.data(), dir_.size() };
+    }
+
+private:
+    std::string dir_;
+    // Variables are opened relative to this, so no call builds a full path.
+    int dir_fd_ = -1;
+    // Why dir_ couldn't be opened, reported by every call.
+    int dir_errno_ = 0;
+    // Real efivarfs needs the immutable bit cleared before changes,
+    // and can't be written to through a rename.
+    bool efivarfs_ = false;
+
+    // Name-guid, see efivarfs_backend.cpp
+    struct var_file;
+
+    [[nodiscard]] auto check(const var_file& file) const -> vresult<lak::monostate>;
+};
+
+}
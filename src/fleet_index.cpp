@@ -0,0 +1,413 @@
+#include "fleet_index.h"
+#include "dump_corpus.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace efibootmgrw {
+
+auto to_string(fleet_index::field f) -> lak::astring_view {
+    switch (f) {
+        case fleet_index::field::label:     return "label";
+        case fleet_index::field::loader:    return "loader";
+        case fleet_index::field::partition: return "partition";
+        case fleet_index::field::node:      return "node";
+    }
+
+    unreachable();
+    return { };
+}
+
+namespace {
+
+using posting = fleet_index::posting;
+
+[[nodiscard]]
+auto field_index(fleet_index::field f) -> size_t {
+    return static_cast<size_t>(f);
+}
+
+// The lists an entry with summary is posted to, one per distinct key.
+[[nodiscard]]
+auto lists_for(fleet_index& index, const load_option_summary& s) -> vec<vec<posting>*> {
+    vec<vec<posting>*> lists;
+
+    if (s.malformed)
+        return lists;
+
+    auto add = [&](fleet_index::field f, std::string_view value) {
+        fleet_index::posting_map& map = index.postings[field_index(f)];
+        std::string key = fleet_index::key(f, value);
+
+        auto it = map.find(key);
+        if (it == map.end())
+            it = map.emplace(std::move(key), vec<posting> { }).first;
+
+        if (std::find(lists.begin(), lists.end(), &it->second) == lists.end())
+            lists.push_back(&it->second);
+    };
+
+    add(fleet_index::field::label, s.label);
+
+    if (s.has_file)
+        add(fleet_index::field::loader, s.loader);
+
+    for (const std::string& guid : s.partitions)
+        add(fleet_index::field::partition, guid);
+
+    for (const std::string& node : s.nodes)
+        add(fleet_index::field::node, node);
+
+    return lists;
+}
+
+// The first posting of each host, i.e. where it has its earliest match.
+template<typename F>
+void for_each_first(lak::span<const posting> list, F&& f) {
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (i == 0 || list[i].host != list[i - 1].host)
+            f(list[i]);
+    }
+}
+
+}
+
+void fleet_index::add(u32 host, const load_option_summary& summary, u16 position) {
+    for (vec<posting>* list : lists_for(*this, summary))
+        list->push_back(posting { host, position });
+}
+
+void fleet_index::merge(fleet_index&& other) {
+    unreadable_hosts += other.unreadable_hosts;
+
+    for (size_t f = 0; f < field_count; ++f) {
+        for (auto& [key, list] : other.postings[f]) {
+            if (auto it = postings[f].find(key); it != postings[f].end())
+                it->second.insert(it->second.end(), list.begin(), list.end());
+            else
+                postings[f].emplace(key, std::move(list));
+        }
+    }
+}
+
+void fleet_index::finish() {
+    for (posting_map& map : postings) {
+        for (auto& [key, list] : map)
+            std::sort(list.begin(), list.end());
+    }
+}
+
+auto fleet_index::find(field f, std::string_view value) const -> lak::span<const posting> {
+    const posting_map& map = postings[field_index(f)];
+
+    if (auto it = map.find(value); it != map.end())
+        return lak::span<const posting> { it->second.data(), it->second.size() };
+
+    return { };
+}
+
+auto fleet_index::key(field f, std::string_view value) -> std::string {
+    if (f == field::label)
+        return std::string(value);
+
+    if (f == field::loader && value.size() > 6 && value.substr(0, 5) == "File(" && value.back() == ')')
+        value = value.substr(5, value.size() - 6);
+
+    std::string key(value);
+
+    for (char& c : key) {
+        if (c >= 'A' && c <= 'Z')
+            c = static_cast<char>(c - 'A' + 'a');
+    }
+
+    return key;
+}
+
+#ifndef _WIN32
+
+namespace {
+
+// Scratch space for one worker, reused from host to host.
+struct index_worker {
+    fleet_index index;
+    load_option_store store;
+    // Every distinct payload's lists, so only its first occurrence hashes keys.
+    std::unordered_map<const load_option_summary*, vec<vec<posting>*>> lists;
+
+    vec<std::pair<u16, const load_option_summary*>> entries;
+    vec<u16> order;
+};
+
+void index_host(index_worker& w, int root_fd, const char* host, u32 host_index) {
+    w.entries.clear();
+    w.order.clear();
+
+    lak::optional<dump_host_totals> read = read_dump_host(root_fd, host, [&](lak::optional<u16> id, lak::span<const byte_t> bytes) {
+        if (id) {
+            w.entries.emplace_back(*id, &w.store.intern(bytes).summary);
+            return;
+        }
+
+        for (size_t i = 0; i + sizeof(u16) <= bytes.size(); i += sizeof(u16)) {
+            u16 order_id;
+            std::memcpy(&order_id, bytes.data() + i, sizeof(u16));
+            w.order.push_back(order_id);
+        }
+    });
+
+    if (!read) {
+        ++w.index.unreadable_hosts;
+        return;
+    }
+
+    for (const auto& [id, summary] : w.entries) {
+        auto at = std::find(w.order.begin(), w.order.end(), id);
+        auto position = static_cast<size_t>(at - w.order.begin());
+
+        if (at == w.order.end() || position >= fleet_index::no_position)
+            position = fleet_index::no_position;
+
+        auto it = w.lists.find(summary);
+        if (it == w.lists.end())
+            it = w.lists.emplace(summary, lists_for(w.index, *summary)).first;
+
+        for (vec<posting>* list : it->second)
+            list->push_back(posting { host_index, static_cast<u16>(position) });
+    }
+}
+
+}
+
+auto build_fleet_index(lak::astring_view dir, size_t jobs) -> vresult<fleet_index> {
+    vresult<dump_corpus> opened = dump_corpus::open(dir);
+
+    if (!opened.is_ok())
+        return lak::err_t { opened.unsafe_unwrap_err() };
+
+    const dump_corpus& corpus = opened.unsafe_unwrap();
+    const vec<std::string>& hosts = corpus.hosts();
+
+    size_t workers = std::max<size_t>(std::min(jobs, hosts.size()), 1);
+    vec<index_worker> state(workers);
+
+    {
+        thread_pool pool { workers > 1 ? workers : 0 };
+
+        pool.for_each_index_stealing(hosts.size(), [&](size_t w, size_t i) {
+            index_host(state[w], corpus.fd(), hosts[i].c_str(), static_cast<u32>(i));
+        });
+    }
+
+    fleet_index result = std::move(state[0].index);
+
+    for (size_t w = 1; w < workers; ++w)
+        result.merge(std::move(state[w].index));
+
+    result.hosts = hosts;
+    result.finish();
+
+    return lak::ok_t { std::move(result) };
+}
+
+#else
+
+auto build_fleet_index(lak::astring_view, size_t) -> vresult<fleet_index> {
+    return lak::err_t { var_err { var_err::kind_t::unsupported } };
+}
+
+#endif
+
+auto parse_fleet_query(std::string_view text) -> lak::result<fleet_query, fleet_query_parse_err> {
+    size_t pos = 0;
+
+    auto err = [&](lak::astring_view what) {
+        return lak::err_t { fleet_query_parse_err { pos, what } };
+    };
+
+    auto at_space = [&] {
+        return text[pos] == ' ' || text[pos] == '\t';
+    };
+
+    auto parse_match = [&](fleet_query::match& m) -> lak::result<lak::monostate, fleet_query_parse_err> {
+        size_t start = pos;
+
+        while (pos < text.size() && text[pos] != '=' && !at_space())
+            ++pos;
+
+        std::string_view name = text.substr(start, pos - start);
+
+        if (name == "label")
+            m.field = fleet_index::field::label;
+        else if (name == "loader")
+            m.field = fleet_index::field::loader;
+        else if (name == "partition")
+            m.field = fleet_index::field::partition;
+        else if (name == "node")
+            m.field = fleet_index::field::node;
+        else {
+            pos = start;
+            return err("expected label, loader, partition or node");
+        }
+
+        if (pos == text.size() || text[pos] != '=')
+            return err("expected '='");
+
+        ++pos;
+
+        std::string value;
+
+        if (pos < text.size() && text[pos] == '"') {
+            size_t quote = pos++;
+
+            while (pos < text.size() && text[pos] != '"')
+                value += text[pos++];
+
+            if (pos == text.size()) {
+                pos = quote;
+                return err("unterminated quote");
+            }
+
+            ++pos;
+        } else {
+            while (pos < text.size() && !at_space() && text[pos] != '<' && text[pos] != '@')
+                value += text[pos++];
+        }
+
+        if (value.empty())
+            return err("expected a value");
+
+        m.value = fleet_index::key(m.field, value);
+
+        if (pos < text.size() && text[pos] == '@') {
+            ++pos;
+
+            size_t n = 0;
+            size_t digits = 0;
+
+            for (; pos < text.size() && text[pos] >= '0' && text[pos] <= '9'; ++pos, ++digits) {
+                n = n * 10 + static_cast<size_t>(text[pos] - '0');
+
+                if (n >= fleet_index::no_position)
+                    return err("position out of range");
+            }
+
+            if (digits == 0)
+                return err("expected a position");
+
+            m.position = static_cast<u16>(n);
+        }
+
+        return lak::ok_t { };
+    };
+
+    fleet_query query;
+
+    while (true) {
+        while (pos < text.size() && at_space())
+            ++pos;
+
+        if (pos == text.size())
+            break;
+
+        fleet_query::term& t = query.terms.emplace_back();
+
+        if (auto res = parse_match(t.first); !res.is_ok())
+            return lak::err_t { res.unsafe_unwrap_err() };
+
+        if (pos < text.size() && text[pos] == '<') {
+            if (t.first.position)
+                return err("a position can't be used with '<'");
+
+            ++pos;
+            t.before.emplace();
+
+            if (auto res = parse_match(*t.before); !res.is_ok())
+                return lak::err_t { res.unsafe_unwrap_err() };
+
+            if (t.before->position)
+                return err("a position can't be used with '<'");
+        }
+
+        if (pos < text.size() && !at_space())
+            return err("expected a space");
+    }
+
+    if (query.terms.empty())
+        return err("empty query");
+
+    return lak::ok_t { std::move(query) };
+}
+
+namespace {
+
+[[nodiscard]]
+auto hosts_matching(const fleet_index& index, const fleet_query::match& m) -> vec<u32> {
+    vec<u32> hosts;
+
+    for (const posting& p : index.find(m.field, m.value)) {
+        if (m.position && p.position != *m.position)
+            continue;
+
+        if (hosts.empty() || hosts.back() != p.host)
+            hosts.push_back(p.host);
+    }
+
+    return hosts;
+}
+
+// Hosts whose earliest a is in BootOrder and ahead of their earliest b.
+[[nodiscard]]
+auto hosts_ordered(const fleet_index& index, const fleet_query::match& a, const fleet_query::match& b) -> vec<u32> {
+    vec<posting> first_a, first_b;
+
+    for_each_first(index.find(a.field, a.value), [&](const posting& p) { first_a.push_back(p); });
+    for_each_first(index.find(b.field, b.value), [&](const posting& p) { first_b.push_back(p); });
+
+    vec<u32> hosts;
+
+    for (size_t i = 0, j = 0; i < first_a.size() && j < first_b.size();) {
+        if (first_a[i].host < first_b[j].host) {
+            ++i;
+        } else if (first_b[j].host < first_a[i].host) {
+            ++j;
+        } else {
+            if (first_a[i].position != fleet_index::no_position && first_a[i].position < first_b[j].position)
+                hosts.push_back(first_a[i].host);
+            ++i;
+            ++j;
+        }
+    }
+
+    return hosts;
+}
+
+}
+
+auto run_fleet_query(const fleet_index& index, const fleet_query& query) -> vec<u32> {
+    if (query.terms.empty())
+        return { };
+
+    vec<vec<u32>> results;
+
+    for (const fleet_query::term& t : query.terms)
+        results.push_back(t.before ? hosts_ordered(index, t.first, *t.before) : hosts_matching(index, t.first));
+
+    // Smallest first, so each intersection is at most as long as it.
+    std::sort(results.begin(), results.end(), [](const vec<u32>& a, const vec<u32>& b) {
+        return a.size() < b.size();
+    });
+
+    vec<u32> hosts = std::move(results[0]);
+    vec<u32> scratch;
+
+    for (size_t i = 1; i < results.size() && !hosts.empty(); ++i) {
+        scratch.clear();
+        std::set_intersection(hosts.begin(), hosts.end(), results[i].begin(), results[i].end(), std::back_inserter(scratch));
+        std::swap(hosts, scratch);
+    }
+
+    return hosts;
+}
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "dump_analysis.h"
+#include "load_option_store.h"
+
+#include <array>
+
+namespace efibootmgrw {
+
+/*
+ * Inverted indexes over the Boot#### entries of a dump corpus, so questions
+ * like "which hosts boot \EFI\ubuntu\shimx64.efi first" are answered from
+ * posting lists instead of by reading and decoding every host again.
+ */
+struct fleet_index {
+    enum class field : u8 {
+        // Description, as is
+        label,
+        // Path of the first File() node, e.g. \efi\ubuntu\shimx64.efi
+        loader,
+        // GUID of a GPT HD() node
+        partition,
+        // Name of any node in the text form, e.g. mac, ipv4, hd, file
+        node,
+    };
+
+    static constexpr size_t field_count = 4;
+
+    // Entries not in BootOrder
+    static constexpr u16 no_position = 0xFFFF;
+
+    // A host with an entry that has some value, at its first position in BootOrder.
+    struct posting {
+        u32 host;
+        u16 position;
+
+        auto operator<=>(const posting&) const = default;
+    };
+
+    // Each sorted by host then position.
+    using posting_map = std::unordered_map<std::string, vec<posting>, string_hash, std::equal_to<>>;
+
+    // Their index is what postings refer to them by.
+    vec<std::string> hosts;
+    size_t unreadable_hosts = 0;
+    std::array<posting_map, field_count> postings;
+
+    // An entry of host with summary, at position in its BootOrder.
+    void add(u32 host, const load_option_summary& summary, u16 position);
+
+    // Takes other's postings, for indexes built over disjoint hosts.
+    void merge(fleet_index&& other);
+
+    // Sorts every list, once nothing more is added.
+    void finish();
+
+    // Empty if no entry has value, which is looked up as given, see key().
+    [[nodiscard]]
+    auto find(field f, std::string_view value) const -> lak::span<const posting>;
+
+    // How values of f are keyed: lower case except for labels, and loaders
+    // without any File() around them.
+    [[nodiscard]]
+    static auto key(field f, std::string_view value) -> std::string;
+};
+
+[[nodiscard]]
+auto to_string(fleet_index::field f) -> lak::astring_view;
+
+// Reads and indexes every host of the corpus at dir, spread over `jobs` threads.
+[[nodiscard]]
+auto build_fleet_index(lak::astring_view dir, size_t jobs) -> vresult<fleet_index>;
+
+/*
+ * Space separated terms, all of which a host has to match:
+ *
+ *   field=value      an entry has value, e.g. loader=\EFI\ubuntu\shimx64.efi
+ *   field=value@N    the entry at BootOrder position N does, @0 being first
+ *   a<b              some entry matching a comes before every entry
+ *                    matching b in BootOrder, e.g. node=mac<node=hd
+ *
+ * with field being label, loader, partition or node. Values can be quoted
+ * with "" to hold spaces, < or @.
+ */
+struct fleet_query {
+    struct match {
+        fleet_index::field field;
+        std::string value;
+        lak::optional<u16> position;
+    };
+
+    struct term {
+        match first;
+        // Only set for a<b, as b
+        lak::optional<match> before;
+    };
+
+    vec<term> terms;
+};
+
+struct fleet_query_parse_err {
+    // Into the query being parsed.
+    size_t offset;
+    lak::astring_view what;
+};
+
+[[nodiscard]]
+auto parse_fleet_query(std::string_view text) -> lak::result<fleet_query, fleet_query_parse_err>;
+
+// Indices into index.hosts of the matching hosts, sorted.
+[[nodiscard]]
+auto run_fleet_query(const fleet_index& index, const fleet_query& query) -> vec<u32>;
+
+}
@@ -0,0 +1,151 @@
+#include "json_writer.h"
+
+#include <cmath>
+#include <iterator>
+
+namespace efibootmgrw {
+
+void json_writer::separate() {
+    if (after_key_) {
+        after_key_ = false;
+        return;
+    }
+
+    u64 bit = u64(1) << (depth_ % 64);
+
+    if (has_elements_ & bit)
+        out_.push_back(',');
+
+    has_elements_ |= bit;
+}
+
+void json_writer::push(char open) {
+    separate();
+    out_.push_back(open);
+    ++depth_;
+    has_elements_ &= ~(u64(1) << (depth_ % 64));
+}
+
+void json_writer::pop(char close) {
+    --depth_;
+    out_.push_back(close);
+}
+
+void json_writer::begin_object() {
+    push('{');
+}
+
+void json_writer::end_object() {
+    pop('}');
+}
+
+void json_writer::begin_array() {
+    push('[');
+}
+
+void json_writer::end_array() {
+    pop(']');
+}
+
+void json_writer::key(lak::astring_view name) {
+    value(name);
+    out_.push_back(':');
+    after_key_ = true;
+}
+
+void json_writer::escape(char32_t c) {
+    switch (c) {
+        case '"':  fmt::format_to(std::back_inserter(out_), "\\\""); return;
+        case '\\': fmt::format_to(std::back_inserter(out_), "\\\\"); return;
+        case '\n': fmt::format_to(std::back_inserter(out_), "\\n"); return;
+        case '\r': fmt::format_to(std::back_inserter(out_), "\\r"); return;
+        case '\t': fmt::format_to(std::back_inserter(out_), "\\t"); return;
+        default: break;
+    }
+
+    // A surrogate still here had no other half, and has no UTF-8 of its own.
+    if (c < 0x20 || (c >= 0xD800 && c < 0xE000))
+        fmt::format_to(std::back_inserter(out_), "\\u{:04x}", static_cast<u32>(c));
+    else
+        append_utf8(out_, c);
+}
+
+void json_writer::value(lak::astring_view str) {
+    separate();
+    out_.push_back('"');
+
+    // Already UTF-8, only the ASCII needs looking at.
+    for (char c : str) {
+        if (static_cast<unsigned char>(c) < 0x80)
+            escape(static_cast<char32_t>(c));
+        else
+            out_.push_back(c);
+    }
+
+    out_.push_back('"');
+}
+
+void json_writer::value(lak::u16string_view str) {
+    separate();
+    out_.push_back('"');
+
+    for (size_t i = 0; i < str.size(); ++i) {
+        char32_t c = str[i];
+
+        if (c >= 0xD800 && c < 0xDC00 && i + 1 < str.size()
+            && str[i + 1] >= 0xDC00 && str[i + 1] < 0xE000) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (str[i + 1] - 0xDC00);
+            ++i;
+        }
+
+        escape(c);
+    }
+
+    out_.push_back('"');
+}
+
+void json_writer::value(u64 n) {
+    separate();
+    fmt::format_to(std::back_inserter(out_), "{}", n);
+}
+
+void json_writer::value(double d) {
+    if (!std::isfinite(d)) {
+        null();
+        return;
+    }
+
+    separate();
+    fmt::format_to(std::back_inserter(out_), "{}", d);
+}
+
+void json_writer::value(bool b) {
+    separate();
+    fmt::format_to(std::back_inserter(out_), "{}", b ? "true" : "false");
+}
+
+void json_writer::null() {
+    separate();
+    fmt::format_to(std::back_inserter(out_), "null");
+}
+
+void json_writer::value_hex(lak::span<const byte_t> bytes) {
+    constexpr char digits[] = "0123456789abcdef";
+
+    separate();
+    out_.push_back('"');
+
+    for (byte_t b : bytes) {
+        out_.push_back(digits[b >> 4]);
+        out_.push_back(digits[b & 0xF]);
+    }
+
+    out_.push_back('"');
+}
+
+void json_writer::newline() {
+    out_.push_back('\n');
+    has_elements_ &= ~u64(1);
+}
+
+}
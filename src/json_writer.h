@@ -0,0 +1,53 @@
+#pragma once
+
+#include "efibootmgrw.h"
+
+namespace efibootmgrw {
+
+/*
+ * Appends JSON to a buffer, inserting the commas itself. Nothing is
+ * checked, keys and values just have to be called in a sensible order.
+ * Strings are escaped as they are written, wide ones transcoded to UTF-8
+ * but for lone surrogates, which are written as \uXXXX escapes.
+ */
+struct json_writer {
+    explicit json_writer(fmt::memory_buffer& out) : out_ { out } {}
+
+    void begin_object();
+    void end_object();
+
+    void begin_array();
+    void end_array();
+
+    void key(lak::astring_view name);
+
+    void value(lak::astring_view str);
+    void value(lak::u16string_view str);
+    void value(u64 n);
+    // null for anything JSON can't hold, i.e. inf and nan
+    void value(double d);
+    void value(bool b);
+    void null();
+
+    // Raw bytes as a lower case hex string.
+    void value_hex(lak::span<const byte_t> bytes);
+
+    // For ndjson, between top level values.
+    void newline();
+
+private:
+    fmt::memory_buffer& out_;
+
+    // Bit n is set once depth n has had its first element.
+    u64 has_elements_ = 0;
+    size_t depth_ = 0;
+    bool after_key_ = false;
+
+    void separate();
+    void escape(char32_t c);
+
+    void push(char open);
+    void pop(char close);
+};
+
+}
@@ -0,0 +1,212 @@
+#include "listing.h"
+#include "boot_snapshot.h"
+#include "boot_json.h"
+#include "efi_load_option.h"
+#include "load_option_inventory.h"
+#include "loader_resolver.h"
+#include "stats.h"
+#include "device_path_text.h"
+#include "ucs2.h"
+
+#include "fmt/color.h"
+#include "fmt/format.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+namespace efibootmgrw {
+
+namespace {
+
+void append_loader(fmt::memory_buffer& line, const loader_file& loader) {
+    switch (loader.status) {
+        case loader_file::status_t::found:
+            fmt::format_to(
+                std::back_inserter(line),
+                "\t-> {} ({} bytes, sha256 {:02x})",
+                loader.path,
+                loader.size,
+                fmt::join(loader.digest, "")
+            );
+            break;
+        case loader_file::status_t::unreadable:
+            fmt::format_to(
+                std::back_inserter(line),
+                "\t-> {} (unreadable, {})",
+                loader.path,
+                std::strerror(static_cast<int>(loader.code))
+            );
+            break;
+        case loader_file::status_t::table_unreadable:
+            fmt::format_to(
+                std::back_inserter(line),
+                "\t-> {} ({}: {})",
+                loader.path,
+                to_string(loader.status),
+                loader.table_error.string()
+            );
+            break;
+        case loader_file::status_t::missing:
+        case loader_file::status_t::not_mounted:
+            fmt::format_to(std::back_inserter(line), "\t-> {} ({})", loader.path, to_string(loader.status));
+            break;
+        case loader_file::status_t::no_file:
+            break;
+    }
+}
+
+}
+
+auto default_print(Context& ctx, efivar_backend& vars) -> vresult<lak::monostate> {
+    BootSnapshot snap = BootSnapshot::load(vars, ctx.args.jobs);
+
+    // Every line is formatted into this, so once it has grown to the longest
+    // line nothing per entry touches the heap.
+    fmt::memory_buffer line;
+
+    if (snap.boot_next)
+        fmt::format_to(std::back_inserter(line), "BootNext: {:0>4X}\n", *snap.boot_next);
+
+    if (snap.boot_current)
+        fmt::format_to(std::back_inserter(line), "BootCurrent: {:0>4X}\n", *snap.boot_current);
+
+    if (snap.timeout)
+        fmt::format_to(std::back_inserter(line), "Timeout: {} seconds\n", *snap.timeout);
+
+    std::fwrite(line.data(), 1, line.size(), stdout);
+
+    if (snap.boot_order_error())
+        return lak::err_t { *snap.boot_order_error() };
+
+    // Verbose lines also say which file each entry boots, resolved and hashed
+    // in one batch up front rather than an entry at a time.
+    vec<loader_file> loaders;
+    size_t next_loader = 0;
+
+    if (ctx.args.verbose) {
+        vec<lak::span<const byte_t>> paths;
+
+        for (u16 id : snap.boot_order()) {
+            const BootSnapshot::entry* e = snap.find(id);
+
+            if (!e->err)
+                load_option_view::parse(e->data).if_ok([&](load_option_view opt) {
+                    paths.push_back(opt.file_path_list());
+                });
+        }
+
+        loaders = resolve_loaders(partition_mounts::load(), paths, ctx.args.jobs);
+    }
+
+    stat_timer timer { stat_kind::decode };
+
+    for (u16 id : snap.boot_order()) {
+        const BootSnapshot::entry* e = snap.find(id);
+
+        if (!e->err) {
+            load_option_view::parse(e->data)
+                .if_ok([&](load_option_view opt) {
+                    line.clear();
+                    fmt::format_to(std::back_inserter(line), "Boot{:0>4X}: ", id);
+                    append_u8string(line, opt.desc());
+
+                    if (ctx.args.verbose) {
+                        line.push_back('\t');
+                        format_device_path(line, opt.file_path_list());
+                        append_loader(line, loaders[next_loader++]);
+                    }
+
+                    line.push_back('\n');
+                    std::fwrite(line.data(), 1, line.size(), stdout);
+                })
+                .if_err([&](load_option_err err) {
+                    fmt::print(stderr, "Boot{:0>4X} is malformed: {}\n", id, to_string(err));
+                });
+        } else {
+            fmt::print(
+                stderr,
+                fmt::emphasis::bold | fg(fmt::color::crimson),
+                "Unable to read Boot{:0>4X}: {}!\n",
+                id,
+                to_u8string(e->err->wstring())
+            );
+        }
+    }
+
+    return lak::ok_t { };
+}
+
+auto inventory_print(Context& ctx, efivar_backend& vars) -> vresult<lak::monostate> {
+    vresult<load_option_inventory> res = load_option_inventory::load(vars, ctx.args.jobs);
+
+    if (!res.is_ok())
+        return lak::err_t { res.unsafe_unwrap_err() };
+
+    const load_option_inventory& inv = res.unsafe_unwrap();
+
+    if (inv.probed())
+        fmt::print(stderr, "Variables can't be listed here, only ids near those in use were probed\n");
+
+    stat_timer timer { stat_kind::decode };
+    fmt::memory_buffer line;
+
+    for (const load_option_inventory::entry& e : inv.entries()) {
+        line.clear();
+        append_u8string(line, load_option_name { e.cls, e.id }.view());
+
+        if (e.err) {
+            fmt::format_to(std::back_inserter(line), ": unreadable, {}", to_u8string(e.err->wstring()));
+        } else {
+            load_option_view::parse(e.data)
+                .if_ok([&](load_option_view opt) {
+                    fmt::format_to(std::back_inserter(line), ": ");
+                    append_u8string(line, opt.desc());
+
+                    if (ctx.args.verbose) {
+                        line.push_back('\t');
+                        format_device_path(line, opt.file_path_list());
+                    }
+                })
+                .if_err([&](load_option_err err) {
+                    fmt::format_to(std::back_inserter(line), ": malformed, {}", to_string(err));
+                });
+        }
+
+        if (inv.is_orphan(e)) {
+            fmt::format_to(std::back_inserter(line), " (not in ");
+            append_u8string(line, load_option_order_name(e.cls));
+            line.push_back(')');
+        }
+
+        line.push_back('\n');
+        std::fwrite(line.data(), 1, line.size(), stdout);
+    }
+
+    for (const load_option_inventory::reference& ref : inv.dangling()) {
+        line.clear();
+        append_u8string(line, load_option_order_name(ref.cls));
+        fmt::format_to(std::back_inserter(line), " lists missing ");
+        append_u8string(line, load_option_name { ref.cls, ref.id }.view());
+        line.push_back('\n');
+        std::fwrite(line.data(), 1, line.size(), stdout);
+    }
+
+    return lak::ok_t { };
+}
+
+void json_print(Context& ctx, efivar_backend& vars) {
+    BootSnapshot snap = BootSnapshot::load(vars, ctx.args.jobs);
+
+    fmt::memory_buffer out;
+
+    {
+        stat_timer timer { stat_kind::decode };
+        write_boot_json(out, snap, ctx.args.ndjson);
+    }
+
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    std::fflush(stdout);
+}
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+namespace efibootmgrw {
+
+// BootNext, BootCurrent, Timeout and a line per BootOrder entry,
+// with its device path when verbose.
+[[nodiscard]]
+auto default_print(Context& ctx, efivar_backend& vars) -> vresult<lak::monostate>;
+
+// --all, every load option variable of every class, marking those their
+// order variable leaves out, followed by ids order variables list that
+// don't exist.
+[[nodiscard]]
+auto inventory_print(Context& ctx, efivar_backend& vars) -> vresult<lak::monostate>;
+
+// --json or --ndjson, built up in memory and written with a single fwrite.
+void json_print(Context& ctx, efivar_backend& vars);
+
+}
@@ -0,0 +1,183 @@
+#include "load_option_inventory.h"
+#include "stats.h"
+
+#include <algorithm>
+
+namespace efibootmgrw {
+
+namespace {
+
+[[nodiscard]]
+auto entry_less(const load_option_inventory::entry& a, const load_option_inventory::entry& b) -> bool {
+    return a.cls != b.cls ? a.cls < b.cls : a.id < b.id;
+}
+
+[[nodiscard]]
+auto is_not_found(const load_option_inventory::entry& e) -> bool {
+    return e.err && e.err->kind == var_err::kind_t::not_found;
+}
+
+void read_entry(efivar_backend& vars, load_option_inventory::entry& e, bump_arena& arena, size_t& calls) {
+    read_variable(vars, load_option_name { e.cls, e.id }, efi_global_variable, arena, &calls)
+            .if_ok([&](lak::span<byte_t> data) {
+                e.data = data;
+            })
+            .if_err([&](var_err err) {
+                e.err = err;
+            });
+}
+
+}
+
+auto load_option_inventory::load(efivar_backend& vars, size_t jobs) -> vresult<load_option_inventory> {
+    stat_timer timer { stat_kind::snapshot };
+    load_option_inventory inv;
+
+    for (size_t c = 0; c < load_option_class_count; ++c) {
+        lak::wstring_view name = load_option_order_name(static_cast<load_option_class>(c));
+
+        if (name.empty())
+            continue;
+
+        // A missing or unreadable order variable lists nothing.
+        read_variable(vars, name, efi_global_variable, inv.arena_, &inv.calls_)
+                .if_ok([&](lak::span<byte_t> data) {
+                    inv.orders_[c] = lak::span<const u16> {
+                            reinterpret_cast<const u16*>(data.data()),
+                            data.size() / sizeof(u16)
+                    };
+                });
+    }
+
+    ++inv.calls_;
+    vresult<vec<efi_var_name>> names = vars.enumerate();
+
+    if (names.is_ok()) {
+        for (const efi_var_name& var : names.unsafe_unwrap()) {
+            if (var.guid != efi_global_variable)
+                continue;
+
+            if (lak::optional<parsed_load_option_name> parsed = parse_load_option_name(var.name))
+                inv.entries_.push_back(entry { parsed->cls, parsed->id, { }, lak::nullopt });
+        }
+    } else if (names.unsafe_unwrap_err().kind == var_err::kind_t::unsupported) {
+        inv.probed_ = true;
+
+        for (size_t c = 0; c < load_option_class_count; ++c) {
+            for (u16 id : inv.orders_[c])
+                inv.entries_.push_back(entry { static_cast<load_option_class>(c), id, { }, lak::nullopt });
+        }
+    } else {
+        return lak::err_t { names.unsafe_unwrap_err() };
+    }
+
+    auto sort_unique = [&] {
+        std::sort(inv.entries_.begin(), inv.entries_.end(), entry_less);
+        inv.entries_.erase(
+                std::unique(inv.entries_.begin(), inv.entries_.end(), [](const entry& a, const entry& b) {
+                    return a.cls == b.cls && a.id == b.id;
+                }),
+                inv.entries_.end()
+        );
+    };
+
+    sort_unique();
+    inv.read_entries(vars, jobs);
+
+    if (inv.probed_) {
+        size_t known = inv.entries_.size();
+
+        auto already_read = [&](load_option_class cls, u16 id) -> const entry* {
+            auto end = inv.entries_.begin() + static_cast<ptrdiff_t>(known);
+            auto it = std::lower_bound(inv.entries_.begin(), end, entry { cls, id, { }, lak::nullopt }, entry_less);
+            return it != end && it->cls == cls && it->id == id ? &*it : nullptr;
+        };
+
+        // Each probe depends on the misses before it, so these can't be batched.
+        for (size_t c = 0; c < load_option_class_count; ++c) {
+            auto cls = static_cast<load_option_class>(c);
+            u16 misses = 0;
+
+            for (u32 id = 0; id <= 0xFFFF && misses < probe_gap; ++id) {
+                if (const entry* e = already_read(cls, static_cast<u16>(id))) {
+                    misses = is_not_found(*e) ? static_cast<u16>(misses + 1) : u16(0);
+                    continue;
+                }
+
+                entry e { cls, static_cast<u16>(id), { }, lak::nullopt };
+                read_entry(vars, e, inv.arena_, inv.calls_);
+
+                if (is_not_found(e)) {
+                    ++misses;
+                } else {
+                    misses = 0;
+                    inv.entries_.push_back(e);
+                }
+            }
+        }
+
+        sort_unique();
+    }
+
+    // Listed but gone by the time we read it, or probed for nothing.
+    std::erase_if(inv.entries_, is_not_found);
+
+    for (size_t c = 0; c < load_option_class_count; ++c) {
+        auto cls = static_cast<load_option_class>(c);
+        lak::span<const u16> order = inv.orders_[c];
+
+        for (auto it = order.begin(); it != order.end(); ++it) {
+            bool repeated = std::find(order.begin(), it, *it) != it;
+
+            if (!repeated && !inv.find(cls, *it))
+                inv.dangling_.push_back(reference { cls, *it });
+        }
+    }
+
+    return lak::ok_t { std::move(inv) };
+}
+
+void load_option_inventory::read_entries(efivar_backend& vars, size_t jobs) {
+    vec<load_option_name> names;
+    vec<variable_read> reads(entries_.size());
+    names.reserve(entries_.size());
+
+    for (const entry& e : entries_)
+        names.push_back(load_option_name { e.cls, e.id });
+
+    read_variables_parallel(
+            vars,
+            lak::span<const load_option_name> { names.data(), names.size() },
+            jobs,
+            arena_,
+            calls_,
+            lak::span<variable_read> { reads.data(), reads.size() }
+    );
+
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        entries_[i].data = reads[i].data;
+        entries_[i].err  = reads[i].err;
+    }
+}
+
+auto load_option_inventory::find(load_option_class cls, u16 id) const -> const entry* {
+    auto it = std::lower_bound(
+            entries_.begin(),
+            entries_.end(),
+            entry { cls, id, { }, lak::nullopt },
+            entry_less
+    );
+
+    return it != entries_.end() && it->cls == cls && it->id == id ? &*it : nullptr;
+}
+
+auto load_option_inventory::is_orphan(const entry& e) const -> bool {
+    if (load_option_order_name(e.cls).empty())
+        return false;
+
+    lak::span<const u16> order = orders_[static_cast<size_t>(e.cls)];
+
+    return std::find(order.begin(), order.end(), e.id) == order.end();
+}
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "efibootmgrw.h"
+#include "efivar_backend.h"
+#include "load_option_name.h"
+#include "arena.h"
+
+namespace efibootmgrw {
+
+/*
+ * Every load option variable of every class, whether or not an order
+ * variable lists it, so orphaned entries and order variables naming
+ * entries that no longer exist can both be found.
+ */
+struct load_option_inventory {
+    struct entry {
+        load_option_class cls;
+        u16 id;
+        // Points into the inventory's arena, empty if err is set
+        lak::span<const byte_t> data;
+        lak::optional<var_err> err;
+    };
+
+    struct reference {
+        load_option_class cls;
+        u16 id;
+    };
+
+    load_option_inventory() = default;
+
+    // Entries point into the arena, so a copy would dangle.
+    load_option_inventory(const load_option_inventory&) = delete;
+    load_option_inventory& operator=(const load_option_inventory&) = delete;
+
+    load_option_inventory(load_option_inventory&&) = default;
+    load_option_inventory& operator=(load_option_inventory&&) = default;
+
+    /*
+     * Backends that can list variables are listed once, which for efivarfs
+     * is a single directory sweep. Those that can't are probed instead:
+     * every id an order variable names, then upwards from 0000 until
+     * probe_gap ids in a row don't exist, as firmware hands out the lowest
+     * free id. Entries are read by up to `jobs` threads if the backend
+     * allows it.
+     */
+    [[nodiscard]]
+    static auto load(efivar_backend& vars, size_t jobs = 1) -> vresult<load_option_inventory>;
+
+    static constexpr u16 probe_gap = 16;
+
+    // Sorted by class then id.
+    [[nodiscard]]
+    auto entries() const -> lak::span<const entry> {
+        return lak::span<const entry> { entries_.data(), entries_.size() };
+    }
+
+    [[nodiscard]]
+    auto find(load_option_class cls, u16 id) const -> const entry*;
+
+    // Empty for classes without an order variable, or where it couldn't be read.
+    [[nodiscard]]
+    auto order(load_option_class cls) const -> lak::span<const u16> {
+        return orders_[static_cast<size_t>(cls)];
+    }
+
+    // Exists, but isn't in its class's order variable.
+    [[nodiscard]]
+    auto is_orphan(const entry& e) const -> bool;
+
+    // Ids order variables list that have no variable, in order.
+    [[nodiscard]]
+    auto dangling() const -> lak::span<const reference> {
+        return lak::span<const reference> { dangling_.data(), dangling_.size() };
+    }
+
+    // Whether entries were found by probing, and so may be missing some.
+    [[nodiscard]]
+    auto probed() const -> bool {
+        return probed_;
+    }
+
+    // Number of calls made to the backend by load().
+    [[nodiscard]]
+    auto firmware_calls() const -> size_t {
+        return calls_;
+    }
+
+private:
+    bump_arena arena_;
+    vec<entry> entries_;
+    vec<reference> dangling_;
+
+    lak::span<const u16> orders_[load_option_class_count];
+
+    bool probed_ = false;
+    size_t calls_ = 0;
+
+    void read_entries(efivar_backend& vars, size_t jobs);
+};
+
+}
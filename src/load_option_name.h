@@ -0,0 +1,139 @@
+#pragma once
+
+#include "efibootmgrw.h"
+
+#include <algorithm>
+#include <iterator>
+#include <string_view>
+
+namespace efibootmgrw {
+
+// The numbered load option variables, UEFI spec 3.1.
+enum class load_option_class : u8 {
+    boot,
+    driver,
+    sys_prep,
+    platform_recovery,
+    os_recovery,
+};
+
+[[nodiscard]]
+constexpr auto load_option_prefix(load_option_class c) -> lak::wstring_view {
+    switch (c) {
+        case load_option_class::boot:              return L"Boot";
+        case load_option_class::driver:            return L"Driver";
+        case load_option_class::sys_prep:          return L"SysPrep";
+        case load_option_class::platform_recovery: return L"PlatformRecovery";
+        case load_option_class::os_recovery:       return L"OsRecovery";
+    }
+
+    return { };
+}
+
+constexpr size_t load_option_class_count = 5;
+
+// The variable listing a class's ids in order, empty for classes without one.
+// OsRecoveryOrder lists vendor guids rather than ids, so it doesn't count.
+[[nodiscard]]
+constexpr auto load_option_order_name(load_option_class c) -> lak::wstring_view {
+    switch (c) {
+        case load_option_class::boot:     return L"BootOrder";
+        case load_option_class::driver:   return L"DriverOrder";
+        case load_option_class::sys_prep: return L"SysPrepOrder";
+        default:                          return { };
+    }
+}
+
+/*
+ * Boot####, Driver####, ... built in place, so naming any of the 65536
+ * variables of a class never touches the heap. Kept null terminated, as
+ * GetFirmwareEnvironmentVariableW takes the view's data() as a C string.
+ */
+struct load_option_name {
+    constexpr load_option_name(load_option_class c, u16 id) {
+        constexpr wchar_t hex[] = L"0123456789ABCDEF";
+
+        for (wchar_t ch : load_option_prefix(c))
+            chars_[size_++] = ch;
+
+        for (int shift = 12; shift >= 0; shift -= 4)
+            chars_[size_++] = hex[(id >> shift) & 0xF];
+
+        chars_[size_] = L'\0';
+    }
+
+    [[nodiscard]]
+    constexpr auto view() const -> lak::wstring_view {
+        return lak::wstring_view { chars_, size_ };
+    }
+
+    [[nodiscard]]
+    constexpr operator lak::wstring_view() const { // NOLINT(google-explicit-constructor)
+        return view();
+    }
+
+private:
+    // "PlatformRecovery" + 4 hex digits + null
+    wchar_t chars_[21] { };
+    size_t size_ = 0;
+};
+
+struct parsed_load_option_name {
+    load_option_class cls;
+    u16 id;
+};
+
+// The inverse of load_option_name, nullopt for any other variable.
+[[nodiscard]]
+inline auto parse_load_option_name(lak::wstring_view name) -> lak::optional<parsed_load_option_name> {
+    for (size_t i = 0; i < load_option_class_count; ++i) {
+        auto c = static_cast<load_option_class>(i);
+        lak::wstring_view prefix = load_option_prefix(c);
+
+        if (name.size() != prefix.size() + 4)
+            continue;
+
+        if (!std::equal(prefix.begin(), prefix.end(), name.begin()))
+            continue;
+
+        u16 id = 0;
+
+        for (size_t i = prefix.size(); i < name.size(); ++i) {
+            wchar_t ch = name[i];
+            u16 digit;
+
+            // Firmware only ever creates upper case ids, see UEFI spec 3.1.
+            if (ch >= L'0' && ch <= L'9')      digit = static_cast<u16>(ch - L'0');
+            else if (ch >= L'A' && ch <= L'F') digit = static_cast<u16>(ch - L'A' + 10);
+            else return lak::nullopt;
+
+            id = static_cast<u16>(id << 4 | digit);
+        }
+
+        return parsed_load_option_name { c, id };
+    }
+
+    return lak::nullopt;
+}
+
+// The same for a name spelled in ASCII, as efivarfs file names are.
+[[nodiscard]]
+inline auto parse_load_option_name(std::string_view name) -> lak::optional<parsed_load_option_name> {
+    // "PlatformRecovery" + 4 hex digits, anything longer names no load option.
+    wchar_t wide[20];
+
+    if (name.size() > std::size(wide))
+        return lak::nullopt;
+
+    for (size_t i = 0; i < name.size(); ++i)
+        wide[i] = static_cast<wchar_t>(static_cast<unsigned char>(name[i]));
+
+    return parse_load_option_name(lak::wstring_view { wide, name.size() });
+}
+
+[[nodiscard]]
+constexpr auto boot_option_name(u16 id) -> load_option_name {
+    return load_option_name { load_option_class::boot, id };
+}
+
+}
@@ -0,0 +1,120 @@
+#include "load_option_store.h"
+#include "efi_load_option.h"
+#include "device_path_text.h"
+#include "ucs2.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace efibootmgrw {
+
+auto content_hash(lak::span<const byte_t> bytes) -> u64 {
+    constexpr u64 m = 0xC6A4A7935BD1E995ull;
+    constexpr int r = 47;
+
+    const byte_t* data = bytes.data();
+    size_t size = bytes.size();
+    u64 h = 0x8445D61A4E774912ull ^ (size * m);
+
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        u64 k;
+        std::memcpy(&k, data + i, sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    const byte_t* tail = data + (size & ~size_t(7));
+
+    switch (size & 7) {
+        case 7: h ^= u64(tail[6]) << 48; [[fallthrough]];
+        case 6: h ^= u64(tail[5]) << 40; [[fallthrough]];
+        case 5: h ^= u64(tail[4]) << 32; [[fallthrough]];
+        case 4: h ^= u64(tail[3]) << 24; [[fallthrough]];
+        case 3: h ^= u64(tail[2]) << 16; [[fallthrough]];
+        case 2: h ^= u64(tail[1]) << 8; [[fallthrough]];
+        case 1: h ^= u64(tail[0]);
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+auto load_option_summary::of(lak::span<const byte_t> bytes) -> load_option_summary {
+    load_option_summary s;
+
+    load_option_view::parse(bytes)
+        .if_ok([&](load_option_view opt) {
+            s.active = opt.active();
+            append_u8string(s.label, opt.desc());
+
+            fmt::memory_buffer text;
+
+            for (const device_path_node& node : device_path_nodes { opt.file_path_list() }) {
+                if (node.is_end())
+                    continue;
+
+                text.clear();
+                format_device_path_node(text, node);
+
+                std::string_view str { text.data(), text.size() };
+                std::string_view name = str.substr(0, str.find('('));
+
+                if (std::find(s.nodes.begin(), s.nodes.end(), name) == s.nodes.end())
+                    s.nodes.emplace_back(name);
+
+                if (node.type == device_path::file_path::type && node.subtype == device_path::file_path::subtype && !s.has_file) {
+                    s.has_file = true;
+                    s.loader.assign(str);
+                }
+
+                if (node.type == device_path::hard_drive::type && node.subtype == device_path::hard_drive::subtype
+                    && node.payload.size() >= device_path::hard_drive::min_size) {
+                    device_path::hard_drive hd = device_path::hard_drive::decode(node.payload);
+
+                    if (hd.signature_type == device_path::hard_drive::signature_guid)
+                        s.partitions.push_back(fmt::format("{}", hd.partition_guid()));
+                }
+            }
+        })
+        .if_err([&](load_option_err) {
+            s.malformed = true;
+        });
+
+    return s;
+}
+
+auto load_option_store::intern(lak::span<const byte_t> bytes) -> const entry& {
+    u64 hash = content_hash(bytes);
+    auto [first, last] = index_.equal_range(hash);
+
+    for (auto it = first; it != last; ++it) {
+        entry& e = entries_[it->second];
+
+        if (std::equal(e.bytes.begin(), e.bytes.end(), bytes.begin(), bytes.end())) {
+            ++e.count;
+            return e;
+        }
+    }
+
+    entry& e = entries_.emplace_back();
+    e.hash = hash;
+    e.bytes.assign(bytes.begin(), bytes.end());
+    // Decoded from the copy, which unlike a mapping is suitably aligned.
+    e.summary = load_option_summary::of(lak::span<const byte_t> { e.bytes.data(), e.bytes.size() });
+    e.count = 1;
+
+    index_.emplace(hash, entries_.size() - 1);
+
+    return e;
+}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "efibootmgrw.h"
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+namespace efibootmgrw {
+
+// MurmurHash64A of bytes. Native endian, so only comparable within one machine.
+[[nodiscard]]
+auto content_hash(lak::span<const byte_t> bytes) -> u64;
+
+// What dump analysis and queries want from a load option, decoded once per distinct payload.
+struct load_option_summary {
+    bool malformed = false;
+    bool active = false;
+    bool has_file = false;
+    // UTF-8
+    std::string label;
+    // Text form of the first File() node, e.g. File(\EFI\BOOT\BOOTX64.EFI)
+    std::string loader;
+    // GUIDs of GPT HD() nodes, as formatted, e.g. C12A7328-F81F-11D2-BA4B-00A0C93EC93B
+    vec<std::string> partitions;
+    // Distinct node names of the text form, e.g. PciRoot, MAC, HD, File
+    vec<std::string> nodes;
+
+    [[nodiscard]]
+    static auto of(lak::span<const byte_t> bytes) -> load_option_summary;
+};
+
+/*
+ * Load options interned by content. The first occurrence of a payload is
+ * copied and summarised, every later one costs a hash, a lookup and a
+ * compare against the copy, so a fleet where each hardware model shares
+ * its Boot#### payloads decodes each payload once.
+ */
+struct load_option_store {
+    struct entry {
+        u64 hash;
+        vec<byte_t> bytes;
+        load_option_summary summary;
+        // Times intern() has returned this entry
+        size_t count = 0;
+    };
+
+    // The entry for bytes, with its count bumped.
+    auto intern(lak::span<const byte_t> bytes) -> const entry&;
+
+    // In the order they were first seen.
+    [[nodiscard]]
+    auto entries() const -> const std::deque<entry>& {
+        return entries_;
+    }
+
+private:
+    // deque, so entries don't move as it grows
+    std::deque<entry> entries_;
+    std::unordered_multimap<u64, size_t> index_;
+};
+
+}
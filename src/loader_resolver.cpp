@@ -0,0 +1,363 @@
+#include "loader_resolver.h"
+#include "plan_changes.h"
+#include "thread_pool.h"
+#include "ucs2.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+
+#ifndef _WIN32
+# include "mapped_file.h"
+# include <dirent.h>
+# include <fcntl.h>
+# include <climits>
+# include <cstdlib>
+#endif
+
+namespace efibootmgrw {
+
+auto to_string(loader_file::status_t status) -> lak::astring_view {
+    switch (status) {
+        case loader_file::status_t::found:            return "found";
+        case loader_file::status_t::missing:          return "missing";
+        case loader_file::status_t::unreadable:       return "unreadable";
+        case loader_file::status_t::not_mounted:      return "not mounted";
+        case loader_file::status_t::table_unreadable: return "partition table unreadable";
+        case loader_file::status_t::no_file:          return "no file";
+    }
+
+    unreachable();
+    return { };
+}
+
+auto partition_mounts::key_of(const device_path::hard_drive& part) -> key {
+    key k { };
+    k.signature_type = part.signature_type;
+
+    if (part.signature_type == device_path::hard_drive::signature_mbr) {
+        std::memcpy(k.signature.data(), part.signature.data(), sizeof(u32));
+        k.number = part.partition_number;
+    } else {
+        k.signature = part.signature;
+    }
+
+    return k;
+}
+
+auto partition_mounts::mount_point(const device_path::hard_drive& part) const -> const std::string* {
+    if (part.signature_type == device_path::hard_drive::signature_none)
+        return nullptr;
+
+    auto it = mounts_.find(key_of(part));
+    return it != mounts_.end() ? &it->second : nullptr;
+}
+
+#ifndef _WIN32
+
+namespace {
+
+// mountinfo escapes space, tab, newline and backslash as \ and three octal digits.
+[[nodiscard]]
+auto unescape_mount_point(std::string_view field) -> std::string {
+    std::string out;
+
+    for (size_t i = 0; i < field.size(); ++i) {
+        if (field[i] == '\\' && field.size() - i > 3 && field[i + 1] >= '0' && field[i + 1] <= '3') {
+            out.push_back(static_cast<char>((field[i + 1] - '0') << 6 | (field[i + 2] - '0') << 3 | (field[i + 3] - '0')));
+            i += 3;
+        } else {
+            out.push_back(field[i]);
+        }
+    }
+
+    return out;
+}
+
+/*
+ * "major:minor" of each mounted device to where it's mounted, preferring a
+ * mount of the filesystem's root over bind mounts of a directory in it.
+ */
+[[nodiscard]]
+auto read_mountinfo(const std::string& path) -> std::unordered_map<std::string, std::string> {
+    std::unordered_map<std::string, std::string> mounts;
+    std::unordered_map<std::string, bool> whole;
+    std::string text;
+
+    read_text_file(lak::astring_view { path.data(), path.size() })
+        .if_ok([&](std::string& t) { text = std::move(t); });
+
+    std::string_view rest = text;
+
+    while (!rest.empty()) {
+        size_t eol = rest.find('\n');
+        std::string_view line = rest.substr(0, eol);
+        rest = eol == std::string_view::npos ? std::string_view { } : rest.substr(eol + 1);
+
+        // mount id, parent id, major:minor, root, mount point, ...
+        std::string_view fields[5];
+        size_t n = 0;
+
+        for (size_t pos = 0; n < std::size(fields) && pos < line.size();) {
+            size_t end = std::min(line.find(' ', pos), line.size());
+            fields[n++] = line.substr(pos, end - pos);
+            pos = end + 1;
+        }
+
+        if (n < std::size(fields))
+            continue;
+
+        std::string dev { fields[2] };
+        bool is_root = fields[3] == "/";
+
+        if (auto it = whole.find(dev); it == whole.end() || (is_root && !it->second)) {
+            mounts[dev] = unescape_mount_point(fields[4]);
+            whole[dev] = is_root;
+        }
+    }
+
+    return mounts;
+}
+
+[[nodiscard]]
+auto read_line(const std::string& path) -> lak::optional<std::string> {
+    vresult<std::string> text = read_text_file(lak::astring_view { path.data(), path.size() });
+
+    if (!text.is_ok())
+        return lak::nullopt;
+
+    std::string line = std::move(text.unsafe_unwrap());
+
+    while (!line.empty() && (line.back() == '\n' || line.back() == ' '))
+        line.pop_back();
+
+    return line;
+}
+
+// sysfs puts a partition's directory inside its disk's, e.g. .../block/sda/sda1.
+[[nodiscard]]
+auto parent_disk(const std::string& partition_dir) -> lak::optional<std::string> {
+    char resolved[PATH_MAX];
+
+    if (!::realpath(partition_dir.c_str(), resolved))
+        return lak::nullopt;
+
+    std::string_view path = resolved;
+    size_t last = path.rfind('/');
+
+    if (last == std::string_view::npos || last == 0)
+        return lak::nullopt;
+
+    std::string_view parent = path.substr(0, last);
+    return std::string(parent.substr(parent.rfind('/') + 1));
+}
+
+}
+
+auto partition_mounts::load(const mount_sources& sources) -> partition_mounts {
+    partition_mounts result;
+
+    std::unordered_map<std::string, std::string> mounted = read_mountinfo(sources.mountinfo);
+
+    if (mounted.empty())
+        return result;
+
+    DIR* dir = ::opendir(sources.sys_block.c_str());
+
+    if (!dir)
+        return result;
+
+    // Only disks with something mounted get their table read, each once.
+    partition_cache tables;
+
+    while (dirent* ent = ::readdir(dir)) {
+        std::string_view name = ent->d_name;
+
+        if (name == "." || name == "..")
+            continue;
+
+        std::string base = sources.sys_block + "/" + ent->d_name;
+
+        lak::optional<std::string> number = read_line(base + "/partition");
+        lak::optional<std::string> dev = read_line(base + "/dev");
+
+        if (!number || !dev)
+            continue;
+
+        auto mount = mounted.find(*dev);
+
+        if (mount == mounted.end())
+            continue;
+
+        lak::optional<std::string> disk = parent_disk(base);
+
+        if (!disk)
+            continue;
+
+        std::string disk_path = sources.dev + "/" + *disk;
+        const partition_table* found = nullptr;
+
+        tables.get(lak::astring_view { disk_path.data(), disk_path.size() })
+            .if_ok([&](const partition_table* t) { found = t; })
+            .if_err([&](const disk_err& err) {
+                if (!result.table_error_)
+                    result.table_error_ = err;
+            });
+
+        if (!found)
+            continue;
+
+        char* end = nullptr;
+        unsigned long n = std::strtoul(number->c_str(), &end, 10);
+
+        if (end == number->c_str() || *end != '\0')
+            continue;
+
+        if (const device_path::hard_drive* part = found->find(static_cast<u32>(n)))
+            result.mounts_.emplace(key_of(*part), mount->second);
+    }
+
+    ::closedir(dir);
+
+    return result;
+}
+
+#else
+
+auto partition_mounts::load(const mount_sources&) -> partition_mounts {
+    return { };
+}
+
+#endif
+
+namespace {
+
+// The partition and path of the first instance, if it names a file on a hard drive.
+struct file_target {
+    device_path::hard_drive part;
+    // UTF-8, with '\' as '/' and a leading '/'
+    std::string path;
+};
+
+[[nodiscard]]
+auto file_target_of(lak::span<const byte_t> file_path_list) -> lak::optional<file_target> {
+    lak::optional<device_path::hard_drive> part;
+    std::string path;
+    std::u16string chars;
+
+    for (const device_path_node& node : device_path_nodes { file_path_list }) {
+        if (node.is_end())
+            break;
+
+        if (node.type == device_path::hard_drive::type && node.subtype == device_path::hard_drive::subtype
+            && node.payload.size() >= device_path::hard_drive::min_size) {
+            part = device_path::hard_drive::decode(node.payload);
+        } else if (node.type == device_path::file_path::type && node.subtype == device_path::file_path::subtype) {
+            device_path::file_path file = device_path::file_path::decode(node.payload);
+
+            chars.clear();
+            for (size_t i = 0; i < file.length(); ++i)
+                chars.push_back(file[i]);
+
+            // Consecutive File() nodes are one path, split wherever the firmware liked.
+            if (!path.empty() && path.back() != '\\' && !chars.empty() && chars.front() != u'\\')
+                path.push_back('\\');
+
+            append_u8string(path, lak::u16string_view { chars.data(), chars.size() });
+        }
+    }
+
+    if (!part || path.empty())
+        return lak::nullopt;
+
+    std::replace(path.begin(), path.end(), '\\', '/');
+
+    if (path.front() != '/')
+        path.insert(path.begin(), '/');
+
+    return file_target { *part, std::move(path) };
+}
+
+// Stats and hashes path, through a mapping so it's read straight from the page cache.
+void hash_file(loader_file& out) {
+#ifndef _WIN32
+    vresult<mapped_file> file = mapped_file::open_at(AT_FDCWD, out.path.c_str());
+
+    if (!file.is_ok()) {
+        const var_err& err = file.unsafe_unwrap_err();
+        out.status = err.kind == var_err::kind_t::not_found ? loader_file::status_t::missing : loader_file::status_t::unreadable;
+        out.code = err.kind == var_err::kind_t::not_found ? 0 : err.code;
+        return;
+    }
+
+    lak::span<const byte_t> bytes = file.unsafe_unwrap().bytes();
+
+    out.status = loader_file::status_t::found;
+    out.size = bytes.size();
+    out.digest = sha256::of(bytes);
+#else
+    out.status = loader_file::status_t::unreadable;
+#endif
+}
+
+}
+
+auto resolve_loaders(const partition_mounts& mounts, lak::span<const lak::span<const byte_t>> file_path_lists, size_t jobs)
+-> vec<loader_file> {
+    vec<loader_file> result(file_path_lists.size());
+
+    // Entries pointing at the same file share its result.
+    vec<loader_file> distinct;
+    std::unordered_map<std::string, size_t> index;
+    vec<size_t> which(file_path_lists.size(), SIZE_MAX);
+
+    for (size_t i = 0; i < file_path_lists.size(); ++i) {
+        lak::optional<file_target> target = file_target_of(file_path_lists[i]);
+
+        if (!target)
+            continue;
+
+        const std::string* mount = mounts.mount_point(target->part);
+
+        if (!mount) {
+            // It may well be on the disk we couldn't read, so don't claim it isn't mounted.
+            if (mounts.table_error()) {
+                result[i].status = loader_file::status_t::table_unreadable;
+                result[i].table_error = *mounts.table_error();
+            } else {
+                result[i].status = loader_file::status_t::not_mounted;
+            }
+
+            result[i].path = std::move(target->path);
+            continue;
+        }
+
+        std::string path = *mount == "/" ? target->path : *mount + target->path;
+
+        auto [it, inserted] = index.emplace(path, distinct.size());
+
+        if (inserted)
+            distinct.emplace_back().path = std::move(path);
+
+        which[i] = it->second;
+    }
+
+    {
+        size_t workers = std::min(jobs, distinct.size());
+        thread_pool pool { workers > 1 ? workers : 0 };
+
+        pool.for_each_index(distinct.size(), [&](size_t i) {
+            hash_file(distinct[i]);
+        });
+    }
+
+    for (size_t i = 0; i < result.size(); ++i) {
+        if (which[i] != SIZE_MAX)
+            result[i] = distinct[which[i]];
+    }
+
+    return result;
+}
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "efi_device_path.h"
+#include "efivar_backend.h"
+#include "partition_table.h"
+#include "sha256.h"
+
+#include <map>
+#include <string>
+
+namespace efibootmgrw {
+
+// Where to look, overridable so a captured system can be inspected.
+struct mount_sources {
+    std::string sys_block = "/sys/class/block";
+    std::string mountinfo = "/proc/self/mountinfo";
+    std::string dev = "/dev";
+};
+
+/*
+ * Mount points of this machine's mounted partitions, keyed by what an HD()
+ * node names them by: the GPT partition GUID, or the MBR disk signature and
+ * partition number. Built once from mountinfo, sysfs and the partition
+ * table of each disk with a mounted partition.
+ */
+struct partition_mounts {
+    [[nodiscard]]
+    static auto load(const mount_sources& sources = { }) -> partition_mounts;
+
+    // Null if the partition isn't mounted here.
+    [[nodiscard]]
+    auto mount_point(const device_path::hard_drive& part) const -> const std::string*;
+
+    [[nodiscard]]
+    auto size() const -> size_t {
+        return mounts_.size();
+    }
+
+    // Why the table of a disk with a mounted partition couldn't be read,
+    // e.g. EACCES when not root. Its partitions are missing from the map.
+    [[nodiscard]]
+    auto table_error() const -> const lak::optional<disk_err>& {
+        return table_error_;
+    }
+
+private:
+    struct key {
+        lak::array<u8, 16> signature;
+        // 0 for GPT, whose GUIDs are unique by themselves
+        u32 number;
+        u8 signature_type;
+
+        auto operator<=>(const key&) const = default;
+    };
+
+    [[nodiscard]]
+    static auto key_of(const device_path::hard_drive& part) -> key;
+
+    std::map<key, std::string> mounts_;
+    lak::optional<disk_err> table_error_;
+};
+
+struct loader_file {
+    enum class status_t : u8 {
+        found,
+        // The partition is mounted but the file isn't on it
+        missing,
+        // Can't be opened or mapped, see code
+        unreadable,
+        // No partition on this machine has the HD() node's signature mounted
+        not_mounted,
+        // Not found, but a mounted partition's disk couldn't be read, see table_error
+        table_unreadable,
+        // Not an HD()/File() path, e.g. network boot or a removable device's default
+        no_file,
+    };
+
+    status_t status = status_t::no_file;
+    // Under the mount point, with '\' as '/'
+    std::string path;
+    u64 size = 0;
+    sha256_digest digest { };
+    // errno when unreadable
+    i64 code = 0;
+    disk_err table_error { disk_err::kind_t::io };
+};
+
+[[nodiscard]]
+auto to_string(loader_file::status_t status) -> lak::astring_view;
+
+/*
+ * The loader each file path list points at, in the same order. Every
+ * distinct file is mapped and hashed once, by up to `jobs` threads.
+ */
+[[nodiscard]]
+auto resolve_loaders(const partition_mounts& mounts, lak::span<const lak::span<const byte_t>> file_path_lists, size_t jobs)
+-> vec<loader_file>;
+
+}
@@ -1,161 +1,297 @@
-#include <utility>
-
-#include "fmt/ranges.h"
-#include "fmt/xchar.h"
-#include "fmt/color.h"
-
-#include "efibootmgrw.h"
-#include "native_methods.h"
-#include "efi_load_option.h"
-#include "cmdline.h"
-#include "reinterpret_visitor.h"
-
-namespace efibootmgrw {
-
-auto read_entry(u16 id, efi_load_option& opt) {
-    auto var = fmt::format(L"Boot{:0>4LX}", id);
-
-    auto v = winapi::get_firmware_env_var(
-            var,
-            winapi::efi_global_variable,
-            opt.as_bytes()
-    );
-
-    return v;
-}
-
-auto default_print(Context& ctx) -> winapi::wresult<lak::monostate> {
-    auto get_u16 = [&](lak::wstring_view var) -> winapi::wresult<u16> {
-        u16 out;
-
-        winapi::wresult<lak::span<void>> res = winapi::get_firmware_env_var(
-                var,
-                winapi::efi_global_variable,
-                { &out, sizeof(u16) }
-        );
-
-        // The buffer value is insignificant.
-        return res.map([&](auto) { return out; });
-    };
-
-    winapi::wresult<u16> boot_next    = get_u16(L"BootNext");
-    winapi::wresult<u16> timeout      = get_u16(L"Timeout");
-    winapi::wresult<u16> boot_current = get_u16(L"BootCurrent");
-
-    lak::array<byte_t, 8192> buf;
-    winapi::wresult<lak::span<void>> boot_order = winapi::get_firmware_env_var(
-            L"BootOrder",
-            winapi::efi_global_variable,
-            lak::span<byte_t> { buf }
-    );
-
-    boot_next.if_ok([&](u16 next) {
-        fmt::print("BootNext: {:0>4LX}\n", next);
-    });
-
-    boot_current.if_ok([&](u16 current) {
-        fmt::print("BootCurrent: {:0>4LX}\n", current);
-    });
-
-    timeout.if_ok([&](u16 timeout) {
-        fmt::print("Timeout: {} seconds\n", timeout);
-    });
-
-    return boot_order.map([&](lak::span<void> res) {
-        lak::span<u16> ids { res };
-
-        for (u16 id : ids) {
-            efi_load_option opt;
-
-            read_entry(id, opt).if_ok([&](lak::span<void>) {
-                fmt::print(L"Boot{:0>4LX}: {}\n", id, opt.desc());
-            }).if_err([&](winapi::win_err err) {
-                fmt::print(
-                    stderr,
-                    fmt::emphasis::bold | fg(fmt::color::crimson),
-                    L"Unable to read Boot{:0>4LX}: {}!",
-                    id,
-                    lak::wstring_view { err.wstring() }
-                );
-            });
-        }
-
-        return lak::monostate { };
-    });
-}
-
-template<typename F, typename... Args>
-auto partial(F&& f, Args&& ... args) {
-    return [=]<typename... Rest>(Rest&& ... rest) mutable {
-        return f(
-                std::forward<Args&&>(args)...,
-                std::forward<Rest&&>(rest)...
-        );
-    };
-}
-
-auto res_main(int argc, const char** argv_ptr) -> lak::result<lak::monostate> {
-    lak::span argv { argv_ptr, static_cast<size_t>(argc) };
-
-    Context ctx;
-
-    parse_args(ctx, argv);
-
-    auto fatal_w = partial(Fatal<Context>::from_wstr, ctx);
-
-    winapi::open_current_process_token(winapi::token_adjust_privileges | winapi::token_query)
-            .and_then(partial(winapi::authenticate, ctx))
-            .map_err(winapi::win_err::to_wstring)
-            .if_err(fatal_w);
-
-    if (ctx.cmdline_args.size() == 1) {
-        default_print(ctx)
-            .map_err(winapi::win_err::to_wstring)
-            .if_err(fatal_w);
-    }
-
-    // Test of copying Boot0002 to Boot0001
-    if (ctx.cmdline_args[1] == "aaa") {
-        caching_efi_load_option e;
-
-        auto v = winapi::get_firmware_env_var(
-                L"Boot0002",
-                winapi::efi_global_variable,
-                e.bytes()
-        );
-
-        v.if_ok([&](auto) {
-             fmt::print(L"Boot0002: {}\n", e.desc(ctx).data());
-             fmt::print("Writing to EFI Boot0001\n");
-         })
-         .and_then([&](lak::span<void> buf) {
-             return winapi::set_firmware_env_var(
-                     L"Boot0001",
-                     winapi::efi_global_variable,
-                     buf
-             );
-         })
-         // re-read it
-         .and_then([&](auto) {
-             e.clear();
-             return winapi::get_firmware_env_var(
-                     L"Boot0001",
-                     winapi::efi_global_variable,
-                     e.bytes()
-             );
-         })
-         .if_ok([&](auto) {
-             fmt::print(L"Boot0001: {}\n", e.desc(ctx).data());
-         })
-         .map_err(winapi::win_err::to_wstring)
-         .if_err(fatal_w);
-    }
-
-    return lak::ok_t { };
-}
-}
-
-int main(int argc, const char** argv) {
-    return efibootmgrw::res_main(argc, argv).is_ok() ? EXIT_SUCCESS : EXIT_FAILURE;
-}
-
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "fmt/ranges.h"
+#include "fmt/xchar.h"
+#include "fmt/color.h"
+
+#include "efibootmgrw.h"
+#include "efivar_backend.h"
+#include "boot_snapshot.h"
+#include "efi_load_option.h"
+#include "device_path_text.h"
+#include "dump_analysis.h"
+#include "fleet_index.h"
+#include "listing.h"
+#include "load_option_name.h"
+#include "transaction.h"
+#include "plan_changes.h"
+#include "batch.h"
+#include "sim_backend.h"
+#include "cache_backend.h"
+#include "stats.h"
+#include "watch.h"
+#include "cmdline.h"
+#include "ucs2.h"
+
+#ifdef _WIN32
+# include "native_methods.h"
+#endif
+
+namespace efibootmgrw {
+
+void print_stats(Context& ctx, const transaction_stats& stats) {
+    if (ctx.args.verbose) {
+        fmt::print(
+                "{} written, {} deleted, {} already up to date\n",
+                stats.written,
+                stats.deleted,
+                stats.skipped
+        );
+    }
+}
+
+// Removed however the run ends, even through Fatal, which exits without
+// unwinding the stack but still runs static destructors.
+struct simulated_journal_file {
+    std::string path;
+
+    ~simulated_journal_file() {
+        discard();
+    }
+
+    void discard() {
+        if (!path.empty())
+            std::remove(path.c_str());
+
+        path.clear();
+    }
+};
+
+template<typename F, typename... Args>
+auto partial(F&& f, Args&& ... args) {
+    return [=]<typename... Rest>(Rest&& ... rest) mutable {
+        return f(
+                std::forward<Args&&>(args)...,
+                std::forward<Rest&&>(rest)...
+        );
+    };
+}
+
+auto res_main(int argc, const char** argv_ptr) -> lak::result<lak::monostate> {
+    lak::span argv { argv_ptr, static_cast<size_t>(argc) };
+
+#ifdef _WIN32
+    // We print labels as UTF-8.
+    winapi::set_console_output_utf8();
+#endif
+
+    Context ctx;
+
+    parse_args(ctx, argv);
+
+    auto fatal_w = partial(Fatal<Context>::from_wstr, ctx);
+
+    // Offline, doesn't touch this machine's variables at all.
+    if (ctx.args.analyze_dir && !ctx.args.queries.empty()) {
+        vec<fleet_query> queries;
+
+        for (lak::astring_view q : ctx.args.queries) {
+            parse_fleet_query(std::string_view { q.data(), q.size() })
+                .if_ok([&](fleet_query& query) { queries.push_back(std::move(query)); })
+                .if_err([&](const fleet_query_parse_err& err) {
+                    Fatal(ctx, "--query {}: {} at column {}\n", q, err.what, err.offset + 1);
+                });
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        fleet_index index;
+
+        build_fleet_index(*ctx.args.analyze_dir, ctx.args.jobs)
+            .if_ok([&](fleet_index& i) { index = std::move(i); })
+            .map_err(var_err::to_wstring)
+            .if_err(fatal_w);
+
+        if (ctx.args.verbose) {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            fmt::print(stderr, "indexed {} hosts ({} unreadable) in {}us\n", index.hosts.size(), index.unreadable_hosts, us.count());
+        }
+
+        for (size_t i = 0; i < queries.size(); ++i) {
+            start = std::chrono::steady_clock::now();
+            vec<u32> hosts = run_fleet_query(index, queries[i]);
+
+            if (ctx.args.verbose) {
+                auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                fmt::print(stderr, "{}: {} hosts in {}us\n", ctx.args.queries[i], hosts.size(), us.count());
+            }
+
+            // Headed by the query when there are several, as a comment.
+            if (queries.size() > 1)
+                fmt::print("# {} ({} hosts)\n", ctx.args.queries[i], hosts.size());
+
+            for (u32 host : hosts)
+                fmt::print("{}\n", index.hosts[host]);
+        }
+
+        return lak::ok_t { };
+    }
+
+    if (ctx.args.analyze_dir) {
+        lak::optional<golden_host> golden;
+
+        if (ctx.args.golden_dir) {
+            load_golden_host(*ctx.args.golden_dir)
+                .if_ok([&](golden_host& g) { golden = std::move(g); })
+                .map_err(var_err::to_wstring)
+                .if_err(fatal_w);
+        }
+
+        analyze_dumps(*ctx.args.analyze_dir, ctx.args.jobs, golden ? &*golden : nullptr)
+            .if_ok([](const dump_analysis& a) { print_dump_analysis(a); })
+            .map_err(var_err::to_wstring)
+            .if_err(fatal_w);
+
+        return lak::ok_t { };
+    }
+
+    run_stats run;
+
+    if (ctx.args.stats || ctx.args.stats_textfile)
+        active_stats = &run;
+
+    std::unique_ptr<efivar_backend> vars = make_default_backend(ctx);
+
+    {
+        stat_timer timer { stat_kind::authenticate };
+
+        vars->authenticate(ctx)
+                .map_err(var_err::to_wstring)
+                .if_err(fatal_w);
+    }
+
+    lak::astring_view journal = ctx.args.journal ? *ctx.args.journal : default_journal_path();
+
+    // The in-memory copy gets a journal of its own, a real one is only
+    // ever recovered from or left behind by a real run.
+    static simulated_journal_file sim_journal;
+
+    if (ctx.args.simulate) {
+        simulated_journal(journal)
+            .if_ok([&](std::string& path) { sim_journal.path = std::move(path); })
+            .map_err(var_err::to_wstring)
+            .if_err(fatal_w);
+
+        journal = lak::astring_view { sim_journal.path.data(), sim_journal.path.size() };
+    }
+
+    if (ctx.args.rollback || ctx.args.resume) {
+        (ctx.args.rollback ? rollback_journal : resume_journal)(*vars, journal)
+            .if_ok([&](const transaction_stats& stats) { print_stats(ctx, stats); })
+            .map_err(var_err::to_wstring)
+            .if_err(fatal_w);
+    }
+
+    vresult<transaction> tx = [&] {
+        stat_timer timer { stat_kind::plan };
+
+        if (ctx.args.batch_file)
+            return plan_batch(ctx, *vars);
+
+        partition_cache disks;
+        return plan_changes(ctx, *vars, disks);
+    }();
+
+    if (!tx.is_ok())
+        fatal_w(tx.unsafe_unwrap_err().wstring());
+
+    if (!tx.unsafe_unwrap().empty()) {
+        if (journal_exists(journal)) {
+            Fatal(ctx, "{} is left over from an interrupted run, use --rollback or --resume first\n", journal);
+        }
+
+        stat_timer timer { stat_kind::commit };
+
+        tx.unsafe_unwrap().commit(*vars, journal)
+            .if_ok([&](const transaction_stats& stats) { print_stats(ctx, stats); })
+            .if_err([&](const var_err& err) {
+                // A simulated journal goes with the in-memory copy it describes.
+                if (!ctx.args.simulate && journal_exists(journal)) {
+                    Fatal(ctx, "{}, changes are journaled in {}\n", to_u8string(err.wstring()), journal);
+                }
+
+                fatal_w(err.wstring());
+            });
+    }
+
+    // Done with, and --watch may well end with a signal.
+    sim_journal.discard();
+
+    if (ctx.args.watch) {
+        watch(ctx, *vars)
+            .map_err(var_err::to_wstring)
+            .if_err(fatal_w);
+    } else {
+        stat_timer timer { stat_kind::output };
+
+        if (ctx.args.json || ctx.args.ndjson) {
+            json_print(ctx, *vars);
+        } else if (ctx.args.all) {
+            inventory_print(ctx, *vars)
+                .map_err(var_err::to_wstring)
+                .if_err(fatal_w);
+        } else if (!ctx.args.quiet) {
+            default_print(ctx, *vars)
+                .map_err(var_err::to_wstring)
+                .if_err(fatal_w);
+        }
+    }
+
+    if (auto* cache = dynamic_cast<cache_backend*>(vars.get())) {
+        // Only costs the next run its head start, not worth failing over.
+        if (auto res = cache->save(); !res.is_ok())
+            fmt::print(stderr, "unable to save the cache: {}\n", to_u8string(res.unsafe_unwrap_err().wstring()));
+
+        if (ctx.args.verbose) {
+            cache_stats stats = cache->stats();
+            fmt::print(stderr, "cache: {} hits, {} misses\n", stats.hits, stats.misses);
+        }
+    }
+
+    if (ctx.args.verbose) {
+        if (const auto* sim = dynamic_cast<const sim_backend*>(vars.get())) {
+            sim_stats stats = sim->stats();
+
+            fmt::print(
+                    stderr,
+                    "simulator: {} reads, {} writes, {} removes, {} bytes written, {} faults, {} of {} bytes used\n",
+                    stats.reads,
+                    stats.writes,
+                    stats.removes,
+                    stats.bytes_written,
+                    stats.faults_injected,
+                    sim->bytes_used(),
+                    ctx.args.sim_capacity ? *ctx.args.sim_capacity : sim_config { }.capacity
+            );
+        }
+    }
+
+    active_stats = nullptr;
+
+    if (ctx.args.stats) {
+        if (ctx.args.json || ctx.args.ndjson) {
+            fmt::memory_buffer out;
+            write_run_stats_json(out, run);
+            std::fwrite(out.data(), 1, out.size(), stderr);
+        } else {
+            print_run_stats(stderr, run);
+        }
+    }
+
+    if (ctx.args.stats_textfile) {
+        // A missed scrape isn't worth failing a run that's already made its changes.
+        if (auto res = write_prometheus_textfile(*ctx.args.stats_textfile, run); !res.is_ok())
+            fmt::print(stderr, "unable to write {}: {}\n", *ctx.args.stats_textfile, to_u8string(res.unsafe_unwrap_err().wstring()));
+    }
+
+    return lak::ok_t { };
+}
+}
+
+int main(int argc, const char** argv) {
+    return efibootmgrw::res_main(argc, argv).is_ok() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
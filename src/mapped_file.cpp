@@ -0,0 +1,65 @@
+#ifndef _WIN32
+
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace efibootmgrw {
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+        : data_ { std::exchange(other.data_, nullptr) }, size_ { std::exchange(other.size_, 0) } {}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+}
+
+mapped_file::~mapped_file() {
+    if (data_) ::munmap(data_, size_);
+}
+
+auto mapped_file::open_at(int dir_fd, const char* name) -> vresult<mapped_file> {
+    int fd = ::openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return lak::err_t { var_err::from_errno(errno) };
+
+    struct stat st { };
+    mapped_file file;
+
+    if (::fstat(fd, &st) < 0) {
+        int code = errno;
+        ::close(fd);
+        return lak::err_t { var_err::from_errno(code) };
+    }
+
+    // mmap refuses empty mappings, and there's nothing to read anyway.
+    if (st.st_size > 0) {
+        void* data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED) {
+            int code = errno;
+            ::close(fd);
+            return lak::err_t { var_err::from_errno(code) };
+        }
+
+        file.data_ = data;
+        file.size_ = static_cast<size_t>(st.st_size);
+    }
+
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+
+    return lak::ok_t { std::move(file) };
+}
+
+}
+
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+namespace efibootmgrw {
+
+// A whole file mapped read-only, unmapped again on destruction.
+struct mapped_file {
+    mapped_file() = default;
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+
+    ~mapped_file();
+
+    // name is relative to the directory dir_fd.
+    [[nodiscard]]
+    static auto open_at(int dir_fd, const char* name) -> vresult<mapped_file>;
+
+    [[nodiscard]]
+    auto bytes() const -> lak::span<const byte_t> {
+        return lak::span<const byte_t> { static_cast<const byte_t*>(data_), size_ };
+    }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+}
@@ -0,0 +1,479 @@
+#include "partition_table.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/stat.h>
+# ifdef __linux__
+#  include <sys/ioctl.h>
+#  include <linux/fs.h>
+# endif
+#endif
+
+namespace efibootmgrw {
+
+auto disk_err::string() const -> std::string {
+    if (code != 0)
+        return std::strerror(static_cast<int>(code));
+
+    switch (kind) {
+        case kind_t::io:                 return "I/O error";
+        case kind_t::no_partition_table: return "No GPT or MBR partition table";
+        case kind_t::corrupt_gpt:        return "Both GPT headers are corrupt";
+        case kind_t::no_such_partition:  return "No such partition";
+        case kind_t::unsupported:        return "Reading partition tables isn't supported here";
+    }
+
+    unreachable();
+    return { };
+}
+
+namespace {
+
+constexpr auto crc32_table = [] {
+    std::array<u32, 256> table { };
+
+    for (u32 i = 0; i < 256; ++i) {
+        u32 c = i;
+        for (int k = 0; k < 8; ++k)
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+
+    return table;
+}();
+
+}
+
+auto crc32(lak::span<const byte_t> bytes) -> u32 {
+    u32 c = 0xFFFFFFFFu;
+
+    for (byte_t b : bytes)
+        c = crc32_table[(c ^ static_cast<u8>(b)) & 0xFF] ^ (c >> 8);
+
+    return c ^ 0xFFFFFFFFu;
+}
+
+auto partition_table::find(u32 number) const -> const device_path::hard_drive* {
+    auto it = std::lower_bound(partitions.begin(), partitions.end(), number, [](const device_path::hard_drive& p, u32 n) {
+        return p.partition_number < n;
+    });
+
+    return it != partitions.end() && it->partition_number == number ? &*it : nullptr;
+}
+
+auto hard_drive_file_path(const device_path::hard_drive& part, lak::astring_view loader) -> vec<byte_t> {
+    std::string path { loader.begin(), loader.end() };
+    std::replace(path.begin(), path.end(), '/', '\\');
+
+    device_path_writer w;
+
+    w.begin_node(device_path::hard_drive::type, device_path::hard_drive::subtype);
+    w.put(part.partition_number);
+    w.put(part.partition_start);
+    w.put(part.partition_size);
+    w.put(part.signature);
+    w.put(part.format);
+    w.put(part.signature_type);
+    w.end_node();
+
+    w.begin_node(device_path::file_path::type, device_path::file_path::subtype);
+    w.put_string(lak::astring_view { path.data(), path.size() });
+    w.end_node();
+
+    w.end_entire();
+
+    return std::move(w.bytes);
+}
+
+#ifndef _WIN32
+
+namespace {
+
+// GPT header, UEFI spec 5.3.2, all little endian.
+namespace gpt {
+    constexpr char signature[8] = { 'E', 'F', 'I', ' ', 'P', 'A', 'R', 'T' };
+    constexpr size_t header_size_offset = 12;
+    constexpr size_t header_crc_offset = 16;
+    constexpr size_t my_lba_offset = 24;
+    constexpr size_t entries_lba_offset = 72;
+    constexpr size_t entry_count_offset = 80;
+    constexpr size_t entry_size_offset = 84;
+    constexpr size_t entries_crc_offset = 88;
+    constexpr size_t min_header_size = 92;
+
+    // More than any real GPT has, so a corrupt count can't have us read the disk.
+    constexpr size_t max_entries_bytes = 1 << 20;
+}
+
+// MBR, and each EBR in an extended partition's chain.
+namespace mbr {
+    constexpr size_t disk_signature_offset = 440;
+    constexpr size_t entries_offset = 446;
+    constexpr size_t entry_size = 16;
+    constexpr size_t boot_signature_offset = 510;
+
+    constexpr u8 type_protective = 0xEE;
+
+    [[nodiscard]]
+    constexpr auto is_extended(u8 type) -> bool {
+        return type == 0x05 || type == 0x0F || type == 0x85;
+    }
+
+    // Logical partitions past this are a loop in the chain, not a disk.
+    constexpr size_t max_logical = 128;
+}
+
+template<typename T>
+[[nodiscard]]
+auto read_le(const vec<byte_t>& bytes, size_t offset) -> T {
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+struct disk_reader {
+    int fd;
+    u64 size;
+    u32 sector_size;
+
+    [[nodiscard]]
+    auto read(u64 lba, size_t bytes, vec<byte_t>& out) const -> dresult<lak::monostate> {
+        out.resize(bytes);
+
+        // lba comes off the disk, so lba * sector_size may well not fit.
+        if (lba > size / sector_size)
+            return lak::err_t { disk_err { disk_err::kind_t::io } };
+
+        u64 offset = lba * sector_size;
+
+        if (offset > size || bytes > size - offset)
+            return lak::err_t { disk_err { disk_err::kind_t::io } };
+
+        for (size_t done = 0; done < bytes;) {
+            ssize_t n = ::pread(fd, out.data() + done, bytes - done, static_cast<off_t>(offset + done));
+
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            if (n < 0)
+                return lak::err_t { disk_err { disk_err::kind_t::io, errno } };
+
+            if (n == 0)
+                return lak::err_t { disk_err { disk_err::kind_t::io } };
+
+            done += static_cast<size_t>(n);
+        }
+
+        return lak::ok_t { };
+    }
+
+    [[nodiscard]]
+    auto last_lba() const -> u64 {
+        return size / sector_size - 1;
+    }
+};
+
+// The header at lba and its entries, if both check out.
+[[nodiscard]]
+auto read_gpt_at(const disk_reader& disk, u64 lba) -> lak::optional<partition_table> {
+    vec<byte_t> header;
+
+    if (!disk.read(lba, disk.sector_size, header).is_ok())
+        return lak::nullopt;
+
+    if (std::memcmp(header.data(), gpt::signature, sizeof(gpt::signature)) != 0)
+        return lak::nullopt;
+
+    auto header_size = read_le<u32>(header, gpt::header_size_offset);
+
+    if (header_size < gpt::min_header_size || header_size > disk.sector_size)
+        return lak::nullopt;
+
+    u32 header_crc = read_le<u32>(header, gpt::header_crc_offset);
+    std::memset(header.data() + gpt::header_crc_offset, 0, sizeof(u32));
+
+    if (crc32(lak::span<const byte_t> { header.data(), header_size }) != header_crc)
+        return lak::nullopt;
+
+    if (read_le<u64>(header, gpt::my_lba_offset) != lba)
+        return lak::nullopt;
+
+    auto entries_lba = read_le<u64>(header, gpt::entries_lba_offset);
+    auto entry_count = read_le<u32>(header, gpt::entry_count_offset);
+    auto entry_size = read_le<u32>(header, gpt::entry_size_offset);
+    auto entries_crc = read_le<u32>(header, gpt::entries_crc_offset);
+
+    if (entry_size < 128 || entry_size % 8 != 0 || size_t(entry_count) * entry_size > gpt::max_entries_bytes)
+        return lak::nullopt;
+
+    vec<byte_t> entries;
+
+    if (!disk.read(entries_lba, size_t(entry_count) * entry_size, entries).is_ok())
+        return lak::nullopt;
+
+    if (crc32(lak::span<const byte_t> { entries.data(), entries.size() }) != entries_crc)
+        return lak::nullopt;
+
+    partition_table table;
+    table.format = device_path::hard_drive::format_gpt;
+    table.sector_size = disk.sector_size;
+
+    for (u32 i = 0; i < entry_count; ++i) {
+        const byte_t* e = entries.data() + size_t(i) * entry_size;
+
+        // An all zero type GUID is an unused entry.
+        if (std::all_of(e, e + efi_guid::size, [](byte_t b) { return b == byte_t { 0 }; }))
+            continue;
+
+        u64 first, last;
+        std::memcpy(&first, e + 32, sizeof(u64));
+        std::memcpy(&last, e + 40, sizeof(u64));
+
+        if (last < first)
+            continue;
+
+        device_path::hard_drive part { };
+        part.partition_number = i + 1;
+        part.partition_start = first;
+        part.partition_size = last - first + 1;
+        // The partition's unique GUID, stored the same way on disk as in the node
+        std::memcpy(part.signature.data(), e + 16, efi_guid::size);
+        part.format = device_path::hard_drive::format_gpt;
+        part.signature_type = device_path::hard_drive::signature_guid;
+
+        table.partitions.push_back(part);
+    }
+
+    return table;
+}
+
+[[nodiscard]]
+auto mbr_partition(u32 number, u64 start, u64 size, u32 disk_signature) -> device_path::hard_drive {
+    device_path::hard_drive part { };
+    part.partition_number = number;
+    part.partition_start = start;
+    part.partition_size = size;
+    std::memcpy(part.signature.data(), &disk_signature, sizeof(u32));
+    part.format = device_path::hard_drive::format_mbr;
+    part.signature_type = device_path::hard_drive::signature_mbr;
+    return part;
+}
+
+// Primaries are 1 to 4 by slot, logicals 5 onwards in chain order.
+[[nodiscard]]
+auto read_mbr(const disk_reader& disk, const vec<byte_t>& sector0) -> partition_table {
+    partition_table table;
+    table.format = device_path::hard_drive::format_mbr;
+    table.sector_size = disk.sector_size;
+
+    auto disk_signature = read_le<u32>(sector0, mbr::disk_signature_offset);
+    lak::optional<u64> extended;
+
+    for (u32 i = 0; i < 4; ++i) {
+        size_t e = mbr::entries_offset + i * mbr::entry_size;
+        auto type = static_cast<u8>(sector0[e + 4]);
+        auto start = read_le<u32>(sector0, e + 8);
+        auto size = read_le<u32>(sector0, e + 12);
+
+        if (type == 0 || size == 0)
+            continue;
+
+        if (mbr::is_extended(type)) {
+            if (!extended)
+                extended = start;
+            continue;
+        }
+
+        table.partitions.push_back(mbr_partition(i + 1, start, size, disk_signature));
+    }
+
+    if (extended) {
+        vec<byte_t> ebr;
+        vec<u64> visited;
+        u64 ebr_lba = *extended;
+
+        for (u32 number = 5; number < 5 + mbr::max_logical; ++number) {
+            // A chain that loops back on itself ends where it starts repeating.
+            if (std::find(visited.begin(), visited.end(), ebr_lba) != visited.end())
+                break;
+
+            visited.push_back(ebr_lba);
+
+            if (!disk.read(ebr_lba, 512, ebr).is_ok())
+                break;
+
+            if (ebr[mbr::boot_signature_offset] != byte_t { 0x55 } || ebr[mbr::boot_signature_offset + 1] != byte_t { 0xAA })
+                break;
+
+            size_t e = mbr::entries_offset;
+            auto start = read_le<u32>(ebr, e + 8);
+            auto size = read_le<u32>(ebr, e + 12);
+
+            if (static_cast<u8>(ebr[e + 4]) != 0 && size != 0)
+                table.partitions.push_back(mbr_partition(number, ebr_lba + start, size, disk_signature));
+
+            // The next EBR, relative to the start of the extended partition.
+            e += mbr::entry_size;
+            auto next = read_le<u32>(ebr, e + 8);
+
+            if (!mbr::is_extended(static_cast<u8>(ebr[e + 4])) || next == 0)
+                break;
+
+            ebr_lba = *extended + next;
+        }
+    }
+
+    std::sort(table.partitions.begin(), table.partitions.end(), [](const auto& a, const auto& b) {
+        return a.partition_number < b.partition_number;
+    });
+
+    return table;
+}
+
+[[nodiscard]]
+auto read_table(const disk_reader& disk, bool force_gpt) -> dresult<partition_table> {
+    vec<byte_t> sector0;
+
+    if (auto res = disk.read(0, 512, sector0); !res.is_ok())
+        return lak::err_t { res.unsafe_unwrap_err() };
+
+    bool has_mbr = sector0[mbr::boot_signature_offset] == byte_t { 0x55 }
+                   && sector0[mbr::boot_signature_offset + 1] == byte_t { 0xAA };
+
+    bool protective = false;
+
+    for (size_t i = 0; i < 4 && has_mbr; ++i)
+        protective |= static_cast<u8>(sector0[mbr::entries_offset + i * mbr::entry_size + 4]) == mbr::type_protective;
+
+    if (protective || force_gpt) {
+        if (lak::optional<partition_table> table = read_gpt_at(disk, 1))
+            return lak::ok_t { std::move(*table) };
+
+        if (lak::optional<partition_table> table = read_gpt_at(disk, disk.last_lba()))
+            return lak::ok_t { std::move(*table) };
+
+        if (protective)
+            return lak::err_t { disk_err { disk_err::kind_t::corrupt_gpt } };
+    }
+
+    if (has_mbr)
+        return lak::ok_t { read_mbr(disk, sector0) };
+
+    return lak::err_t { disk_err { disk_err::kind_t::no_partition_table } };
+}
+
+// For a file, whichever of 512 and 4096 byte sectors finds a GPT header.
+[[nodiscard]]
+auto guess_sector_size(int fd) -> u32 {
+    for (u32 size : { 512u, 4096u }) {
+        char sig[sizeof(gpt::signature)];
+
+        if (::pread(fd, sig, sizeof(sig), size) == sizeof(sig) && std::memcmp(sig, gpt::signature, sizeof(sig)) == 0)
+            return size;
+    }
+
+    return 512;
+}
+
+[[nodiscard]]
+auto read_table_fd(int fd, const struct stat& st, bool force_gpt) -> dresult<partition_table> {
+    disk_reader disk { fd, static_cast<u64>(st.st_size), 512 };
+
+    if (S_ISBLK(st.st_mode)) {
+#ifdef __linux__
+        int sector_size = 0;
+        u64 size = 0;
+
+        if (::ioctl(fd, BLKSSZGET, &sector_size) != 0 || ::ioctl(fd, BLKGETSIZE64, &size) != 0)
+            return lak::err_t { disk_err { disk_err::kind_t::io, errno } };
+
+        disk.sector_size = static_cast<u32>(sector_size);
+        disk.size = size;
+#else
+        off_t end = ::lseek(fd, 0, SEEK_END);
+
+        if (end < 0)
+            return lak::err_t { disk_err { disk_err::kind_t::io, errno } };
+
+        disk.size = static_cast<u64>(end);
+#endif
+    } else {
+        disk.sector_size = guess_sector_size(fd);
+    }
+
+    if (disk.size < 2 * u64(disk.sector_size))
+        return lak::err_t { disk_err { disk_err::kind_t::no_partition_table } };
+
+    return read_table(disk, force_gpt);
+}
+
+}
+
+auto read_partition_table(lak::astring_view path, bool force_gpt) -> dresult<partition_table> {
+    std::string p { path.begin(), path.end() };
+
+    int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return lak::err_t { disk_err { disk_err::kind_t::io, errno } };
+
+    struct stat st { };
+    dresult<partition_table> res = ::fstat(fd, &st) == 0
+            ? read_table_fd(fd, st, force_gpt)
+            : dresult<partition_table> { lak::err_t { disk_err { disk_err::kind_t::io, errno } } };
+
+    ::close(fd);
+
+    return res;
+}
+
+auto partition_cache::get(lak::astring_view path, bool force_gpt) -> dresult<const partition_table*> {
+    std::string p { path.begin(), path.end() };
+    struct stat st { };
+
+    if (::stat(p.c_str(), &st) != 0)
+        return lak::err_t { disk_err { disk_err::kind_t::io, errno } };
+
+    bool block = S_ISBLK(st.st_mode);
+
+    identity id {
+        block ? static_cast<u64>(st.st_rdev) : static_cast<u64>(st.st_dev),
+        block ? 0 : static_cast<u64>(st.st_ino),
+        block,
+        force_gpt,
+    };
+
+    if (auto it = tables_.find(id); it != tables_.end())
+        return lak::ok_t { &it->second };
+
+    dresult<partition_table> table = read_partition_table(path, force_gpt);
+
+    if (!table.is_ok())
+        return lak::err_t { table.unsafe_unwrap_err() };
+
+    ++reads_;
+
+    auto it = tables_.emplace(id, std::move(table.unsafe_unwrap())).first;
+
+    return lak::ok_t { &it->second };
+}
+
+#else
+
+auto read_partition_table(lak::astring_view, bool) -> dresult<partition_table> {
+    return lak::err_t { disk_err { disk_err::kind_t::unsupported } };
+}
+
+auto partition_cache::get(lak::astring_view, bool) -> dresult<const partition_table*> {
+    return lak::err_t { disk_err { disk_err::kind_t::unsupported } };
+}
+
+#endif
+
+}
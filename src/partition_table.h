@@ -0,0 +1,94 @@
+#pragma once
+
+#include "efi_device_path.h"
+
+#include <map>
+#include <string>
+
+namespace efibootmgrw {
+
+struct disk_err {
+    enum class kind_t : u8 {
+        io,
+        // Neither a GPT nor an MBR, or nothing valid of either
+        no_partition_table,
+        // A protective MBR, but neither GPT header checks out
+        corrupt_gpt,
+        no_such_partition,
+        unsupported,
+    };
+
+    kind_t kind;
+
+    // errno for io, 0 otherwise.
+    i64 code = 0;
+
+    [[nodiscard]]
+    auto string() const -> std::string;
+};
+
+template<typename T>
+using dresult = lak::result<T, disk_err>;
+
+// CRC-32 as GPT uses it (IEEE 802.3, reflected, inverted).
+[[nodiscard]]
+auto crc32(lak::span<const byte_t> bytes) -> u32;
+
+/*
+ * The partitions of a disk, each as the HD() node that names it: number,
+ * start and size in logical blocks, and the GPT partition GUID or the MBR
+ * disk signature.
+ */
+struct partition_table {
+    u8 format = device_path::hard_drive::format_gpt;
+    u32 sector_size = 512;
+    // Sorted by partition number
+    vec<device_path::hard_drive> partitions;
+
+    [[nodiscard]]
+    auto find(u32 number) const -> const device_path::hard_drive*;
+};
+
+/*
+ * Reads the GPT of a block device or disk image, falling back to the backup
+ * header if the primary is damaged, or its MBR including logical partitions.
+ * force_gpt reads a GPT even without a protective MBR, as --gpt asks.
+ */
+[[nodiscard]]
+auto read_partition_table(lak::astring_view path, bool force_gpt = false) -> dresult<partition_table>;
+
+/*
+ * Partition tables by device identity, so every name for the same disk
+ * (/dev/sda, /dev/disk/by-id/..., an image through a symlink) reads its
+ * table once per run. Not thread safe.
+ */
+struct partition_cache {
+    [[nodiscard]]
+    auto get(lak::astring_view path, bool force_gpt = false) -> dresult<const partition_table*>;
+
+    // Tables actually read, rather than served from the cache.
+    [[nodiscard]]
+    auto reads() const -> size_t {
+        return reads_;
+    }
+
+private:
+    struct identity {
+        // st_rdev for block devices, st_dev and st_ino for files
+        u64 device;
+        u64 inode;
+        bool block;
+        bool force_gpt;
+
+        auto operator<=>(const identity&) const = default;
+    };
+
+    std::map<identity, partition_table> tables_;
+    size_t reads_ = 0;
+};
+
+// HD(part)/File(loader), with '/' in loader taken as '\'.
+[[nodiscard]]
+auto hard_drive_file_path(const device_path::hard_drive& part, lak::astring_view loader) -> vec<byte_t>;
+
+}
@@ -0,0 +1,230 @@
+#include "plan_changes.h"
+#include "desired_state.h"
+#include "efi_load_option.h"
+#include "load_option_name.h"
+#include "partition_table.h"
+#include "ucs2.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace efibootmgrw {
+
+auto read_text_file(lak::astring_view path) -> vresult<std::string> {
+    std::string p { path.begin(), path.end() };
+    std::FILE* file = p == "-" ? stdin : std::fopen(p.c_str(), "rb");
+
+    if (!file)
+        return lak::err_t { var_err::from_errno(errno) };
+
+    std::string text;
+    char chunk[4096];
+
+    for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), file)) > 0;)
+        text.append(chunk, n);
+
+    bool failed = std::ferror(file) != 0;
+
+    if (file != stdin)
+        std::fclose(file);
+
+    if (failed)
+        return lak::err_t { var_err { var_err::kind_t::io } };
+
+    return lak::ok_t { std::move(text) };
+}
+
+namespace {
+
+// Boot#### on the partition -d and -p name, put first in BootOrder unless -o or -O say otherwise.
+[[nodiscard]]
+auto plan_create(Context& ctx, efivar_backend& vars, partition_cache& disks, transaction& tx, bump_arena& arena)
+-> vresult<lak::monostate> {
+    u16 id = static_cast<u16>(*ctx.args.boot_num);
+    load_option_name name = boot_option_name(id);
+    lak::astring_view disk = ctx.args.disk ? *ctx.args.disk : "/dev/sda";
+
+    vresult<size_t> existing = vars.size(name, efi_global_variable);
+
+    if (existing.is_ok())
+        Fatal(ctx, "Boot{:04X} already exists\n", id);
+    else if (existing.unsafe_unwrap_err().kind != var_err::kind_t::not_found)
+        return lak::err_t { existing.unsafe_unwrap_err() };
+
+    const partition_table* table = nullptr;
+
+    disks.get(disk, ctx.args.force_gpt)
+        .if_ok([&](const partition_table* t) { table = t; })
+        .if_err([&](const disk_err& err) {
+            Fatal(ctx, "unable to read the partition table of {}: {}\n", disk, err.string());
+        });
+
+    const device_path::hard_drive* part = ctx.args.part >= 0 && ctx.args.part <= 0xFFFFFFFF
+            ? table->find(static_cast<u32>(ctx.args.part))
+            : nullptr;
+
+    if (!part)
+        Fatal(ctx, "{} has no partition {}\n", disk, ctx.args.part);
+
+    vec<byte_t> path = hard_drive_file_path(*part, ctx.args.loader);
+
+    if (path.size() > max_file_path_list_size)
+        Fatal(ctx, "loader path {} is too long\n", ctx.args.loader);
+
+    vec<byte_t> option = build_load_option(
+            ctx.args.inactive ? 0 : load_option_active,
+            ctx.args.label,
+            lak::span<const byte_t> { path.data(), path.size() }
+    );
+
+    tx.set(name, efi_global_variable, lak::span<const byte_t> { option.data(), option.size() });
+
+    if (ctx.args.boot_order || ctx.args.delete_boot_order)
+        return lak::ok_t { };
+
+    vec<u16> order { id };
+    vresult<lak::span<byte_t>> current = read_variable(vars, L"BootOrder", efi_global_variable, arena);
+
+    if (current.is_ok()) {
+        lak::span<byte_t> data = current.unsafe_unwrap();
+
+        for (size_t i = 0; i + sizeof(u16) <= data.size(); i += sizeof(u16)) {
+            u16 other;
+            std::memcpy(&other, data.data() + i, sizeof(u16));
+
+            if (other != id)
+                order.push_back(other);
+        }
+    } else if (current.unsafe_unwrap_err().kind != var_err::kind_t::not_found) {
+        return lak::err_t { current.unsafe_unwrap_err() };
+    }
+
+    tx.set_boot_order(lak::span<const u16> { order.data(), order.size() });
+
+    return lak::ok_t { };
+}
+
+}
+
+auto plan_changes(Context& ctx, efivar_backend& vars, partition_cache& disks) -> vresult<transaction> {
+    transaction tx;
+    bump_arena arena;
+
+    // Each of these is written to firmware as a u16, so don't let one wrap.
+    auto check_u16 = [&](lak::astring_view flag, i64 value) {
+        if (value < 0 || value > 0xFFFF)
+            Fatal(ctx, "{} {:X} is out of range, must be 0 to FFFF\n", flag, value);
+    };
+
+    if (ctx.args.boot_num)
+        check_u16("-b", *ctx.args.boot_num);
+
+    if (ctx.args.boot_order)
+        for (i64 id : *ctx.args.boot_order)
+            check_u16("-o", id);
+
+    if (ctx.args.boot_next)
+        check_u16("-n", *ctx.args.boot_next);
+
+    if (ctx.args.timeout && (*ctx.args.timeout < 0 || *ctx.args.timeout > 0xFFFF))
+        Fatal(ctx, "-t {} is out of range, must be 0 to 65535\n", *ctx.args.timeout);
+
+    if (ctx.args.create) {
+        if (auto res = plan_create(ctx, vars, disks, tx, arena); !res.is_ok())
+            return lak::err_t { res.unsafe_unwrap_err() };
+    } else if (ctx.args.boot_num && (ctx.args.active || ctx.args.inactive || ctx.args.delete_boot_num)) {
+        u16 id = static_cast<u16>(*ctx.args.boot_num);
+        load_option_name name = boot_option_name(id);
+
+        vresult<lak::span<byte_t>> entry = read_variable(vars, name, efi_global_variable, arena);
+
+        if (!entry.is_ok())
+            return lak::err_t { entry.unsafe_unwrap_err() };
+
+        lak::span<byte_t> bytes = entry.unsafe_unwrap();
+
+        if (ctx.args.delete_boot_num) {
+            tx.remove(name, efi_global_variable);
+
+            // Don't leave BootOrder pointing at it.
+            vresult<lak::span<byte_t>> current = read_variable(vars, L"BootOrder", efi_global_variable, arena);
+
+            if (current.is_ok()) {
+                lak::span<byte_t> data = current.unsafe_unwrap();
+                vec<u16> order(data.size() / sizeof(u16));
+                std::memcpy(order.data(), data.data(), order.size() * sizeof(u16));
+
+                if (std::erase(order, id) > 0)
+                    tx.set_boot_order(lak::span<const u16> { order.data(), order.size() });
+            } else if (current.unsafe_unwrap_err().kind != var_err::kind_t::not_found) {
+                return lak::err_t { current.unsafe_unwrap_err() };
+            }
+        } else {
+            if (bytes.size() < sizeof(u32))
+                Fatal(ctx, "Boot{:04X} is malformed: {}\n", id, to_string(load_option_err::truncated));
+
+            u32 attributes;
+            std::memcpy(&attributes, bytes.data(), sizeof(u32));
+
+            if (ctx.args.active)
+                attributes |= load_option_active;
+            else
+                attributes &= ~load_option_active;
+
+            std::memcpy(bytes.data(), &attributes, sizeof(u32));
+            tx.set(name, efi_global_variable, bytes);
+        }
+    }
+
+    if (ctx.args.boot_order) {
+        vec<u16> order;
+        for (i64 id : *ctx.args.boot_order)
+            order.push_back(static_cast<u16>(id));
+        tx.set_boot_order(lak::span<const u16> { order.data(), order.size() });
+    } else if (ctx.args.delete_boot_order) {
+        tx.remove(L"BootOrder", efi_global_variable);
+    }
+
+    auto set_u16 = [&](lak::wstring_view name, i64 value) {
+        u16 v = static_cast<u16>(value);
+        tx.set(name, efi_global_variable, lak::span<const byte_t> { reinterpret_cast<const byte_t*>(&v), sizeof(v) });
+    };
+
+    if (ctx.args.boot_next)
+        set_u16(L"BootNext", *ctx.args.boot_next);
+    else if (ctx.args.delete_boot_next)
+        tx.remove(L"BootNext", efi_global_variable);
+
+    if (ctx.args.timeout)
+        set_u16(L"Timeout", *ctx.args.timeout);
+    else if (ctx.args.delete_timeout)
+        tx.remove(L"Timeout", efi_global_variable);
+
+    if (ctx.args.apply_file) {
+        std::string text;
+
+        read_text_file(*ctx.args.apply_file)
+            .if_ok([&](std::string& t) { text = std::move(t); })
+            .if_err([&](const var_err& err) {
+                Fatal(ctx, "unable to read {}: {}\n", *ctx.args.apply_file, to_u8string(err.wstring()));
+            });
+
+        desired_state state;
+
+        parse_desired_state(lak::astring_view { text.data(), text.size() })
+            .if_ok([&](desired_state& s) { state = std::move(s); })
+            .if_err([&](const desired_state_err& err) {
+                Fatal(ctx, "{}:{}: {}\n", *ctx.args.apply_file, err.line, err.what);
+            });
+
+        BootSnapshot snap = BootSnapshot::load(vars, ctx.args.jobs);
+
+        if (auto res = plan_desired_state(state, vars, snap, tx); !res.is_ok())
+            return lak::err_t { res.unsafe_unwrap_err() };
+    }
+
+    return lak::ok_t { std::move(tx) };
+}
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "efivar_backend.h"
+#include "partition_table.h"
+#include "transaction.h"
+
+namespace efibootmgrw {
+
+// The whole file, or all of stdin for "-".
+[[nodiscard]]
+auto read_text_file(lak::astring_view path) -> vresult<std::string>;
+
+/*
+ * Everything the command line asks to change, as one transaction.
+ * Entries that -a, -A or -B refer to must already exist, and the one -c
+ * creates mustn't. -c reads -d's partition table through disks, so
+ * sharing one cache between calls reads each disk once, however many
+ * entries are created on it.
+ */
+[[nodiscard]]
+auto plan_changes(Context& ctx, efivar_backend& vars, partition_cache& disks) -> vresult<transaction>;
+
+}
@@ -0,0 +1,62 @@
+#include "replace_file.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+# include <io.h>
+# include <process.h>
+#else
+# include <unistd.h>
+#endif
+
+namespace efibootmgrw {
+
+auto replace_file(lak::astring_view path, lak::span<const byte_t> bytes) -> vresult<lak::monostate> {
+#ifdef _WIN32
+    int pid = ::_getpid();
+#else
+    int pid = static_cast<int>(::getpid());
+#endif
+
+    std::string final_path { path.begin(), path.end() };
+    // A name of our own, two runs sharing one would write into one file.
+    std::string tmp_path = final_path + ".tmp-" + std::to_string(pid);
+
+    std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+
+    if (!file)
+        return lak::err_t { var_err::from_errno(errno) };
+
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size()
+              && std::fflush(file) == 0;
+
+    // Otherwise a crash can leave the rename without the data it renamed.
+#ifdef _WIN32
+    ok = ok && ::_commit(::_fileno(file)) == 0;
+#else
+    ok = ok && ::fsync(::fileno(file)) == 0;
+#endif
+
+    var_err err = var_err::from_errno(errno);
+
+    if (std::fclose(file) != 0 && ok) {
+        ok = false;
+        err = var_err::from_errno(errno);
+    }
+
+    if (ok && std::rename(tmp_path.c_str(), final_path.c_str()) != 0) {
+        ok = false;
+        err = var_err::from_errno(errno);
+    }
+
+    if (!ok) {
+        std::remove(tmp_path.c_str());
+        return lak::err_t { err };
+    }
+
+    return lak::ok_t { };
+}
+
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+namespace efibootmgrw {
+
+/*
+ * Writes bytes to a file of this process's own beside path, syncs it and
+ * renames it over path, so readers and concurrent writers only ever see
+ * a whole file, never a half written or interleaved one.
+ */
+auto replace_file(lak::astring_view path, lak::span<const byte_t> bytes) -> vresult<lak::monostate>;
+
+}
@@ -0,0 +1,126 @@
+#include "sha256.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace efibootmgrw {
+
+namespace {
+
+constexpr u32 round_constants[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+[[nodiscard]]
+auto load_be32(const u8* p) -> u32 {
+    return u32(p[0]) << 24 | u32(p[1]) << 16 | u32(p[2]) << 8 | u32(p[3]);
+}
+
+}
+
+void sha256::compress(const u8* block) {
+    u32 w[64];
+
+    for (size_t i = 0; i < 16; ++i)
+        w[i] = load_be32(block + i * 4);
+
+    for (size_t i = 16; i < 64; ++i) {
+        u32 s0 = std::rotr(w[i - 15], 7) ^ std::rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        u32 s1 = std::rotr(w[i - 2], 17) ^ std::rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    u32 a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+    u32 e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+
+    for (size_t i = 0; i < 64; ++i) {
+        u32 t1 = h + (std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25)) + ((e & f) ^ (~e & g)) + round_constants[i] + w[i];
+        u32 t2 = (std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+    state_[5] += f;
+    state_[6] += g;
+    state_[7] += h;
+}
+
+void sha256::update(lak::span<const byte_t> bytes) {
+    const auto* p = reinterpret_cast<const u8*>(bytes.data());
+    size_t n = bytes.size();
+
+    length_ += n;
+
+    if (block_size_ > 0) {
+        size_t take = std::min(n, block_.size() - block_size_);
+        std::memcpy(block_.data() + block_size_, p, take);
+        block_size_ += take;
+        p += take;
+        n -= take;
+
+        if (block_size_ < block_.size())
+            return;
+
+        compress(block_.data());
+        block_size_ = 0;
+    }
+
+    // Whole blocks straight from the input, which for a mapped file is the page cache.
+    for (; n >= 64; p += 64, n -= 64)
+        compress(p);
+
+    std::memcpy(block_.data(), p, n);
+    block_size_ = n;
+}
+
+auto sha256::finish() -> sha256_digest {
+    u64 bits = length_ * 8;
+
+    block_[block_size_++] = 0x80;
+
+    if (block_size_ > 56) {
+        std::memset(block_.data() + block_size_, 0, block_.size() - block_size_);
+        compress(block_.data());
+        block_size_ = 0;
+    }
+
+    std::memset(block_.data() + block_size_, 0, 56 - block_size_);
+
+    for (size_t i = 0; i < 8; ++i)
+        block_[56 + i] = static_cast<u8>(bits >> (56 - i * 8));
+
+    compress(block_.data());
+
+    sha256_digest digest;
+
+    for (size_t i = 0; i < 8; ++i) {
+        digest[i * 4 + 0] = static_cast<u8>(state_[i] >> 24);
+        digest[i * 4 + 1] = static_cast<u8>(state_[i] >> 16);
+        digest[i * 4 + 2] = static_cast<u8>(state_[i] >> 8);
+        digest[i * 4 + 3] = static_cast<u8>(state_[i]);
+    }
+
+    return digest;
+}
+
+}
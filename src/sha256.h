@@ -0,0 +1,38 @@
+#pragma once
+
+#include "efibootmgrw.h"
+
+#include <array>
+
+namespace efibootmgrw {
+
+using sha256_digest = std::array<u8, 32>;
+
+// FIPS 180-4 SHA-256, so digests compare against sha256sum and signing manifests.
+struct sha256 {
+    void update(lak::span<const byte_t> bytes);
+
+    // The digest of everything updated with, after which the state is spent.
+    [[nodiscard]]
+    auto finish() -> sha256_digest;
+
+    [[nodiscard]]
+    static auto of(lak::span<const byte_t> bytes) -> sha256_digest {
+        sha256 h;
+        h.update(bytes);
+        return h.finish();
+    }
+
+private:
+    std::array<u32, 8> state_ {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+        0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+    };
+    std::array<u8, 64> block_ { };
+    size_t block_size_ = 0;
+    u64 length_ = 0;
+
+    void compress(const u8* block);
+};
+
+}
@@ -0,0 +1,330 @@
+#include "sim_backend.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <thread>
+
+namespace efibootmgrw {
+
+namespace {
+
+[[nodiscard]]
+auto starts_with(lak::astring_view str, lak::astring_view prefix) -> bool {
+    return str.size() >= prefix.size() && lak::astring_view { str.begin(), str.begin() + prefix.size() } == prefix;
+}
+
+[[nodiscard]]
+auto parse_count(lak::astring_view str, size_t& out) -> bool {
+    auto res = std::from_chars(str.data(), str.data() + str.size(), out);
+    return !str.empty() && res.ec == std::errc() && res.ptr == str.data() + str.size();
+}
+
+}
+
+auto parse_sim_fault(lak::astring_view spec) -> lak::optional<sim_fault> {
+    vec<lak::astring_view> parts;
+
+    for (size_t i = 0; i <= spec.size();) {
+        size_t j = i;
+        while (j < spec.size() && spec[j] != ':')
+            ++j;
+        parts.push_back(lak::astring_view { spec.begin() + i, spec.begin() + j });
+        i = j + 1;
+    }
+
+    if (parts.size() < 2)
+        return lak::nullopt;
+
+    sim_fault fault { };
+
+    if (parts[0] == "read")              fault.op = sim_fault::op_t::read;
+    else if (parts[0] == "write")        fault.op = sim_fault::op_t::write;
+    else if (parts[0] == "remove")       fault.op = sim_fault::op_t::remove;
+    else if (parts[0] == "authenticate") fault.op = sim_fault::op_t::authenticate;
+    else return lak::nullopt;
+
+    if (parts[1] == "not_found")             fault.kind = var_err::kind_t::not_found;
+    else if (parts[1] == "buffer_too_small") fault.kind = var_err::kind_t::buffer_too_small;
+    else if (parts[1] == "out_of_space")     fault.kind = var_err::kind_t::out_of_space;
+    else if (parts[1] == "access_denied")    fault.kind = var_err::kind_t::access_denied;
+    else if (parts[1] == "io")               fault.kind = var_err::kind_t::io;
+    else return lak::nullopt;
+
+    fault.times = 1;
+
+    for (size_t i = 2; i < parts.size(); ++i) {
+        lak::astring_view p = parts[i];
+
+        if (starts_with(p, "after=")) {
+            if (!parse_count(lak::astring_view { p.begin() + 6, p.end() }, fault.after))
+                return lak::nullopt;
+        } else if (starts_with(p, "times=")) {
+            if (!parse_count(lak::astring_view { p.begin() + 6, p.end() }, fault.times))
+                return lak::nullopt;
+        } else if (i == 2) {
+            fault.name = lak::wstring(p.begin(), p.end());
+        } else {
+            return lak::nullopt;
+        }
+    }
+
+    return fault;
+}
+
+auto sim_backend::seed_from(efivar_backend& vars) -> vresult<lak::monostate> {
+    vresult<vec<efi_var_name>> names = vars.enumerate();
+
+    if (!names.is_ok())
+        return lak::err_t { names.unsafe_unwrap_err() };
+
+    struct seeded {
+        const efi_var_name* name;
+        lak::span<byte_t> data;
+        u32 attributes;
+    };
+
+    bump_arena arena;
+    vec<seeded> copies;
+    copies.reserve(names.unsafe_unwrap().size());
+
+    for (const efi_var_name& n : names.unsafe_unwrap()) {
+        u32 attributes = efi_variable_default_attributes;
+        vresult<lak::span<byte_t>> data = read_variable(vars, n.name, n.guid, arena, nullptr, &attributes);
+
+        // Vanished between listing and reading, or unreadable to us.
+        if (data.is_ok())
+            copies.push_back(seeded { &n, data.unsafe_unwrap(), attributes });
+    }
+
+    std::lock_guard lock { mutex_ };
+
+    // Charged like writes, but all or nothing.
+    size_t used = used_;
+
+    for (const seeded& c : copies) {
+        auto it = vars_.find(key_view { c.name->name, c.name->guid });
+        used = used - (it != vars_.end() ? cost(it->first.first, it->second.data.size()) : 0)
+               + cost(c.name->name, c.data.size());
+    }
+
+    if (used > config_.capacity)
+        return lak::err_t { var_err { var_err::kind_t::out_of_space } };
+
+    for (const seeded& c : copies) {
+        vars_.insert_or_assign(
+                key_t { c.name->name, c.name->guid },
+                variable { vec<byte_t>(c.data.begin(), c.data.end()), c.attributes, ++writes_ }
+        );
+    }
+
+    used_ = used;
+
+    return lak::ok_t { };
+}
+
+void sim_backend::inject(sim_fault fault) {
+    std::lock_guard lock { mutex_ };
+    faults_.push_back(std::move(fault));
+}
+
+auto sim_backend::fault(sim_fault::op_t op, lak::wstring_view name) -> lak::optional<var_err> {
+    for (auto it = faults_.begin(); it != faults_.end(); ++it) {
+        if (it->op != op || (!it->name.empty() && lak::wstring_view { it->name } != name))
+            continue;
+
+        if (it->after > 0) {
+            --it->after;
+            continue;
+        }
+
+        var_err err { it->kind };
+
+        if (it->times == 1)
+            faults_.erase(it);
+        else if (it->times > 1)
+            --it->times;
+
+        ++stats_.faults_injected;
+        return err;
+    }
+
+    return lak::nullopt;
+}
+
+void sim_backend::delay(std::chrono::microseconds latency, std::unique_lock<std::mutex>& lock) {
+    if (latency.count() == 0)
+        return;
+
+    if (config_.serialize) {
+        std::this_thread::sleep_for(latency);
+    } else {
+        lock.unlock();
+        std::this_thread::sleep_for(latency);
+        lock.lock();
+    }
+}
+
+auto sim_backend::read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+-> vresult<lak::span<void>> {
+    std::unique_lock lock { mutex_ };
+
+    delay(config_.read_latency, lock);
+    ++stats_.reads;
+
+    if (lak::optional<var_err> err = fault(sim_fault::op_t::read, name))
+        return lak::err_t { *err };
+
+    auto it = vars_.find(key_view { name, guid });
+
+    if (it == vars_.end())
+        return lak::err_t { var_err { var_err::kind_t::not_found } };
+
+    const vec<byte_t>& data = it->second.data;
+
+    if (data.size() > buf.size_bytes())
+        return lak::err_t { var_err { var_err::kind_t::buffer_too_small } };
+
+    std::memcpy(buf.data(), data.data(), data.size());
+
+    if (attributes)
+        *attributes = it->second.attributes;
+
+    return lak::ok_t { lak::span<void> { buf.data(), data.size() } };
+}
+
+auto sim_backend::size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> {
+    std::unique_lock lock { mutex_ };
+
+    // The same firmware call as a read, with a null buffer.
+    delay(config_.read_latency, lock);
+    ++stats_.reads;
+
+    if (lak::optional<var_err> err = fault(sim_fault::op_t::read, name))
+        return lak::err_t { *err };
+
+    auto it = vars_.find(key_view { name, guid });
+
+    if (it == vars_.end())
+        return lak::err_t { var_err { var_err::kind_t::not_found } };
+
+    return lak::ok_t { it->second.data.size() };
+}
+
+auto sim_backend::fingerprint(lak::wstring_view name, lak::wstring_view guid) -> vresult<var_fingerprint> {
+    std::lock_guard lock { mutex_ };
+
+    auto it = vars_.find(key_view { name, guid });
+
+    if (it == vars_.end())
+        return lak::err_t { var_err { var_err::kind_t::not_found } };
+
+    return lak::ok_t { var_fingerprint { it->second.data.size(), it->second.version, 0 } };
+}
+
+auto sim_backend::write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+-> vresult<lak::monostate> {
+    std::unique_lock lock { mutex_ };
+
+    delay(config_.write_latency, lock);
+    ++stats_.writes;
+
+    if (lak::optional<var_err> err = fault(sim_fault::op_t::write, name))
+        return lak::err_t { *err };
+
+    // SetVariable with a DataSize of 0 deletes the variable.
+    if (buf.size_bytes() == 0)
+        return erase(name, guid);
+
+    key_t key { lak::wstring(name.begin(), name.end()), lak::wstring(guid.begin(), guid.end()) };
+    auto it = vars_.find(key);
+
+    // Nor will it change an existing variable's attributes.
+    if (it != vars_.end() && it->second.attributes != attributes)
+        return lak::err_t { var_err { var_err::kind_t::io, EINVAL } };
+
+    size_t old_cost = it != vars_.end() ? cost(key.first, it->second.data.size()) : 0;
+    size_t new_cost = cost(key.first, buf.size_bytes());
+
+    if (used_ - old_cost + new_cost > config_.capacity)
+        return lak::err_t { var_err { var_err::kind_t::out_of_space } };
+
+    const auto* p = static_cast<const byte_t*>(buf.data());
+    vec<byte_t> data(p, p + buf.size_bytes());
+
+    used_ = used_ - old_cost + new_cost;
+    stats_.bytes_written += data.size();
+    ++wear_[key.first];
+
+    if (it != vars_.end())
+        it->second = variable { std::move(data), attributes, ++writes_ };
+    else
+        vars_.emplace(std::move(key), variable { std::move(data), attributes, ++writes_ });
+
+    return lak::ok_t { };
+}
+
+auto sim_backend::remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> {
+    std::unique_lock lock { mutex_ };
+
+    delay(config_.write_latency, lock);
+    ++stats_.removes;
+
+    if (lak::optional<var_err> err = fault(sim_fault::op_t::remove, name))
+        return lak::err_t { *err };
+
+    return erase(name, guid);
+}
+
+auto sim_backend::erase(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> {
+    auto it = vars_.find(key_view { name, guid });
+
+    if (it == vars_.end())
+        return lak::err_t { var_err { var_err::kind_t::not_found } };
+
+    used_ -= cost(it->first.first, it->second.data.size());
+    ++wear_[it->first.first];
+    vars_.erase(it);
+
+    return lak::ok_t { };
+}
+
+auto sim_backend::enumerate() -> vresult<vec<efi_var_name>> {
+    std::lock_guard lock { mutex_ };
+
+    vec<efi_var_name> names;
+    names.reserve(vars_.size());
+
+    for (const auto& [key, var] : vars_)
+        names.push_back(efi_var_name { key.first, key.second });
+
+    return lak::ok_t { std::move(names) };
+}
+
+auto sim_backend::authenticate(Context&) -> vresult<lak::monostate> {
+    std::lock_guard lock { mutex_ };
+
+    if (lak::optional<var_err> err = fault(sim_fault::op_t::authenticate, { }))
+        return lak::err_t { *err };
+
+    return lak::ok_t { };
+}
+
+auto sim_backend::stats() const -> sim_stats {
+    std::lock_guard lock { mutex_ };
+    return stats_;
+}
+
+auto sim_backend::wear(lak::wstring_view name) const -> size_t {
+    std::lock_guard lock { mutex_ };
+    auto it = wear_.find(lak::wstring(name.begin(), name.end()));
+    return it != wear_.end() ? it->second : 0;
+}
+
+auto sim_backend::bytes_used() const -> size_t {
+    std::lock_guard lock { mutex_ };
+    return used_;
+}
+
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+namespace efibootmgrw {
+
+struct sim_fault {
+    enum class op_t : u8 {
+        read,
+        write,
+        remove,
+        authenticate,
+    };
+
+    op_t op;
+    var_err::kind_t kind;
+    // Only calls for this variable, any if empty.
+    lak::wstring name;
+    // Matching calls to let through before failing.
+    size_t after = 0;
+    // Failures before the fault clears itself, 0 for never.
+    size_t times = 1;
+};
+
+// op:kind[:name][:after=N][:times=N], e.g. write:out_of_space:BootOrder
+[[nodiscard]]
+auto parse_sim_fault(lak::astring_view spec) -> lak::optional<sim_fault>;
+
+struct sim_config {
+    std::chrono::microseconds read_latency { 0 };
+    std::chrono::microseconds write_latency { 0 };
+
+    // NVRAM bytes, each variable costing its name, data and overhead.
+    size_t capacity = 64 * 1024;
+    size_t per_variable_overhead = 32;
+
+    // Real firmware runs one call at a time, so latency doesn't overlap.
+    bool serialize = true;
+};
+
+struct sim_stats {
+    size_t reads = 0;
+    size_t writes = 0;
+    size_t removes = 0;
+    size_t bytes_written = 0;
+    size_t faults_injected = 0;
+};
+
+/*
+ * Variables held in memory, with firmware-like latency, a storage limit
+ * and injectable failures, for benchmarking and reproducing incidents
+ * without hardware or privileges. Write counts are kept per variable as
+ * a stand-in for flash wear.
+ */
+struct sim_backend final : efivar_backend {
+    explicit sim_backend(sim_config config = { }) : config_ { config } {}
+
+    // Copies every variable vars can enumerate, or none with out_of_space
+    // if they don't all fit in the capacity left.
+    [[nodiscard]]
+    auto seed_from(efivar_backend& vars) -> vresult<lak::monostate>;
+
+    void inject(sim_fault fault);
+
+    [[nodiscard]]
+    auto read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+    -> vresult<lak::span<void>> override;
+
+    [[nodiscard]]
+    auto size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> override;
+
+    // Free, like efivarfs' stat(), so neither delayed nor counted.
+    [[nodiscard]]
+    auto fingerprint(lak::wstring_view name, lak::wstring_view guid) -> vresult<var_fingerprint> override;
+
+    auto write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+    -> vresult<lak::monostate> override;
+
+    auto remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> override;
+
+    [[nodiscard]]
+    auto enumerate() -> vresult<vec<efi_var_name>> override;
+
+    [[nodiscard]]
+    auto thread_safe() const -> bool override {
+        return true;
+    }
+
+    auto authenticate(Context&) -> vresult<lak::monostate> override;
+
+    [[nodiscard]]
+    auto stats() const -> sim_stats;
+
+    // Writes and removes that have hit name, across every guid.
+    [[nodiscard]]
+    auto wear(lak::wstring_view name) const -> size_t;
+
+    [[nodiscard]]
+    auto bytes_used() const -> size_t;
+
+private:
+    struct variable {
+        vec<byte_t> data;
+        u32 attributes;
+        // Value of writes_ when last written
+        u64 version = 0;
+    };
+
+    using key_t = std::pair<lak::wstring, lak::wstring>;
+    using key_view = std::pair<lak::wstring_view, lak::wstring_view>;
+
+    // Lets lookups take views, so reads don't allocate.
+    struct key_less {
+        using is_transparent = void;
+
+        [[nodiscard]]
+        static auto less(lak::wstring_view a, lak::wstring_view b) -> bool {
+            return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+        }
+
+        template<typename A, typename B>
+        [[nodiscard]]
+        auto operator()(const A& a, const B& b) const -> bool {
+            if (less(a.first, b.first)) return true;
+            if (less(b.first, a.first)) return false;
+            return less(a.second, b.second);
+        }
+    };
+
+    sim_config config_;
+
+    mutable std::mutex mutex_;
+    std::map<key_t, variable, key_less> vars_;
+    std::map<lak::wstring, size_t> wear_;
+    vec<sim_fault> faults_;
+    sim_stats stats_;
+    size_t used_ = 0;
+    u64 writes_ = 0;
+
+    [[nodiscard]]
+    auto cost(const lak::wstring& name, size_t data_size) const -> size_t {
+        return name.size() * sizeof(char16_t) + data_size + config_.per_variable_overhead;
+    }
+
+    // Called with mutex_ held.
+    [[nodiscard]]
+    auto fault(sim_fault::op_t op, lak::wstring_view name) -> lak::optional<var_err>;
+
+    // Removes a variable, for both remove() and a write of no data. Called with mutex_ held.
+    auto erase(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate>;
+
+    void delay(std::chrono::microseconds latency, std::unique_lock<std::mutex>& lock);
+};
+
+}
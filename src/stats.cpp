@@ -0,0 +1,275 @@
+#include "stats.h"
+#include "json_writer.h"
+#include "replace_file.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdio>
+
+namespace efibootmgrw {
+
+run_stats* active_stats = nullptr;
+
+auto to_string(stat_kind kind) -> lak::astring_view {
+    switch (kind) {
+        case stat_kind::read:         return "read";
+        case stat_kind::size:         return "size";
+        case stat_kind::fingerprint:  return "fingerprint";
+        case stat_kind::write:        return "write";
+        case stat_kind::remove:       return "remove";
+        case stat_kind::enumerate:    return "enumerate";
+        case stat_kind::authenticate: return "authenticate";
+        case stat_kind::snapshot:     return "snapshot";
+        case stat_kind::decode:       return "decode";
+        case stat_kind::plan:         return "plan";
+        case stat_kind::commit:       return "commit";
+        case stat_kind::output:       return "output";
+    }
+
+    unreachable();
+    return { };
+}
+
+void latency_histogram::record(u64 ns, u64 n, bool ok) {
+    size_t bucket = std::min<size_t>(std::bit_width(ns), bucket_count - 1);
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(n, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    if (!ok)
+        errors.fetch_add(1, std::memory_order_relaxed);
+
+    u64 prev = max_ns.load(std::memory_order_relaxed);
+    while (prev < ns && !max_ns.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+}
+
+auto latency_histogram::quantile(double q) const -> u64 {
+    u64 total = count.load(std::memory_order_relaxed);
+
+    if (total == 0)
+        return 0;
+
+    auto target = static_cast<u64>(std::ceil(q * static_cast<double>(total)));
+    u64 seen = 0;
+
+    for (size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+
+        // The bucket's bound can be well past anything recorded.
+        if (seen >= target)
+            return std::min(u64(1) << i, max_ns.load(std::memory_order_relaxed));
+    }
+
+    return max_ns.load(std::memory_order_relaxed);
+}
+
+namespace {
+
+// not_found and buffer_too_small are how probing and sizing work, not failures.
+template<typename T>
+void note_result(stat_timer& timer, vresult<T>& res) {
+    if (res.is_ok())
+        return;
+
+    var_err::kind_t kind = res.unsafe_unwrap_err().kind;
+
+    if (kind != var_err::kind_t::not_found && kind != var_err::kind_t::buffer_too_small)
+        timer.fail();
+}
+
+[[nodiscard]]
+auto format_ns(u64 ns) -> std::string {
+    auto d = static_cast<double>(ns);
+
+    if (ns < 1000)
+        return fmt::format("{}ns", ns);
+    if (ns < 1000000)
+        return fmt::format("{:.1f}us", d / 1e3);
+    if (ns < 1000000000)
+        return fmt::format("{:.1f}ms", d / 1e6);
+    return fmt::format("{:.2f}s", d / 1e9);
+}
+
+[[nodiscard]]
+auto is_phase(size_t kind) -> bool {
+    return kind >= stat_first_phase;
+}
+
+}
+
+auto stats_backend::read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+-> vresult<lak::span<void>> {
+    stat_timer timer { stat_kind::read };
+    vresult<lak::span<void>> res = inner_->read(name, guid, buf, attributes);
+
+    if (res.is_ok())
+        timer.add_bytes(res.unsafe_unwrap().size_bytes());
+
+    note_result(timer, res);
+    return res;
+}
+
+auto stats_backend::size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> {
+    stat_timer timer { stat_kind::size };
+    vresult<size_t> res = inner_->size(name, guid);
+    note_result(timer, res);
+    return res;
+}
+
+auto stats_backend::fingerprint(lak::wstring_view name, lak::wstring_view guid) -> vresult<var_fingerprint> {
+    stat_timer timer { stat_kind::fingerprint };
+    vresult<var_fingerprint> res = inner_->fingerprint(name, guid);
+    note_result(timer, res);
+    return res;
+}
+
+auto stats_backend::write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+-> vresult<lak::monostate> {
+    stat_timer timer { stat_kind::write };
+    timer.add_bytes(buf.size_bytes());
+    vresult<lak::monostate> res = inner_->write(name, guid, buf, attributes);
+    note_result(timer, res);
+    return res;
+}
+
+auto stats_backend::remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> {
+    stat_timer timer { stat_kind::remove };
+    vresult<lak::monostate> res = inner_->remove(name, guid);
+    note_result(timer, res);
+    return res;
+}
+
+auto stats_backend::enumerate() -> vresult<vec<efi_var_name>> {
+    stat_timer timer { stat_kind::enumerate };
+    vresult<vec<efi_var_name>> res = inner_->enumerate();
+    note_result(timer, res);
+    return res;
+}
+
+void print_run_stats(std::FILE* file, const run_stats& stats) {
+    fmt::print(file, "{:<14}{:>8}{:>8}{:>12}{:>10}{:>10}{:>10}{:>10}\n",
+               "", "calls", "errors", "bytes", "total", "p50", "p99", "max");
+
+    for (size_t i = 0; i < stat_kind_count; ++i) {
+        const latency_histogram& h = stats.kinds[i];
+        u64 count = h.count.load(std::memory_order_relaxed);
+
+        if (count == 0)
+            continue;
+
+        fmt::print(file, "{:<14}{:>8}{:>8}{:>12}{:>10}{:>10}{:>10}{:>10}\n",
+                   to_string(static_cast<stat_kind>(i)),
+                   count,
+                   h.errors.load(std::memory_order_relaxed),
+                   h.bytes.load(std::memory_order_relaxed),
+                   format_ns(h.total_ns.load(std::memory_order_relaxed)),
+                   format_ns(h.quantile(0.5)),
+                   format_ns(h.quantile(0.99)),
+                   format_ns(h.max_ns.load(std::memory_order_relaxed)));
+    }
+}
+
+void write_run_stats_json(fmt::memory_buffer& out, const run_stats& stats) {
+    json_writer w { out };
+
+    auto section = [&](lak::astring_view name, bool phases) {
+        w.key(name);
+        w.begin_object();
+
+        for (size_t i = 0; i < stat_kind_count; ++i) {
+            if (is_phase(i) != phases)
+                continue;
+
+            const latency_histogram& h = stats.kinds[i];
+
+            w.key(to_string(static_cast<stat_kind>(i)));
+            w.begin_object();
+            w.key("calls");
+            w.value(h.count.load(std::memory_order_relaxed));
+            w.key("errors");
+            w.value(h.errors.load(std::memory_order_relaxed));
+            w.key("bytes");
+            w.value(h.bytes.load(std::memory_order_relaxed));
+            w.key("total_ns");
+            w.value(h.total_ns.load(std::memory_order_relaxed));
+            w.key("p50_ns");
+            w.value(h.quantile(0.5));
+            w.key("p99_ns");
+            w.value(h.quantile(0.99));
+            w.key("max_ns");
+            w.value(h.max_ns.load(std::memory_order_relaxed));
+
+            // Bucket i counts latencies under 2^i ns.
+            w.key("buckets");
+            w.begin_array();
+            for (const std::atomic<u64>& b : h.buckets)
+                w.value(b.load(std::memory_order_relaxed));
+            w.end_array();
+
+            w.end_object();
+        }
+
+        w.end_object();
+    };
+
+    w.begin_object();
+    section("backend", false);
+    section("phases", true);
+    w.end_object();
+    w.newline();
+}
+
+auto write_prometheus_textfile(lak::astring_view path, const run_stats& stats) -> vresult<lak::monostate> {
+    fmt::memory_buffer out;
+    auto it = std::back_inserter(out);
+
+    auto histogram = [&](lak::astring_view metric, lak::astring_view label, lak::astring_view help, bool phases) {
+        fmt::format_to(it, "# HELP {} {}\n# TYPE {} histogram\n", metric, help, metric);
+
+        for (size_t i = 0; i < stat_kind_count; ++i) {
+            if (is_phase(i) != phases)
+                continue;
+
+            const latency_histogram& h = stats.kinds[i];
+            lak::astring_view kind = to_string(static_cast<stat_kind>(i));
+            u64 cumulative = 0;
+
+            // Every other bucket, from about a microsecond to about 17 seconds.
+            for (size_t b = 0; b < latency_histogram::bucket_count; ++b) {
+                cumulative += h.buckets[b].load(std::memory_order_relaxed);
+
+                if (b >= 10 && b <= 34 && b % 2 == 0)
+                    fmt::format_to(it, "{}_bucket{{{}=\"{}\",le=\"{}\"}} {}\n",
+                                   metric, label, kind, static_cast<double>(u64(1) << b) / 1e9, cumulative);
+            }
+
+            u64 count = h.count.load(std::memory_order_relaxed);
+
+            fmt::format_to(it, "{}_bucket{{{}=\"{}\",le=\"+Inf\"}} {}\n", metric, label, kind, count);
+            fmt::format_to(it, "{}_sum{{{}=\"{}\"}} {}\n",
+                           metric, label, kind, static_cast<double>(h.total_ns.load(std::memory_order_relaxed)) / 1e9);
+            fmt::format_to(it, "{}_count{{{}=\"{}\"}} {}\n", metric, label, kind, count);
+        }
+    };
+
+    auto counter = [&](lak::astring_view metric, lak::astring_view help, auto get) {
+        fmt::format_to(it, "# HELP {} {}\n# TYPE {} counter\n", metric, help, metric);
+
+        for (size_t i = 0; i < stat_first_phase; ++i)
+            fmt::format_to(it, "{}{{op=\"{}\"}} {}\n", metric, to_string(static_cast<stat_kind>(i)), get(stats.kinds[i]));
+    };
+
+    histogram("efibootmgrw_backend_call_seconds", "op", "Latency of calls to the firmware variable backend.", false);
+    counter("efibootmgrw_backend_call_errors_total", "Backend calls that failed.",
+            [](const latency_histogram& h) { return h.errors.load(std::memory_order_relaxed); });
+    counter("efibootmgrw_backend_bytes_total", "Bytes read from or written to the backend.",
+            [](const latency_histogram& h) { return h.bytes.load(std::memory_order_relaxed); });
+    histogram("efibootmgrw_phase_seconds", "phase", "Time spent in each phase of a run.", true);
+
+    return replace_file(path, lak::span<const byte_t> { reinterpret_cast<const byte_t*>(out.data()), out.size() });
+}
+
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+#include <atomic>
+#include <chrono>
+
+namespace efibootmgrw {
+
+enum class stat_kind : u8 {
+    // Calls that reach the platform backend
+    read,
+    size,
+    fingerprint,
+    write,
+    remove,
+    enumerate,
+
+    // Phases of a run. output includes the snapshot it prints and
+    // decoding its entries, parsing them and formatting their lines.
+    authenticate,
+    snapshot,
+    decode,
+    plan,
+    commit,
+    output,
+};
+
+constexpr size_t stat_kind_count = 12;
+constexpr size_t stat_first_phase = static_cast<size_t>(stat_kind::authenticate);
+
+[[nodiscard]]
+auto to_string(stat_kind kind) -> lak::astring_view;
+
+/*
+ * Latencies in power of two buckets, bucket i counting those under 2^i ns
+ * and at least 2^(i-1) ns. Safe to record into from several threads.
+ */
+struct latency_histogram {
+    static constexpr size_t bucket_count = 40;
+
+    std::atomic<u64> buckets[bucket_count] { };
+    std::atomic<u64> count { 0 };
+    // Not counting not_found and buffer_too_small, which come up in normal use.
+    std::atomic<u64> errors { 0 };
+    std::atomic<u64> bytes { 0 };
+    std::atomic<u64> total_ns { 0 };
+    std::atomic<u64> max_ns { 0 };
+
+    void record(u64 ns, u64 bytes, bool ok);
+
+    // Upper bound of the bucket the q quantile falls in, 0 if empty.
+    [[nodiscard]]
+    auto quantile(double q) const -> u64;
+};
+
+struct run_stats {
+    latency_histogram kinds[stat_kind_count];
+
+    [[nodiscard]]
+    auto operator[](stat_kind kind) -> latency_histogram& {
+        return kinds[static_cast<size_t>(kind)];
+    }
+
+    [[nodiscard]]
+    auto operator[](stat_kind kind) const -> const latency_histogram& {
+        return kinds[static_cast<size_t>(kind)];
+    }
+};
+
+// Where --stats collects to, null without it, so disabled timers cost a load and a branch.
+extern run_stats* active_stats;
+
+// Times its scope into active_stats, if there is one.
+struct stat_timer {
+    explicit stat_timer(stat_kind kind) : stats_ { active_stats }, kind_ { kind } {
+        if (stats_)
+            start_ = std::chrono::steady_clock::now();
+    }
+
+    stat_timer(const stat_timer&) = delete;
+    stat_timer& operator=(const stat_timer&) = delete;
+
+    ~stat_timer() {
+        if (stats_) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+            (*stats_)[kind_].record(static_cast<u64>(ns.count()), bytes_, ok_);
+        }
+    }
+
+    void add_bytes(size_t n) {
+        bytes_ += n;
+    }
+
+    void fail() {
+        ok_ = false;
+    }
+
+private:
+    run_stats* stats_;
+    stat_kind kind_;
+    std::chrono::steady_clock::time_point start_;
+    u64 bytes_ = 0;
+    bool ok_ = true;
+};
+
+/*
+ * Times every call into inner. make_default_backend puts it directly over
+ * the platform backend, under --cache and --simulate, so what it sees is
+ * what reached the firmware.
+ */
+struct stats_backend final : efivar_backend {
+    explicit stats_backend(std::unique_ptr<efivar_backend> inner) : inner_ { std::move(inner) } {}
+
+    [[nodiscard]]
+    auto read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+    -> vresult<lak::span<void>> override;
+
+    [[nodiscard]]
+    auto size(lak::wstring_view name, lak::wstring_view guid) -> vresult<size_t> override;
+
+    [[nodiscard]]
+    auto fingerprint(lak::wstring_view name, lak::wstring_view guid) -> vresult<var_fingerprint> override;
+
+    auto write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+    -> vresult<lak::monostate> override;
+
+    auto remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> override;
+
+    [[nodiscard]]
+    auto enumerate() -> vresult<vec<efi_var_name>> override;
+
+    [[nodiscard]]
+    auto thread_safe() const -> bool override {
+        return inner_->thread_safe();
+    }
+
+    auto authenticate(Context& ctx) -> vresult<lak::monostate> override {
+        return inner_->authenticate(ctx);
+    }
+
+private:
+    std::unique_ptr<efivar_backend> inner_;
+};
+
+// A line per kind that was recorded, with call counts, bytes and latencies.
+void print_run_stats(std::FILE* file, const run_stats& stats);
+
+void write_run_stats_json(fmt::memory_buffer& out, const run_stats& stats);
+
+/*
+ * The Prometheus text format, for node_exporter's textfile collector.
+ * Written beside path and renamed over it, so a scrape never sees half.
+ */
+[[nodiscard]]
+auto write_prometheus_textfile(lak::astring_view path, const run_stats& stats) -> vresult<lak::monostate>;
+
+}
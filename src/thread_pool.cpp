@@ -0,0 +1,146 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace efibootmgrw {
+
+thread_pool::thread_pool(size_t workers) {
+    threads_.reserve(workers);
+
+    for (size_t i = 0; i < workers; ++i)
+        threads_.emplace_back([this] { worker(); });
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock { mutex_ };
+        stop_ = true;
+    }
+
+    work_cv_.notify_all();
+
+    for (std::thread& t : threads_)
+        t.join();
+}
+
+void thread_pool::for_each_index(size_t count, const std::function<void(size_t)>& f) {
+    if (count == 0)
+        return;
+
+    if (threads_.empty()) {
+        for (size_t i = 0; i < count; ++i)
+            f(i);
+        return;
+    }
+
+    std::unique_lock lock { mutex_ };
+
+    job_ = &f;
+    next_ = 0;
+    count_ = count;
+    pending_ = count;
+
+    work_cv_.notify_all();
+    done_cv_.wait(lock, [&] { return pending_ == 0; });
+
+    job_ = nullptr;
+}
+
+namespace {
+
+// Own cache line each, the owner and thieves both hammer these.
+struct alignas(64) steal_range {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+}
+
+void thread_pool::for_each_index_stealing(size_t count, const std::function<void(size_t, size_t)>& f) {
+    size_t workers = std::max<size_t>(threads_.size(), 1);
+
+    vec<steal_range> ranges(workers);
+
+    for (size_t w = 0; w < workers; ++w) {
+        ranges[w].begin = count * w / workers;
+        ranges[w].end = count * (w + 1) / workers;
+    }
+
+    for_each_index(workers, [&](size_t w) {
+        steal_range& own = ranges[w];
+
+        for (;;) {
+            size_t i = count;
+
+            {
+                std::lock_guard lock { own.mutex };
+                if (own.begin < own.end)
+                    i = own.begin++;
+            }
+
+            if (i != count) {
+                f(w, i);
+                continue;
+            }
+
+            // Find the fullest slice, then take its back half.
+            steal_range* victim = nullptr;
+            size_t most = 0;
+
+            for (steal_range& r : ranges) {
+                if (&r == &own) continue;
+
+                std::lock_guard lock { r.mutex };
+                if (r.end - r.begin > most) {
+                    most = r.end - r.begin;
+                    victim = &r;
+                }
+            }
+
+            if (!victim)
+                return;
+
+            size_t begin, end;
+
+            {
+                std::lock_guard lock { victim->mutex };
+
+                // Someone may have got there first.
+                if (victim->begin == victim->end)
+                    continue;
+
+                end = victim->end;
+                begin = victim->begin + (victim->end - victim->begin) / 2;
+                victim->end = begin;
+            }
+
+            std::lock_guard lock { own.mutex };
+            own.begin = begin;
+            own.end = end;
+        }
+    });
+}
+
+void thread_pool::worker() {
+    std::unique_lock lock { mutex_ };
+
+    for (;;) {
+        work_cv_.wait(lock, [&] { return stop_ || (job_ && next_ < count_); });
+
+        if (stop_)
+            return;
+
+        size_t i = next_++;
+        const std::function<void(size_t)>& f = *job_;
+
+        lock.unlock();
+        f(i);
+        lock.lock();
+
+        if (--pending_ == 0)
+            done_cv_.notify_all();
+    }
+}
+
+}
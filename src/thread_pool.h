@@ -0,0 +1,51 @@
+#pragma once
+
+#include "efibootmgrw.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace efibootmgrw {
+
+struct thread_pool {
+    explicit thread_pool(size_t workers);
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    ~thread_pool();
+
+    [[nodiscard]]
+    auto size() const -> size_t {
+        return threads_.size();
+    }
+
+    // Calls f(i) for every i in [0, count) across the pool and
+    // returns once they have all finished. Not reentrant.
+    void for_each_index(size_t count, const std::function<void(size_t)>& f);
+
+    // As above but f(worker, i), worker being unique to the calling thread
+    // for the duration. Workers start on even slices of [0, count) and steal
+    // half of the fullest slice when theirs runs dry, so a few expensive
+    // items don't leave the rest of the pool idle.
+    void for_each_index_stealing(size_t count, const std::function<void(size_t, size_t)>& f);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+
+    const std::function<void(size_t)>* job_ = nullptr;
+    size_t next_ = 0;
+    size_t count_ = 0;
+    size_t pending_ = 0;
+    bool stop_ = false;
+
+    vec<std::thread> threads_;
+
+    void worker();
+};
+
+}
@@ -0,0 +1,537 @@
+#include "transaction.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+# include <io.h>
+# include <process.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace efibootmgrw {
+
+namespace {
+
+constexpr char journal_magic[8] = { 'E', 'F', 'B', 'M', 'W', 'J', 'N', '1' };
+
+struct journal_record {
+    // data unset if the variable didn't exist
+    var_change before;
+    var_change after;
+};
+
+// SetVariable deletes a variable written with no data.
+[[nodiscard]]
+auto deletes(const var_change& c) -> bool {
+    return !c.data || c.data->empty();
+}
+
+// Entries exist before anything refers to them, and stop existing after.
+[[nodiscard]]
+auto rank(const var_change& c) -> int {
+    if (!parse_load_option_name(c.name)) return 1;
+    return deletes(c) ? 2 : 0;
+}
+
+[[nodiscard]]
+auto same_var(const var_change& a, const var_change& b) -> bool {
+    return a.name == b.name && a.guid == b.guid;
+}
+
+struct stored_value {
+    lak::span<byte_t> data;
+    u32 attributes;
+};
+
+[[nodiscard]]
+auto read_current(efivar_backend& vars, const var_change& c, bump_arena& arena)
+-> vresult<lak::optional<stored_value>> {
+    u32 attributes = efi_variable_default_attributes;
+    vresult<lak::span<byte_t>> res = read_variable(vars, c.name, c.guid, arena, nullptr, &attributes);
+
+    if (res.is_ok())
+        return lak::ok_t { lak::optional<stored_value> { stored_value { res.unsafe_unwrap(), attributes } } };
+
+    if (res.unsafe_unwrap_err().kind == var_err::kind_t::not_found)
+        return lak::ok_t { lak::optional<stored_value> { } };
+
+    return lak::err_t { res.unsafe_unwrap_err() };
+}
+
+// Attributes count too, a change to only them still has to be written.
+[[nodiscard]]
+auto holds(const lak::optional<stored_value>& current, const var_change& c) -> bool {
+    if (!current || deletes(c))
+        return !current && deletes(c);
+
+    return current->attributes == c.attributes
+           && current->data.size() == c.data->size()
+           && std::equal(current->data.begin(), current->data.end(), c.data->begin());
+}
+
+/*
+ * stored_attributes are those of the variable as it is now, if it exists.
+ * Firmware won't change them in place, so a variable stored with others is
+ * removed and then written afresh. Its old value is journaled either way,
+ * so failing between the two rolls back like any other failed write.
+ */
+auto apply(efivar_backend& vars, var_change& c, lak::optional<u32> stored_attributes, transaction_stats& stats)
+-> vresult<lak::monostate> {
+    if (!deletes(c)) {
+        if (stored_attributes && *stored_attributes != c.attributes) {
+            vresult<lak::monostate> res = vars.remove(c.name, c.guid);
+
+            if (!res.is_ok() && res.unsafe_unwrap_err().kind != var_err::kind_t::not_found)
+                return res;
+        }
+
+        return vars.write(c.name, c.guid, lak::span<void> { c.data->data(), c.data->size() }, c.attributes)
+                .if_ok([&](auto) { ++stats.written; });
+    }
+
+    vresult<lak::monostate> res = vars.remove(c.name, c.guid);
+
+    if (!res.is_ok() && res.unsafe_unwrap_err().kind == var_err::kind_t::not_found)
+        return lak::ok_t { };
+
+    return res.if_ok([&](auto) { ++stats.deleted; });
+}
+
+// For rollback and resume, which may find some of the work already done.
+auto apply_if_changed(efivar_backend& vars, var_change& c, transaction_stats& stats)
+-> vresult<lak::monostate> {
+    bump_arena arena;
+
+    return read_current(vars, c, arena)
+            .and_then([&](const lak::optional<stored_value>& current) -> vresult<lak::monostate> {
+                if (holds(current, c)) {
+                    ++stats.skipped;
+                    return lak::ok_t { };
+                }
+
+                return apply(vars, c, current ? lak::optional<u32> { current->attributes } : lak::nullopt, stats);
+            });
+}
+
+/*
+ * Journal layout, all little endian:
+ *   magic[8] u32 count
+ *   count * { change before, change after }
+ * where change is
+ *   u16 name_len u16 name[name_len] u16 guid_len u16 guid[guid_len]
+ *   u32 attributes u8 exists u32 size byte_t data[size]
+ */
+
+template<typename T>
+void put(vec<byte_t>& out, T value) {
+    const auto* p = reinterpret_cast<const byte_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+void put_string(vec<byte_t>& out, lak::wstring_view str) {
+    put(out, static_cast<u16>(str.size()));
+    for (wchar_t c : str)
+        put(out, static_cast<u16>(c));
+}
+
+void put_change(vec<byte_t>& out, const var_change& c) {
+    put_string(out, c.name);
+    put_string(out, c.guid);
+    put(out, c.attributes);
+    put(out, static_cast<u8>(c.data ? 1 : 0));
+    put(out, static_cast<u32>(c.data ? c.data->size() : 0));
+    if (c.data)
+        out.insert(out.end(), c.data->begin(), c.data->end());
+}
+
+[[nodiscard]]
+auto encode(const vec<journal_record>& records) -> vec<byte_t> {
+    vec<byte_t> out { std::begin(journal_magic), std::end(journal_magic) };
+
+    put(out, static_cast<u32>(records.size()));
+
+    for (const journal_record& r : records) {
+        put_change(out, r.before);
+        put_change(out, r.after);
+    }
+
+    return out;
+}
+
+struct journal_reader {
+    lak::span<const byte_t> bytes;
+    size_t pos = 0;
+    bool ok = true;
+
+    template<typename T>
+    auto get() -> T {
+        T out { };
+        if (!ok || bytes.size() - pos < sizeof(T)) {
+            ok = false;
+            return out;
+        }
+        std::memcpy(&out, bytes.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return out;
+    }
+
+    auto get_string() -> lak::wstring {
+        lak::wstring out;
+        u16 len = get<u16>();
+        for (u16 i = 0; ok && i < len; ++i)
+            out.push_back(static_cast<wchar_t>(get<u16>()));
+        return out;
+    }
+
+    auto get_change() -> var_change {
+        var_change c;
+        c.name = get_string();
+        c.guid = get_string();
+        c.attributes = get<u32>();
+        bool exists = get<u8>() != 0;
+        u32 size = get<u32>();
+
+        if (!ok || bytes.size() - pos < size) {
+            ok = false;
+            return c;
+        }
+
+        if (exists)
+            c.data = vec<byte_t>(bytes.begin() + pos, bytes.begin() + pos + size);
+
+        pos += size;
+        return c;
+    }
+};
+
+[[nodiscard]]
+auto decode(lak::span<const byte_t> bytes) -> vresult<vec<journal_record>> {
+    if (bytes.size() < sizeof(journal_magic) || std::memcmp(bytes.data(), journal_magic, sizeof(journal_magic)) != 0)
+        return lak::err_t { var_err { var_err::kind_t::corrupt } };
+
+    journal_reader r { bytes, sizeof(journal_magic) };
+    vec<journal_record> records;
+
+    u32 count = r.get<u32>();
+
+    for (u32 i = 0; r.ok && i < count; ++i) {
+        journal_record rec;
+        rec.before = r.get_change();
+        rec.after = r.get_change();
+        records.push_back(std::move(rec));
+    }
+
+    if (!r.ok || r.pos != bytes.size())
+        return lak::err_t { var_err { var_err::kind_t::corrupt } };
+
+    return lak::ok_t { std::move(records) };
+}
+
+[[nodiscard]]
+auto last_errno() -> var_err {
+    return var_err::from_errno(errno);
+}
+
+#ifndef _WIN32
+// A rename is only durable once the directory holding it has been synced.
+[[nodiscard]]
+auto sync_parent_dir(const std::string& path) -> vresult<lak::monostate> {
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0)
+        return lak::err_t { last_errno() };
+
+    bool ok = ::fsync(fd) == 0;
+    var_err err = last_errno();
+    ::close(fd);
+
+    if (!ok)
+        return lak::err_t { err };
+
+    return lak::ok_t { };
+}
+#endif
+
+// Written beside the journal and renamed over it, so it's never half there.
+[[nodiscard]]
+auto write_journal(lak::astring_view path, const vec<byte_t>& bytes) -> vresult<lak::monostate> {
+    std::string final_path { path.begin(), path.end() };
+    std::string tmp_path = final_path + ".tmp";
+
+    std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+
+    if (!file)
+        return lak::err_t { last_errno() };
+
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size()
+              && std::fflush(file) == 0;
+
+#ifdef _WIN32
+    ok = ok && ::_commit(::_fileno(file)) == 0;
+#else
+    ok = ok && ::fsync(::fileno(file)) == 0;
+#endif
+
+    var_err err = last_errno();
+
+    if (std::fclose(file) != 0 && ok) {
+        ok = false;
+        err = last_errno();
+    }
+
+    if (ok && std::rename(tmp_path.c_str(), final_path.c_str()) != 0) {
+        ok = false;
+        err = last_errno();
+    }
+
+    if (!ok) {
+        std::remove(tmp_path.c_str());
+        return lak::err_t { err };
+    }
+
+#ifndef _WIN32
+    // Without this a power cut can lose the rename, and with it the only
+    // record of how to undo a half applied commit.
+    if (auto res = sync_parent_dir(final_path); !res.is_ok()) {
+        std::remove(final_path.c_str());
+        return res;
+    }
+#endif
+
+    return lak::ok_t { };
+}
+
+[[nodiscard]]
+auto read_file(lak::astring_view path) -> vresult<vec<byte_t>> {
+    std::string p { path.begin(), path.end() };
+    std::FILE* file = std::fopen(p.c_str(), "rb");
+
+    if (!file)
+        return lak::err_t { last_errno() };
+
+    vec<byte_t> bytes;
+    byte_t chunk[4096];
+
+    for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), file)) > 0;)
+        bytes.insert(bytes.end(), chunk, chunk + n);
+
+    bool failed = std::ferror(file) != 0;
+    std::fclose(file);
+
+    if (failed)
+        return lak::err_t { var_err { var_err::kind_t::io } };
+
+    return lak::ok_t { std::move(bytes) };
+}
+
+[[nodiscard]]
+auto read_journal(lak::astring_view path) -> vresult<vec<journal_record>> {
+    return read_file(path).and_then([](vec<byte_t>& bytes) {
+        return decode(lak::span<const byte_t> { bytes.data(), bytes.size() });
+    });
+}
+
+[[nodiscard]]
+auto remove_journal(lak::astring_view path) -> vresult<lak::monostate> {
+    std::string p { path.begin(), path.end() };
+
+    if (std::remove(p.c_str()) != 0)
+        return lak::err_t { last_errno() };
+
+    return lak::ok_t { };
+}
+
+}
+
+void transaction::set(lak::wstring_view name, lak::wstring_view guid, lak::span<const byte_t> data, u32 attributes) {
+    changes_.push_back(var_change {
+            lak::wstring(name.begin(), name.end()),
+            lak::wstring(guid.begin(), guid.end()),
+            vec<byte_t>(data.begin(), data.end()),
+            attributes,
+    });
+}
+
+void transaction::remove(lak::wstring_view name, lak::wstring_view guid) {
+    changes_.push_back(var_change {
+            lak::wstring(name.begin(), name.end()),
+            lak::wstring(guid.begin(), guid.end()),
+            lak::nullopt,
+    });
+}
+
+void transaction::set_boot_order(lak::span<const u16> order) {
+    set(
+            L"BootOrder",
+            efi_global_variable,
+            lak::span<const byte_t> { reinterpret_cast<const byte_t*>(order.data()), order.size_bytes() }
+    );
+}
+
+auto transaction::commit(efivar_backend& vars, lak::astring_view journal_path) -> vresult<transaction_stats> {
+    transaction_stats stats;
+
+    // Last change to each variable wins.
+    vec<var_change> changes;
+
+    for (auto it = changes_.rbegin(); it != changes_.rend(); ++it) {
+        bool seen = std::any_of(changes.begin(), changes.end(), [&](const var_change& c) {
+            return same_var(c, *it);
+        });
+
+        if (!seen)
+            changes.push_back(*it);
+    }
+
+    std::reverse(changes.begin(), changes.end());
+    std::stable_sort(changes.begin(), changes.end(), [](const var_change& a, const var_change& b) {
+        return rank(a) < rank(b);
+    });
+
+    // Nothing is written until every old value is known.
+    bump_arena arena;
+    vec<journal_record> records;
+
+    for (var_change& c : changes) {
+        vresult<lak::optional<stored_value>> current = read_current(vars, c, arena);
+
+        if (!current.is_ok())
+            return lak::err_t { current.unsafe_unwrap_err() };
+
+        const lak::optional<stored_value>& old = current.unsafe_unwrap();
+
+        if (holds(old, c)) {
+            ++stats.skipped;
+            continue;
+        }
+
+        journal_record rec;
+        rec.before.name = c.name;
+        rec.before.guid = c.guid;
+        if (old) {
+            rec.before.data = vec<byte_t>(old->data.begin(), old->data.end());
+            rec.before.attributes = old->attributes;
+        }
+        rec.after = std::move(c);
+
+        records.push_back(std::move(rec));
+    }
+
+    if (records.empty())
+        return lak::ok_t { stats };
+
+    if (auto res = write_journal(journal_path, encode(records)); !res.is_ok())
+        return lak::err_t { res.unsafe_unwrap_err() };
+
+    for (size_t i = 0; i < records.size(); ++i) {
+        const var_change& before = records[i].before;
+        vresult<lak::monostate> res = apply(
+                vars,
+                records[i].after,
+                before.data ? lak::optional<u32> { before.attributes } : lak::nullopt,
+                stats
+        );
+
+        if (res.is_ok())
+            continue;
+
+        // Undo from the failed change back, it may have half happened.
+        transaction_stats undo;
+        bool undone = true;
+
+        for (size_t j = i + 1; j-- > 0;)
+            undone = apply_if_changed(vars, records[j].before, undo).is_ok() && undone;
+
+        // Leave the journal for --rollback if we couldn't clean up ourselves.
+        if (undone)
+            (void) remove_journal(journal_path);
+
+        return lak::err_t { res.unsafe_unwrap_err() };
+    }
+
+    return remove_journal(journal_path).map([&](auto) { return stats; });
+}
+
+auto default_journal_path() -> lak::astring_view {
+#ifdef _WIN32
+    // Fixed, so a run from any directory finds what an interrupted one left.
+    static const std::string path = [] {
+        const char* dir = std::getenv("ProgramData");
+        return std::string { dir && *dir ? dir : "C:\\ProgramData" } + "\\efibootmgrw.journal";
+    }();
+
+    return lak::astring_view { path.data(), path.size() };
+#else
+    // Survives a reboot, unlike /tmp.
+    return "/var/tmp/efibootmgrw.journal";
+#endif
+}
+
+auto journal_exists(lak::astring_view path) -> bool {
+    std::string p { path.begin(), path.end() };
+
+    if (std::FILE* file = std::fopen(p.c_str(), "rb")) {
+        std::fclose(file);
+        return true;
+    }
+
+    return false;
+}
+
+auto simulated_journal(lak::astring_view journal_path) -> vresult<std::string> {
+#ifdef _WIN32
+    int pid = ::_getpid();
+#else
+    int pid = static_cast<int>(::getpid());
+#endif
+
+    std::string path { journal_path.begin(), journal_path.end() };
+    path += ".sim-" + std::to_string(pid);
+
+    if (!journal_exists(journal_path)) {
+        std::remove(path.c_str());
+        return lak::ok_t { std::move(path) };
+    }
+
+    return read_file(journal_path)
+        .and_then([&](vec<byte_t>& bytes) { return write_journal(lak::astring_view { path.data(), path.size() }, bytes); })
+        .map([&](auto) { return std::move(path); });
+}
+
+auto rollback_journal(efivar_backend& vars, lak::astring_view path) -> vresult<transaction_stats> {
+    return read_journal(path).and_then([&](vec<journal_record>& records) -> vresult<transaction_stats> {
+        transaction_stats stats;
+
+        for (auto it = records.rbegin(); it != records.rend(); ++it) {
+            if (auto res = apply_if_changed(vars, it->before, stats); !res.is_ok())
+                return lak::err_t { res.unsafe_unwrap_err() };
+        }
+
+        return remove_journal(path).map([&](auto) { return stats; });
+    });
+}
+
+auto resume_journal(efivar_backend& vars, lak::astring_view path) -> vresult<transaction_stats> {
+    return read_journal(path).and_then([&](vec<journal_record>& records) -> vresult<transaction_stats> {
+        transaction_stats stats;
+
+        for (journal_record& rec : records) {
+            if (auto res = apply_if_changed(vars, rec.after, stats); !res.is_ok())
+                return lak::err_t { res.unsafe_unwrap_err() };
+        }
+
+        return remove_journal(path).map([&](auto) { return stats; });
+    });
+}
+
+}
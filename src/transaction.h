@@ -0,0 +1,90 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+namespace efibootmgrw {
+
+struct var_change {
+    lak::wstring name;
+    lak::wstring guid;
+    // Unset to delete the variable.
+    lak::optional<vec<byte_t>> data;
+    u32 attributes = efi_variable_default_attributes;
+};
+
+struct transaction_stats {
+    size_t written = 0;
+    size_t deleted = 0;
+    // Already held the requested value, so weren't touched.
+    size_t skipped = 0;
+};
+
+/*
+ * Collects variable changes and applies them as one batch.
+ *
+ * Later changes to a variable replace earlier ones, and changes that
+ * wouldn't alter what's stored are dropped before anything is written.
+ * New Boot####, Driver#### and other load options go first, then
+ * BootOrder and friends, then load option deletions, so no order
+ * variable ever points at a missing entry.
+ *
+ * A variable whose attributes change is removed and written again, as
+ * firmware won't change them in place. The old and new value of every
+ * change is journaled before the first write. A failed write rolls
+ * back what was applied. A run that dies part way leaves the journal
+ * for rollback_journal/resume_journal.
+ */
+struct transaction {
+    void set(
+            lak::wstring_view name,
+            lak::wstring_view guid,
+            lak::span<const byte_t> data,
+            u32 attributes = efi_variable_default_attributes
+    );
+
+    void remove(lak::wstring_view name, lak::wstring_view guid);
+
+    void set_boot_order(lak::span<const u16> order);
+
+    [[nodiscard]]
+    auto changes() const -> lak::span<const var_change> {
+        return lak::span<const var_change> { changes_.data(), changes_.size() };
+    }
+
+    [[nodiscard]]
+    auto empty() const -> bool {
+        return changes_.empty();
+    }
+
+    [[nodiscard]]
+    auto commit(efivar_backend& vars, lak::astring_view journal_path) -> vresult<transaction_stats>;
+
+private:
+    vec<var_change> changes_;
+};
+
+// Where the journal goes unless --journal says otherwise.
+[[nodiscard]]
+auto default_journal_path() -> lak::astring_view;
+
+[[nodiscard]]
+auto journal_exists(lak::astring_view path) -> bool;
+
+/*
+ * A journal of the simulator's own beside journal_path, starting as a
+ * copy of it if there is one. --simulate recovers from and commits to
+ * this, so the real journal is never removed, and a simulated commit
+ * never leaves one for a real run to find. Removing it is up to the caller.
+ */
+[[nodiscard]]
+auto simulated_journal(lak::astring_view journal_path) -> vresult<std::string>;
+
+// Puts back every value the journal recorded as old, then removes it.
+[[nodiscard]]
+auto rollback_journal(efivar_backend& vars, lak::astring_view path) -> vresult<transaction_stats>;
+
+// Applies every value the journal recorded as new, then removes it.
+[[nodiscard]]
+auto resume_journal(efivar_backend& vars, lak::astring_view path) -> vresult<transaction_stats>;
+
+}
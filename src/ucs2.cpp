@@ -0,0 +1,214 @@
+#include "ucs2.h"
+
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+# define EFIBOOTMGRW_SSE2
+# include <immintrin.h>
+// AVX2 needs per-function target attributes and a runtime check, so GCC and clang only.
+# if defined(__GNUC__)
+#  define EFIBOOTMGRW_AVX2
+# endif
+#endif
+
+namespace efibootmgrw {
+
+namespace {
+
+// For encoding through append_utf8 straight into a buffer already big enough.
+struct raw_out {
+    char* p;
+
+    void push_back(char c) {
+        *p++ = c;
+    }
+};
+
+// Encodes the code point at str[i], a surrogate pair counting as one.
+inline void encode_one(const char16_t* str, size_t n, size_t& i, raw_out& out) {
+    char32_t c = str[i++];
+
+    if (c >= 0xD800 && c < 0xDC00 && i < n && str[i] >= 0xDC00 && str[i] < 0xE000)
+        c = 0x10000 + ((c - 0xD800) << 10) + (str[i++] - 0xDC00);
+
+    append_utf8(out, c);
+}
+
+#ifdef EFIBOOTMGRW_SSE2
+auto find_nul16_sse2(const char16_t* str, size_t n) -> size_t {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)));
+
+        if (mask)
+            return i + std::countr_zero(mask) / 2;
+    }
+
+    // The last few units are covered by one more load ending at n, ignoring
+    // the units it has in common with the block before.
+    if (i < n && n >= 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + n - 8));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero))) >> ((i - (n - 8)) * 2);
+
+        return mask ? i + std::countr_zero(mask) / 2 : n;
+    }
+
+    return i + find_nul16_scalar(lak::span<const char16_t> { str + i, n - i });
+}
+
+/*
+ * Blocks of 8 that are all ASCII are narrowed and stored in one go. Any
+ * other block stores its ASCII prefix the same way (the bytes past it are
+ * overwritten after), then encodes one code point the slow way.
+ *
+ * out has room for 3 bytes a unit and i + 8 <= n, so the 8 byte store
+ * never runs past it.
+ */
+void utf16_to_utf8_sse2(const char16_t* str, size_t n, size_t& i, raw_out& out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i non_ascii = _mm_set1_epi16(static_cast<short>(0xFF80));
+
+    while (i + 8 <= n) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+        auto ascii = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, non_ascii), zero)));
+
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out.p), _mm_packus_epi16(v, v));
+
+        if (ascii == 0xFFFF) {
+            i += 8;
+            out.p += 8;
+            continue;
+        }
+
+        auto prefix = static_cast<size_t>(std::countr_one(ascii) / 2);
+        i += prefix;
+        out.p += prefix;
+
+        encode_one(str, n, i, out);
+    }
+
+    /*
+     * If the last 8 units are all ASCII, the ones already encoded came out
+     * a byte each, so a store ending at n rewrites them unchanged and
+     * finishes the string.
+     */
+    if (i < n && n >= 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + n - 8));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, non_ascii), zero)) == 0xFFFF) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out.p - (i - (n - 8))), _mm_packus_epi16(v, v));
+            out.p += n - i;
+            i = n;
+        }
+    }
+}
+#endif
+
+#ifdef EFIBOOTMGRW_AVX2
+[[nodiscard]]
+auto cpu_has_avx2() -> bool {
+    static const bool has = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return has;
+}
+
+__attribute__((target("avx2")))
+auto find_nul16_avx2(const char16_t* str, size_t n) -> size_t {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, zero)));
+
+        if (mask)
+            return i + std::countr_zero(mask) / 2;
+    }
+
+    return i + find_nul16_sse2(str + i, n - i);
+}
+
+// As the SSE2 version, 16 units at a time.
+__attribute__((target("avx2")))
+void utf16_to_utf8_avx2(const char16_t* str, size_t n, size_t& i, raw_out& out) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i non_ascii = _mm256_set1_epi16(static_cast<short>(0xFF80));
+
+    while (i + 16 <= n) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i));
+        auto ascii = static_cast<unsigned>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(v, non_ascii), zero)));
+
+        // packus narrows within each 128 bit lane, so gather the two low halves.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0b1000);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out.p), _mm256_castsi256_si128(packed));
+
+        if (ascii == 0xFFFFFFFF) {
+            i += 16;
+            out.p += 16;
+            continue;
+        }
+
+        auto prefix = static_cast<size_t>(std::countr_one(ascii) / 2);
+        i += prefix;
+        out.p += prefix;
+
+        encode_one(str, n, i, out);
+    }
+}
+#endif
+
+}
+
+auto find_nul16_scalar(lak::span<const char16_t> str) -> size_t {
+    size_t i = 0;
+    while (i < str.size() && str[i] != 0)
+        ++i;
+    return i;
+}
+
+auto find_nul16(lak::span<const char16_t> str) -> size_t {
+#if defined(EFIBOOTMGRW_AVX2)
+    if (str.size() >= 16 && cpu_has_avx2())
+        return find_nul16_avx2(str.data(), str.size());
+#endif
+#if defined(EFIBOOTMGRW_SSE2)
+    return find_nul16_sse2(str.data(), str.size());
+#else
+    return find_nul16_scalar(str);
+#endif
+}
+
+auto utf16_to_utf8_scalar(lak::u16string_view str, char* out) -> size_t {
+    raw_out o { out };
+
+    for (size_t i = 0; i < str.size();)
+        encode_one(str.data(), str.size(), i, o);
+
+    return static_cast<size_t>(o.p - out);
+}
+
+auto utf16_to_utf8(lak::u16string_view str, char* out) -> size_t {
+    raw_out o { out };
+    size_t i = 0;
+
+#if defined(EFIBOOTMGRW_AVX2)
+    if (str.size() >= 16 && cpu_has_avx2())
+        utf16_to_utf8_avx2(str.data(), str.size(), i, o);
+#endif
+#if defined(EFIBOOTMGRW_SSE2)
+    utf16_to_utf8_sse2(str.data(), str.size(), i, o);
+#endif
+
+    while (i < str.size())
+        encode_one(str.data(), str.size(), i, o);
+
+    return static_cast<size_t>(o.p - out);
+}
+
+}
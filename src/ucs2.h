@@ -0,0 +1,68 @@
+#pragma once
+
+#include "efibootmgrw.h"
+
+namespace efibootmgrw {
+
+/*
+ * Index of the first null in str, or str.size() if there isn't one. SSE2
+ * on x86-64, AVX2 where the CPU has it.
+ */
+[[nodiscard]]
+auto find_nul16(lak::span<const char16_t> str) -> size_t;
+
+[[nodiscard]]
+auto find_nul16_scalar(lak::span<const char16_t> str) -> size_t;
+
+/*
+ * Writes str as UTF-8 to out, which needs room for 3 bytes a unit, and
+ * returns how many bytes were written. Runs of ASCII are narrowed a vector
+ * at a time where find_nul16 is vectorized.
+ */
+[[nodiscard]]
+auto utf16_to_utf8(lak::u16string_view str, char* out) -> size_t;
+
+[[nodiscard]]
+auto utf16_to_utf8_scalar(lak::u16string_view str, char* out) -> size_t;
+
+// Firmware strings are UCS-2, though some firmware happily writes UTF-16 anyway.
+// Lone surrogates are encoded as they are rather than replaced.
+template<typename OUT>
+inline void append_u8string(OUT& out, lak::u16string_view str) {
+    size_t old_size = out.size();
+    out.resize(old_size + str.size() * 3);
+    out.resize(old_size + utf16_to_utf8(str, out.data() + old_size));
+}
+
+// UTF-8 in, f(char16_t) for each UTF-16 unit out. Doesn't validate.
+template<typename F>
+inline void for_each_u16(lak::astring_view str, F&& f) {
+    for (size_t i = 0; i < str.size();) {
+        auto b = static_cast<u8>(str[i]);
+        size_t n = b < 0x80 ? 1 : b < 0xE0 ? 2 : b < 0xF0 ? 3 : 4;
+        char32_t c = n == 1 ? b : n == 2 ? b & 0x1F : n == 3 ? b & 0x0F : b & 0x07;
+
+        for (size_t j = 1; j < n && i + j < str.size(); ++j)
+            c = (c << 6) | (static_cast<u8>(str[i + j]) & 0x3F);
+
+        i += n;
+
+        if (c >= 0x10000) {
+            c -= 0x10000;
+            f(static_cast<char16_t>(0xD800 + (c >> 10)));
+            f(static_cast<char16_t>(0xDC00 + (c & 0x3FF)));
+        } else {
+            f(static_cast<char16_t>(c));
+        }
+    }
+}
+
+[[nodiscard]]
+inline auto to_u8string(lak::u16string_view str) -> std::string {
+    std::string out;
+    out.reserve(str.size());
+    append_u8string(out, str);
+    return out;
+}
+
+}
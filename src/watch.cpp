@@ -0,0 +1,428 @@
+#include "watch.h"
+#include "device_path_text.h"
+#include "efi_load_option.h"
+#include "json_writer.h"
+#include "load_option_inventory.h"
+#include "ucs2.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <thread>
+
+#ifndef _WIN32
+# include "efivarfs_backend.h"
+# include <cerrno>
+# include <cctype>
+# include <poll.h>
+# include <unistd.h>
+# include <sys/inotify.h>
+#endif
+
+namespace efibootmgrw {
+
+namespace {
+
+using var_map = std::map<lak::wstring, vec<byte_t>>;
+
+constexpr lak::wstring_view global_names[] = { L"BootOrder", L"BootNext", L"BootCurrent", L"Timeout" };
+
+constexpr std::chrono::seconds min_poll_interval { 1 };
+constexpr std::chrono::seconds max_poll_interval { 30 };
+
+// How long to wait for the rest of a burst of changes, e.g. an entry and BootOrder.
+constexpr int settle_ms = 100;
+
+[[nodiscard]]
+auto is_watched(lak::wstring_view name) -> bool {
+    return parse_load_option_name(name)
+           || std::find(std::begin(global_names), std::end(global_names), name) != std::end(global_names);
+}
+
+/*
+ * A variable that exists but can't be read this time keeps its value from
+ * previous, so a flaky read isn't reported as a removal and re-adding.
+ */
+void keep_previous(var_map& out, const var_map& previous, lak::wstring_view name) {
+    if (auto it = previous.find(lak::wstring(name.begin(), name.end())); it != previous.end())
+        out.insert(*it);
+}
+
+[[nodiscard]]
+auto load_all(efivar_backend& vars, size_t jobs, const var_map& previous) -> vresult<var_map> {
+    vresult<load_option_inventory> inv = load_option_inventory::load(vars, jobs);
+
+    if (!inv.is_ok())
+        return lak::err_t { inv.unsafe_unwrap_err() };
+
+    var_map out;
+
+    for (const load_option_inventory::entry& e : inv.unsafe_unwrap().entries()) {
+        load_option_name name { e.cls, e.id };
+
+        if (e.err)
+            keep_previous(out, previous, name);
+        else
+            out.emplace(name.view(), vec<byte_t>(e.data.begin(), e.data.end()));
+    }
+
+    bump_arena arena;
+
+    for (lak::wstring_view name : global_names) {
+        vresult<lak::span<byte_t>> data = read_variable(vars, name, efi_global_variable, arena);
+
+        if (data.is_ok())
+            out.emplace(name, vec<byte_t>(data.unsafe_unwrap().begin(), data.unsafe_unwrap().end()));
+        else if (data.unsafe_unwrap_err().kind != var_err::kind_t::not_found)
+            keep_previous(out, previous, name);
+    }
+
+    return lak::ok_t { std::move(out) };
+}
+
+enum class change_kind {
+    added,
+    removed,
+    changed,
+};
+
+[[nodiscard]]
+auto to_string(change_kind kind) -> lak::astring_view {
+    switch (kind) {
+        case change_kind::added:   return "added";
+        case change_kind::removed: return "removed";
+        case change_kind::changed: return "changed";
+    }
+
+    unreachable();
+    return { };
+}
+
+[[nodiscard]]
+auto u16_at(const vec<byte_t>& data, size_t i) -> u16 {
+    u16 v;
+    std::memcpy(&v, data.data() + i * sizeof(u16), sizeof(u16));
+    return v;
+}
+
+struct change_printer {
+    explicit change_printer(Context& ctx) : ctx { ctx } {}
+
+    Context& ctx;
+    fmt::memory_buffer out;
+    fmt::memory_buffer scratch;
+
+    void text(change_kind kind, lak::wstring_view name, const vec<byte_t>* data) {
+        append_u8string(out, name);
+        fmt::format_to(std::back_inserter(out), " {}", to_string(kind));
+
+        if (data) {
+            if (name == lak::wstring_view { L"BootOrder" }) {
+                out.push_back(':');
+                for (size_t i = 0; i < data->size() / sizeof(u16); ++i)
+                    fmt::format_to(std::back_inserter(out), "{}{:0>4X}", i ? "," : " ", u16_at(*data, i));
+            } else if (!parse_load_option_name(name)) {
+                if (data->size() >= sizeof(u16)) {
+                    if (name == lak::wstring_view { L"Timeout" })
+                        fmt::format_to(std::back_inserter(out), ": {} seconds", u16_at(*data, 0));
+                    else
+                        fmt::format_to(std::back_inserter(out), ": {:0>4X}", u16_at(*data, 0));
+                }
+            } else {
+                load_option_view::parse(lak::span<const byte_t> { data->data(), data->size() })
+                    .if_ok([&](load_option_view opt) {
+                        fmt::format_to(std::back_inserter(out), ": ");
+                        append_u8string(out, opt.desc());
+
+                        if (ctx.args.verbose) {
+                            out.push_back('\t');
+                            format_device_path(out, opt.file_path_list());
+                        }
+                    })
+                    .if_err([&](load_option_err err) {
+                        fmt::format_to(std::back_inserter(out), ": malformed, {}", to_string(err));
+                    });
+            }
+        }
+
+        out.push_back('\n');
+    }
+
+    void json(change_kind kind, lak::wstring_view name, const vec<byte_t>* data) {
+        json_writer w { out };
+
+        scratch.clear();
+        append_u8string(scratch, name);
+
+        w.begin_object();
+        w.key("event");
+        w.value(to_string(kind));
+        w.key("variable");
+        w.value(lak::astring_view { scratch.data(), scratch.size() });
+
+        if (data) {
+            if (name == lak::wstring_view { L"BootOrder" }) {
+                w.key("boot_order");
+                w.begin_array();
+                for (size_t i = 0; i < data->size() / sizeof(u16); ++i)
+                    w.value(u64(u16_at(*data, i)));
+                w.end_array();
+            } else if (!parse_load_option_name(name)) {
+                if (data->size() >= sizeof(u16)) {
+                    w.key("value");
+                    w.value(u64(u16_at(*data, 0)));
+                }
+            } else {
+                load_option_view::parse(lak::span<const byte_t> { data->data(), data->size() })
+                    .if_ok([&](load_option_view opt) {
+                        w.key("attributes");
+                        w.value(u64(opt.attributes()));
+                        w.key("active");
+                        w.value(opt.active());
+                        w.key("label");
+                        w.value(opt.desc());
+
+                        scratch.clear();
+                        format_device_path(scratch, opt.file_path_list());
+                        w.key("device_path");
+                        w.value(lak::astring_view { scratch.data(), scratch.size() });
+
+                        w.key("optional_data");
+                        w.value_hex(opt.optional_data());
+                    })
+                    .if_err([&](load_option_err err) {
+                        w.key("error");
+                        w.value(to_string(err));
+                    });
+            }
+        }
+
+        w.end_object();
+        w.newline();
+    }
+
+    void print(change_kind kind, lak::wstring_view name, const vec<byte_t>* data) {
+        if (ctx.args.json || ctx.args.ndjson)
+            json(kind, name, data);
+        else
+            text(kind, name, data);
+    }
+
+    void flush() {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        std::fflush(stdout);
+        out.clear();
+    }
+};
+
+// Prints how after differs from before, returns whether it does at all.
+auto print_changes(change_printer& printer, const var_map& before, const var_map& after) -> bool {
+    bool any = false;
+    auto b = before.begin();
+    auto a = after.begin();
+
+    while (b != before.end() || a != after.end()) {
+        if (a == after.end() || (b != before.end() && b->first < a->first)) {
+            printer.print(change_kind::removed, b->first, nullptr);
+            any = true;
+            ++b;
+        } else if (b == before.end() || a->first < b->first) {
+            printer.print(change_kind::added, a->first, &a->second);
+            any = true;
+            ++a;
+        } else {
+            if (a->second != b->second) {
+                printer.print(change_kind::changed, a->first, &a->second);
+                any = true;
+            }
+            ++a;
+            ++b;
+        }
+    }
+
+    printer.flush();
+    return any;
+}
+
+#ifndef _WIN32
+
+// "Name-guid" of a global variable to Name, nullopt for anything else.
+[[nodiscard]]
+auto global_variable_of(lak::astring_view file) -> lak::optional<lak::wstring> {
+    constexpr size_t guid_chars = 36;
+
+    if (file.size() < guid_chars + 2 || file[file.size() - guid_chars - 1] != '-')
+        return lak::nullopt;
+
+    lak::astring_view guid { file.end() - guid_chars, file.end() };
+
+    // efi_global_variable, braces dropped and lower cased as efivarfs has it
+    for (size_t i = 0; i < guid_chars; ++i) {
+        auto want = static_cast<char>(std::tolower(static_cast<unsigned char>(efi_global_variable[i + 1])));
+        if (guid[i] != want)
+            return lak::nullopt;
+    }
+
+    return lak::wstring(file.begin(), file.end() - guid_chars - 1);
+}
+
+/*
+ * Blocks until inotify reports something in the directory, then re-reads
+ * just the variables it named. inotify only hears about writes made through
+ * efivarfs, so --watch-rescan also re-reads everything after that long
+ * without any. Returns false if inotify stops working, so the caller can
+ * fall back to polling.
+ */
+auto watch_inotify(Context& ctx, efivar_backend& vars, lak::astring_view dir, var_map& state, change_printer& printer)
+-> vresult<bool> {
+    int fd = ::inotify_init1(IN_CLOEXEC);
+
+    if (fd < 0)
+        return lak::ok_t { false };
+
+    std::string path { dir.begin(), dir.end() };
+
+    constexpr u32 mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_ATTRIB;
+
+    if (::inotify_add_watch(fd, path.c_str(), mask) < 0) {
+        ::close(fd);
+        return lak::ok_t { false };
+    }
+
+    alignas(inotify_event) char buf[16 * 1024];
+    vec<lak::wstring> touched;
+    bump_arena arena;
+
+    // -1 waits for an event however long it takes.
+    int rescan_ms = ctx.args.watch_rescan ? static_cast<int>(*ctx.args.watch_rescan * 1000) : -1;
+
+    for (;;) {
+        touched.clear();
+        bool reread_all = false;
+
+        // Wait for the first event, then gather the rest of the burst.
+        for (bool first = true;;) {
+            pollfd p { fd, POLLIN, 0 };
+            int ready = ::poll(&p, 1, first ? rescan_ms : settle_ms);
+
+            if (ready < 0 && errno == EINTR)
+                continue;
+
+            if (ready == 0 && first)
+                reread_all = true;
+
+            if (ready <= 0)
+                break;
+
+            first = false;
+
+            ssize_t len = ::read(fd, buf, sizeof(buf));
+
+            if (len <= 0) {
+                ::close(fd);
+                return lak::ok_t { false };
+            }
+
+            for (ssize_t i = 0; i < len;) {
+                const auto* ev = reinterpret_cast<const inotify_event*>(buf + i);
+                i += static_cast<ssize_t>(sizeof(inotify_event) + ev->len);
+
+                if (ev->mask & IN_Q_OVERFLOW)
+                    reread_all = true;
+
+                if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                    ::close(fd);
+                    return lak::ok_t { false };
+                }
+
+                if (ev->len == 0)
+                    continue;
+
+                lak::optional<lak::wstring> name = global_variable_of(lak::astring_view::from_c_str(ev->name));
+
+                if (name && is_watched(*name) && std::find(touched.begin(), touched.end(), *name) == touched.end())
+                    touched.push_back(std::move(*name));
+            }
+        }
+
+        var_map next;
+
+        if (reread_all) {
+            vresult<var_map> all = load_all(vars, ctx.args.jobs, state);
+
+            if (!all.is_ok()) {
+                ::close(fd);
+                return lak::err_t { all.unsafe_unwrap_err() };
+            }
+
+            next = std::move(all.unsafe_unwrap());
+        } else {
+            next = state;
+
+            for (const lak::wstring& name : touched) {
+                vresult<lak::span<byte_t>> data = read_variable(vars, name, efi_global_variable, arena);
+
+                // Anything else unreadable keeps its last value, as in load_all.
+                if (data.is_ok())
+                    next[name].assign(data.unsafe_unwrap().begin(), data.unsafe_unwrap().end());
+                else if (data.unsafe_unwrap_err().kind == var_err::kind_t::not_found)
+                    next.erase(name);
+            }
+
+            // Nothing read from here on outlives this burst.
+            arena = bump_arena { };
+        }
+
+        print_changes(printer, state, next);
+        state = std::move(next);
+    }
+}
+
+#endif
+
+}
+
+auto watch(Context& ctx, efivar_backend& vars) -> vresult<lak::monostate> {
+    change_printer printer { ctx };
+    vresult<var_map> initial = load_all(vars, ctx.args.jobs, { });
+
+    if (!initial.is_ok())
+        return lak::err_t { initial.unsafe_unwrap_err() };
+
+    var_map state = std::move(initial.unsafe_unwrap());
+    print_changes(printer, { }, state);
+
+#ifndef _WIN32
+    if (const auto* fs = dynamic_cast<const efivarfs_backend*>(&vars)) {
+        vresult<bool> res = watch_inotify(ctx, vars, fs->dir(), state, printer);
+
+        if (!res.is_ok())
+            return lak::err_t { res.unsafe_unwrap_err() };
+
+        // inotify gave up on us, poll instead.
+    }
+#endif
+
+    std::chrono::seconds interval = min_poll_interval;
+
+    for (;;) {
+        std::this_thread::sleep_for(interval);
+
+        vresult<var_map> next = load_all(vars, ctx.args.jobs, state);
+
+        if (!next.is_ok())
+            return lak::err_t { next.unsafe_unwrap_err() };
+
+        if (print_changes(printer, state, next.unsafe_unwrap()))
+            interval = min_poll_interval;
+        else
+            interval = std::min(interval * 2, max_poll_interval);
+
+        state = std::move(next.unsafe_unwrap());
+    }
+}
+
+}
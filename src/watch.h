@@ -0,0 +1,21 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+namespace efibootmgrw {
+
+/*
+ * --watch: prints the boot configuration once, then only what changes,
+ * a line per variable added, removed or changed (a JSON object per line
+ * with --json or --ndjson). Never returns unless reading fails.
+ *
+ * On efivarfs only the variables inotify reports as touched are re-read,
+ * and changes that didn't go through efivarfs go unseen unless
+ * --watch-rescan asks for a full re-read after a quiet spell. Elsewhere
+ * everything is re-read on a poll that backs off from 1 to 30 seconds
+ * while nothing changes.
+ */
+[[nodiscard]]
+auto watch(Context& ctx, efivar_backend& vars) -> vresult<lak::monostate>;
+
+}
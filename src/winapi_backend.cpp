@@ -0,0 +1,58 @@
+#ifdef _WIN32
+
+#include "winapi_backend.h"
+#include "native_methods.h"
+
+namespace efibootmgrw {
+
+namespace {
+
+[[nodiscard]]
+auto to_var_err(winapi::win_err e) -> var_err {
+    var_err::kind_t kind;
+
+    switch (e.err) {
+        case ERROR_ENVVAR_NOT_FOUND:      kind = var_err::kind_t::not_found; break;
+        case ERROR_INSUFFICIENT_BUFFER:   kind = var_err::kind_t::buffer_too_small; break;
+        case ERROR_NOT_ENOUGH_MEMORY:
+        case ERROR_NO_SYSTEM_RESOURCES:   kind = var_err::kind_t::out_of_space; break;
+        case ERROR_ACCESS_DENIED:
+        case ERROR_PRIVILEGE_NOT_HELD:    kind = var_err::kind_t::access_denied; break;
+        // What we get on legacy BIOS systems.
+        case ERROR_INVALID_FUNCTION:      kind = var_err::kind_t::unsupported; break;
+        default:                          kind = var_err::kind_t::io; break;
+    }
+
+    return var_err { kind, static_cast<i64>(e.err) };
+}
+
+}
+
+auto winapi_backend::read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+-> vresult<lak::span<void>> {
+    return winapi::get_firmware_env_var(name, guid, buf, attributes).map_err(to_var_err);
+}
+
+auto winapi_backend::write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+-> vresult<lak::monostate> {
+    return winapi::set_firmware_env_var(name, guid, buf, attributes).map_err(to_var_err);
+}
+
+auto winapi_backend::remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> {
+    // A zero sized write deletes the variable.
+    return winapi::set_firmware_env_var(name, guid, { }, efi_variable_default_attributes).map_err(to_var_err);
+}
+
+auto winapi_backend::enumerate() -> vresult<vec<efi_var_name>> {
+    return lak::err_t { var_err { var_err::kind_t::unsupported } };
+}
+
+auto winapi_backend::authenticate(Context& ctx) -> vresult<lak::monostate> {
+    return winapi::open_current_process_token(winapi::token_adjust_privileges | winapi::token_query)
+            .and_then([&](winapi::handle_t token) { return winapi::authenticate(ctx, token); })
+            .map_err(to_var_err);
+}
+
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "efivar_backend.h"
+
+namespace efibootmgrw {
+
+struct winapi_backend final : efivar_backend {
+    [[nodiscard]]
+    auto read(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32* attributes)
+    -> vresult<lak::span<void>> override;
+
+    auto write(lak::wstring_view name, lak::wstring_view guid, lak::span<void> buf, u32 attributes)
+    -> vresult<lak::monostate> override;
+
+    auto remove(lak::wstring_view name, lak::wstring_view guid) -> vresult<lak::monostate> override;
+
+    // There's no documented way to list variables through the Win32 API.
+    [[nodiscard]]
+    auto enumerate() -> vresult<vec<efi_var_name>> override;
+
+    // The kernel serialises calls into firmware for us.
+    [[nodiscard]]
+    auto thread_safe() const -> bool override {
+        return true;
+    }
+
+    auto authenticate(Context& ctx) -> vresult<lak::monostate> override;
+};
+
+}
@@ -0,0 +1,155 @@
+#include "test.h"
+#include "fixtures.h"
+
+#include "batch.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace efibootmgrw::test {
+
+namespace {
+
+// A path of its own, name may have spaces, removed again afterwards.
+struct temp_path {
+    std::string path;
+
+    explicit temp_path(std::string_view name) {
+        static size_t count = 0;
+        path = (std::filesystem::temp_directory_path()
+                / fmt::format("efibootmgrw-test-{} {}", count++, name)).string();
+        std::remove(path.c_str());
+    }
+
+    ~temp_path() {
+        std::remove(path.c_str());
+    }
+
+    [[nodiscard]]
+    auto view() const -> lak::astring_view {
+        return lak::astring_view { path.data(), path.size() };
+    }
+};
+
+struct temp_file : temp_path {
+    explicit temp_file(std::string_view text, std::string_view name = "batch") : temp_path { name } {
+        std::ofstream out { path, std::ios::binary | std::ios::trunc };
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+};
+
+// Plans batch against vars, as efibootmgrw --batch would with nothing else on the command line.
+[[nodiscard]]
+auto plan(efivar_backend& vars, const temp_file& batch) -> vresult<transaction> {
+    Context ctx;
+    ctx.args.batch_file = batch.view();
+    return plan_batch(ctx, vars);
+}
+
+[[nodiscard]]
+auto commit(sim_backend& sim, const temp_file& batch, const temp_path& journal) -> vresult<transaction_stats> {
+    vresult<transaction> tx = plan(sim, batch);
+    CHECK(tx.is_ok());
+
+    if (!tx.is_ok())
+        return lak::err_t { tx.unsafe_unwrap_err() };
+
+    return tx.unsafe_unwrap().commit(sim, journal.view());
+}
+
+[[nodiscard]]
+auto boot_order(sim_backend& sim) -> vec<u16> {
+    bump_arena arena;
+    vresult<lak::span<byte_t>> res = read_variable(sim, L"BootOrder", efi_global_variable, arena);
+
+    if (!res.is_ok())
+        return { };
+
+    vec<u16> order(res.unsafe_unwrap().size() / sizeof(u16));
+    std::memcpy(order.data(), res.unsafe_unwrap().data(), order.size() * sizeof(u16));
+    return order;
+}
+
+[[nodiscard]]
+auto u16_value(sim_backend& sim, lak::wstring_view name) -> lak::optional<u16> {
+    u16 value;
+    vresult<lak::span<void>> res = sim.read(name, efi_global_variable, { &value, sizeof(value) }, nullptr);
+
+    if (!res.is_ok() || res.unsafe_unwrap().size_bytes() != sizeof(value))
+        return lak::nullopt;
+
+    return value;
+}
+
+[[nodiscard]]
+auto exists(sim_backend& sim, lak::wstring_view name) -> bool {
+    return sim.size(name, efi_global_variable).is_ok();
+}
+
+}
+
+TEST(batch_lines_see_earlier_lines_changes) {
+    // The second -B drops Boot0002 from the BootOrder the first left, not
+    // the one in firmware, or Boot0001 would come back.
+    std::unique_ptr<sim_backend> sim = make_store(4);
+    temp_file batch { "-b 0001 -B\n-b 0002 -B\n" };
+    temp_path journal { "journal" };
+
+    CHECK(commit(*sim, batch, journal).is_ok());
+    CHECK(boot_order(*sim) == vec<u16> { 0, 3 });
+    CHECK(!exists(*sim, L"Boot0001"));
+    CHECK(!exists(*sim, L"Boot0002"));
+}
+
+TEST(batch_skips_comments_and_blank_lines) {
+    std::unique_ptr<sim_backend> sim = make_store(4);
+    temp_file batch { "# -b 0003 -B\n\n   # -t 9\n\t\n-n 0002\n" };
+    temp_path journal { "journal" };
+
+    CHECK(commit(*sim, batch, journal).is_ok());
+    CHECK(exists(*sim, L"Boot0003"));
+    CHECK(boot_order(*sim) == vec<u16> { 0, 1, 2, 3 });
+    CHECK(u16_value(*sim, L"Timeout") == u16(0));
+    CHECK(u16_value(*sim, L"BootNext") == u16(2));
+}
+
+TEST(batch_unquotes_arguments) {
+    std::unique_ptr<sim_backend> sim = make_store(4);
+    temp_file state { "Timeout 9\n", "boot menu.conf" };
+    temp_file batch { fmt::format("--apply \"{}\"\n-n '0003'\n-o \"0003\",'0000'\n", state.path) };
+    temp_path journal { "journal" };
+
+    CHECK(commit(*sim, batch, journal).is_ok());
+    CHECK(u16_value(*sim, L"Timeout") == u16(9));
+    CHECK(u16_value(*sim, L"BootNext") == u16(3));
+    CHECK(boot_order(*sim) == vec<u16> { 3, 0 });
+}
+
+TEST(batch_commits_every_line_as_one_transaction) {
+    // Timeout, set by the last line, fails to write, and the first line's
+    // changes come back out with it.
+    std::unique_ptr<sim_backend> sim = make_store(4);
+    temp_file batch { "-b 0001 -B\n-n 0002\n-t 7\n" };
+    temp_path journal { "journal" };
+
+    sim->inject(sim_fault { sim_fault::op_t::write, var_err::kind_t::io, L"Timeout" });
+
+    CHECK(!commit(*sim, batch, journal).is_ok());
+    CHECK(exists(*sim, L"Boot0001"));
+    CHECK(boot_order(*sim) == vec<u16> { 0, 1, 2, 3 });
+    CHECK(!exists(*sim, L"BootNext"));
+    CHECK(u16_value(*sim, L"Timeout") == u16(0));
+    CHECK(!journal_exists(journal.view()));
+
+    // And without the fault, all of it lands through the one journal.
+    CHECK(commit(*sim, batch, journal).is_ok());
+    CHECK(!exists(*sim, L"Boot0001"));
+    CHECK(boot_order(*sim) == vec<u16> { 0, 2, 3 });
+    CHECK(u16_value(*sim, L"BootNext") == u16(2));
+    CHECK(u16_value(*sim, L"Timeout") == u16(7));
+    CHECK(!journal_exists(journal.view()));
+}
+
+}
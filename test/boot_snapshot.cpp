@@ -0,0 +1,27 @@
+#include "test.h"
+
+#include "boot_snapshot.h"
+#include "sim_backend.h"
+
+namespace efibootmgrw::test {
+
+TEST(boot_snapshot_takes_only_whole_u16s) {
+    sim_backend sim;
+    u8 bytes[] = { 0x05, 0x00, 0x07 };
+
+    auto write = [&](lak::wstring_view name, size_t size) {
+        (void) sim.write(name, efi_global_variable, { bytes, size }, efi_variable_default_attributes);
+    };
+
+    write(L"BootNext", 2);
+    write(L"Timeout", 1);
+    write(L"BootCurrent", 3);
+
+    BootSnapshot snap = BootSnapshot::load(sim);
+
+    CHECK(snap.boot_next && *snap.boot_next == 5);
+    CHECK(!snap.timeout);
+    CHECK(!snap.boot_current);
+}
+
+}
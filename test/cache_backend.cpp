@@ -0,0 +1,158 @@
+#include "test.h"
+#include "fixtures.h"
+
+#include "cache_backend.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace efibootmgrw::test {
+
+namespace {
+
+// A cache path of its own, removed again afterwards.
+struct temp_cache {
+    std::string path;
+
+    temp_cache() {
+        static size_t count = 0;
+        path = (std::filesystem::temp_directory_path()
+                / fmt::format("efibootmgrw-test-{}.cache", count++)).string();
+        std::remove(path.c_str());
+    }
+
+    ~temp_cache() {
+        std::remove(path.c_str());
+    }
+
+    [[nodiscard]]
+    auto view() const -> lak::astring_view {
+        return lak::astring_view { path.data(), path.size() };
+    }
+
+    [[nodiscard]]
+    auto bytes() const -> vec<byte_t> {
+        std::ifstream in { path, std::ios::binary };
+        vec<char> chars { std::istreambuf_iterator<char> { in }, std::istreambuf_iterator<char> { } };
+        vec<byte_t> out(chars.size());
+        std::memcpy(out.data(), chars.data(), chars.size());
+        return out;
+    }
+
+    void overwrite(const vec<byte_t>& bytes) const {
+        std::ofstream out { path, std::ios::binary | std::ios::trunc };
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+};
+
+constexpr size_t entries = 3;
+
+// Reads BootOrder and every entry through vars, as a listing would.
+[[nodiscard]]
+auto read_all(efivar_backend& vars) -> vec<vec<byte_t>> {
+    vec<vec<byte_t>> out;
+    bump_arena arena;
+
+    auto one = [&](lak::wstring_view name) {
+        vresult<lak::span<byte_t>> res = read_variable(vars, name, efi_global_variable, arena);
+        CHECK(res.is_ok());
+
+        if (res.is_ok())
+            out.emplace_back(res.unsafe_unwrap().begin(), res.unsafe_unwrap().end());
+    };
+
+    one(L"BootOrder");
+
+    for (size_t i = 0; i < entries; ++i)
+        one(boot_option_name(static_cast<u16>(i)));
+
+    return out;
+}
+
+// Fills path with a cache of make_store(entries).
+void warm(const temp_cache& cache) {
+    cache_backend vars { make_store(entries), cache.view() };
+    (void) read_all(vars);
+    CHECK(vars.save().is_ok());
+}
+
+// Reads through a cache at path and checks it agrees with store, returning the hits.
+[[nodiscard]]
+auto hits_reading(const temp_cache& cache, std::unique_ptr<sim_backend> store) -> size_t {
+    vec<vec<byte_t>> expected = read_all(*store);
+
+    cache_backend vars { std::move(store), cache.view() };
+    CHECK(read_all(vars) == expected);
+
+    return vars.stats().hits;
+}
+
+}
+
+TEST(cache_backend_serves_unchanged_variables) {
+    temp_cache cache;
+    warm(cache);
+
+    CHECK(hits_reading(cache, make_store(entries)) == entries + 1);
+}
+
+TEST(cache_backend_truncated_cache_is_cold) {
+    temp_cache cache;
+    warm(cache);
+
+    vec<byte_t> bytes = cache.bytes();
+    bytes.resize(bytes.size() / 2);
+    cache.overwrite(bytes);
+
+    (void) hits_reading(cache, make_store(entries));
+}
+
+TEST(cache_backend_damaged_records_are_cold) {
+    temp_cache cache;
+    warm(cache);
+
+    // Every record's data pointing past the end of the file.
+    vec<byte_t> bytes = cache.bytes();
+    cache_header header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+
+    for (u32 i = 0; i < header.count; ++i) {
+        cache_record r;
+        byte_t* at = bytes.data() + sizeof(header) + i * sizeof(cache_record);
+        std::memcpy(&r, at, sizeof(r));
+        r.data_offset = static_cast<u32>(bytes.size());
+        r.data_size = 1;
+        std::memcpy(at, &r, sizeof(r));
+    }
+
+    cache.overwrite(bytes);
+
+    CHECK(hits_reading(cache, make_store(entries)) == 0);
+}
+
+TEST(cache_backend_garbage_is_cold) {
+    temp_cache cache;
+    cache.overwrite(vec<byte_t>(4096, byte_t { 0xAB }));
+
+    CHECK(hits_reading(cache, make_store(entries)) == 0);
+}
+
+TEST(cache_backend_changed_variables_miss) {
+    temp_cache cache;
+    warm(cache);
+
+    // Same names, but BootOrder and Boot0001 no longer what was cached.
+    std::unique_ptr<sim_backend> store = make_store(entries);
+    u16 order[] = { 2, 0 };
+    u8 entry[] = { 1, 2, 3 };
+
+    (void) store->write(L"BootOrder", efi_global_variable, { order, sizeof(order) }, efi_variable_default_attributes);
+    (void) store->write(L"Boot0001", efi_global_variable, { entry, sizeof(entry) }, efi_variable_default_attributes);
+
+    CHECK(hits_reading(cache, std::move(store)) == entries - 1);
+}
+
+}
@@ -0,0 +1,263 @@
+#include "test.h"
+
+#include "device_path_text.h"
+
+#include <initializer_list>
+
+namespace efibootmgrw::test {
+
+namespace {
+
+[[nodiscard]]
+auto format(lak::span<const byte_t> path) -> std::string {
+    fmt::memory_buffer out;
+    format_device_path(out, path);
+    return std::string(out.data(), out.size());
+}
+
+[[nodiscard]]
+auto parse(std::string_view text) -> lak::optional<vec<byte_t>> {
+    lak::optional<vec<byte_t>> out;
+
+    parse_device_path(lak::astring_view { text.data(), text.size() })
+        .if_ok([&](vec<byte_t>& bytes) { out = std::move(bytes); });
+
+    return out;
+}
+
+// A whole path of one node with exactly this payload.
+[[nodiscard]]
+auto node(DevicePathType type, u8 subtype, std::initializer_list<int> payload) -> vec<byte_t> {
+    device_path_writer w;
+    w.begin_node(type, subtype);
+    for (int b : payload)
+        w.put(static_cast<u8>(b));
+    w.end_node();
+    w.end_entire();
+    return std::move(w.bytes);
+}
+
+// Formatting and then parsing gives back the same bytes, and formatting those the same text.
+void check_format_round_trip(const vec<byte_t>& path, std::string_view expected_text, const char* file, int line) {
+    std::string text = format(lak::span<const byte_t> { path.data(), path.size() });
+
+    if (!expected_text.empty() && text != expected_text)
+        fail(file, line, fmt::format("formatted as {}, expected {}", text, expected_text));
+
+    lak::optional<vec<byte_t>> parsed = parse(text);
+
+    if (!parsed) {
+        fail(file, line, fmt::format("{} doesn't parse", text));
+        return;
+    }
+
+    if (*parsed != path)
+        fail(file, line, fmt::format("{} parses to different bytes", text));
+
+    std::string again = format(lak::span<const byte_t> { parsed->data(), parsed->size() });
+
+    if (again != text)
+        fail(file, line, fmt::format("{} formats back as {}", text, again));
+}
+
+// Parsing, formatting and parsing again gives the same bytes both times.
+void check_parse_round_trip(std::string_view text, const char* file, int line) {
+    lak::optional<vec<byte_t>> first = parse(text);
+
+    if (!first) {
+        fail(file, line, fmt::format("{} doesn't parse", text));
+        return;
+    }
+
+    std::string formatted = format(lak::span<const byte_t> { first->data(), first->size() });
+    lak::optional<vec<byte_t>> second = parse(formatted);
+
+    if (!second || *second != *first)
+        fail(file, line, fmt::format("{} formats as {}, which parses differently", text, formatted));
+}
+
+#define CHECK_FORMAT(PATH, TEXT) check_format_round_trip(PATH, TEXT, __FILE__, __LINE__)
+#define CHECK_PARSE(TEXT) check_parse_round_trip(TEXT, __FILE__, __LINE__)
+
+template<size_t N>
+void put_zeros(device_path_writer& w) {
+    for (size_t i = 0; i < N; ++i)
+        w.put(u8 { 0 });
+}
+
+[[nodiscard]]
+auto ipv4_node(bool with_gateway, u16 local_port, u16 remote_port) -> vec<byte_t> {
+    device_path_writer w;
+    w.begin_node(DevicePathType::Messaging, device_path::ipv4::subtype);
+    w.put(lak::array<u8, 4> { 192, 168, 0, 2 });
+    w.put(lak::array<u8, 4> { 192, 168, 0, 1 });
+    w.put(local_port);
+    w.put(remote_port);
+    w.put(u16 { 6 });
+    w.put(u8 { 1 });
+    if (with_gateway) {
+        w.put(lak::array<u8, 4> { 192, 168, 0, 254 });
+        w.put(lak::array<u8, 4> { 255, 255, 255, 0 });
+    }
+    w.end_node();
+    w.end_entire();
+    return std::move(w.bytes);
+}
+
+[[nodiscard]]
+auto ipv6_node(bool with_gateway, u16 local_port, u16 remote_port, u8 origin) -> vec<byte_t> {
+    lak::array<u8, 16> local { 0xFE, 0x80 };
+    local[15] = 2;
+    lak::array<u8, 16> remote { 0xFE, 0x80 };
+    remote[15] = 1;
+    lak::array<u8, 16> gateway { 0x20, 0x01, 0x0D, 0xB8 };
+    gateway[15] = 0xFF;
+
+    device_path_writer w;
+    w.begin_node(DevicePathType::Messaging, device_path::ipv6::subtype);
+    w.put(local);
+    w.put(remote);
+    w.put(local_port);
+    w.put(remote_port);
+    w.put(u16 { 17 });
+    w.put(origin);
+    if (with_gateway) {
+        w.put(u8 { 64 });
+        w.put(gateway);
+    }
+    w.end_node();
+    w.end_entire();
+    return std::move(w.bytes);
+}
+
+constexpr std::string_view guid_text = "11111111-2222-3333-4444-555555555555";
+
+}
+
+TEST(device_path_hardware_nodes_round_trip) {
+    CHECK_FORMAT(node(DevicePathType::Hardware, device_path::pci::subtype, { 0x2, 0x1C }), "Pci(0x1C,0x2)");
+
+    device_path_writer ven;
+    ven.begin_node(DevicePathType::Hardware, device_path::hardware_vendor::subtype);
+    byte_t guid[efi_guid::size];
+    efi_guid { 0x11111111, 0x2222, 0x3333, { 0x44, 0x44, 0x55, 0x55, 0x55, 0x55, 0x55, 0x55 } }.to_bytes(guid);
+    ven.put_bytes(guid);
+    ven.put(u8 { 0xAB });
+    ven.end_node();
+    ven.end_entire();
+    CHECK_FORMAT(ven.bytes, fmt::format("VenHw({},AB)", guid_text));
+}
+
+TEST(device_path_acpi_nodes_round_trip) {
+    CHECK_FORMAT(node(DevicePathType::Acpi, device_path::acpi::subtype, { 0xD0, 0x41, 0x03, 0x0A, 0, 0, 0, 0 }), "PciRoot(0x0)");
+    CHECK_FORMAT(node(DevicePathType::Acpi, device_path::acpi::subtype, { 0xD0, 0x41, 0x08, 0x0A, 1, 0, 0, 0 }), "PcieRoot(0x1)");
+    CHECK_FORMAT(node(DevicePathType::Acpi, device_path::acpi::subtype, { 0xD0, 0x41, 0x01, 0x05, 0, 0, 0, 0 }), "Acpi(PNP0501,0x0)");
+}
+
+TEST(device_path_messaging_nodes_round_trip) {
+    CHECK_FORMAT(node(DevicePathType::Messaging, device_path::usb::subtype, { 3, 0 }), "USB(0x3,0x0)");
+    CHECK_FORMAT(
+            node(DevicePathType::Messaging, device_path::sata::subtype, { 1, 0, 0xFF, 0xFF, 0, 0 }),
+            "Sata(0x1,0xFFFF,0x0)"
+    );
+    CHECK_FORMAT(
+            node(DevicePathType::Messaging, device_path::nvme::subtype, { 1, 0, 0, 0, 0, 0x25, 0x38, 0xB1, 0x21, 0x00, 0xA0, 0x01 }),
+            "NVMe(0x1,00-25-38-B1-21-00-A0-01)"
+    );
+
+    device_path_writer uri;
+    uri.begin_node(DevicePathType::Messaging, device_path::uri::subtype);
+    uri.put_bytes(lak::span<const byte_t> { reinterpret_cast<const byte_t*>("http://x/a(1).efi"), 17 });
+    uri.end_node();
+    uri.end_entire();
+    CHECK_FORMAT(uri.bytes, "Uri(http://x/a(1).efi)");
+}
+
+TEST(device_path_mac_round_trip) {
+    device_path_writer eth;
+    eth.begin_node(DevicePathType::Messaging, device_path::mac::subtype);
+    for (int b : { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 })
+        eth.put(static_cast<u8>(b));
+    put_zeros<26>(eth);
+    eth.put(u8 { 1 });
+    eth.end_node();
+    eth.end_entire();
+    CHECK_FORMAT(eth.bytes, "MAC(525400123456,0x1)");
+
+    // Garbage past the 6 bytes ethernet uses has to survive too.
+    device_path_writer junk;
+    junk.begin_node(DevicePathType::Messaging, device_path::mac::subtype);
+    for (int i = 0; i < 32; ++i)
+        junk.put(static_cast<u8>(i + 1));
+    junk.put(u8 { 1 });
+    junk.end_node();
+    junk.end_entire();
+    CHECK_FORMAT(junk.bytes, "");
+}
+
+TEST(device_path_ipv4_round_trip) {
+    // The 23 byte node, and the 15 byte one older firmware writes.
+    CHECK_FORMAT(ipv4_node(true, 0, 0), "IPv4(192.168.0.1,TCP,Static,192.168.0.2,192.168.0.254,255.255.255.0)");
+    CHECK_FORMAT(ipv4_node(false, 0, 0), "IPv4(192.168.0.1,TCP,Static,192.168.0.2)");
+    CHECK_FORMAT(ipv4_node(true, 1024, 69), "IPv4(192.168.0.1:69,TCP,Static,192.168.0.2:1024,192.168.0.254,255.255.255.0)");
+    CHECK_FORMAT(ipv4_node(false, 1024, 69), "IPv4(192.168.0.1:69,TCP,Static,192.168.0.2:1024)");
+
+    CHECK(parse("IPv4(192.168.0.1,TCP,Static,192.168.0.2)")->size() == 4 + 15 + 4);
+    CHECK(parse("IPv4(192.168.0.1)")->size() == 4 + 23 + 4);
+}
+
+TEST(device_path_ipv6_round_trip) {
+    CHECK_FORMAT(ipv6_node(true, 0, 0, 0), "IPv6(fe80:0:0:0:0:0:0:1,UDP,Static,fe80:0:0:0:0:0:0:2,2001:db8:0:0:0:0:0:ff,0x40)");
+    CHECK_FORMAT(ipv6_node(false, 0, 0, 1), "IPv6(fe80:0:0:0:0:0:0:1,UDP,StatelessAutoConfigure,fe80:0:0:0:0:0:0:2)");
+    CHECK_FORMAT(ipv6_node(true, 546, 547, 2), "");
+    CHECK_FORMAT(ipv6_node(false, 546, 547, 7), "IPv6([fe80:0:0:0:0:0:0:1]:547,UDP,0x7,[fe80:0:0:0:0:0:0:2]:546)");
+}
+
+TEST(device_path_media_nodes_round_trip) {
+    CHECK_PARSE(fmt::format("HD(1,GPT,{},0x800,0x100000)", guid_text));
+    CHECK_PARSE("HD(5,MBR,0xDEADBEEF,0x800,0x1000)");
+    CHECK_PARSE("HD(1,0x3,0,0x0,0x0)");
+    CHECK_PARSE(fmt::format("VenMedia({})", guid_text));
+    CHECK_PARSE(fmt::format("VenMsg({},0102)", guid_text));
+
+    lak::optional<vec<byte_t>> hd = parse(fmt::format("HD(1,GPT,{},0x800,0x100000)", guid_text));
+    CHECK(hd.has_value());
+    if (hd)
+        CHECK_FORMAT(*hd, fmt::format("HD(1,GPT,{},0x800,0x100000)", guid_text));
+
+    device_path_writer file;
+    file.begin_node(DevicePathType::Media, device_path::file_path::subtype);
+    file.put_string("\\EFI\\d\xC3\xA9j\xC3\xA0\\\xF0\x9F\x98\x80.efi");
+    file.end_node();
+    file.end_entire();
+    CHECK_FORMAT(file.bytes, "File(\\EFI\\d\xC3\xA9j\xC3\xA0\\\xF0\x9F\x98\x80.efi)");
+}
+
+TEST(device_path_whole_paths_round_trip) {
+    CHECK_PARSE(fmt::format("PciRoot(0x0)/Pci(0x1F,0x2)/Sata(0x0,0xFFFF,0x0)/HD(1,GPT,{},0x800,0x100000)/File(\\EFI\\BOOT\\BOOTX64.EFI)", guid_text));
+    CHECK_PARSE("PciRoot(0x0)/Pci(0x1C,0x0)/MAC(525400123456,0x1)/IPv4(0.0.0.0)");
+    CHECK_PARSE("PciRoot(0x0)/Pci(0x1C,0x0)/MAC(525400123456,0x1)/IPv6(::)");
+    CHECK_PARSE("PciRoot(0x0)/Pci(0x1,0x0),PciRoot(0x1)/Pci(0x2,0x0)");
+    CHECK_PARSE("\\EFI\\BOOT\\BOOTX64.EFI");
+    CHECK_PARSE("Path(4,6,0102)");
+}
+
+TEST(device_path_lossy_nodes_fall_back_to_path) {
+    // A Pci node with a trailing byte, a File without its terminator, an
+    // HD with a signature its format doesn't use, and a lone surrogate.
+    CHECK_FORMAT(node(DevicePathType::Hardware, device_path::pci::subtype, { 0x2, 0x1C, 0x7 }), "Path(1,1,021C07)");
+    CHECK_FORMAT(node(DevicePathType::Media, device_path::file_path::subtype, { 'a', 0 }), "Path(4,4,6100)");
+    CHECK_FORMAT(node(DevicePathType::Media, device_path::file_path::subtype, { 0x00, 0xD8, 0, 0 }), "Path(4,4,00D80000)");
+    CHECK_FORMAT(node(DevicePathType::Media, device_path::file_path::subtype, { ')', 0, '/', 0, 0, 0 }), "Path(4,4,29002F000000)");
+
+    vec<byte_t> hd = *parse("HD(5,MBR,0xDEADBEEF,0x800,0x1000)");
+    // signature byte 4 is past what an MBR signature uses
+    hd[4 + 20 + 4] = byte_t(1);
+    CHECK_FORMAT(hd, "");
+    CHECK(format(lak::span<const byte_t> { hd.data(), hd.size() }).starts_with("Path(4,1,"));
+
+    CHECK_FORMAT(node(DevicePathType::Acpi, device_path::acpi::subtype, { 0, 0, 0, 0, 0, 0, 0, 0 }), "Path(2,1,0000000000000000)");
+    CHECK_FORMAT(node(static_cast<DevicePathType>(0x05), 0x01, { 1, 2, 3 }), "Path(5,1,010203)");
+}
+
+}
@@ -0,0 +1,57 @@
+#include "test.h"
+
+#include "device_path_text.h"
+#include "efi_load_option.h"
+
+#include <string>
+
+namespace efibootmgrw::test {
+
+namespace {
+
+[[nodiscard]]
+auto parse(std::string_view text) -> vec<byte_t> {
+    vec<byte_t> out;
+
+    parse_device_path(lak::astring_view { text.data(), text.size() })
+        .if_ok([&](vec<byte_t>& bytes) { out = std::move(bytes); });
+
+    return out;
+}
+
+[[nodiscard]]
+auto same(std::string_view a, std::string_view b) -> bool {
+    vec<byte_t> x = parse(a), y = parse(b);
+    return !x.empty() && !y.empty()
+           && same_device_path(lak::span<const byte_t> { x.data(), x.size() }, lak::span<const byte_t> { y.data(), y.size() });
+}
+
+}
+
+TEST(same_device_path_ignores_short_network_layouts) {
+    // The 15 and 39 byte nodes are the 23 and 56 byte ones with zero gateway and mask.
+    CHECK(same("MAC(525400123456,0x1)/IPv4(192.168.0.1:69,TCP,Static,192.168.0.2)",
+               "MAC(525400123456,0x1)/IPv4(192.168.0.1:69,TCP,Static,192.168.0.2,0.0.0.0,0.0.0.0)"));
+    CHECK(same("IPv6(fe80::1,UDP,Static,fe80::2)", "IPv6(fe80::1,UDP,Static,fe80::2,::,0x0)"));
+
+    CHECK(!same("IPv4(192.168.0.1,TCP,Static,192.168.0.2)",
+                "IPv4(192.168.0.1,TCP,Static,192.168.0.2,192.168.0.254,255.255.255.0)"));
+    CHECK(!same("IPv4(192.168.0.1:69,TCP,Static,192.168.0.2)", "IPv4(192.168.0.1,TCP,Static,192.168.0.2)"));
+    CHECK(!same("IPv6(fe80::1,UDP,Static,fe80::2)", "IPv6(fe80::1,UDP,Static,fe80::2,::,0x40)"));
+}
+
+TEST(same_device_path_compares_everything_else_exactly) {
+    CHECK(same("PciRoot(0x0)/Pci(0x1,0x0)/\\EFI\\a.efi", "PciRoot(0x0)/Pci(0x1,0x0)/\\EFI\\a.efi"));
+    CHECK(!same("PciRoot(0x0)/Pci(0x1,0x0)/\\EFI\\a.efi", "PciRoot(0x0)/Pci(0x1,0x0)/\\EFI\\b.efi"));
+    CHECK(!same("PciRoot(0x0)/Pci(0x1,0x0)", "PciRoot(0x0)/Pci(0x1,0x0)/Pci(0x0,0x0)"));
+    CHECK(!same("PciRoot(0x0)/Pci(0x1,0x0)", "PciRoot(0x0)/Pci(0x1,0x0),PciRoot(0x0)"));
+    CHECK(!same("IPv4(192.168.0.1)", "IPv6(::)"));
+}
+
+TEST(parse_device_path_rejects_what_a_load_option_cannot_hold) {
+    std::string file(max_file_path_list_size / 2, 'a');
+    CHECK(parse("\\" + file).empty());
+    CHECK(!parse("\\" + file.substr(0, 1000)).empty());
+}
+
+}
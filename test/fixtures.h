@@ -0,0 +1,96 @@
+#pragma once
+
+#include "efi_load_option.h"
+#include "load_option_name.h"
+#include "sim_backend.h"
+
+#include <cstdio>
+#include <memory>
+
+#ifdef _WIN32
+# include <io.h>
+# include <fcntl.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+// Shared by the tests and the benchmarks.
+namespace efibootmgrw::test {
+
+/*
+ * A store holding BootOrder, BootCurrent, Timeout and n entries booting
+ * file_path_list. Without a config, it has room for as many as asked for.
+ */
+[[nodiscard]]
+inline auto make_store(size_t n, lak::span<const byte_t> file_path_list = { }, lak::optional<sim_config> config = lak::nullopt)
+-> std::unique_ptr<sim_backend> {
+    if (!config) {
+        config = sim_config { };
+        config->capacity = size_t(1) << 26;
+    }
+
+    auto sim = std::make_unique<sim_backend>(*config);
+    vec<u16> order;
+
+    auto write = [&](lak::wstring_view name, lak::span<const byte_t> bytes) {
+        (void) sim->write(
+                name,
+                efi_global_variable,
+                lak::span<void> { const_cast<byte_t*>(bytes.data()), bytes.size() },
+                efi_variable_default_attributes
+        );
+    };
+
+    for (size_t i = 0; i < n; ++i) {
+        std::string label = fmt::format("Linux Boot Manager {}", i);
+        vec<byte_t> option = build_load_option(
+                load_option_active,
+                lak::astring_view { label.data(), label.size() },
+                file_path_list
+        );
+
+        write(boot_option_name(static_cast<u16>(i)), lak::span<const byte_t> { option.data(), option.size() });
+        order.push_back(static_cast<u16>(i));
+    }
+
+    u16 zero = 0;
+    write(L"BootOrder", lak::span<const byte_t> { reinterpret_cast<const byte_t*>(order.data()), order.size() * 2 });
+    write(L"BootCurrent", lak::span<const byte_t> { reinterpret_cast<const byte_t*>(&zero), 2 });
+    write(L"Timeout", lak::span<const byte_t> { reinterpret_cast<const byte_t*>(&zero), 2 });
+
+    return sim;
+}
+
+// Listings print, which isn't what a test or benchmark of one is after.
+struct silence_stdout {
+    int saved;
+
+    silence_stdout() {
+        std::fflush(stdout);
+#ifdef _WIN32
+        saved = ::_dup(::_fileno(stdout));
+        int null = ::_open("NUL", _O_WRONLY);
+        ::_dup2(null, ::_fileno(stdout));
+        ::_close(null);
+#else
+        saved = ::dup(::fileno(stdout));
+        int null = ::open("/dev/null", O_WRONLY);
+        ::dup2(null, ::fileno(stdout));
+        ::close(null);
+#endif
+    }
+
+    ~silence_stdout() {
+        std::fflush(stdout);
+#ifdef _WIN32
+        ::_dup2(saved, ::_fileno(stdout));
+        ::_close(saved);
+#else
+        ::dup2(saved, ::fileno(stdout));
+        ::close(saved);
+#endif
+    }
+};
+
+}
@@ -0,0 +1,34 @@
+#include "test.h"
+
+#include "json_writer.h"
+
+namespace efibootmgrw::test {
+
+namespace {
+
+[[nodiscard]]
+auto json_of(lak::u16string_view str) -> std::string {
+    fmt::memory_buffer out;
+    json_writer json { out };
+    json.value(str);
+    return fmt::to_string(out);
+}
+
+}
+
+TEST(json_writer_escapes_lone_surrogates) {
+    char16_t high[] = { u'a', 0xD83D, u'b' };
+    CHECK(json_of(lak::u16string_view { high, 3 }) == "\"a\\ud83db\"");
+
+    char16_t low_first[] = { 0xDE00, 0xD83D };
+    CHECK(json_of(lak::u16string_view { low_first, 2 }) == "\"\\ude00\\ud83d\"");
+
+    char16_t trailing[] = { u'x', 0xD83D };
+    CHECK(json_of(lak::u16string_view { trailing, 2 }) == "\"x\\ud83d\"");
+
+    // A real pair is still one code point in UTF-8.
+    char16_t pair[] = { 0xD83D, 0xDE00, 0x20AC, 0x01 };
+    CHECK(json_of(lak::u16string_view { pair, 4 }) == "\"\xF0\x9F\x98\x80\xE2\x82\xAC\\u0001\"");
+}
+
+}
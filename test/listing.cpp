@@ -0,0 +1,37 @@
+#include "test.h"
+#include "fixtures.h"
+
+#include "listing.h"
+
+#include <memory>
+
+namespace efibootmgrw::test {
+
+namespace {
+
+// Allocations made by a listing of n entries, once warmed up.
+[[nodiscard]]
+auto listing_allocations(size_t n) -> size_t {
+    std::unique_ptr<sim_backend> sim = make_store(n);
+    Context ctx;
+    silence_stdout quiet;
+
+    (void) default_print(ctx, *sim);
+
+    size_t before = allocations();
+    (void) default_print(ctx, *sim);
+    return allocations() - before;
+}
+
+}
+
+TEST(default_print_allocates_nothing_per_entry) {
+    // Both fit in the snapshot arena's first chunk, so any difference is per entry.
+    size_t few = listing_allocations(10);
+    size_t many = listing_allocations(100);
+
+    if (few != many)
+        fail(__FILE__, __LINE__, fmt::format("10 entries made {} allocations, 100 made {}", few, many));
+}
+
+}
@@ -0,0 +1,96 @@
+#include "test.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Counted, for tests that check what a steady state allocates.
+static std::atomic<size_t> allocation_count { 0 };
+
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace efibootmgrw::test {
+
+namespace {
+
+struct test_case {
+    lak::astring_view name;
+    test_fn fn;
+};
+
+// Function local, as registrars run during static initialisation.
+auto tests() -> vec<test_case>& {
+    static vec<test_case> all;
+    return all;
+}
+
+size_t failures = 0;
+
+}
+
+void add(lak::astring_view name, test_fn fn) {
+    tests().push_back(test_case { name, fn });
+}
+
+void fail(const char* file, int line, std::string what) {
+    fmt::print(stderr, "  {}:{}: {}\n", file, line, what);
+    ++failures;
+}
+
+auto allocations() -> size_t {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+}
+
+// xmake run test [substring]
+int main(int argc, const char** argv) {
+    using namespace efibootmgrw;
+    using namespace efibootmgrw::test;
+
+    lak::optional<lak::astring_view> filter;
+
+    if (argc == 2) {
+        filter = lak::astring_view::from_c_str(argv[1]);
+    } else if (argc > 2) {
+        fmt::print(stderr, "Usage: {} [substring]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t run = 0, failed = 0;
+
+    for (const test_case& t : tests()) {
+        std::string_view name { t.name.data(), t.name.size() };
+
+        if (filter && name.find(std::string_view { filter->data(), filter->size() }) == std::string_view::npos)
+            continue;
+
+        size_t before = failures;
+        t.fn();
+        ++run;
+
+        bool ok = failures == before;
+        failed += ok ? 0 : 1;
+        fmt::print("{} {}\n", ok ? "ok  " : "FAIL", t.name);
+    }
+
+    fmt::print("{} run, {} failed\n", run, failed);
+
+    return failed == 0 && run > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
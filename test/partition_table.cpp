@@ -0,0 +1,274 @@
+#include "test.h"
+
+#include "partition_table.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// partition tables are only read on POSIX systems
+#ifndef _WIN32
+
+#include <unistd.h>
+
+namespace efibootmgrw::test {
+
+namespace {
+
+struct image {
+    u32 sector_size;
+    vec<byte_t> bytes;
+
+    image(u32 sector_size, u64 sectors) : sector_size(sector_size), bytes(sector_size * sectors) { }
+
+    [[nodiscard]]
+    auto sectors() const -> u64 {
+        return bytes.size() / sector_size;
+    }
+
+    template<typename T>
+    void put(u64 offset, T value) {
+        std::memcpy(bytes.data() + offset, &value, sizeof(T));
+    }
+
+    void put_boot_signature(u64 sector_offset) {
+        put<u8>(sector_offset + 510, 0x55);
+        put<u8>(sector_offset + 511, 0xAA);
+    }
+
+    // An MBR style entry in the sector at sector_offset.
+    void put_mbr_entry(u64 sector_offset, size_t i, u8 type, u32 start, u32 size) {
+        u64 e = sector_offset + 446 + 16 * i;
+        put<u8>(e + 4, type);
+        put<u32>(e + 8, start);
+        put<u32>(e + 12, size);
+    }
+
+    // Writes the image to a file of its own for read_partition_table to open.
+    [[nodiscard]]
+    auto save() const -> std::string {
+        static size_t count = 0;
+
+        std::filesystem::path path = std::filesystem::temp_directory_path()
+                / fmt::format("efibootmgrw-test-{}-{}.img", ::getpid(), count++);
+
+        std::ofstream out { path, std::ios::binary };
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+
+        return path.string();
+    }
+};
+
+struct saved_image {
+    std::string path;
+
+    explicit saved_image(const image& img) : path(img.save()) { }
+
+    ~saved_image() {
+        std::remove(path.c_str());
+    }
+
+    [[nodiscard]]
+    auto read(bool force_gpt = false) const -> dresult<partition_table> {
+        return read_partition_table(lak::astring_view { path.data(), path.size() }, force_gpt);
+    }
+};
+
+constexpr u32 entry_count = 128;
+constexpr u32 entry_size = 128;
+
+struct gpt_partition {
+    u32 number;
+    u64 first;
+    u64 last;
+    u8 guid_byte;
+};
+
+// A protective MBR and both GPT headers, each with its own copy of the entries.
+[[nodiscard]]
+auto gpt_image(u32 sector_size, u64 sectors, std::initializer_list<gpt_partition> parts) -> image {
+    image img { sector_size, sectors };
+
+    img.put_mbr_entry(0, 0, 0xEE, 1, static_cast<u32>(sectors - 1));
+    img.put_boot_signature(0);
+
+    vec<byte_t> entries(entry_count * entry_size);
+
+    for (const gpt_partition& p : parts) {
+        size_t o = (p.number - 1) * entry_size;
+        std::memset(entries.data() + o, 0xAB, 16);
+        std::memset(entries.data() + o + 16, p.guid_byte, 16);
+        std::memcpy(entries.data() + o + 32, &p.first, sizeof(u64));
+        std::memcpy(entries.data() + o + 40, &p.last, sizeof(u64));
+    }
+
+    u32 entries_crc = crc32(lak::span<const byte_t> { entries.data(), entries.size() });
+    u64 entry_sectors = (entries.size() + sector_size - 1) / sector_size;
+
+    auto put_header = [&](u64 lba, u64 alternate, u64 entries_lba) {
+        u64 h = lba * sector_size;
+        std::memcpy(img.bytes.data() + h, "EFI PART", 8);
+        img.put<u32>(h + 8, 0x10000);
+        img.put<u32>(h + 12, 92);
+        img.put<u64>(h + 24, lba);
+        img.put<u64>(h + 32, alternate);
+        img.put<u64>(h + 40, 2 + entry_sectors);
+        img.put<u64>(h + 48, sectors - 2 - entry_sectors);
+        img.put<u64>(h + 72, entries_lba);
+        img.put<u32>(h + 80, entry_count);
+        img.put<u32>(h + 84, entry_size);
+        img.put<u32>(h + 88, entries_crc);
+        img.put<u32>(h + 16, crc32(lak::span<const byte_t> { img.bytes.data() + h, 92 }));
+
+        std::memcpy(img.bytes.data() + entries_lba * sector_size, entries.data(), entries.size());
+    };
+
+    put_header(1, sectors - 1, 2);
+    put_header(sectors - 1, 1, sectors - 1 - entry_sectors);
+
+    return img;
+}
+
+void check_partition(const partition_table& table, u32 number, u64 start, u64 size, const char* file, int line) {
+    const device_path::hard_drive* part = table.find(number);
+
+    if (!part)
+        fail(file, line, fmt::format("no partition {}", number));
+    else if (part->partition_start != start || part->partition_size != size)
+        fail(file, line, fmt::format("partition {} is {}+{}, expected {}+{}", number, part->partition_start, part->partition_size, start, size));
+}
+
+#define CHECK_PARTITION(TABLE, NUMBER, START, SIZE) check_partition(TABLE, NUMBER, START, SIZE, __FILE__, __LINE__)
+
+}
+
+TEST(partition_table_reads_gpt_behind_protective_mbr) {
+    saved_image img { gpt_image(512, 4096, { { 1, 2048, 2999, 0x11 }, { 3, 3000, 3999, 0x33 } }) };
+
+    dresult<partition_table> res = img.read();
+    CHECK(res.is_ok());
+
+    if (!res.is_ok())
+        return;
+
+    const partition_table& table = res.unsafe_unwrap();
+    CHECK(table.format == device_path::hard_drive::format_gpt);
+    CHECK(table.sector_size == 512);
+    CHECK(table.partitions.size() == 2);
+    CHECK_PARTITION(table, 1, 2048, 952);
+    CHECK_PARTITION(table, 3, 3000, 1000);
+    CHECK(!table.find(2));
+    CHECK(table.find(3)->signature[0] == 0x33);
+    CHECK(table.find(3)->signature_type == device_path::hard_drive::signature_guid);
+}
+
+TEST(partition_table_falls_back_to_backup_gpt) {
+    image raw = gpt_image(512, 4096, { { 1, 2048, 2999, 0x11 } });
+    // Breaks the primary header's CRC.
+    raw.bytes[512 + 20] ^= byte_t { 0xFF };
+
+    saved_image img { raw };
+    dresult<partition_table> res = img.read();
+    CHECK(res.is_ok());
+
+    if (res.is_ok())
+        CHECK_PARTITION(res.unsafe_unwrap(), 1, 2048, 952);
+
+    // With both headers gone a protective MBR is a corrupt GPT, not an MBR.
+    raw.bytes[(raw.sectors() - 1) * 512 + 20] ^= byte_t { 0xFF };
+
+    saved_image worse { raw };
+    dresult<partition_table> bad = worse.read();
+    CHECK(!bad.is_ok() && bad.unsafe_unwrap_err().kind == disk_err::kind_t::corrupt_gpt);
+}
+
+TEST(partition_table_reads_4096_byte_sectors) {
+    saved_image img { gpt_image(4096, 1024, { { 2, 256, 499, 0x22 } }) };
+
+    dresult<partition_table> res = img.read();
+    CHECK(res.is_ok());
+
+    if (!res.is_ok())
+        return;
+
+    CHECK(res.unsafe_unwrap().sector_size == 4096);
+    CHECK(res.unsafe_unwrap().partitions.size() == 1);
+    CHECK_PARTITION(res.unsafe_unwrap(), 2, 256, 244);
+}
+
+TEST(partition_table_follows_ebr_chain) {
+    image raw { 512, 8192 };
+    raw.put<u32>(440, 0xDEADBEEF);
+    raw.put_mbr_entry(0, 0, 0x0C, 2048, 1024);
+    raw.put_mbr_entry(0, 1, 0x05, 4096, 4000);
+    raw.put_boot_signature(0);
+
+    // Each EBR's logical partition is relative to it, the next EBR to the extended partition.
+    u64 ebr1 = 4096 * 512, ebr2 = (4096 + 1000) * 512;
+    raw.put_mbr_entry(ebr1, 0, 0x83, 63, 500);
+    raw.put_mbr_entry(ebr1, 1, 0x05, 1000, 1000);
+    raw.put_boot_signature(ebr1);
+    raw.put_mbr_entry(ebr2, 0, 0x83, 63, 700);
+    raw.put_boot_signature(ebr2);
+
+    saved_image img { raw };
+    dresult<partition_table> res = img.read();
+    CHECK(res.is_ok());
+
+    if (!res.is_ok())
+        return;
+
+    const partition_table& table = res.unsafe_unwrap();
+    CHECK(table.format == device_path::hard_drive::format_mbr);
+    CHECK(table.partitions.size() == 3);
+    CHECK_PARTITION(table, 1, 2048, 1024);
+    CHECK_PARTITION(table, 5, 4096 + 63, 500);
+    CHECK_PARTITION(table, 6, 4096 + 1000 + 63, 700);
+    CHECK(table.find(5)->signature_type == device_path::hard_drive::signature_mbr);
+}
+
+TEST(partition_table_stops_looping_ebr_chain) {
+    image raw { 512, 8192 };
+    raw.put_mbr_entry(0, 0, 0x05, 4096, 4000);
+    raw.put_boot_signature(0);
+
+    u64 ebr1 = 4096 * 512, ebr2 = (4096 + 1000) * 512;
+    raw.put_mbr_entry(ebr1, 0, 0x83, 63, 500);
+    raw.put_mbr_entry(ebr1, 1, 0x05, 1000, 1000);
+    raw.put_boot_signature(ebr1);
+    // Names itself as the next EBR.
+    raw.put_mbr_entry(ebr2, 0, 0x83, 63, 700);
+    raw.put_mbr_entry(ebr2, 1, 0x05, 1000, 1000);
+    raw.put_boot_signature(ebr2);
+
+    saved_image img { raw };
+    dresult<partition_table> res = img.read();
+    CHECK(res.is_ok());
+
+    if (!res.is_ok())
+        return;
+
+    CHECK(res.unsafe_unwrap().partitions.size() == 2);
+    CHECK_PARTITION(res.unsafe_unwrap(), 5, 4096 + 63, 500);
+    CHECK_PARTITION(res.unsafe_unwrap(), 6, 4096 + 1000 + 63, 700);
+}
+
+TEST(partition_table_rejects_lba_past_end) {
+    image raw = gpt_image(512, 4096, { { 1, 2048, 2999, 0x11 } });
+
+    // Entries at an LBA whose byte offset wraps around to where they really
+    // are. Taking that at face value would hide the broken backup header.
+    raw.put<u64>(512 + 72, 2 + (u64(1) << 55));
+    raw.put<u32>(512 + 16, 0);
+    raw.put<u32>(512 + 16, crc32(lak::span<const byte_t> { raw.bytes.data() + 512, 92 }));
+    raw.bytes[(raw.sectors() - 1) * 512 + 20] ^= byte_t { 0xFF };
+
+    saved_image img { raw };
+    dresult<partition_table> res = img.read();
+    CHECK(!res.is_ok() && res.unsafe_unwrap_err().kind == disk_err::kind_t::corrupt_gpt);
+}
+
+}
+
+#endif
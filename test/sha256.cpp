@@ -0,0 +1,86 @@
+#include "test.h"
+
+#include "sha256.h"
+
+#include <string>
+
+namespace efibootmgrw::test {
+
+namespace {
+
+[[nodiscard]]
+auto bytes_of(std::string_view str) -> lak::span<const byte_t> {
+    return lak::span<const byte_t> { reinterpret_cast<const byte_t*>(str.data()), str.size() };
+}
+
+[[nodiscard]]
+auto hex(const sha256_digest& digest) -> std::string {
+    std::string out;
+
+    for (u8 b : digest)
+        out += fmt::format("{:02x}", b);
+
+    return out;
+}
+
+void check_digest(const sha256_digest& digest, std::string_view expected, const char* what, const char* file, int line) {
+    if (std::string got = hex(digest); got != expected)
+        fail(file, line, fmt::format("sha256 of {} is {}, expected {}", what, got, expected));
+}
+
+#define CHECK_DIGEST(DIGEST, EXPECTED, WHAT) check_digest(DIGEST, EXPECTED, WHAT, __FILE__, __LINE__)
+
+constexpr std::string_view fips_448_bit = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+}
+
+TEST(sha256_fips_180_2_vectors) {
+    CHECK_DIGEST(sha256::of(bytes_of("")), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", "nothing");
+    CHECK_DIGEST(sha256::of(bytes_of("abc")), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", "abc");
+    CHECK_DIGEST(sha256::of(bytes_of(fips_448_bit)), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", "the 448 bit message");
+
+    std::string million(1000000, 'a');
+    CHECK_DIGEST(sha256::of(bytes_of(million)), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", "a million a");
+}
+
+// The lengths either side of where the padding and length spill into another block.
+TEST(sha256_padding_boundaries) {
+    struct {
+        size_t length;
+        std::string_view digest;
+    } cases[] = {
+        { 55, "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318" },
+        { 56, "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a" },
+        { 63, "7d3e74a05d7db15bce4ad9ec0658ea98e3f06eeecf16b4c6fff2da457ddc2f34" },
+        { 64, "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb" },
+        { 119, "31eba51c313a5c08226adf18d4a359cfdfd8d2e816b13f4af952f7ea6584dcfb" },
+        { 120, "2f3d335432c70b580af0e8e1b3674a7c020d683aa5f73aaaedfdc55af904c21c" },
+    };
+
+    for (const auto& c : cases) {
+        std::string input(c.length, 'a');
+        CHECK_DIGEST(sha256::of(bytes_of(input)), c.digest, fmt::format("{} a", c.length).c_str());
+    }
+}
+
+TEST(sha256_split_updates) {
+    // Every split of the 448 bit message, so the block buffer fills from each offset.
+    for (size_t split = 0; split <= fips_448_bit.size(); ++split) {
+        sha256 h;
+        h.update(bytes_of(fips_448_bit.substr(0, split)));
+        h.update(bytes_of(fips_448_bit.substr(split)));
+        CHECK_DIGEST(h.finish(), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+                     fmt::format("the 448 bit message split at {}", split).c_str());
+    }
+
+    // And a million a in uneven pieces, some crossing several blocks at once.
+    std::string million(1000000, 'a');
+    sha256 h;
+
+    for (size_t pos = 0, piece = 1; pos < million.size(); pos += piece, piece = piece * 7 % 193 + 1)
+        h.update(bytes_of(std::string_view { million }.substr(pos, piece)));
+
+    CHECK_DIGEST(h.finish(), "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", "a million a in pieces");
+}
+
+}
@@ -0,0 +1,55 @@
+#include "test.h"
+
+#include "sim_backend.h"
+
+namespace efibootmgrw::test {
+
+TEST(sim_backend_write_of_nothing_removes) {
+    sim_backend sim;
+    u16 value = 1;
+
+    CHECK(sim.write(L"Timeout", efi_global_variable, { &value, sizeof(value) }, efi_variable_default_attributes).is_ok());
+    size_t used = sim.bytes_used();
+    CHECK(used > 0);
+
+    // As SetVariable does with a DataSize of 0.
+    CHECK(sim.write(L"Timeout", efi_global_variable, { &value, 0 }, efi_variable_default_attributes).is_ok());
+    CHECK(sim.bytes_used() == 0);
+
+    vresult<size_t> size = sim.size(L"Timeout", efi_global_variable);
+    CHECK(!size.is_ok() && size.unsafe_unwrap_err().kind == var_err::kind_t::not_found);
+
+    vresult<lak::monostate> again = sim.write(L"Timeout", efi_global_variable, { &value, 0 }, efi_variable_default_attributes);
+    CHECK(!again.is_ok() && again.unsafe_unwrap_err().kind == var_err::kind_t::not_found);
+}
+
+TEST(sim_backend_seed_is_charged_against_capacity) {
+    sim_backend machine;
+    u8 big[1000] = { };
+    u16 value = 1;
+
+    CHECK(machine.write(L"Boot0000", efi_global_variable, { big, sizeof(big) }, efi_variable_default_attributes).is_ok());
+    CHECK(machine.write(L"Timeout", efi_global_variable, { &value, sizeof(value) }, efi_variable_default_attributes).is_ok());
+
+    sim_config config;
+    config.capacity = machine.bytes_used();
+
+    sim_backend fits { config };
+    CHECK(fits.seed_from(machine).is_ok());
+    CHECK(fits.bytes_used() == machine.bytes_used());
+    CHECK(!fits.write(L"BootNext", efi_global_variable, { &value, sizeof(value) }, efi_variable_default_attributes).is_ok());
+
+    // Seeding again replaces rather than adds to what's there.
+    CHECK(fits.seed_from(machine).is_ok());
+    CHECK(fits.bytes_used() == machine.bytes_used());
+
+    config.capacity = machine.bytes_used() - 1;
+
+    sim_backend full { config };
+    vresult<lak::monostate> res = full.seed_from(machine);
+    CHECK(!res.is_ok() && res.unsafe_unwrap_err().kind == var_err::kind_t::out_of_space);
+    CHECK(full.bytes_used() == 0);
+    CHECK(!full.size(L"Timeout", efi_global_variable).is_ok());
+}
+
+}
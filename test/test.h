@@ -0,0 +1,38 @@
+#pragma once
+
+#include "efibootmgrw.h"
+
+#include <string>
+
+namespace efibootmgrw::test {
+
+using test_fn = void (*)();
+
+// Called by TEST() before main, in the order the files were linked.
+void add(lak::astring_view name, test_fn fn);
+
+// Marks the running test failed, and carries on with it.
+void fail(const char* file, int line, std::string what);
+
+// Heap allocations made so far by the whole program.
+[[nodiscard]]
+auto allocations() -> size_t;
+
+struct registrar {
+    registrar(lak::astring_view name, test_fn fn) {
+        add(name, fn);
+    }
+};
+
+}
+
+#define TEST(NAME)                                                                       \
+    static void test_##NAME();                                                           \
+    static ::efibootmgrw::test::registrar registrar_##NAME { #NAME, &test_##NAME };      \
+    static void test_##NAME()
+
+#define CHECK(...)                                                                       \
+    do {                                                                                 \
+        if (!(__VA_ARGS__))                                                              \
+            ::efibootmgrw::test::fail(__FILE__, __LINE__, #__VA_ARGS__);                 \
+    } while (0)
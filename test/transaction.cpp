@@ -0,0 +1,218 @@
+#include "test.h"
+
+#include "sim_backend.h"
+#include "transaction.h"
+
+#include <cstdio>
+#include <filesystem>
+
+namespace efibootmgrw::test {
+
+namespace {
+
+constexpr u32 volatile_attributes = efi_variable_bootservice_access | efi_variable_runtime_access;
+
+// A journal path of its own, removed again afterwards.
+struct temp_journal {
+    std::string path;
+
+    temp_journal() {
+        static size_t count = 0;
+        path = (std::filesystem::temp_directory_path()
+                / fmt::format("efibootmgrw-test-{}.journal", count++)).string();
+        std::remove(path.c_str());
+    }
+
+    ~temp_journal() {
+        std::remove(path.c_str());
+    }
+
+    [[nodiscard]]
+    auto view() const -> lak::astring_view {
+        return lak::astring_view { path.data(), path.size() };
+    }
+};
+
+struct stored {
+    vec<byte_t> data;
+    u32 attributes = 0;
+
+    auto operator==(const stored&) const -> bool = default;
+};
+
+[[nodiscard]]
+auto get(sim_backend& sim, lak::wstring_view name) -> lak::optional<stored> {
+    byte_t buf[64];
+    u32 attributes = 0;
+    vresult<lak::span<void>> res = sim.read(name, efi_global_variable, { buf, sizeof(buf) }, &attributes);
+
+    if (!res.is_ok())
+        return lak::nullopt;
+
+    return stored { vec<byte_t>(buf, buf + res.unsafe_unwrap().size_bytes()), attributes };
+}
+
+void put(sim_backend& sim, lak::wstring_view name, std::initializer_list<u8> bytes, u32 attributes = efi_variable_default_attributes) {
+    vec<byte_t> data;
+    for (u8 b : bytes)
+        data.push_back(byte_t { b });
+
+    (void) sim.write(name, efi_global_variable, { data.data(), data.size() }, attributes);
+}
+
+[[nodiscard]]
+auto bytes(std::initializer_list<u8> list) -> vec<byte_t> {
+    vec<byte_t> out;
+    for (u8 b : list)
+        out.push_back(byte_t { b });
+    return out;
+}
+
+// What every test starts from, and the transaction they try to commit.
+void seed(sim_backend& sim) {
+    put(sim, L"Boot0000", { 1, 2, 3 });
+    put(sim, L"BootOrder", { 0, 0 });
+    put(sim, L"Timeout", { 5, 0 });
+}
+
+[[nodiscard]]
+auto planned() -> transaction {
+    vec<byte_t> entry = bytes({ 9, 9 }), order = bytes({ 1, 0 }), timeout = bytes({ 7, 0 });
+
+    transaction tx;
+    tx.set(L"Boot0001", efi_global_variable, { entry.data(), entry.size() });
+    tx.set(L"BootOrder", efi_global_variable, { order.data(), order.size() });
+    tx.set(L"Timeout", efi_global_variable, { timeout.data(), timeout.size() }, volatile_attributes);
+    tx.remove(L"Boot0000", efi_global_variable);
+    return tx;
+}
+
+void check_seeded(sim_backend& sim, const char* file, int line) {
+    bool ok = get(sim, L"Boot0000") == stored { bytes({ 1, 2, 3 }), efi_variable_default_attributes }
+              && get(sim, L"BootOrder") == stored { bytes({ 0, 0 }), efi_variable_default_attributes }
+              && get(sim, L"Timeout") == stored { bytes({ 5, 0 }), efi_variable_default_attributes }
+              && !get(sim, L"Boot0001");
+
+    if (!ok)
+        fail(file, line, "variables aren't back to what they were");
+}
+
+void check_planned(sim_backend& sim, const char* file, int line) {
+    bool ok = !get(sim, L"Boot0000")
+              && get(sim, L"Boot0001") == stored { bytes({ 9, 9 }), efi_variable_default_attributes }
+              && get(sim, L"BootOrder") == stored { bytes({ 1, 0 }), efi_variable_default_attributes }
+              && get(sim, L"Timeout") == stored { bytes({ 7, 0 }), volatile_attributes };
+
+    if (!ok)
+        fail(file, line, "variables don't hold the planned values");
+}
+
+#define CHECK_SEEDED(SIM) check_seeded(SIM, __FILE__, __LINE__)
+#define CHECK_PLANNED(SIM) check_planned(SIM, __FILE__, __LINE__)
+
+[[nodiscard]]
+auto write_fault(lak::wstring_view name) -> sim_fault {
+    return sim_fault { sim_fault::op_t::write, var_err::kind_t::io, lak::wstring(name.begin(), name.end()) };
+}
+
+}
+
+TEST(transaction_recreates_variable_to_change_attributes) {
+    sim_backend sim;
+    temp_journal journal;
+    put(sim, L"Timeout", { 5, 0 });
+
+    vec<byte_t> same = bytes({ 5, 0 });
+    transaction tx;
+    tx.set(L"Timeout", efi_global_variable, { same.data(), same.size() }, volatile_attributes);
+
+    CHECK(tx.commit(sim, journal.view()).is_ok());
+    CHECK(get(sim, L"Timeout") == stored { same, volatile_attributes });
+    CHECK(!journal_exists(journal.view()));
+}
+
+TEST(transaction_commits_every_change) {
+    sim_backend sim;
+    temp_journal journal;
+    seed(sim);
+
+    CHECK(planned().commit(sim, journal.view()).is_ok());
+    CHECK_PLANNED(sim);
+    CHECK(!journal_exists(journal.view()));
+}
+
+TEST(transaction_rolls_back_failed_write) {
+    sim_backend sim;
+    temp_journal journal;
+    seed(sim);
+    sim.inject(write_fault(L"BootOrder"));
+
+    CHECK(!planned().commit(sim, journal.view()).is_ok());
+    CHECK_SEEDED(sim);
+    CHECK(!journal_exists(journal.view()));
+}
+
+TEST(transaction_rolls_back_between_remove_and_recreate) {
+    // Timeout's attributes change, so it's removed before the failing write.
+    sim_backend sim;
+    temp_journal journal;
+    seed(sim);
+    sim.inject(write_fault(L"Timeout"));
+
+    CHECK(!planned().commit(sim, journal.view()).is_ok());
+    CHECK_SEEDED(sim);
+    CHECK(!journal_exists(journal.view()));
+}
+
+// The second write fails, and so does undoing the first, leaving the journal.
+void half_apply(sim_backend& sim, const temp_journal& journal) {
+    seed(sim);
+    sim.inject(write_fault(L"BootOrder"));
+    sim.inject(sim_fault { sim_fault::op_t::remove, var_err::kind_t::io, L"Boot0001" });
+
+    CHECK(!planned().commit(sim, journal.view()).is_ok());
+    CHECK(journal_exists(journal.view()));
+    CHECK(get(sim, L"Boot0001").has_value());
+    CHECK(get(sim, L"BootOrder") == stored { bytes({ 0, 0 }), efi_variable_default_attributes });
+}
+
+TEST(transaction_half_applied_journal_rolls_back) {
+    sim_backend sim;
+    temp_journal journal;
+    half_apply(sim, journal);
+
+    CHECK(rollback_journal(sim, journal.view()).is_ok());
+    CHECK_SEEDED(sim);
+    CHECK(!journal_exists(journal.view()));
+}
+
+TEST(transaction_half_applied_journal_resumes) {
+    sim_backend sim;
+    temp_journal journal;
+    half_apply(sim, journal);
+
+    CHECK(resume_journal(sim, journal.view()).is_ok());
+    CHECK_PLANNED(sim);
+    CHECK(!journal_exists(journal.view()));
+}
+
+TEST(transaction_simulated_resume_leaves_journal) {
+    sim_backend sim;
+    temp_journal journal;
+    half_apply(sim, journal);
+
+    vresult<std::string> copy = simulated_journal(journal.view());
+    CHECK(copy.is_ok());
+
+    if (!copy.is_ok())
+        return;
+
+    lak::astring_view copy_view { copy.unsafe_unwrap().data(), copy.unsafe_unwrap().size() };
+
+    CHECK(resume_journal(sim, copy_view).is_ok());
+    CHECK_PLANNED(sim);
+    CHECK(!journal_exists(copy_view));
+    CHECK(journal_exists(journal.view()));
+}
+
+}
@@ -0,0 +1,101 @@
+#include "test.h"
+
+#include "ucs2.h"
+
+#include <cstring>
+
+namespace efibootmgrw::test {
+
+namespace {
+
+// What gets put in an otherwise ASCII string, one at each position.
+enum class unit_kind {
+    nul,
+    non_ascii,
+    surrogate_pair,
+    lone_high,
+    lone_low,
+};
+
+constexpr unit_kind unit_kinds[] = {
+    unit_kind::nul, unit_kind::non_ascii, unit_kind::surrogate_pair, unit_kind::lone_high, unit_kind::lone_low,
+};
+
+[[nodiscard]]
+auto kind_name(unit_kind kind) -> const char* {
+    switch (kind) {
+        case unit_kind::nul:            return "nul";
+        case unit_kind::non_ascii:      return "non-ASCII";
+        case unit_kind::surrogate_pair: return "surrogate pair";
+        case unit_kind::lone_high:      return "lone high surrogate";
+        case unit_kind::lone_low:       return "lone low surrogate";
+    }
+
+    return "?";
+}
+
+// length ASCII units with kind at pos. A pair that doesn't fit loses its low half.
+[[nodiscard]]
+auto make_units(size_t length, size_t pos, unit_kind kind) -> std::u16string {
+    std::u16string str(length, u'\0');
+
+    for (size_t i = 0; i < length; ++i)
+        str[i] = static_cast<char16_t>(u'a' + i % 26);
+
+    switch (kind) {
+        case unit_kind::nul:       str[pos] = u'\0'; break;
+        case unit_kind::non_ascii: str[pos] = 0x20AC; break;
+        case unit_kind::lone_high: str[pos] = 0xD83D; break;
+        case unit_kind::lone_low:  str[pos] = 0xDE00; break;
+        case unit_kind::surrogate_pair:
+            str[pos] = 0xD83D;
+            if (pos + 1 < length)
+                str[pos + 1] = 0xDE00;
+            break;
+    }
+
+    return str;
+}
+
+void check_matches_scalar(const std::u16string& str, const char* what, size_t pos, const char* file, int line) {
+    lak::span<const char16_t> units { str.data(), str.size() };
+
+    size_t found = find_nul16(units), expected = find_nul16_scalar(units);
+
+    if (found != expected)
+        fail(file, line, fmt::format("find_nul16 of {} units with a {} at {} is {}, expected {}", str.size(), what, pos, found, expected));
+
+    // Both start from the same garbage, so bytes past the end must match too.
+    std::string out(str.size() * 3 + 16, '\xCC'), scalar_out = out;
+    size_t written = utf16_to_utf8(lak::u16string_view { str.data(), str.size() }, out.data());
+    size_t scalar_written = utf16_to_utf8_scalar(lak::u16string_view { str.data(), str.size() }, scalar_out.data());
+
+    if (written != scalar_written || out != scalar_out)
+        fail(file, line, fmt::format("utf16_to_utf8 of {} units with a {} at {} wrote {} bytes, expected {}", str.size(), what, pos, written, scalar_written));
+}
+
+}
+
+TEST(ucs2_vectorized_matches_scalar) {
+    for (size_t length = 0; length <= 40; ++length) {
+        check_matches_scalar(std::u16string(length, u'x'), "nothing", 0, __FILE__, __LINE__);
+
+        for (size_t pos = 0; pos < length; ++pos)
+            for (unit_kind kind : unit_kinds)
+                check_matches_scalar(make_units(length, pos, kind), kind_name(kind), pos, __FILE__, __LINE__);
+    }
+}
+
+TEST(ucs2_lone_surrogates_encode_as_they_are) {
+    char out[16];
+
+    char16_t high[] = { u'a', 0xD83D, u'b' };
+    CHECK(utf16_to_utf8(lak::u16string_view { high, 3 }, out) == 5);
+    CHECK(std::memcmp(out, "a\xED\xA0\xBD" "b", 5) == 0);
+
+    char16_t pair[] = { 0xD83D, 0xDE00 };
+    CHECK(utf16_to_utf8(lak::u16string_view { pair, 2 }, out) == 4);
+    CHECK(std::memcmp(out, "\xF0\x9F\x98\x80", 4) == 0);
+}
+
+}
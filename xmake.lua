@@ -1,60 +1,118 @@
-add_rules("mode.debug", "mode.release")
-
-set_project("efibootmgrw")
-
-if is_plat("windows") then
-    set_languages("cxxlatest")
-
-    -- bruh
-    add_cxflags("/Zc:__cplusplus")
-    add_cxflags("/Zc:preprocessor")
-else
-    set_languages("cxx20")
-end
-
-add_rules("mode.debug", "mode.release")
-
-add_requires("fmt 8.0.0")
-
-set_warnings("allextra")
-
-if is_mode("debug") then
-    add_defines("DEBUG")
-
-    set_symbols("debug")
-
-    set_optimize("fastest")
-
-    add_cxflags("-fsanitize=address,undefined,integer -g -fno-omit-frame-pointer")
-    add_ldflags("-fsanitize=address,undefined,integer -g -fno-omit-frame-pointer")
-end
-
-if is_mode("release") then
-    add_defines("NDEBUG")
-
-    add_cxflags("-fomit-frame-pointer")
-
-    set_optimize("fastest")
-end
-
-target("efibootmgrw")
-    set_kind("binary")
-
-    add_files("src/*.cpp")
-    add_headerfiles("src/*.h")
-
-    add_syslinks("kernel32", "advapi32", "user32")
-
-    add_includedirs("lak/inc")
-    add_includedirs("lak/src")
-
-    add_files("lak/src/*.cpp", {
-      includedirs = "lak/inc/",
-      defines = {
-        "UNICODE",
-        "WIN32_LEAN_AND_MEAN",
-        "NOMINMAX"
-      }
-    })
-
-    add_packages("fmt")
+add_rules("mode.debug", "mode.release")
+
+set_project("efibootmgrw")
+
+if is_plat("windows") then
+    set_languages("cxxlatest")
+
+    -- bruh
+    add_cxflags("/Zc:__cplusplus")
+    add_cxflags("/Zc:preprocessor")
+else
+    set_languages("cxx20")
+end
+
+add_rules("mode.debug", "mode.release")
+
+add_requires("fmt 8.0.0")
+
+set_warnings("allextra")
+
+if is_mode("debug") then
+    add_defines("DEBUG")
+
+    set_symbols("debug")
+
+    set_optimize("fastest")
+
+    add_cxflags("-fsanitize=address,undefined,integer -g -fno-omit-frame-pointer")
+    add_ldflags("-fsanitize=address,undefined,integer -g -fno-omit-frame-pointer")
+end
+
+if is_mode("release") then
+    add_defines("NDEBUG")
+
+    add_cxflags("-fomit-frame-pointer")
+
+    set_optimize("fastest")
+end
+
+target("efibootmgrw")
+    set_kind("binary")
+
+    add_files("src/*.cpp")
+    add_headerfiles("src/*.h")
+
+    if is_plat("windows") then
+        add_syslinks("kernel32", "advapi32", "user32")
+    end
+
+    add_includedirs("lak/inc")
+    add_includedirs("lak/src")
+
+    add_files("lak/src/*.cpp", {
+      includedirs = "lak/inc/",
+      defines = {
+        "UNICODE",
+        "WIN32_LEAN_AND_MEAN",
+        "NOMINMAX"
+      }
+    })
+
+    add_packages("fmt")
+
+-- xmake run bench [--filter name] [--out results.json]
+target("bench")
+    set_kind("binary")
+    set_default(false)
+
+    add_files("bench/*.cpp")
+    add_files("src/*.cpp|main.cpp")
+    add_includedirs("src")
+    -- for the store fixtures it shares with the tests
+    add_includedirs("test")
+
+    if is_plat("windows") then
+        add_syslinks("kernel32", "advapi32", "user32")
+    end
+
+    add_includedirs("lak/inc")
+    add_includedirs("lak/src")
+
+    add_files("lak/src/*.cpp", {
+      includedirs = "lak/inc/",
+      defines = {
+        "UNICODE",
+        "WIN32_LEAN_AND_MEAN",
+        "NOMINMAX"
+      }
+    })
+
+    add_packages("fmt")
+
+-- xmake run test [substring]
+target("test")
+    set_kind("binary")
+    set_default(false)
+
+    add_files("test/*.cpp")
+    add_files("src/*.cpp|main.cpp")
+    add_includedirs("src")
+
+    if is_plat("windows") then
+        add_syslinks("kernel32", "advapi32", "user32")
+    end
+
+    add_includedirs("lak/inc")
+    add_includedirs("lak/src")
+
+    add_files("lak/src/*.cpp", {
+      includedirs = "lak/inc/",
+      defines = {
+        "UNICODE",
+        "WIN32_LEAN_AND_MEAN",
+        "NOMINMAX"
+      }
+    })
+
+    add_packages("fmt")